@@ -7,7 +7,8 @@
  *      byte_queue.c
  *
  *  DESCRIPTION
- *      Circular buffer implementation.
+ *      Circular buffer implementation. The buffer sizes are powers of two,
+ *      so the indices are wrapped by masking.
  *
  ******************************************************************************/
 
@@ -27,45 +28,29 @@
  *  Private Definitions
  *============================================================================*/
 
-/* Intended buffer size in number of bytes */
-#define BUFFER_SIZE 256
-
 /* Largest amount of data that can be stored in the buffer */
-#define BUFFER_LEN (BUFFER_SIZE - 1)
-
-/* Length of data currently held in queue */
-#define QUEUE_LENGTH \
-       ((g_tail >= g_head) ? g_tail - g_head : BUFFER_SIZE - g_head + g_tail)
-           
-/* Amount of free space left in queue (= BUFFER_LEN - QUEUE_LENGTH) */
-#define QUEUE_FREE \
-       ((g_tail >= g_head) ? BUFFER_LEN - g_tail + g_head : g_head - g_tail - 1)
-
-/*============================================================================*
- *  Private Data
- *============================================================================*/
+#define BUFFER_LEN(p_queue)     ((p_queue)->mask + 1)
 
-/* Circular buffer */
-static uint8 g_queue[BUFFER_SIZE];
+/* Length of data currently held in queue. The indices run freely, so their
+ * difference is the length even after the tail has wrapped around.
+ */
+#define QUEUE_LENGTH(p_queue) \
+       ((uint16)(((p_queue)->tail - (p_queue)->head) & 0xFFFF))
 
-/* Pointer to head of queue (next byte to be read out) */
-static uint16 g_head = 0;
-
-/* Pointer to head of queue after committing most recent peek */
-static uint16 g_peek = 0;
-
-/* Pointer to tail of queue (next byte to be inserted) */
-static uint16 g_tail = 0;
+/* Amount of free space left in queue */
+#define QUEUE_FREE(p_queue) \
+       (BUFFER_LEN(p_queue) - QUEUE_LENGTH(p_queue))
 
 /*============================================================================*
  *  Private Function Prototypes
  *============================================================================*/
 
 /* Append the supplied data to the queue */
-static void copyIntoBuffer(const uint8 *p_data, uint16 len);
+static void copyIntoBuffer(BYTE_QUEUE_T *p_queue, const uint8 *p_data,
+                           uint16 len);
 
 /* Read up to the requested number of bytes out of the queue */
-static uint16 peekBuffer(uint8 *p_data, uint16 len);
+static uint16 peekBuffer(BYTE_QUEUE_T *p_queue, uint8 *p_data, uint16 len);
 
 /*============================================================================*
  *  Private Function Implementations
@@ -80,69 +65,63 @@ static uint16 peekBuffer(uint8 *p_data, uint16 len);
  *      space available in the buffer. If not, the existing data will be
  *      overwritten to accommodate the new data.
  *
- *      At the end of the function g_head points to the oldest queue entry and
- *      g_tail the next insertion point.
+ *      The tail is only moved once the data is in the buffer, so a consumer
+ *      never sees bytes which have not been written yet.
  *
  * PARAMETERS
- *      p_data [in]     Pointer to the data to be copied
- *      len    [in]     Number of bytes of data to be copied
+ *      p_queue [in]    Queue to copy the data into
+ *      p_data  [in]    Pointer to the data to be copied
+ *      len     [in]    Number of bytes of data to be copied
  *
  * RETURNS
  *      Nothing
  *----------------------------------------------------------------------------*/
-static void copyIntoBuffer(const uint8 *p_data, uint16 len)
+static void copyIntoBuffer(BYTE_QUEUE_T *p_queue, const uint8 *p_data,
+                           uint16 len)
 {
+    uint16 offset;          /* Offset of the tail in the buffer */
+    uint16 first;           /* Number of bytes copied before wrapping */
+    
     /* Sanity check */
     if ((len == 0) || (p_data == NULL))
         return;
     
     /* No point copying more data into the queue than the queue can hold */
-    if (len > BUFFER_LEN)
+    if (len > BUFFER_LEN(p_queue))
     {
         /* Advance input pointer to the last BUFFER_LEN bytes */
-        p_data += len - BUFFER_LEN;
+        p_data += len - BUFFER_LEN(p_queue);
         
         /* Adjust len */
-        len = BUFFER_LEN;
+        len = BUFFER_LEN(p_queue);
     }
     
     /* Check whether the queue will overflow */
-    if (len > QUEUE_FREE)
+    if (len > QUEUE_FREE(p_queue))
     {
-        /* Advance g_head to point to the oldest item, after the overflow */
-        g_head += len - QUEUE_FREE;
+        /* Advance the head to point to the oldest item, after the overflow */
+        p_queue->head = (p_queue->head + len - QUEUE_FREE(p_queue)) & 0xFFFF;
         
-        /* If this goes past the end of the buffer, wrap around */
-        if (g_head >= BUFFER_SIZE)
-            g_head -= BUFFER_SIZE;
-        
-        /* Update g_peek similarly */
-        g_peek = g_head;
+        /* Update the peek index similarly */
+        p_queue->peek = p_queue->head;
     }
     
-    /* Check whether we're going past the end of the buffer */
-    if (g_tail + len >= BUFFER_SIZE)
-    {
-        /* Calculate how much space there is till the end of the buffer */
-        const uint16 available = BUFFER_SIZE - g_tail;
-        
-        /* Copy data into the queue up to end of buffer */
-        MemCopy(&g_queue[g_tail], p_data, available);
-        
-        /* Update g_tail */
-        g_tail = len - available;
-        
-        /* Copy data from start of buffer */
-        MemCopy(g_queue, p_data + available, g_tail);
-    }
-    else
-    {
-        /* Append data to tail of the queue */
-        MemCopy(&g_queue[g_tail], p_data, len);
-        
-        /* Update g_tail */
-        g_tail += len;
-    }
+    /* Copy data into the queue up to end of buffer, then from the start of
+     * the buffer
+     */
+    offset = p_queue->tail & p_queue->mask;
+    first = BUFFER_LEN(p_queue) - offset;
+    
+    if (first > len)
+        first = len;
+    
+    MemCopy(&p_queue->p_buffer[offset], p_data, first);
+    
+    if (len > first)
+        MemCopy(p_queue->p_buffer, p_data + first, len - first);
+    
+    /* Hand the data over to the consumer */
+    p_queue->tail = (p_queue->tail + len) & 0xFFFF;
 }
 
 /*----------------------------------------------------------------------------*
@@ -155,47 +134,42 @@ static void copyIntoBuffer(const uint8 *p_data, uint16 len)
  *      data is read.
  *
  * PARAMETERS
- *      p_data [in]     Pointer to buffer to store read data in
- *      len    [in]     Number of bytes of data to peek
+ *      p_queue [in]    Queue to read the data from
+ *      p_data  [in]    Pointer to buffer to store read data in
+ *      len     [in]    Number of bytes of data to peek
  *
  * RETURNS
  *      Number of bytes of data peeked.
  *----------------------------------------------------------------------------*/
-static uint16 peekBuffer(uint8 *p_data, uint16 len)
+static uint16 peekBuffer(BYTE_QUEUE_T *p_queue, uint8 *p_data, uint16 len)
 {
-    uint16 peeked = len;    /* Number of bytes of data peeked */
+    const uint16 head = p_queue->head;
+    uint16 peeked = QUEUE_LENGTH(p_queue);  /* Number of bytes peeked */
+    uint16 offset;          /* Offset of the head in the buffer */
+    uint16 first;           /* Number of bytes copied before wrapping */
     
     /* Sanity check */
     if ((len == 0) || (p_data == NULL))
         return 0;
     
     /* Cannot peek more data than is available */
-    if (peeked > QUEUE_LENGTH)
-        peeked = QUEUE_LENGTH;
+    if (peeked > len)
+        peeked = len;
     
-    /* Check whether we're going past the end of the buffer */
-    if (g_head + peeked >= BUFFER_SIZE)
-    {
-        /* Calculate how much space there is till the end of the buffer */
-        const uint16 available = BUFFER_SIZE - g_head;
-        
-        /* Copy data up to end of buffer */
-        MemCopy(p_data, &g_queue[g_head], available);
-        
-        /* Update g_peek */
-        g_peek = peeked - available;
-        
-        /* Copy data from start of buffer */
-        MemCopy(p_data + available, g_queue, g_peek);
-    }
-    else
-    {
-        /* Peek data starting from the head of the queue */
-        MemCopy(p_data, &g_queue[g_head], peeked);
-        
-        /* Update g_peek */
-        g_peek = g_head + peeked;
-    }
+    /* Copy data up to end of buffer, then from the start of the buffer */
+    offset = head & p_queue->mask;
+    first = BUFFER_LEN(p_queue) - offset;
+    
+    if (first > peeked)
+        first = peeked;
+    
+    MemCopy(p_data, &p_queue->p_buffer[offset], first);
+    
+    if (peeked > first)
+        MemCopy(p_data + first, p_queue->p_buffer, peeked - first);
+    
+    /* Update the peek index */
+    p_queue->peek = (head + peeked) & 0xFFFF;
     
     return peeked;
 }
@@ -204,6 +178,36 @@ static uint16 peekBuffer(uint8 *p_data, uint16 len)
  *  Public Function Implementations
  *============================================================================*/
 
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      BQInit
+ *
+ *  DESCRIPTION
+ *      Set up a queue over the supplied buffer, leaving it empty. Queues
+ *      declared with BQ_DECLARE_QUEUE need not be set up.
+ *
+ * PARAMETERS
+ *      p_queue  [out]  Queue to set up
+ *      p_buffer [in]   Buffer to hold the queued data
+ *      size     [in]   Size of the buffer, a power of two no larger than
+ *                      0x8000
+ *
+ * RETURNS
+ *      TRUE if the queue has been set up
+ *      FALSE if the size is not supported
+ *----------------------------------------------------------------------------*/
+bool BQInit(BYTE_QUEUE_T *p_queue, uint8 *p_buffer, uint16 size)
+{
+    if ((size == 0) || (size > 0x8000) || !BQ_IS_POWER_OF_TWO(size))
+        return FALSE;
+    
+    p_queue->p_buffer = p_buffer;
+    p_queue->mask = size - 1;
+    p_queue->head = p_queue->peek = p_queue->tail = 0;
+    
+    return TRUE;
+}
+
 /*----------------------------------------------------------------------------*
  *  NAME
  *      BQSafeQueueBytes
@@ -213,21 +217,22 @@ static uint16 peekBuffer(uint8 *p_data, uint16 len)
  *      If there is not enough space FALSE is returned instead.
  *
  * PARAMETERS
- *      p_data [in]     Pointer to the data to be queued
- *      len    [in]     Number of bytes of data to be queued
+ *      p_queue [in]    Queue to add the data to
+ *      p_data  [in]    Pointer to the data to be queued
+ *      len     [in]    Number of bytes of data to be queued
  *
  * RETURNS
  *      TRUE if the data is queued successfully
  *      FALSE if there is not enough space in the queue
  *----------------------------------------------------------------------------*/
-bool BQSafeQueueBytes(const uint8 *p_data, uint16 len)
+bool BQSafeQueueBytes(BYTE_QUEUE_T *p_queue, const uint8 *p_data, uint16 len)
 {
     /* Check whether there is enough space available in the buffer */
-    bool ret_val = (QUEUE_FREE >= len);
+    bool ret_val = (QUEUE_FREE(p_queue) >= len);
     
     /* If so, copy the data into the buffer */
     if (ret_val)
-        copyIntoBuffer(p_data, len);
+        copyIntoBuffer(p_queue, p_data, len);
     
     return ret_val;
 }
@@ -242,16 +247,17 @@ bool BQSafeQueueBytes(const uint8 *p_data, uint16 len)
  *      the end of the new data.
  *
  * PARAMETERS
- *      p_data [in]     Pointer to the data to be queued
- *      len    [in]     Number of bytes of data to be queued
+ *      p_queue [in]    Queue to add the data to
+ *      p_data  [in]    Pointer to the data to be queued
+ *      len     [in]    Number of bytes of data to be queued
  *
  * RETURNS
  *      Nothing
  *----------------------------------------------------------------------------*/
-void BQForceQueueBytes(const uint8 *p_data, uint16 len)
+void BQForceQueueBytes(BYTE_QUEUE_T *p_queue, const uint8 *p_data, uint16 len)
 {
     /* Copy data into the buffer whether or not space is available */
-    copyIntoBuffer(p_data, len);
+    copyIntoBuffer(p_queue, p_data, len);
 }
 
 /*----------------------------------------------------------------------------*
@@ -262,14 +268,14 @@ void BQForceQueueBytes(const uint8 *p_data, uint16 len)
  *      Return the total size of the buffer.
  *
  * PARAMETERS
- *      None
+ *      p_queue [in]    Queue
  *
  * RETURNS
  *      Total buffer size in bytes
  *----------------------------------------------------------------------------*/
-uint16 BQGetBufferCapacity(void)
+uint16 BQGetBufferCapacity(const BYTE_QUEUE_T *p_queue)
 {
-    return BUFFER_LEN;
+    return BUFFER_LEN(p_queue);
 }
 
 /*----------------------------------------------------------------------------*
@@ -280,14 +286,14 @@ uint16 BQGetBufferCapacity(void)
  *      Return the amount of data currently in the queue.
  *
  * PARAMETERS
- *      None
+ *      p_queue [in]    Queue
  *
  * RETURNS
  *      Size of data currently stored in the queue in bytes.
  *----------------------------------------------------------------------------*/
-uint16 BQGetDataSize(void)
+uint16 BQGetDataSize(const BYTE_QUEUE_T *p_queue)
 {
-    return QUEUE_LENGTH;
+    return QUEUE_LENGTH(p_queue);
 }
 
 /*----------------------------------------------------------------------------*
@@ -298,14 +304,14 @@ uint16 BQGetDataSize(void)
  *      Return the amount of free space available in the buffer.
  *
  * PARAMETERS
- *      None
+ *      p_queue [in]    Queue
  *
  * RETURNS
  *      Size of free space available in the buffer in bytes.
  *----------------------------------------------------------------------------*/
-uint16 BQGetAvailableSize(void)
+uint16 BQGetAvailableSize(const BYTE_QUEUE_T *p_queue)
 {
-    return QUEUE_FREE;
+    return QUEUE_FREE(p_queue);
 }
 
 /*----------------------------------------------------------------------------*
@@ -313,18 +319,19 @@ uint16 BQGetAvailableSize(void)
  *      BQClearBuffer
  *
  *  DESCRIPTION
- *      Clear buffer contents leaving the queue empty.
+ *      Clear buffer contents leaving the queue empty. Only the consumer may
+ *      clear the queue.
  *
  * PARAMETERS
- *      None
+ *      p_queue [in]    Queue to clear
  *
  * RETURNS
  *      Nothing
  *----------------------------------------------------------------------------*/
-void BQClearBuffer(void)
+void BQClearBuffer(BYTE_QUEUE_T *p_queue)
 {
-    /* Reset queue pointers */
-    g_head = g_peek = g_tail = 0;
+    /* Drop everything up to the tail. The tail is left to the producer. */
+    p_queue->head = p_queue->peek = p_queue->tail;
 }
 
 /*----------------------------------------------------------------------------*
@@ -338,20 +345,21 @@ void BQClearBuffer(void)
  *      whatever data is available.
  *
  * PARAMETERS
- *      p_data [out]    Pointer to a buffer to store the extracted data in
- *      len    [in]     Number of bytes of data to be extracted
+ *      p_queue [in]    Queue to extract the data from
+ *      p_data  [out]   Pointer to a buffer to store the extracted data in
+ *      len     [in]    Number of bytes of data to be extracted
  *
  * RETURNS
  *      Number of bytes actually extracted, may be fewer than requested if not
  *      enough data is available.
  *----------------------------------------------------------------------------*/
-uint16 BQPopBytes(uint8 *p_data, uint16 len)
+uint16 BQPopBytes(BYTE_QUEUE_T *p_queue, uint8 *p_data, uint16 len)
 {
     /* Copy the data into the return buffer */
-    uint16 peeked = peekBuffer(p_data, len);
+    uint16 peeked = peekBuffer(p_queue, p_data, len);
     
     /* Remove the peeked data from the queue */
-    BQCommitLastPeek();
+    BQCommitLastPeek(p_queue);
     
     /* Return number of bytes peeked */
     return peeked;
@@ -367,17 +375,18 @@ uint16 BQPopBytes(uint8 *p_data, uint16 len)
  *      the function returns immediately with whatever data is available.
  *
  * PARAMETERS
- *      p_data [out]    Pointer to a buffer to store the peeked data in
- *      len    [in]     Number of bytes of data to be peeked
+ *      p_queue [in]    Queue to peek the data from
+ *      p_data  [out]   Pointer to a buffer to store the peeked data in
+ *      len     [in]    Number of bytes of data to be peeked
  *
  * RETURNS
  *      Number of bytes actually peeked, may be fewer than requested if not
  *      enough data is available.
  *----------------------------------------------------------------------------*/
-uint16 BQPeekBytes(uint8 *p_data, uint16 len)
+uint16 BQPeekBytes(BYTE_QUEUE_T *p_queue, uint8 *p_data, uint16 len)
 {
     /* Peek into the buffer */
-    return peekBuffer(p_data, len);
+    return peekBuffer(p_queue, p_data, len);
 }
 
 /*----------------------------------------------------------------------------*
@@ -389,13 +398,75 @@ uint16 BQPeekBytes(uint8 *p_data, uint16 len)
  *      BQPeekBytes.
  *
  * PARAMETERS
- *      None
+ *      p_queue [in]    Queue
  *
  * RETURNS
  *      Nothing
  *----------------------------------------------------------------------------*/
-void BQCommitLastPeek(void)
+void BQCommitLastPeek(BYTE_QUEUE_T *p_queue)
+{
+    /* Move the head to the current peek location */
+    p_queue->head = p_queue->peek;
+}
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      BQPeekSpans
+ *
+ *  DESCRIPTION
+ *      Peek all the data held in the queue without copying it. The data is
+ *      returned as two spans pointing into the buffer, the second one holding
+ *      the data wrapped around to the start of the buffer. It stays valid
+ *      until it is removed from the queue.
+ *
+ * PARAMETERS
+ *      p_queue [in]    Queue to peek the data from
+ *      p_spans [out]   Array of two spans to return the data in
+ *
+ * RETURNS
+ *      Number of bytes peeked, in both spans.
+ *----------------------------------------------------------------------------*/
+uint16 BQPeekSpans(const BYTE_QUEUE_T *p_queue, BQ_SPAN_T *p_spans)
 {
-    /* Update g_head to point to current g_peek location */
-    g_head = g_peek;
+    const uint16 peeked = QUEUE_LENGTH(p_queue);
+    const uint16 offset = p_queue->head & p_queue->mask;
+    uint16 first = BUFFER_LEN(p_queue) - offset;
+    
+    if (first > peeked)
+        first = peeked;
+    
+    /* Data up to the end of the buffer */
+    p_spans[0].p_data = &p_queue->p_buffer[offset];
+    p_spans[0].len = first;
+    
+    /* Data wrapped around to the start of the buffer */
+    p_spans[1].p_data = p_queue->p_buffer;
+    p_spans[1].len = peeked - first;
+    
+    return peeked;
+}
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      BQCommitBytes
+ *
+ *  DESCRIPTION
+ *      Remove the specified number of bytes from the head of the queue, once
+ *      they have been read through BQPeekSpans.
+ *
+ * PARAMETERS
+ *      p_queue [in]    Queue
+ *      len     [in]    Number of bytes to remove
+ *
+ * RETURNS
+ *      Nothing
+ *----------------------------------------------------------------------------*/
+void BQCommitBytes(BYTE_QUEUE_T *p_queue, uint16 len)
+{
+    /* Cannot remove more data than is held */
+    if (len > QUEUE_LENGTH(p_queue))
+        len = QUEUE_LENGTH(p_queue);
+    
+    p_queue->head = (p_queue->head + len) & 0xFFFF;
+    p_queue->peek = p_queue->head;
 }
@@ -7,7 +7,14 @@
  *      byte_queue.h
  *
  *  DESCRIPTION
- *      Interface to circular buffer implementation.
+ *      Interface to circular buffer implementation. Any number of queues can
+ *      be declared, each with its own buffer whose size is a power of two.
+ *
+ *      The queue is safe to be filled by one producer and drained by one
+ *      consumer running in different contexts: only the producer moves the
+ *      tail, and only the consumer moves the head. BQForceQueueBytes moves
+ *      the head as well, so it may only be used on a queue whose producer
+ *      and consumer run in the same context.
  *
  ******************************************************************************/
 
@@ -17,13 +24,86 @@
 /*============================================================================*
  *  SDK Header Files
  *============================================================================*/
- 
+
 #include <types.h>          /* Commonly used type definitions */
 
 /*============================================================================*
  *  Public Definitions
  *============================================================================*/
 
+/* Whether a queue size is a power of two, for use in #if */
+#define BQ_IS_POWER_OF_TWO(size)    (((size) & ((size) - 1)) == 0)
+
+/* Declare a static queue 'name' holding up to 'size' bytes. The size must be
+ * a power of two no larger than 0x8000.
+ */
+#define BQ_DECLARE_QUEUE(name, size) \
+    static uint8 name##_buffer[(size)]; \
+    static BYTE_QUEUE_T name = { name##_buffer, (size) - 1, 0, 0, 0 }
+
+/*============================================================================*
+ *  Public Data Types
+ *============================================================================*/
+
+/* A byte queue. The indices run freely over the whole uint16 range and are
+ * masked when the buffer is accessed, so the queue can hold as many bytes as
+ * the buffer does.
+ */
+typedef struct
+{
+    /* Buffer of 'mask' + 1 bytes */
+    uint8              *p_buffer;
+
+    /* Size of the buffer less one */
+    uint16              mask;
+
+    /* Index of the head of queue (next byte to be read out), only moved by
+     * the consumer
+     */
+    volatile uint16     head;
+
+    /* Index of the head of queue after committing most recent peek */
+    uint16              peek;
+
+    /* Index of the tail of queue (next byte to be inserted), only moved by
+     * the producer
+     */
+    volatile uint16     tail;
+
+} BYTE_QUEUE_T;
+
+/* Data held in a queue, pointing into its buffer */
+typedef struct
+{
+    const uint8        *p_data;
+    uint16              len;
+
+} BQ_SPAN_T;
+
+/*============================================================================*
+ *  Public Function Prototypes
+ *============================================================================*/
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      BQInit
+ *
+ *  DESCRIPTION
+ *      Set up a queue over the supplied buffer, leaving it empty. Queues
+ *      declared with BQ_DECLARE_QUEUE need not be set up.
+ *
+ * PARAMETERS
+ *      p_queue  [out]  Queue to set up
+ *      p_buffer [in]   Buffer to hold the queued data
+ *      size     [in]   Size of the buffer, a power of two no larger than
+ *                      0x8000
+ *
+ * RETURNS
+ *      TRUE if the queue has been set up
+ *      FALSE if the size is not supported
+ *----------------------------------------------------------------------------*/
+extern bool BQInit(BYTE_QUEUE_T *p_queue, uint8 *p_buffer, uint16 size);
+
 /*----------------------------------------------------------------------------*
  *  NAME
  *      BQSafeQueueBytes
@@ -33,14 +113,16 @@
  *      If there is not enough space FALSE is returned instead.
  *
  * PARAMETERS
- *      p_data [in]     Pointer to the data to be queued
- *      len    [in]     Number of bytes of data to be queued
+ *      p_queue [in]    Queue to add the data to
+ *      p_data  [in]    Pointer to the data to be queued
+ *      len     [in]    Number of bytes of data to be queued
  *
  * RETURNS
  *      TRUE if the data is queued successfully
  *      FALSE if there is not enough space in the buffer
  *----------------------------------------------------------------------------*/
-extern bool BQSafeQueueBytes(const uint8 *p_data, uint16 len);
+extern bool BQSafeQueueBytes(BYTE_QUEUE_T *p_queue, const uint8 *p_data,
+                             uint16 len);
 
 /*----------------------------------------------------------------------------*
  *  NAME
@@ -52,13 +134,15 @@ extern bool BQSafeQueueBytes(const uint8 *p_data, uint16 len);
  *      the end of the new data.
  *
  * PARAMETERS
- *      p_data [in]     Pointer to the data to be queued
- *      len    [in]     Number of bytes of data to be queued
+ *      p_queue [in]    Queue to add the data to
+ *      p_data  [in]    Pointer to the data to be queued
+ *      len     [in]    Number of bytes of data to be queued
  *
  * RETURNS
  *      Nothing
  *----------------------------------------------------------------------------*/
-extern void BQForceQueueBytes(const uint8 *p_data, uint16 len);
+extern void BQForceQueueBytes(BYTE_QUEUE_T *p_queue, const uint8 *p_data,
+                              uint16 len);
 
 /*----------------------------------------------------------------------------*
  *  NAME
@@ -68,12 +152,12 @@ extern void BQForceQueueBytes(const uint8 *p_data, uint16 len);
  *      Return the total size of the buffer.
  *
  * PARAMETERS
- *      None
+ *      p_queue [in]    Queue
  *
  * RETURNS
  *      Total buffer size in bytes
  *----------------------------------------------------------------------------*/
-extern uint16 BQGetBufferCapacity(void);
+extern uint16 BQGetBufferCapacity(const BYTE_QUEUE_T *p_queue);
 
 /*----------------------------------------------------------------------------*
  *  NAME
@@ -83,12 +167,12 @@ extern uint16 BQGetBufferCapacity(void);
  *      Return the amount of data currently in the queue.
  *
  * PARAMETERS
- *      None
+ *      p_queue [in]    Queue
  *
  * RETURNS
  *      Size of data currently stored in the queue in bytes.
  *----------------------------------------------------------------------------*/
-extern uint16 BQGetDataSize(void);
+extern uint16 BQGetDataSize(const BYTE_QUEUE_T *p_queue);
 
 /*----------------------------------------------------------------------------*
  *  NAME
@@ -98,27 +182,28 @@ extern uint16 BQGetDataSize(void);
  *      Return the amount of free space available in the buffer.
  *
  * PARAMETERS
- *      None
+ *      p_queue [in]    Queue
  *
  * RETURNS
  *      Size of free space available in the buffer in bytes.
  *----------------------------------------------------------------------------*/
-extern uint16 BQGetAvailableSize(void);
+extern uint16 BQGetAvailableSize(const BYTE_QUEUE_T *p_queue);
 
 /*----------------------------------------------------------------------------*
  *  NAME
  *      BQClearBuffer
  *
  *  DESCRIPTION
- *      Clear buffer contents leaving the queue empty.
+ *      Clear buffer contents leaving the queue empty. Only the consumer may
+ *      clear the queue.
  *
  * PARAMETERS
- *      None
+ *      p_queue [in]    Queue to clear
  *
  * RETURNS
  *      Nothing
  *----------------------------------------------------------------------------*/
-extern void BQClearBuffer(void);
+extern void BQClearBuffer(BYTE_QUEUE_T *p_queue);
 
 /*----------------------------------------------------------------------------*
  *  NAME
@@ -131,14 +216,15 @@ extern void BQClearBuffer(void);
  *      whatever data is available.
  *
  * PARAMETERS
- *      p_data [out]    Pointer to a buffer to store the extracted data in
- *      len    [in]     Number of bytes of data to be extracted
+ *      p_queue [in]    Queue to extract the data from
+ *      p_data  [out]   Pointer to a buffer to store the extracted data in
+ *      len     [in]    Number of bytes of data to be extracted
  *
  * RETURNS
  *      Number of bytes actually extracted, may be fewer than requested if not
  *      enough data is available.
  *----------------------------------------------------------------------------*/
-extern uint16 BQPopBytes(uint8 *p_data, uint16 len);
+extern uint16 BQPopBytes(BYTE_QUEUE_T *p_queue, uint8 *p_data, uint16 len);
 
 /*----------------------------------------------------------------------------*
  *  NAME
@@ -150,14 +236,15 @@ extern uint16 BQPopBytes(uint8 *p_data, uint16 len);
  *      the function returns immediately with whatever data is available.
  *
  * PARAMETERS
- *      p_data [out]    Pointer to a buffer to store the peeked data in
- *      len    [in]     Number of bytes of data to be peeked
+ *      p_queue [in]    Queue to peek the data from
+ *      p_data  [out]   Pointer to a buffer to store the peeked data in
+ *      len     [in]    Number of bytes of data to be peeked
  *
  * RETURNS
  *      Number of bytes actually peeked, may be fewer than requested if not
  *      enough data is available.
  *----------------------------------------------------------------------------*/
-extern uint16 BQPeekBytes(uint8 *p_data, uint16 len);
+extern uint16 BQPeekBytes(BYTE_QUEUE_T *p_queue, uint8 *p_data, uint16 len);
 
 /*----------------------------------------------------------------------------*
  *  NAME
@@ -168,11 +255,47 @@ extern uint16 BQPeekBytes(uint8 *p_data, uint16 len);
  *      BQPeekBytes.
  *
  * PARAMETERS
- *      None
+ *      p_queue [in]    Queue
+ *
+ * RETURNS
+ *      Nothing
+ *----------------------------------------------------------------------------*/
+extern void BQCommitLastPeek(BYTE_QUEUE_T *p_queue);
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      BQPeekSpans
+ *
+ *  DESCRIPTION
+ *      Peek all the data held in the queue without copying it. The data is
+ *      returned as two spans pointing into the buffer, the second one holding
+ *      the data wrapped around to the start of the buffer. It stays valid
+ *      until it is removed from the queue.
+ *
+ * PARAMETERS
+ *      p_queue [in]    Queue to peek the data from
+ *      p_spans [out]   Array of two spans to return the data in
+ *
+ * RETURNS
+ *      Number of bytes peeked, in both spans.
+ *----------------------------------------------------------------------------*/
+extern uint16 BQPeekSpans(const BYTE_QUEUE_T *p_queue, BQ_SPAN_T *p_spans);
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      BQCommitBytes
+ *
+ *  DESCRIPTION
+ *      Remove the specified number of bytes from the head of the queue, once
+ *      they have been read through BQPeekSpans.
+ *
+ * PARAMETERS
+ *      p_queue [in]    Queue
+ *      len     [in]    Number of bytes to remove
  *
  * RETURNS
  *      Nothing
  *----------------------------------------------------------------------------*/
-extern void BQCommitLastPeek(void);
+extern void BQCommitBytes(BYTE_QUEUE_T *p_queue, uint16 len);
 
 #endif /* __BYTE_QUEUE_H__ */
@@ -0,0 +1,243 @@
+/******************************************************************************
+ *  Copyright (c) 2012 - 2016 Qualcomm Technologies International, Ltd.
+ *  Part of CSR uEnergy SDK 2.6.1
+ *  Application version 2.6.1.0
+ *
+ *  FILE
+ *      char_map.c
+ *
+ *  DESCRIPTION
+ *      ASCII to HID usage translation tables. There is one table per keyboard
+ *      layout, generated from the layout descriptions in char_map_layouts.h.
+ *      Every character is translated with a single table lookup, the tables
+ *      live in ROM.
+ *
+ ******************************************************************************/
+
+/*============================================================================*
+ *  Local Header Files
+ *============================================================================*/
+
+#include "char_map.h"       /* Interface to this source file */
+#include "nvm_access.h"     /* Interface to NVM */
+#include "user_config.h"    /* User configuration */
+
+/*============================================================================*
+ *  Private Definitions
+ *============================================================================*/
+
+/* Table entry for a key typed without modifiers */
+#define KEY(usage)          CHAR_MAP_ENTRY(CHAR_MAP_MOD_NONE, (usage))
+
+/* Table entry for a key typed with Shift held */
+#define SHIFT(usage)        CHAR_MAP_ENTRY(CHAR_MAP_MOD_SHIFT, (usage))
+
+/* Table entry for a key typed with AltGr held */
+#define ALTGR(usage)        CHAR_MAP_ENTRY(CHAR_MAP_MOD_ALTGR, (usage))
+
+/* Table entry for a character which can not be typed */
+#define NONE                (0)
+
+/* The layout descriptions use the macros above */
+#include "char_map_layouts.h"
+
+/* The offset of data being stored in NVM for the character map. This offset
+ * is added to the character map offset to NVM region (see
+ * char_map_data.nvm_offset) to get the absolute offset at which this data is
+ * stored in NVM
+ */
+#define CHAR_MAP_NVM_LAYOUT_OFFSET          (0)
+
+/* Number of words of NVM memory used by the character map */
+#define CHAR_MAP_NVM_MEMORY_WORDS           (1)
+
+/*============================================================================*
+ *  Private Data Types
+ *============================================================================*/
+
+typedef struct
+{
+    /* Table of the active layout */
+    const uint16   *p_map;
+
+    /* Active layout */
+    uint16          layout;
+
+    /* NVM offset at which the character map data is stored */
+    uint16          nvm_offset;
+
+} CHAR_MAP_DATA_T;
+
+/*============================================================================*
+ *  Private Data
+ *============================================================================*/
+
+/* Translation tables, one per layout. Layouts other than US start from the
+ * US entries and override the ones listed in their own description.
+ */
+static const uint16 char_map[char_map_layout_count][CHAR_MAP_SIZE] =
+{
+    [char_map_layout_us]  = { CHAR_MAP_LAYOUT_US },
+    [char_map_layout_jis] = { CHAR_MAP_LAYOUT_US CHAR_MAP_LAYOUT_JIS },
+    [char_map_layout_uk]  = { CHAR_MAP_LAYOUT_US CHAR_MAP_LAYOUT_UK },
+    [char_map_layout_de]  = { CHAR_MAP_LAYOUT_US CHAR_MAP_LAYOUT_DE }
+};
+
+/* Character map data */
+static CHAR_MAP_DATA_T char_map_data =
+{
+    char_map[DEFAULT_KEYBOARD_LAYOUT],
+    DEFAULT_KEYBOARD_LAYOUT,
+    0
+};
+
+/*============================================================================*
+ *  Public Function Implementations
+ *============================================================================*/
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      CharMapLookup
+ *
+ *  DESCRIPTION
+ *      Translate a character into the usage ID and modifier needed to type it
+ *      on the active layout.
+ *
+ * PARAMETERS
+ *      ch [in]         Character to translate
+ *
+ * RETURNS
+ *      Table entry for the character, 0 if it can not be typed
+ *----------------------------------------------------------------------------*/
+uint16 CharMapLookup(uint8 ch)
+{
+    /* uint8 may hold more than 8 bits, so check the range as well */
+    return (ch < CHAR_MAP_SIZE) ? char_map_data.p_map[ch] : 0;
+}
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      CharMapSetLayout
+ *
+ *  DESCRIPTION
+ *      Select the keyboard layout used for the translation and store it in
+ *      NVM.
+ *
+ * PARAMETERS
+ *      layout [in]     Layout to select
+ *
+ * RETURNS
+ *      TRUE if the layout is known and has been selected
+ *----------------------------------------------------------------------------*/
+bool CharMapSetLayout(uint16 layout)
+{
+    if (layout >= char_map_layout_count)
+        return FALSE;
+
+    if (layout != char_map_data.layout)
+    {
+        char_map_data.layout = layout;
+        char_map_data.p_map = char_map[layout];
+
+        Nvm_Write(&char_map_data.layout, sizeof(char_map_data.layout),
+                  char_map_data.nvm_offset + CHAR_MAP_NVM_LAYOUT_OFFSET);
+    }
+
+    return TRUE;
+}
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      CharMapGetLayout
+ *
+ *  DESCRIPTION
+ *      Return the keyboard layout used for the translation.
+ *
+ * PARAMETERS
+ *      None
+ *
+ * RETURNS
+ *      Active layout
+ *----------------------------------------------------------------------------*/
+uint16 CharMapGetLayout(void)
+{
+    return char_map_data.layout;
+}
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      CharMapReadDataFromNVM
+ *
+ *  DESCRIPTION
+ *      Read the selected keyboard layout from NVM.
+ *
+ * PARAMETERS
+ *      p_offset [in/out]   NVM offset of the character map data, advanced
+ *                          past it on return
+ *
+ * RETURNS
+ *      Nothing
+ *----------------------------------------------------------------------------*/
+void CharMapReadDataFromNVM(uint16 *p_offset)
+{
+    char_map_data.nvm_offset = *p_offset;
+
+    Nvm_Read(&char_map_data.layout, sizeof(char_map_data.layout),
+             char_map_data.nvm_offset + CHAR_MAP_NVM_LAYOUT_OFFSET);
+
+    /* Fall back to the default layout if NVM holds an unknown one */
+    if (char_map_data.layout >= char_map_layout_count)
+        char_map_data.layout = DEFAULT_KEYBOARD_LAYOUT;
+
+    char_map_data.p_map = char_map[char_map_data.layout];
+
+    *p_offset += CHAR_MAP_NVM_MEMORY_WORDS;
+}
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      CharMapInitWriteDataToNVM
+ *
+ *  DESCRIPTION
+ *      Write the default keyboard layout to NVM for the first time during
+ *      application initialisation.
+ *
+ * PARAMETERS
+ *      p_offset [in/out]   NVM offset of the character map data, advanced
+ *                          past it on return
+ *
+ * RETURNS
+ *      Nothing
+ *----------------------------------------------------------------------------*/
+void CharMapInitWriteDataToNVM(uint16 *p_offset)
+{
+    char_map_data.nvm_offset = *p_offset;
+    char_map_data.layout = DEFAULT_KEYBOARD_LAYOUT;
+    char_map_data.p_map = char_map[char_map_data.layout];
+
+    Nvm_Write(&char_map_data.layout, sizeof(char_map_data.layout),
+              char_map_data.nvm_offset + CHAR_MAP_NVM_LAYOUT_OFFSET);
+
+    *p_offset += CHAR_MAP_NVM_MEMORY_WORDS;
+}
+
+#ifdef NVM_TYPE_FLASH
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      WriteCharMapDataInNvm
+ *
+ *  DESCRIPTION
+ *      Write the character map data to NVM after it has been erased.
+ *
+ * PARAMETERS
+ *      None
+ *
+ * RETURNS
+ *      Nothing
+ *----------------------------------------------------------------------------*/
+void WriteCharMapDataInNvm(void)
+{
+    Nvm_Write(&char_map_data.layout, sizeof(char_map_data.layout),
+              char_map_data.nvm_offset + CHAR_MAP_NVM_LAYOUT_OFFSET);
+}
+#endif /* NVM_TYPE_FLASH */
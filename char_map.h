@@ -0,0 +1,168 @@
+/******************************************************************************
+ *  Copyright (c) 2012 - 2016 Qualcomm Technologies International, Ltd.
+ *  Part of CSR uEnergy SDK 2.6.1
+ *  Application version 2.6.1.0
+ *
+ *  FILE
+ *      char_map.h
+ *
+ *  DESCRIPTION
+ *      Header file for the ASCII to HID usage translation tables
+ *
+ ******************************************************************************/
+
+#ifndef __CHAR_MAP_H__
+#define __CHAR_MAP_H__
+
+/*============================================================================*
+ *  SDK Header Files
+ *============================================================================*/
+
+#include <types.h>          /* Commonly used type definitions */
+
+/*============================================================================*
+ *  Public Definitions
+ *============================================================================*/
+
+/* Number of characters covered by the translation table */
+#define CHAR_MAP_SIZE                   (128)
+
+/* Modifier bits used in the translation table. These are the bits of the
+ * modifier byte of the keyboard input report.
+ */
+#define CHAR_MAP_MOD_NONE               (0x00)
+#define CHAR_MAP_MOD_SHIFT              (0x02)  /* Left Shift */
+#define CHAR_MAP_MOD_ALTGR              (0x40)  /* Right Alt */
+
+/* A table entry holds the modifier byte in the upper and the usage ID in the
+ * lower 8 bits. An entry of 0 means the character can not be typed.
+ */
+#define CHAR_MAP_ENTRY(modifier, usage) \
+                                ((uint16)(((modifier) << 8) | (usage)))
+
+/* Extract the usage ID from a table entry */
+#define CHAR_MAP_USAGE(entry)           ((uint8)((entry) & 0x00FF))
+
+/* Extract the modifier byte from a table entry */
+#define CHAR_MAP_MODIFIER(entry)        ((uint8)(((entry) >> 8) & 0x00FF))
+
+/*============================================================================*
+ *  Public Data Types
+ *============================================================================*/
+
+/* Keyboard layouts the translation tables are generated for. The values are
+ * used over UART and stored in NVM, so new layouts must be added at the end.
+ */
+typedef enum
+{
+    char_map_layout_us = 0,     /* US */
+    char_map_layout_jis,        /* Japanese */
+    char_map_layout_uk,         /* United Kingdom */
+    char_map_layout_de,         /* German */
+
+    char_map_layout_count       /* Number of layouts */
+
+} char_map_layout;
+
+/*============================================================================*
+ *  Public Function Prototypes
+ *============================================================================*/
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      CharMapLookup
+ *
+ *  DESCRIPTION
+ *      Translate a character into the usage ID and modifier needed to type it
+ *      on the active layout.
+ *
+ * PARAMETERS
+ *      ch [in]         Character to translate
+ *
+ * RETURNS
+ *      Table entry for the character, 0 if it can not be typed
+ *----------------------------------------------------------------------------*/
+extern uint16 CharMapLookup(uint8 ch);
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      CharMapSetLayout
+ *
+ *  DESCRIPTION
+ *      Select the keyboard layout used for the translation and store it in
+ *      NVM.
+ *
+ * PARAMETERS
+ *      layout [in]     Layout to select
+ *
+ * RETURNS
+ *      TRUE if the layout is known and has been selected
+ *----------------------------------------------------------------------------*/
+extern bool CharMapSetLayout(uint16 layout);
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      CharMapGetLayout
+ *
+ *  DESCRIPTION
+ *      Return the keyboard layout used for the translation.
+ *
+ * PARAMETERS
+ *      None
+ *
+ * RETURNS
+ *      Active layout
+ *----------------------------------------------------------------------------*/
+extern uint16 CharMapGetLayout(void);
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      CharMapReadDataFromNVM
+ *
+ *  DESCRIPTION
+ *      Read the selected keyboard layout from NVM.
+ *
+ * PARAMETERS
+ *      p_offset [in/out]   NVM offset of the character map data, advanced
+ *                          past it on return
+ *
+ * RETURNS
+ *      Nothing
+ *----------------------------------------------------------------------------*/
+extern void CharMapReadDataFromNVM(uint16 *p_offset);
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      CharMapInitWriteDataToNVM
+ *
+ *  DESCRIPTION
+ *      Write the default keyboard layout to NVM for the first time during
+ *      application initialisation.
+ *
+ * PARAMETERS
+ *      p_offset [in/out]   NVM offset of the character map data, advanced
+ *                          past it on return
+ *
+ * RETURNS
+ *      Nothing
+ *----------------------------------------------------------------------------*/
+extern void CharMapInitWriteDataToNVM(uint16 *p_offset);
+
+#ifdef NVM_TYPE_FLASH
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      WriteCharMapDataInNvm
+ *
+ *  DESCRIPTION
+ *      Write the character map data to NVM after it has been erased.
+ *
+ * PARAMETERS
+ *      None
+ *
+ * RETURNS
+ *      Nothing
+ *----------------------------------------------------------------------------*/
+extern void WriteCharMapDataInNvm(void);
+#endif /* NVM_TYPE_FLASH */
+
+#endif /* __CHAR_MAP_H__ */
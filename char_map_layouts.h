@@ -0,0 +1,123 @@
+/******************************************************************************
+ *  Copyright (c) 2012 - 2016 Qualcomm Technologies International, Ltd.
+ *  Part of CSR uEnergy SDK 2.6.1
+ *  Application version 2.6.1.0
+ *
+ *  FILE
+ *      char_map_layouts.h
+ *
+ *  DESCRIPTION
+ *      Keyboard layout descriptions for the ASCII to HID usage translation.
+ *      The translation tables in char_map.c are generated from these lists
+ *      by the preprocessor at build time.
+ *
+ *      The US layout lists every character that can be typed. The other
+ *      layouts only list the characters which are typed differently. Their
+ *      tables are initialised with the US entries first and then with the
+ *      layout's own entries, which take precedence. An entry of NONE means
+ *      the character can not be typed with a single key press on that
+ *      layout, e.g. because it sits on a dead key.
+ *
+ *      Each list is used with the macros below, which char_map.c defines
+ *      before including this file:
+ *
+ *          KEY(usage)      Key pressed on its own
+ *          SHIFT(usage)    Key pressed with Shift
+ *          ALTGR(usage)    Key pressed with AltGr
+ *          NONE            Character can not be typed
+ *
+ ******************************************************************************/
+
+#ifndef __CHAR_MAP_LAYOUTS_H__
+#define __CHAR_MAP_LAYOUTS_H__
+
+/*============================================================================*
+ *  Public Definitions
+ *============================================================================*/
+
+/* US (ANSI) layout */
+#define CHAR_MAP_LAYOUT_US \
+    /* Control characters */ \
+    ['\b'] = KEY(0x2A),     /* Backspace */ \
+    ['\t'] = KEY(0x2B),     /* Tab */ \
+    ['\n'] = KEY(0x28),     /* Enter */ \
+    ['\r'] = KEY(0x28),     /* Enter */ \
+    [0x1B] = KEY(0x29),     /* Escape */ \
+    [0x7F] = KEY(0x4C),     /* Delete */ \
+    \
+    /* Space and punctuation */ \
+    [' ']  = KEY(0x2C), \
+    ['!']  = SHIFT(0x1E),   ['"']  = SHIFT(0x34),   ['#']  = SHIFT(0x20), \
+    ['$']  = SHIFT(0x21),   ['%']  = SHIFT(0x22),   ['&']  = SHIFT(0x24), \
+    ['\''] = KEY(0x34),     ['(']  = SHIFT(0x26),   [')']  = SHIFT(0x27), \
+    ['*']  = SHIFT(0x25),   ['+']  = SHIFT(0x2E),   [',']  = KEY(0x36), \
+    ['-']  = KEY(0x2D),     ['.']  = KEY(0x37),     ['/']  = KEY(0x38), \
+    [':']  = SHIFT(0x33),   [';']  = KEY(0x33),     ['<']  = SHIFT(0x36), \
+    ['=']  = KEY(0x2E),     ['>']  = SHIFT(0x37),   ['?']  = SHIFT(0x38), \
+    ['@']  = SHIFT(0x1F),   ['[']  = KEY(0x2F),     ['\\'] = KEY(0x31), \
+    [']']  = KEY(0x30),     ['^']  = SHIFT(0x23),   ['_']  = SHIFT(0x2D), \
+    ['`']  = KEY(0x35),     ['{']  = SHIFT(0x2F),   ['|']  = SHIFT(0x31), \
+    ['}']  = SHIFT(0x30),   ['~']  = SHIFT(0x35), \
+    \
+    /* Digits */ \
+    ['1']  = KEY(0x1E),     ['2']  = KEY(0x1F),     ['3']  = KEY(0x20), \
+    ['4']  = KEY(0x21),     ['5']  = KEY(0x22),     ['6']  = KEY(0x23), \
+    ['7']  = KEY(0x24),     ['8']  = KEY(0x25),     ['9']  = KEY(0x26), \
+    ['0']  = KEY(0x27), \
+    \
+    /* Upper case letters */ \
+    ['A']  = SHIFT(0x04),   ['B']  = SHIFT(0x05),   ['C']  = SHIFT(0x06), \
+    ['D']  = SHIFT(0x07),   ['E']  = SHIFT(0x08),   ['F']  = SHIFT(0x09), \
+    ['G']  = SHIFT(0x0A),   ['H']  = SHIFT(0x0B),   ['I']  = SHIFT(0x0C), \
+    ['J']  = SHIFT(0x0D),   ['K']  = SHIFT(0x0E),   ['L']  = SHIFT(0x0F), \
+    ['M']  = SHIFT(0x10),   ['N']  = SHIFT(0x11),   ['O']  = SHIFT(0x12), \
+    ['P']  = SHIFT(0x13),   ['Q']  = SHIFT(0x14),   ['R']  = SHIFT(0x15), \
+    ['S']  = SHIFT(0x16),   ['T']  = SHIFT(0x17),   ['U']  = SHIFT(0x18), \
+    ['V']  = SHIFT(0x19),   ['W']  = SHIFT(0x1A),   ['X']  = SHIFT(0x1B), \
+    ['Y']  = SHIFT(0x1C),   ['Z']  = SHIFT(0x1D), \
+    \
+    /* Lower case letters */ \
+    ['a']  = KEY(0x04),     ['b']  = KEY(0x05),     ['c']  = KEY(0x06), \
+    ['d']  = KEY(0x07),     ['e']  = KEY(0x08),     ['f']  = KEY(0x09), \
+    ['g']  = KEY(0x0A),     ['h']  = KEY(0x0B),     ['i']  = KEY(0x0C), \
+    ['j']  = KEY(0x0D),     ['k']  = KEY(0x0E),     ['l']  = KEY(0x0F), \
+    ['m']  = KEY(0x10),     ['n']  = KEY(0x11),     ['o']  = KEY(0x12), \
+    ['p']  = KEY(0x13),     ['q']  = KEY(0x14),     ['r']  = KEY(0x15), \
+    ['s']  = KEY(0x16),     ['t']  = KEY(0x17),     ['u']  = KEY(0x18), \
+    ['v']  = KEY(0x19),     ['w']  = KEY(0x1A),     ['x']  = KEY(0x1B), \
+    ['y']  = KEY(0x1C),     ['z']  = KEY(0x1D),
+
+/* Japanese (JIS) layout, differences from US. Backslash is typed with the
+ * Ro key (International1) and '|' with the Yen key (International3).
+ */
+#define CHAR_MAP_LAYOUT_JIS \
+    ['"']  = SHIFT(0x1F),   ['&']  = SHIFT(0x23),   ['\''] = SHIFT(0x24), \
+    ['(']  = SHIFT(0x25),   [')']  = SHIFT(0x26),   ['=']  = SHIFT(0x2D), \
+    ['^']  = KEY(0x2E),     ['~']  = SHIFT(0x2E),   ['@']  = KEY(0x2F), \
+    ['`']  = SHIFT(0x2F),   ['[']  = KEY(0x30),     ['{']  = SHIFT(0x30), \
+    [']']  = KEY(0x32),     ['}']  = SHIFT(0x32),   [':']  = KEY(0x34), \
+    ['*']  = SHIFT(0x34),   ['+']  = SHIFT(0x33),   ['\\'] = KEY(0x87), \
+    ['_']  = SHIFT(0x87),   ['|']  = SHIFT(0x89),
+
+/* United Kingdom layout, differences from US */
+#define CHAR_MAP_LAYOUT_UK \
+    ['"']  = SHIFT(0x1F),   ['@']  = SHIFT(0x34),   ['#']  = KEY(0x32), \
+    ['~']  = SHIFT(0x32),   ['\\'] = KEY(0x64),     ['|']  = SHIFT(0x64),
+
+/* German (QWERTZ) layout, differences from US. '^' and '`' are dead keys
+ * on this layout and need a second key press, so they are not typed.
+ */
+#define CHAR_MAP_LAYOUT_DE \
+    ['y']  = KEY(0x1D),     ['z']  = KEY(0x1C),     ['Y']  = SHIFT(0x1D), \
+    ['Z']  = SHIFT(0x1C),   ['"']  = SHIFT(0x1F),   ['&']  = SHIFT(0x23), \
+    ['/']  = SHIFT(0x24),   ['(']  = SHIFT(0x25),   [')']  = SHIFT(0x26), \
+    ['=']  = SHIFT(0x27),   ['?']  = SHIFT(0x2D),   ['\\'] = ALTGR(0x2D), \
+    ['+']  = KEY(0x30),     ['*']  = SHIFT(0x30),   ['~']  = ALTGR(0x30), \
+    ['#']  = KEY(0x32),     ['\''] = SHIFT(0x32),   ['<']  = KEY(0x64), \
+    ['>']  = SHIFT(0x64),   ['|']  = ALTGR(0x64),   [',']  = KEY(0x36), \
+    [';']  = SHIFT(0x36),   ['.']  = KEY(0x37),     [':']  = SHIFT(0x37), \
+    ['-']  = KEY(0x38),     ['_']  = SHIFT(0x38),   ['@']  = ALTGR(0x14), \
+    ['{']  = ALTGR(0x24),   ['[']  = ALTGR(0x25),   [']']  = ALTGR(0x26), \
+    ['}']  = ALTGR(0x27),   ['^']  = NONE,          ['`']  = NONE,
+
+#endif /* __CHAR_MAP_LAYOUTS_H__ */
@@ -64,6 +64,20 @@
 /* Supervision timeout (ms) = PREFERRED_SUPERVISION_TIMEOUT * 10 ms */
 #define PREFERRED_SUPERVISION_TIMEOUT         0x04e2 /* 12.5 seconds. */
 
+/* Connection parameters requested while key strokes are being sent when
+ * ADAPTIVE_CONN_PARAMS is enabled in user_config.h. The preferred ones above
+ * are requested again once the keyboard is quiet.
+ */
+/* Minimum and maximum connection interval in number of frames */
+#define BURST_MAX_CON_INTERVAL                0x0006 /* 7.5 ms */
+#define BURST_MIN_CON_INTERVAL                0x0006 /* 7.5 ms */
+
+/* Slave latency in number of connection intervals */
+#define BURST_SLAVE_LATENCY                   0x0000
+
+/* Supervision timeout (ms) = BURST_SUPERVISION_TIMEOUT * 10 ms */
+#define BURST_SUPERVISION_TIMEOUT             0x04e2 /* 12.5 seconds. */
+
 /* Max num of conn param update that we send in one connection*/
 #define MAX_NUM_CONN_PARAM_UPDATE_REQS        4
 
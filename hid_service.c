@@ -58,12 +58,20 @@ typedef struct
     uint8                   output_report[ATTR_LEN_HID_OUTPUT_REPORT];
 
     /* ATTR_LEN_HID_CONSUMER_REPORT = length of one consumer report(2) * 
-     * MAX_CONSUMER_KEYS(that can be sent in one consumer report). This has to
-     * be specified in hid_service_db.db.
+     * CONSUMER_REPORT_KEYS(that can be sent in one consumer report). This has
+     * to be specified in hid_service_db.db.
      */
 
     uint8                   last_consumer_report[ATTR_LEN_HID_CONSUMER_REPORT];
 
+#ifdef NKRO_SUPPORT
+    /* N-key rollover Report Client Configuration */
+    gatt_client_config      nkro_client_config;
+
+    /* Array to hold the last sent N-key rollover report to the HID Host.*/
+    uint8                   last_nkro_report[ATTR_LEN_HID_NKRO_REPORT];
+#endif /* NKRO_SUPPORT */
+
     /* HID protocol mode is HID_REPORT_MODE mode by default */
     hid_protocol_mode       report_mode;
 
@@ -93,7 +101,11 @@ HID_DATA_T hid_data;
  *  Private Definitions
  *============================================================================*/
 
+#ifdef NKRO_SUPPORT
+#define HID_SERVICE_NVM_MEMORY_WORDS                      (4)
+#else
 #define HID_SERVICE_NVM_MEMORY_WORDS                      (3)
+#endif /* NKRO_SUPPORT */
 
 /* The offset of data being stored in NVM for HID service. This offset is added
  * to HID service offset to NVM region (see hid_data.nvm_offset) to get the 
@@ -102,6 +114,7 @@ HID_DATA_T hid_data;
 #define HID_NVM_INPUT_BOOT_RPT_CLIENT_CONFIG_OFFSET       (0)
 #define HID_NVM_INPUT_RPT_CLIENT_CONFIG_OFFSET            (1)
 #define HID_NVM_CONSUMER_RPT_CLIENT_CONFIG_OFFSET         (2)
+#define HID_NVM_NKRO_RPT_CLIENT_CONFIG_OFFSET             (3)
 
 /*=============================================================================*
  *  Private Function Prototypes
@@ -203,12 +216,13 @@ static void handleControlPointUpdate(hid_control_point_op control_op)
         {
              hid_data.suspended = TRUE;
 
-             /* Host has suspended its operations, application may like 
-              * to do a low frequency key scan. The sample application is 
-              * not doing any thing special in this case other than not sending
-              * a connection parameter update request if the remote host is
-              * currently suspended.
+             /* Host has suspended its operations. The key matrix is scanned
+              * at the slow rate sooner, and no connection parameter update
+              * request is sent while the remote host is suspended.
               */
+#ifdef ADAPTIVE_KEY_SCAN
+             KeyScanHostSuspended();
+#endif /* ADAPTIVE_KEY_SCAN */
         }
         break;
 
@@ -216,9 +230,8 @@ static void handleControlPointUpdate(hid_control_point_op control_op)
         {
              hid_data.suspended = FALSE;
 
-             /* Host has exited suspended mode, application may like 
-              * to do a normal frequency key scan. The sample application is 
-              * not doing any thing special in this case.
+             /* Host has exited suspended mode. The key matrix goes back to
+              * the fast scan rate on the next key press, as it does anyway.
               */
         }
         break;
@@ -257,6 +270,10 @@ extern void HidDataInit(void)
 
     MemSet(hid_data.last_consumer_report, 0x00, ATTR_LEN_HID_CONSUMER_REPORT);
 
+#ifdef NKRO_SUPPORT
+    MemSet(hid_data.last_nkro_report, 0x00, ATTR_LEN_HID_NKRO_REPORT);
+#endif /* NKRO_SUPPORT */
+
     hid_data.input_report_handle = INVALID_ATT_HANDLE;
     hid_data.notify_enable = FALSE;
 
@@ -268,6 +285,9 @@ extern void HidDataInit(void)
         hid_data.input_client_config = gatt_client_config_none;
         hid_data.input_boot_client_config = gatt_client_config_none;
         hid_data.consumer_client_config = gatt_client_config_none;
+#ifdef NKRO_SUPPORT
+        hid_data.nkro_client_config = gatt_client_config_none;
+#endif /* NKRO_SUPPORT */
 
         /* Update the NVM  with the same. */
         Nvm_Write((uint16*)&hid_data.input_boot_client_config,
@@ -279,6 +299,11 @@ extern void HidDataInit(void)
         Nvm_Write((uint16*)&hid_data.consumer_client_config,
             sizeof(gatt_client_config),
              hid_data.nvm_offset + HID_NVM_CONSUMER_RPT_CLIENT_CONFIG_OFFSET);
+#ifdef NKRO_SUPPORT
+        Nvm_Write((uint16*)&hid_data.nkro_client_config,
+            sizeof(gatt_client_config),
+             hid_data.nvm_offset + HID_NVM_NKRO_RPT_CLIENT_CONFIG_OFFSET);
+#endif /* NKRO_SUPPORT */
     }
     else /* Bonded */
     {
@@ -386,6 +411,22 @@ extern void HidHandleAccessRead(GATT_ACCESS_IND_T *p_ind)
         }
         break;
 
+#ifdef NKRO_SUPPORT
+        case HANDLE_HID_NKRO_RPT_CLIENT_CONFIG:
+        {
+            p_value = val;
+
+            BufWriteUint16(&p_value, hid_data.nkro_client_config);
+            length = 2;
+
+            /* BufWriteUint16 will have incremented p_value. Revert it back
+             * to point to val.
+             */
+            p_value -= length;
+        }
+        break;
+#endif /* NKRO_SUPPORT */
+
         case HANDLE_HID_INPUT_REPORT:
         case HANDLE_HID_BOOT_INPUT_REPORT:
         {
@@ -403,6 +444,16 @@ extern void HidHandleAccessRead(GATT_ACCESS_IND_T *p_ind)
         }
         break;
 
+#ifdef NKRO_SUPPORT
+        case HANDLE_HID_NKRO_REPORT:
+        {
+            p_value = hid_data.last_nkro_report;
+
+            length = ATTR_LEN_HID_NKRO_REPORT;
+        }
+        break;
+#endif /* NKRO_SUPPORT */
+
         case HANDLE_HID_PROTOCOL_MODE:
         {
             p_value = val;
@@ -575,6 +626,43 @@ extern void HidHandleAccessWrite(GATT_ACCESS_IND_T *p_ind)
         }
         break;
 
+#ifdef NKRO_SUPPORT
+        case HANDLE_HID_NKRO_RPT_CLIENT_CONFIG:
+        {
+            client_config = BufReadUint16(&p_value);
+
+            /* Client Configuration is bit field value so ideally bitwise 
+             * comparison should be used but since the application supports only 
+             * notifications, direct comparison is being used.
+             */
+            if((client_config == gatt_client_config_notification) ||
+               (client_config == gatt_client_config_none))
+            {
+                /* Like consumer reports, N-key rollover reports are sent only
+                 * in report mode.
+                 */
+                if(hid_data.report_mode)
+                {
+                    hid_data.nkro_client_config = client_config;
+
+                    Nvm_Write(&client_config, sizeof(gatt_client_config), 
+                   hid_data.nvm_offset + HID_NVM_NKRO_RPT_CLIENT_CONFIG_OFFSET);
+                }
+            }
+
+            else
+            {
+                /* INDICATION or RESERVED */
+
+                /* Return Error as only 'Notifications' are supported for 
+                   Keyboard application */
+
+                rc = gatt_status_desc_improper_config;
+            }
+        }
+        break;
+#endif /* NKRO_SUPPORT */
+
         case HANDLE_HID_OUTPUT_REPORT:
         case HANDLE_HID_BOOT_OUTPUT_REPORT:
         {
@@ -666,11 +754,39 @@ extern bool HidIsNotifyEnabledOnReportId(uint8 report_id)
             return (hid_data.consumer_client_config & 
                                                gatt_client_config_notification);
 
+#ifdef NKRO_SUPPORT
+        case HID_NKRO_REPORT_ID:
+            return HidIsNkroReportEnabled();
+#endif /* NKRO_SUPPORT */
+
         default:
             return FALSE;
     }
 }
 
+#ifdef NKRO_SUPPORT
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      HidIsNkroReportEnabled
+ *
+ *  DESCRIPTION
+ *      This function returns whether key presses are to be sent in N-key
+ *      rollover reports, which is the case when the host has enabled their
+ *      notifications and is using report mode. In boot mode, the boot input
+ *      report is used instead.
+ *
+ *  RETURNS/MODIFIES
+ *      TRUE/FALSE: N-key rollover reports in use or not
+ *
+ *----------------------------------------------------------------------------*/
+
+extern bool HidIsNkroReportEnabled(void)
+{
+    return (hid_data.report_mode == hid_report_mode) &&
+           (hid_data.nkro_client_config & gatt_client_config_notification);
+}
+#endif /* NKRO_SUPPORT */
+
 /*-----------------------------------------------------------------------------*
  *  NAME
  *      HidIsNotificationEnabled
@@ -753,6 +869,24 @@ extern bool HidSendInputReport(uint16 ucid, uint8 report_id, uint8 *report)
         }
         break;
 
+#ifdef NKRO_SUPPORT
+        case HID_NKRO_REPORT_ID:
+        {
+            GattCharValueNotification(ucid,
+                          HANDLE_HID_NKRO_REPORT,
+                          ATTR_LEN_HID_NKRO_REPORT,
+                          report);
+            /* Update the last sent N-key rollover report array with the
+             * report that has just been sent.
+             */
+            MemCopy(hid_data.last_nkro_report, report, 
+                                            ATTR_LEN_HID_NKRO_REPORT);
+
+            notification_sent = TRUE;
+        }
+        break;
+#endif /* NKRO_SUPPORT */
+
         default:
         break;
     }
@@ -793,6 +927,13 @@ extern void HidReadDataFromNVM(bool bonded, uint16 *p_offset)
         Nvm_Read((uint16*)&hid_data.consumer_client_config,
                    sizeof(gatt_client_config),
                hid_data.nvm_offset + HID_NVM_CONSUMER_RPT_CLIENT_CONFIG_OFFSET);
+
+#ifdef NKRO_SUPPORT
+        /* Read HID N-key rollover Report Client Configuration */
+        Nvm_Read((uint16*)&hid_data.nkro_client_config,
+                   sizeof(gatt_client_config),
+                   hid_data.nvm_offset + HID_NVM_NKRO_RPT_CLIENT_CONFIG_OFFSET);
+#endif /* NKRO_SUPPORT */
     }
     
     /* Increment the offset by the number of words of NVM memory required 
@@ -867,6 +1008,13 @@ extern void WriteHIDServiceDataInNvm(void)
                sizeof(gatt_client_config),
               hid_data.nvm_offset + HID_NVM_CONSUMER_RPT_CLIENT_CONFIG_OFFSET);
 
+#ifdef NKRO_SUPPORT
+    /* Write HID N-key rollover Report Client Configuration */
+    Nvm_Write((uint16*)&hid_data.nkro_client_config,
+               sizeof(gatt_client_config),
+              hid_data.nvm_offset + HID_NVM_NKRO_RPT_CLIENT_CONFIG_OFFSET);
+#endif /* NKRO_SUPPORT */
+
 }
 #endif /* NVM_TYPE_FLASH */
 
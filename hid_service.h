@@ -85,6 +85,13 @@ extern void HidHandleAccessWrite(GATT_ACCESS_IND_T *p_ind);
  */
 extern bool HidIsNotifyEnabledOnReportId(uint8 report_id);
 
+#ifdef NKRO_SUPPORT
+/* This function checks whether key presses are to be sent in N-key rollover
+ * reports
+ */
+extern bool HidIsNkroReportEnabled(void);
+#endif /* NKRO_SUPPORT */
+
 /* This function checks whether notifications have been enabled on all the
  * report characteristics in HID service(or boot keyboard input report)
  */
@@ -0,0 +1,254 @@
+/******************************************************************************
+ *  FILE
+ *      debounce_check.c
+ *
+ *  DESCRIPTION
+ *      Feeds a corpus of key matrix scans to SuppressGhostKeys and DebounceFX,
+ *      as the PIO controller event handler does, and prints the rows passed on
+ *      after each scan. The corpus is generated from a seed and
+ *      mixes random noise on the matrix with keys typed, held and chorded with
+ *      bouncing contacts, and gaps between scans long enough for the debounce
+ *      reset timer to expire.
+ *
+ *      It is built against both debounce engines, as debounce_check and
+ *      debounce_check_ref, and "make debounce-check" fails unless their
+ *      outputs are the same.
+ *
+ *      Usage: debounce_check [-s seed] [-n scans]
+ *
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "shim.h"
+#include "keyboard_hw.h"
+
+/*============================================================================*
+ *  Private Definitions
+ *============================================================================*/
+
+/* Time between two scans of the key matrix by the PIO controller */
+#define SCAN_TIME                   (5 * MILLISECOND)
+
+/* Gap between two scans letting the debounce reset timer expire */
+#define LONG_GAP_TIME               (40 * MILLISECOND)
+
+/* Scans generated by one corpus model before switching to another */
+#define SEGMENT_SCANS               (250)
+
+/* Longest bounce on a key press or release, in scans */
+#define MAX_BOUNCE_SCANS            (4)
+
+/* Keys typed at once by the typing model */
+#define MAX_CHORD                   (6)
+
+/*============================================================================*
+ *  Private Data Types
+ *============================================================================*/
+
+typedef enum
+{
+    model_noise = 0,    /* Every key random on every scan */
+    model_sparse,       /* A few random keys, mostly an idle matrix */
+    model_typing,       /* Keys pressed and released with bouncing contacts */
+    model_count
+
+} corpus_model;
+
+/* A key being typed by the typing model */
+typedef struct
+{
+    uint16 scan_code;               /* 0 when not in use */
+    uint16 bounce;                  /* Bouncing scans left */
+    uint16 hold;                    /* Scans left before the release */
+
+} TYPED_KEY_T;
+
+/*============================================================================*
+ *  Private Data
+ *============================================================================*/
+
+static uint32 random_state;
+
+static TYPED_KEY_T typed_keys[MAX_CHORD];
+
+/*============================================================================*
+ *  Private Function Implementations
+ *============================================================================*/
+
+/* xorshift32 */
+static uint32 nextRandom(void)
+{
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+
+    return random_state;
+}
+
+static void setKey(uint8 *rows, uint16 scan_code, bool pressed)
+{
+    const uint16 row = scan_code / COLUMNS;
+    const uint8 bit = (uint8)(1 << (scan_code % COLUMNS));
+
+    if(pressed)
+    {
+        rows[row] |= bit;
+    }
+    else
+    {
+        rows[row] &= (uint8)~bit;
+    }
+}
+
+/* Advance the keys of the typing model by one scan */
+static void typeKeys(uint8 *rows)
+{
+    TYPED_KEY_T *p_key;
+    uint16 i;
+
+    for(i = 0; i < MAX_CHORD; i++)
+    {
+        p_key = &typed_keys[i];
+
+        if(p_key->scan_code == 0)
+        {
+            /* Start typing another key now and then */
+            if(nextRandom() % 16 == 0)
+            {
+                p_key->scan_code = 1 + nextRandom() % (ROWS * COLUMNS - 1);
+                p_key->bounce = nextRandom() % (MAX_BOUNCE_SCANS + 1);
+                p_key->hold = nextRandom() % 12;
+            }
+            continue;
+        }
+
+        if(p_key->bounce)
+        {
+            /* Contacts bouncing on the press */
+            -- p_key->bounce;
+            setKey(rows, p_key->scan_code, nextRandom() & 1);
+        }
+        else if(p_key->hold)
+        {
+            -- p_key->hold;
+            setKey(rows, p_key->scan_code, TRUE);
+
+            if(p_key->hold == 0)
+            {
+                /* Bounce on the release too */
+                p_key->bounce = nextRandom() % (MAX_BOUNCE_SCANS + 1);
+            }
+        }
+        else
+        {
+            setKey(rows, p_key->scan_code, FALSE);
+            p_key->scan_code = 0;
+        }
+    }
+}
+
+static void generateScan(corpus_model model, uint8 *rows)
+{
+    uint16 i;
+
+    switch(model)
+    {
+        case model_noise:
+        {
+            for(i = 0; i < ROWS; i++)
+            {
+                rows[i] = (uint8)(nextRandom() & 0xFF);
+            }
+        }
+        break;
+
+        case model_sparse:
+        {
+            memset(rows, 0, ROWS * sizeof(uint8));
+            if(nextRandom() % 4 == 0)
+            {
+                setKey(rows, nextRandom() % (ROWS * COLUMNS), TRUE);
+            }
+        }
+        break;
+
+        default:
+        {
+            typeKeys(rows);
+        }
+        break;
+    }
+}
+
+/*============================================================================*
+ *  Public Function Implementations
+ *============================================================================*/
+
+int main(int argc, char *argv[])
+{
+    /* The state of the matrix carried from one scan to the next */
+    uint8 matrix[ROWS];
+    uint8 rows[ROWS];
+    uint32 scans = 200000;
+    uint32 scan;
+    corpus_model model = model_noise;
+    uint16 i;
+
+    random_state = 1;
+
+    for(i = 1; i < argc; i++)
+    {
+        if(strcmp(argv[i], "-s") == 0 && i + 1 < argc)
+        {
+            random_state = (uint32)strtoul(argv[++i], NULL, 0);
+        }
+        else if(strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+        {
+            scans = (uint32)strtoul(argv[++i], NULL, 0);
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [-s seed] [-n scans]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    if(random_state == 0)
+    {
+        random_state = 1;
+    }
+
+    ShimBoot();
+    InitHardware();
+
+    memset(matrix, 0, sizeof(matrix));
+    memset(typed_keys, 0, sizeof(typed_keys));
+
+    for(scan = 0; scan < scans; scan++)
+    {
+        if(scan % SEGMENT_SCANS == 0)
+        {
+            model = (corpus_model)(nextRandom() % model_count);
+        }
+
+        generateScan(model, matrix);
+        memcpy(rows, matrix, sizeof(rows));
+
+        SuppressGhostKeys(rows);
+        DebounceFX(rows);
+
+        printf("%u", scan);
+        for(i = 0; i < ROWS; i++)
+        {
+            printf(" %02x", rows[i]);
+        }
+        printf("\n");
+
+        ShimRunFor((nextRandom() % 64 == 0) ? LONG_GAP_TIME : SCAN_TIME);
+    }
+
+    return 0;
+}
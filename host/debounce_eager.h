@@ -0,0 +1,17 @@
+/******************************************************************************
+ *  FILE
+ *      debounce_eager.h
+ *
+ *  DESCRIPTION
+ *      Forced into the builds of the application for the eager checks, to
+ *      report key presses on the first scan they are seen in whatever
+ *      user_config.h selects. It can be forced in with debounce_ref.h to
+ *      check the reference debounce engine the same way.
+ *
+ *****************************************************************************/
+
+#include "user_config.h"
+
+#ifndef DEBOUNCE_EAGER_PRESS
+#define DEBOUNCE_EAGER_PRESS
+#endif
@@ -0,0 +1,15 @@
+/******************************************************************************
+ *  FILE
+ *      debounce_ref.h
+ *
+ *  DESCRIPTION
+ *      Forced into the build of keyboard_hw.c for debounce_check_ref, to
+ *      debounce the keys one at a time whatever user_config.h selects. It is
+ *      included ahead of the source, and the include guard of user_config.h
+ *      keeps the source from defining DEBOUNCE_BIT_PARALLEL again.
+ *
+ *****************************************************************************/
+
+#include "user_config.h"
+
+#undef DEBOUNCE_BIT_PARALLEL
@@ -0,0 +1,1029 @@
+/******************************************************************************
+ *  FILE
+ *      kbd_bench.c
+ *
+ *  DESCRIPTION
+ *      Typing throughput benchmark. A text is sent to the keyboard
+ *      application over the UART, and every character goes through the
+ *      receive callback, the key stroke queue and the input report
+ *      notifications, over a simulated link (see shim.h). It is sent in two
+ *      modes:
+ *
+ *          text        plain text, typed by test(). The queue overflow policy
+ *                      is left at its default. Unless that is
+ *                      key_queue_policy_reject, the sender is not held back
+ *                      when the queue is full and key strokes are lost
+ *                      instead.
+ *          frames      DATA frames of the framed protocol (see uartio.h),
+ *                      under key_queue_policy_reject. A frame is sent once the
+ *                      previous one has been acknowledged, with as many
+ *                      characters as the free slot count of the reply allows,
+ *                      so nothing is lost. A frame with more characters than
+ *                      the queue can ever take is sent first, and the run
+ *                      fails unless it is NAKed as too long.
+ *          strings     STRING frames, likewise, with a string ID. Up to the
+ *                      number of strings the application tracks are in
+ *                      flight, and the run fails unless every one of them is
+ *                      answered with a DONE frame saying it has been typed.
+ *                      A STRING frame too long is checked for first too.
+ *
+ *      In all modes the sender honours the flow control of the UART driver.
+ *      The input reports sent over the air are decoded back into the keys
+ *      typed, and the run fails unless they are the characters of the text,
+ *      in order.
+ *
+ *      This is repeated for every combination of connection interval, packets
+ *      per connection event and busy injection rate, each run in a fresh
+ *      process so that the application starts from power on. For each one is
+ *      reported:
+ *
+ *          chars/s     characters typed on the host per second, from the
+ *                      first byte sent to the last notification sent over
+ *                      the air
+ *          notif/char  input report notifications sent per character
+ *          events/char connection events woken up for per character
+ *          keyq        high-water mark of the pending key stroke queue
+ *          lost        characters of the text missing on the host, + key
+ *                      strokes dropped or overwritten by the queue overflow
+ *                      policy
+ *          fwbuf       high-water mark of the firmware transmit buffers
+ *          uart        high-water mark of the bytes waiting in the UART driver
+ *          busy        notifications refused with gatt_status_busy, because
+ *                      the buffers were full + at random
+ *
+ *      Every mode is then run once more with the busy injection refusing
+ *      notifications one at a time, so that later ones can be accepted ahead
+ *      of a refused one. Key strokes dropped for being overtaken may lose
+ *      characters, but the run fails if any key is typed in excess, typed
+ *      out of order or left held down.
+ *
+ *      The output can be saved and given back with -c, to fail when the
+ *      throughput of any combination has dropped. The link is simulated, so
+ *      runs are repeatable and any change comes from the application.
+ *
+ *      Usage: kbd_bench [-f text_file] [-l latency] [-c baseline]
+ *                       [-t tolerance_percent]
+ *
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "shim.h"
+#include "sdk/app_gatt_db.h"
+#include "char_map.h"
+
+/*============================================================================*
+ *  Private Definitions
+ *============================================================================*/
+
+/* Time without notifications after which the last ones are taken to have
+ * gone out
+ */
+#define DRAIN_TIME                  (10 * SECOND)
+
+/* Time after which a frame is sent again if it has not been answered */
+#define FRAME_TIMEOUT               (100 * MILLISECOND)
+
+/* The UART runs at the rate the application configures */
+#define UART_BAUD                   (115200)
+
+/* Firmware transmit buffers of the simulated link */
+#define TX_BUFFERS                  (8)
+
+/* Framed protocol, see uartio.h */
+#define FRAME_SOF                   (0xA5)
+#define FRAME_TYPE_DATA             (0x01)
+#define FRAME_TYPE_POLICY           (0x03)
+#define FRAME_TYPE_GET_STATS        (0x04)
+#define FRAME_TYPE_STRING           (0x07)
+#define FRAME_TYPE_ACK              (0x80)
+#define FRAME_TYPE_NAK              (0x81)
+#define FRAME_TYPE_STATS            (0x82)
+#define FRAME_TYPE_DONE             (0x84)
+#define FRAME_OVERHEAD              (5)
+#define FRAME_MAX_PAYLOAD           (32)
+#define FRAME_MAX_REPLY_PAYLOAD     (49)
+
+/* Most characters in a frame, see UART_FRAME_MAX_CHARS */
+#define FRAME_MAX_CHARS             (14)
+
+/* NAK frame payload: free slots and reason, see UART_NAK_TOO_LONG */
+#define NAK_REASON                  (1)
+#define NAK_TOO_LONG                (0x02)
+
+/* Characters in the frame which has to be NAKed as too long */
+#define TOO_LONG_CHARS              (32)
+
+/* Offsets of the counters in the STATS frame payload */
+#define STATS_DROPPED               (6)
+#define STATS_OVERWRITTEN           (8)
+#define STATS_HIGH_WATER            (10)
+#define STATS_PAYLOAD               (12)
+
+/* key_queue_policy_reject, see keyboard.h */
+#define POLICY_REJECT               (0)
+
+/* Strings in flight, see UART_MAX_PENDING_STRINGS */
+#define MAX_PENDING_STRINGS         (4)
+
+/* DONE frame payload: free slots, string ID and UART_STRING_TYPED */
+#define DONE_ID                     (1)
+#define DONE_STATUS                 (2)
+#define STRING_TYPED                (0)
+
+/* Key strokes a character may need, see KEY_STROKES_PER_TYPED_CHAR */
+#define KEY_STROKES_PER_CHAR        (2)
+
+/* Largest text typed */
+#define MAX_TEXT                    (8192)
+
+/* Largest number of keys decoded from the input reports */
+#define MAX_TYPED                   (2 * MAX_TEXT)
+
+/* Offset of the modifier byte and of the keys in an input report */
+#define REPORT_MODIFIER             (0)
+#define REPORT_KEYS                 (2)
+
+/* Largest number of combinations in a baseline */
+#define MAX_BASELINE                (128)
+
+/*============================================================================*
+ *  Private Data Types
+ *============================================================================*/
+
+typedef enum
+{
+    bench_mode_text = 0,
+    bench_mode_frames,
+    bench_mode_strings,
+    bench_mode_count
+
+} bench_mode;
+
+typedef struct
+{
+    bench_mode mode;
+    uint16 interval;                /* In 1.25 ms units */
+    uint16 packets_per_event;
+    uint16 busy_per_mille;
+    bool busy_once;
+
+} BENCH_CASE_T;
+
+typedef struct
+{
+    BENCH_CASE_T    bench_case;
+    double          chars_per_sec;
+    double          notifications_per_char;
+    double          events_per_char;
+    uint16          key_queue_high_water;
+    uint16          key_strokes_lost;
+    uint32          chars_typed;
+    uint32          chars_lost;
+    uint32          keys_extra;
+    bool            keys_held;
+    uint32          strings_dropped;
+    SHIM_LINK_STATS_T link;
+
+} BENCH_RESULT_T;
+
+/* Frame received from the application */
+typedef struct
+{
+    uint8 type;
+    uint8 seq;
+    uint8 len;
+    uint8 payload[FRAME_MAX_REPLY_PAYLOAD];
+
+} BENCH_FRAME_T;
+
+/*============================================================================*
+ *  Private Data
+ *============================================================================*/
+
+static const char *const mode_names[bench_mode_count] =
+                                            { "text", "frames", "strings" };
+
+static const uint16 intervals[] = { 6, 12, 24, 48 };
+static const uint16 packets_per_event[] = { 1, 2, 4 };
+static const uint16 busy_per_mille[] = { 0, 100 };
+
+/* Combination run with the notifications refused one at a time */
+static const uint16 busy_once_interval = 6;
+static const uint16 busy_once_packets_per_event = 4;
+static const uint16 busy_once_per_mille = 100;
+
+/* Default text, with runs of the same character and of Shift */
+static const char default_text[] =
+    "The quick brown fox jumps over the lazy dog. "
+    "PACK MY BOX WITH FIVE DOZEN LIQUOR JUGS! "
+    "Sphinx of black quartz, judge my vow: 0123456789. "
+    "Little lambs eat ivy; a kid'll eat ivy too, wouldn't you? "
+    "aaa bbb ccc ... !!! @@@ ((( ))) -_=+[]{}\\|;:'\",<.>/?`~ "
+    "Mississippi, Tennessee, committee, bookkeeper, Aardvark. "
+    "The quick brown fox jumps over the lazy dog. "
+    "PACK MY BOX WITH FIVE DOZEN LIQUOR JUGS! ";
+
+static char text[MAX_TEXT];
+static uint32 text_length;
+
+static uint32 byte_time;
+
+/* Measurement in the child process */
+static uint32 input_reports;
+static uint32 last_report_time;
+
+/* Keys typed on the host, decoded from the input reports as character map
+ * entries, and the last input report
+ */
+static uint16 typed[MAX_TYPED];
+static uint32 typed_length;
+static uint8 last_input_report[ATTR_LEN_HID_INPUT_REPORT];
+
+/* Frames received from the application */
+static uint8 rx_frame[FRAME_OVERHEAD + FRAME_MAX_REPLY_PAYLOAD];
+static uint16 rx_frame_length;
+static BENCH_FRAME_T last_reply;
+static uint32 replies;
+static BENCH_FRAME_T last_stats;
+static bool stats_received;
+
+/* DONE frames received, and how many of them were not in order or did not
+ * say the string had been typed
+ */
+static uint32 strings_done;
+static uint32 strings_failed;
+static uint32 strings_dropped;
+
+/*============================================================================*
+ *  Private Function Implementations
+ *============================================================================*/
+
+static uint8 crc8(const uint8 *p_data, uint16 length)
+{
+    uint8 crc = 0;
+    uint16 i;
+    uint16 bit;
+
+    for(i = 0; i < length; i++)
+    {
+        crc ^= p_data[i];
+        for(bit = 0; bit < 8; bit++)
+        {
+            crc = (crc & 0x80) ? (uint8)((crc << 1) ^ 0x07) :
+                                 (uint8)(crc << 1);
+        }
+    }
+
+    return crc;
+}
+
+/* Decode the keys an input report presses on the host, as they would be
+ * typed: every key not pressed in the report before, with the modifiers of
+ * this report
+ */
+static void decodeInputReport(const uint8 *p_report, uint16 size)
+{
+    uint16 i;
+    uint16 k;
+
+    if(size != ATTR_LEN_HID_INPUT_REPORT)
+    {
+        return;
+    }
+
+    for(i = REPORT_KEYS; i < ATTR_LEN_HID_INPUT_REPORT; i++)
+    {
+        if(p_report[i] == 0)
+        {
+            continue;
+        }
+
+        for(k = REPORT_KEYS; k < ATTR_LEN_HID_INPUT_REPORT; k++)
+        {
+            if(last_input_report[k] == p_report[i])
+            {
+                break;
+            }
+        }
+
+        if(k == ATTR_LEN_HID_INPUT_REPORT && typed_length < MAX_TYPED)
+        {
+            typed[typed_length++] = CHAR_MAP_ENTRY(p_report[REPORT_MODIFIER],
+                                                   p_report[i]);
+        }
+    }
+
+    memcpy(last_input_report, p_report, ATTR_LEN_HID_INPUT_REPORT);
+}
+
+static void countNotification(uint16 cid, uint16 handle, uint16 size,
+                              const uint8 *p_value)
+{
+    (void)cid;
+
+    if(handle == HANDLE_HID_INPUT_REPORT)
+    {
+        ++ input_reports;
+        last_report_time = ShimNow();
+        decodeInputReport(p_value, size);
+    }
+}
+
+/* Compare the keys typed on the host with the text. Returns the number of
+ * characters typed in order, as the longest common subsequence of both, and
+ * counts the characters missing and the keys typed in excess.
+ */
+static uint32 checkTyped(uint32 *p_lost, uint32 *p_extra)
+{
+    static uint16 expected[MAX_TEXT];
+    static uint32 row[2][MAX_TYPED + 1];
+    uint32 expected_length = 0;
+    uint32 *p_prev;
+    uint32 *p_cur;
+    uint32 i;
+    uint32 j;
+    uint16 entry;
+
+    /* Characters which can not be typed are skipped by the application */
+    for(i = 0; i < text_length; i++)
+    {
+        entry = CharMapLookup((uint8)text[i]);
+        if(entry != 0)
+        {
+            expected[expected_length++] = entry;
+        }
+    }
+
+    memset(row, 0, sizeof(row));
+    for(i = 1; i <= expected_length; i++)
+    {
+        p_prev = row[(i - 1) & 1];
+        p_cur = row[i & 1];
+
+        for(j = 1; j <= typed_length; j++)
+        {
+            if(expected[i - 1] == typed[j - 1])
+            {
+                p_cur[j] = p_prev[j - 1] + 1;
+            }
+            else
+            {
+                p_cur[j] = (p_prev[j] > p_cur[j - 1]) ? p_prev[j] :
+                                                        p_cur[j - 1];
+            }
+        }
+    }
+
+    i = row[expected_length & 1][typed_length];
+    *p_lost = expected_length - i;
+    *p_extra = typed_length - i;
+
+    return i;
+}
+
+/* Pick the frames out of what the application writes to the UART. Echoed
+ * text is ASCII, so it never holds a start of frame.
+ */
+static void captureFrames(const uint8 *p_data, uint16 length)
+{
+    BENCH_FRAME_T *p_frame;
+    uint16 i;
+
+    for(i = 0; i < length; i++)
+    {
+        if(rx_frame_length == 0 && p_data[i] != FRAME_SOF)
+        {
+            continue;
+        }
+
+        rx_frame[rx_frame_length++] = p_data[i];
+
+        if(rx_frame_length == 4 && rx_frame[3] > FRAME_MAX_REPLY_PAYLOAD)
+        {
+            rx_frame_length = 0;
+        }
+        else if(rx_frame_length > 4 &&
+                rx_frame_length == FRAME_OVERHEAD + rx_frame[3])
+        {
+            rx_frame_length = 0;
+
+            if(crc8(&rx_frame[1], 3 + rx_frame[3]) != rx_frame[4 + rx_frame[3]])
+            {
+                continue;
+            }
+
+            if(rx_frame[1] == FRAME_TYPE_DONE)
+            {
+                /* String IDs count up from 0 */
+                if(rx_frame[4 + DONE_ID] != (uint8)strings_done)
+                {
+                    ++ strings_failed;
+                }
+                else if(rx_frame[4 + DONE_STATUS] != STRING_TYPED)
+                {
+                    ++ strings_dropped;
+                }
+                ++ strings_done;
+                continue;
+            }
+
+            p_frame = (rx_frame[1] == FRAME_TYPE_STATS) ? &last_stats :
+                                                          &last_reply;
+            p_frame->type = rx_frame[1];
+            p_frame->seq = rx_frame[2];
+            p_frame->len = rx_frame[3];
+            memcpy(p_frame->payload, &rx_frame[4], rx_frame[3]);
+
+            if(p_frame == &last_stats)
+            {
+                stats_received = TRUE;
+            }
+            ++ replies;
+        }
+    }
+}
+
+/* Read a counter of the STATS frame, 0xFFFF if there was none */
+static uint16 statsValue(uint16 offset)
+{
+    if(!stats_received || last_stats.len < STATS_PAYLOAD)
+    {
+        return 0xFFFF;
+    }
+
+    return (uint16)(last_stats.payload[offset] |
+                    (last_stats.payload[offset + 1] << 8));
+}
+
+/* Send bytes over the UART, one byte time each, holding back while the UART
+ * driver has no room for them
+ */
+static void sendUart(const uint8 *p_data, uint32 length)
+{
+    uint32 sent = 0;
+
+    while(sent < length)
+    {
+        sent += ShimUartRx(&p_data[sent], 1);
+        ShimRunFor(byte_time);
+    }
+}
+
+/* Build a frame. Returns its length. */
+static uint16 buildFrame(uint8 *p_frame, uint8 type, uint8 seq,
+                         const uint8 *p_payload, uint8 len)
+{
+    p_frame[0] = FRAME_SOF;
+    p_frame[1] = type;
+    p_frame[2] = seq;
+    p_frame[3] = len;
+    memcpy(&p_frame[4], p_payload, len);
+    p_frame[4 + len] = crc8(&p_frame[1], 3 + len);
+
+    return FRAME_OVERHEAD + len;
+}
+
+/* Send a frame and wait for it to be answered, sending it again when it is
+ * NAKed once the queue has room. Returns the free slot count of the answer.
+ */
+static uint8 sendFrame(uint8 type, uint8 seq, const uint8 *p_payload,
+                       uint8 len)
+{
+    uint8 frame[FRAME_OVERHEAD + FRAME_MAX_PAYLOAD];
+    uint32 sent_replies;
+    uint32 waited;
+
+    buildFrame(frame, type, seq, p_payload, len);
+
+    for(;;)
+    {
+        sent_replies = replies;
+        sendUart(frame, FRAME_OVERHEAD + len);
+
+        for(waited = 0; waited < FRAME_TIMEOUT; waited += byte_time)
+        {
+            if(replies != sent_replies &&
+               (last_reply.type != FRAME_TYPE_NAK ||
+                (stats_received && type == FRAME_TYPE_GET_STATS)))
+            {
+                break;
+            }
+            ShimRunFor(byte_time);
+        }
+
+        if(type == FRAME_TYPE_GET_STATS && stats_received)
+        {
+            return 0;
+        }
+
+        if(replies != sent_replies && last_reply.type == FRAME_TYPE_ACK &&
+           last_reply.seq == seq)
+        {
+            return last_reply.payload[0];
+        }
+
+        if(replies != sent_replies && last_reply.type == FRAME_TYPE_NAK)
+        {
+            if(last_reply.payload[NAK_REASON] == NAK_TOO_LONG)
+            {
+                fprintf(stderr, "frame of %u bytes NAKed as too long\n",
+                        len);
+                exit(1);
+            }
+
+            /* Wait for the unasked ACK saying the queue has room */
+            sent_replies = replies;
+            while(replies == sent_replies)
+            {
+                ShimRunFor(byte_time);
+            }
+        }
+    }
+}
+
+/* Send a frame of TOO_LONG_CHARS characters, more than the queue can ever
+ * take, and fail unless it is NAKed as too long. The frame is not taken, so
+ * the next one is sent with the same sequence number.
+ */
+static void checkTooLong(uint8 type, uint8 seq)
+{
+    uint8 frame[FRAME_OVERHEAD + FRAME_MAX_PAYLOAD];
+    uint8 payload[FRAME_MAX_PAYLOAD];
+    uint8 len = 0;
+    uint32 sent_replies = replies;
+    uint32 waited;
+
+    if(type == FRAME_TYPE_STRING)
+    {
+        payload[len++] = 0;
+    }
+    while(len < FRAME_MAX_PAYLOAD && len < TOO_LONG_CHARS)
+    {
+        payload[len++] = 'a';
+    }
+
+    sendUart(frame, buildFrame(frame, type, seq, payload, len));
+
+    for(waited = 0; waited < FRAME_TIMEOUT && replies == sent_replies;
+        waited += byte_time)
+    {
+        ShimRunFor(byte_time);
+    }
+
+    if(replies == sent_replies || last_reply.type != FRAME_TYPE_NAK ||
+       last_reply.seq != seq || last_reply.payload[NAK_REASON] != NAK_TOO_LONG)
+    {
+        fprintf(stderr, "frame of %u bytes not NAKed as too long\n", len);
+        exit(1);
+    }
+}
+
+/* Type the text in DATA frames under key_queue_policy_reject */
+static void typeFrames(void)
+{
+    const uint8 policy = POLICY_REJECT;
+    uint32 sent = 0;
+    uint8 seq = 0;
+    uint8 free_slots;
+    uint32 len;
+
+    free_slots = sendFrame(FRAME_TYPE_POLICY, seq++, &policy, 1);
+    checkTooLong(FRAME_TYPE_DATA, seq);
+
+    while(sent < text_length)
+    {
+        /* Leave room for the release of the last character */
+        len = (free_slots > KEY_STROKES_PER_CHAR) ?
+                         (free_slots - 1) / KEY_STROKES_PER_CHAR : 1;
+        if(len > FRAME_MAX_CHARS)
+        {
+            len = FRAME_MAX_CHARS;
+        }
+        if(len > text_length - sent)
+        {
+            len = text_length - sent;
+        }
+
+        free_slots = sendFrame(FRAME_TYPE_DATA, seq++,
+                               (const uint8 *)&text[sent], (uint8)len);
+        sent += len;
+    }
+}
+
+/* Type the text in STRING frames under key_queue_policy_reject, and wait for
+ * all of them to be done
+ */
+static void typeStrings(void)
+{
+    const uint8 policy = POLICY_REJECT;
+    uint8 payload[FRAME_MAX_PAYLOAD];
+    uint32 sent = 0;
+    uint32 strings = 0;
+    uint8 seq = 0;
+    uint8 free_slots;
+    uint32 len;
+
+    free_slots = sendFrame(FRAME_TYPE_POLICY, seq++, &policy, 1);
+    checkTooLong(FRAME_TYPE_STRING, seq);
+
+    while(sent < text_length)
+    {
+        len = (free_slots > KEY_STROKES_PER_CHAR) ?
+                         (free_slots - 1) / KEY_STROKES_PER_CHAR : 1;
+        if(len > FRAME_MAX_CHARS)
+        {
+            len = FRAME_MAX_CHARS;
+        }
+        if(len > text_length - sent)
+        {
+            len = text_length - sent;
+        }
+
+        while(strings - strings_done >= MAX_PENDING_STRINGS)
+        {
+            ShimRunFor(byte_time);
+        }
+
+        payload[0] = (uint8)strings++;
+        memcpy(&payload[1], &text[sent], len);
+
+        free_slots = sendFrame(FRAME_TYPE_STRING, seq++, payload,
+                               (uint8)(len + 1));
+        sent += len;
+    }
+
+    while(strings_done < strings)
+    {
+        ShimRunFor(byte_time);
+    }
+
+    if(strings_failed)
+    {
+        fprintf(stderr, "%u of %u strings done out of order\n",
+                strings_failed, strings);
+        exit(1);
+    }
+}
+
+/* Run one combination. Called in a fresh process. */
+static void runCase(const BENCH_CASE_T *p_case, uint16 latency,
+                    BENCH_RESULT_T *p_result)
+{
+    SHIM_LINK_T link;
+    uint32 start;
+    uint16 i;
+
+    link.packets_per_event = p_case->packets_per_event;
+    link.tx_buffers = TX_BUFFERS;
+    link.busy_per_mille = p_case->busy_per_mille;
+    link.busy_once = p_case->busy_once;
+    link.accept_param_updates = FALSE;
+    link.seed = 1;
+    ShimSetLink(&link);
+
+    ShimSetNotificationHook(countNotification);
+    ShimSetUartTxHook(captureFrames);
+
+    ShimStartSession(p_case->interval, latency, byte_time);
+
+    ShimClearLinkStats();
+    input_reports = 0;
+    typed_length = 0;
+    start = ShimNow();
+    last_report_time = start;
+
+    if(p_case->mode == bench_mode_frames)
+    {
+        typeFrames();
+    }
+    else if(p_case->mode == bench_mode_strings)
+    {
+        typeStrings();
+    }
+    else
+    {
+        sendUart((const uint8 *)text, text_length);
+    }
+    while(ShimNow() - last_report_time < DRAIN_TIME)
+    {
+        ShimRunFor(DRAIN_TIME - (ShimNow() - last_report_time));
+    }
+
+    ShimGetLinkStats(&p_result->link);
+
+    /* Ask for the queue counters, as the frame following the ones sent */
+    sendFrame(FRAME_TYPE_GET_STATS,
+              (p_case->mode != bench_mode_text) ?
+                        (uint8)(last_reply.seq + 1) : 0, NULL, 0);
+
+    p_result->bench_case = *p_case;
+    p_result->chars_typed = checkTyped(&p_result->chars_lost,
+                                       &p_result->keys_extra);
+    p_result->strings_dropped = strings_dropped;
+    p_result->keys_held = FALSE;
+    for(i = 0; i < ATTR_LEN_HID_INPUT_REPORT; i++)
+    {
+        p_result->keys_held |= (last_input_report[i] != 0);
+    }
+    p_result->chars_per_sec = (last_report_time != start) ?
+      (double)p_result->chars_typed * SECOND / (last_report_time - start) : 0;
+    p_result->notifications_per_char = (double)input_reports / text_length;
+    p_result->events_per_char =
+                (double)p_result->link.connection_events / text_length;
+    p_result->key_queue_high_water = statsValue(STATS_HIGH_WATER);
+    p_result->key_strokes_lost = statsValue(STATS_DROPPED) +
+                                 statsValue(STATS_OVERWRITTEN);
+}
+
+/* Print the results of one combination after 'p_prefix' */
+static void printResult(const char *p_prefix, const BENCH_RESULT_T *p_result)
+{
+    const BENCH_CASE_T *p_case = &p_result->bench_case;
+
+    printf("%s%-7s %11.2f %10u %9u %8.1f %11.2f %12.2f %5u %5u+%u %5u "
+           "%5u %5u+%u\n", p_prefix, mode_names[p_case->mode],
+           p_case->interval * 1.25, p_case->packets_per_event,
+           p_case->busy_per_mille, p_result->chars_per_sec,
+           p_result->notifications_per_char, p_result->events_per_char,
+           p_result->key_queue_high_water, p_result->chars_lost,
+           p_result->key_strokes_lost,
+           p_result->link.tx_buffers_high_water,
+           p_result->link.uart_rx_high_water,
+           p_result->link.busy_full, p_result->link.busy_injected);
+}
+
+/* Run one combination in a child process */
+static int forkCase(const BENCH_CASE_T *p_case, uint16 latency,
+                    BENCH_RESULT_T *p_result)
+{
+    int fds[2];
+    pid_t pid;
+    int status;
+    ssize_t got;
+
+    if(pipe(fds) != 0)
+    {
+        return -1;
+    }
+
+    fflush(stdout);
+    pid = fork();
+    if(pid < 0)
+    {
+        return -1;
+    }
+
+    if(pid == 0)
+    {
+        close(fds[0]);
+        runCase(p_case, latency, p_result);
+        got = write(fds[1], p_result, sizeof(*p_result));
+        _exit(got == (ssize_t)sizeof(*p_result) ? 0 : 1);
+    }
+
+    close(fds[1]);
+    got = read(fds[0], p_result, sizeof(*p_result));
+    close(fds[0]);
+    waitpid(pid, &status, 0);
+
+    return (got == (ssize_t)sizeof(*p_result) && WIFEXITED(status) &&
+            WEXITSTATUS(status) == 0) ? 0 : -1;
+}
+
+static void loadText(const char *path)
+{
+    FILE *p_file;
+
+    if(path == NULL)
+    {
+        text_length = strlen(default_text);
+        memcpy(text, default_text, text_length);
+        return;
+    }
+
+    p_file = fopen(path, "rb");
+    if(p_file == NULL)
+    {
+        perror(path);
+        exit(2);
+    }
+    text_length = fread(text, 1, sizeof(text), p_file);
+    fclose(p_file);
+
+    if(text_length == 0)
+    {
+        fprintf(stderr, "%s: empty\n", path);
+        exit(2);
+    }
+}
+
+/* Read the chars/s of every combination of a previous output */
+static uint16 loadBaseline(const char *path, BENCH_RESULT_T *p_baseline)
+{
+    char line[256];
+    char mode[16];
+    FILE *p_file = fopen(path, "r");
+    uint16 num = 0;
+    double interval_ms;
+    unsigned packets;
+    unsigned busy;
+    uint16 m;
+
+    if(p_file == NULL)
+    {
+        perror(path);
+        exit(2);
+    }
+
+    while(num < MAX_BASELINE && fgets(line, sizeof(line), p_file) != NULL)
+    {
+        if(sscanf(line, "%15s %lf %u %u %lf", mode, &interval_ms, &packets,
+                  &busy, &p_baseline[num].chars_per_sec) != 5)
+        {
+            continue;
+        }
+
+        for(m = 0; m < bench_mode_count; m++)
+        {
+            if(strcmp(mode, mode_names[m]) == 0)
+            {
+                p_baseline[num].bench_case.mode = (bench_mode)m;
+                p_baseline[num].bench_case.interval =
+                                    (uint16)(interval_ms * 1000 / 1250 + 0.5);
+                p_baseline[num].bench_case.packets_per_event =
+                                    (uint16)packets;
+                p_baseline[num].bench_case.busy_per_mille = (uint16)busy;
+                ++ num;
+            }
+        }
+    }
+    fclose(p_file);
+
+    return num;
+}
+
+/*============================================================================*
+ *  Public Function Implementations
+ *============================================================================*/
+
+int main(int argc, char *argv[])
+{
+    static BENCH_RESULT_T baseline[MAX_BASELINE];
+    const char *text_path = NULL;
+    const char *baseline_path = NULL;
+    double tolerance = 1.0;
+    uint16 baseline_num = 0;
+    uint16 latency = 0;
+    uint16 regressions = 0;
+    uint16 mismatches = 0;
+    BENCH_CASE_T bench_case;
+    BENCH_RESULT_T result;
+    uint16 m, i, j, k, b;
+
+    for(i = 1; i < argc; i++)
+    {
+        if(strcmp(argv[i], "-f") == 0 && i + 1 < argc)
+        {
+            text_path = argv[++i];
+        }
+        else if(strcmp(argv[i], "-l") == 0 && i + 1 < argc)
+        {
+            latency = (uint16)strtoul(argv[++i], NULL, 0);
+        }
+        else if(strcmp(argv[i], "-c") == 0 && i + 1 < argc)
+        {
+            baseline_path = argv[++i];
+        }
+        else if(strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+        {
+            tolerance = strtod(argv[++i], NULL);
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [-f text_file] [-l latency] "
+                    "[-c baseline] [-t tolerance_percent]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    loadText(text_path);
+    if(baseline_path != NULL)
+    {
+        baseline_num = loadBaseline(baseline_path, baseline);
+    }
+
+    /* Start bit, 8 data bits and stop bit */
+    byte_time = (10 * SECOND + UART_BAUD - 1) / UART_BAUD;
+
+    printf("# %u characters, slave latency %u, %u firmware buffers, "
+           "UART %u baud\n", text_length, latency, TX_BUFFERS, UART_BAUD);
+    printf("# mode  interval_ms pkts/event busy/1000  chars/s  notif/char "
+           "events/char  keyq  lost fwbuf  uart  busy\n");
+
+    for(m = 0; m < bench_mode_count; m++)
+    for(i = 0; i < sizeof(intervals) / sizeof(intervals[0]); i++)
+    for(j = 0; j < sizeof(packets_per_event) / sizeof(packets_per_event[0]);
+        j++)
+    for(k = 0; k < sizeof(busy_per_mille) / sizeof(busy_per_mille[0]); k++)
+    {
+        bench_case.mode = (bench_mode)m;
+        bench_case.interval = intervals[i];
+        bench_case.packets_per_event = packets_per_event[j];
+        bench_case.busy_per_mille = busy_per_mille[k];
+        bench_case.busy_once = FALSE;
+
+        if(forkCase(&bench_case, latency, &result) != 0)
+        {
+            fprintf(stderr, "run failed: %s, interval %u, %u packets/event, "
+                    "busy %u/1000\n", mode_names[m], bench_case.interval,
+                    bench_case.packets_per_event, bench_case.busy_per_mille);
+            return 1;
+        }
+
+        printResult("", &result);
+
+        if(result.chars_lost || result.keys_extra || result.keys_held ||
+           result.strings_dropped)
+        {
+            printf("# MISMATCH: %u of %u characters typed, %u missing, "
+                   "%u keys in excess, %u strings not typed\n",
+                   result.chars_typed, result.chars_typed + result.chars_lost,
+                   result.chars_lost, result.keys_extra,
+                   result.strings_dropped);
+            ++ mismatches;
+        }
+
+        for(b = 0; b < baseline_num; b++)
+        {
+            if(baseline[b].bench_case.mode == bench_case.mode &&
+               baseline[b].bench_case.interval == bench_case.interval &&
+               baseline[b].bench_case.packets_per_event ==
+                                        bench_case.packets_per_event &&
+               baseline[b].bench_case.busy_per_mille ==
+                                        bench_case.busy_per_mille &&
+               result.chars_per_sec < baseline[b].chars_per_sec *
+                                      (1.0 - tolerance / 100.0))
+            {
+                printf("# REGRESSION: was %.1f chars/s\n",
+                       baseline[b].chars_per_sec);
+                ++ regressions;
+            }
+        }
+    }
+
+    /* Commented out, so that they are not taken for a baseline */
+    printf("# notifications refused one at a time:\n");
+
+    for(m = 0; m < bench_mode_count; m++)
+    {
+        bench_case.mode = (bench_mode)m;
+        bench_case.interval = busy_once_interval;
+        bench_case.packets_per_event = busy_once_packets_per_event;
+        bench_case.busy_per_mille = busy_once_per_mille;
+        bench_case.busy_once = TRUE;
+
+        if(forkCase(&bench_case, latency, &result) != 0)
+        {
+            fprintf(stderr, "run failed: %s, notifications refused one at a "
+                    "time\n", mode_names[m]);
+            return 1;
+        }
+
+        printResult("# ", &result);
+
+        /* Every character missing, and every string reported not typed, has
+         * to be down to key strokes dropped
+         */
+        if(result.keys_extra || result.keys_held ||
+           result.chars_lost > result.key_strokes_lost ||
+           (result.strings_dropped && !result.key_strokes_lost))
+        {
+            printf("# MISMATCH: %u characters missing for %u key strokes "
+                   "dropped, %u keys in excess%s\n", result.chars_lost,
+                   result.key_strokes_lost, result.keys_extra,
+                   result.keys_held ? ", keys left held" : "");
+            ++ mismatches;
+        }
+    }
+
+    if(mismatches)
+    {
+        fprintf(stderr, "%u combinations did not type the text\n",
+                mismatches);
+        return 1;
+    }
+
+    if(regressions)
+    {
+        fprintf(stderr, "%u combinations slower than the baseline\n",
+                regressions);
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,151 @@
+/******************************************************************************
+ *  FILE
+ *      kbd_host.c
+ *
+ *  DESCRIPTION
+ *      Runs the keyboard application on the host. It is connected to by a
+ *      simulated HID host which pairs with it and enables the input report
+ *      notifications, then the text read from standard input is sent to it
+ *      over the UART at the configured baud rate. Every input report notified
+ *      is printed with the virtual time it was sent at.
+ *
+ *      Usage: kbd_host [-b baud] [-i interval] [-v] < text
+ *
+ *          -b baud       UART rate in bits per second (default 115200)
+ *          -i interval   Connection interval in 1.25 ms units (default 6)
+ *          -v            Copy what the application writes to the UART to
+ *                        standard error
+ *
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "shim.h"
+#include "sdk/app_gatt_db.h"
+
+/*============================================================================*
+ *  Private Data
+ *============================================================================*/
+
+static uint32 input_reports;
+static uint32 consumer_reports;
+
+/*============================================================================*
+ *  Private Function Implementations
+ *============================================================================*/
+
+static void printNotification(uint16 cid, uint16 handle, uint16 size,
+                              const uint8 *p_value)
+{
+    uint16 i;
+
+    (void)cid;
+
+    if(handle == HANDLE_HID_INPUT_REPORT)
+    {
+        ++ input_reports;
+        printf("%10u us  input   ", ShimNow());
+    }
+    else if(handle == HANDLE_HID_CONSUMER_REPORT)
+    {
+        ++ consumer_reports;
+        printf("%10u us  consumer", ShimNow());
+    }
+    else
+    {
+        printf("%10u us  0x%04x  ", ShimNow(), handle);
+    }
+
+    for(i = 0; i < size; i++)
+    {
+        printf(" %02x", p_value[i]);
+    }
+    printf("\n");
+}
+
+static void copyUartTx(const uint8 *p_data, uint16 length)
+{
+    fwrite(p_data, 1, length, stderr);
+}
+
+/* Send bytes over the UART, one byte time each, holding back while the UART
+ * driver has no room for them
+ */
+static void sendUart(const uint8 *p_data, uint32 length, uint32 byte_time)
+{
+    uint32 sent = 0;
+
+    while(sent < length)
+    {
+        sent += ShimUartRx(&p_data[sent], 1);
+        ShimRunFor(byte_time);
+    }
+}
+
+/*============================================================================*
+ *  Public Function Implementations
+ *============================================================================*/
+
+int main(int argc, char *argv[])
+{
+    uint32 baud = 115200;
+    uint16 interval = 6;
+    uint32 byte_time;
+    uint32 start;
+    uint32 chars = 0;
+    int ch;
+    int i;
+
+    for(i = 1; i < argc; i++)
+    {
+        if(strcmp(argv[i], "-b") == 0 && i + 1 < argc)
+        {
+            baud = (uint32)strtoul(argv[++i], NULL, 0);
+        }
+        else if(strcmp(argv[i], "-i") == 0 && i + 1 < argc)
+        {
+            interval = (uint16)strtoul(argv[++i], NULL, 0);
+        }
+        else if(strcmp(argv[i], "-v") == 0)
+        {
+            ShimSetUartTxHook(copyUartTx);
+        }
+        else
+        {
+            fprintf(stderr,
+                    "usage: %s [-b baud] [-i interval] [-v] < text\n",
+                    argv[0]);
+            return 2;
+        }
+    }
+
+    if(baud == 0)
+    {
+        baud = 115200;
+    }
+
+    /* Start bit, 8 data bits and stop bit */
+    byte_time = (10 * SECOND + baud - 1) / baud;
+
+    ShimSetNotificationHook(printNotification);
+
+    ShimStartSession(interval, 0, byte_time);
+
+    start = ShimNow();
+    while((ch = getchar()) != EOF)
+    {
+        const uint8 byte = (uint8)ch;
+
+        sendUart(&byte, 1, byte_time);
+        ++ chars;
+    }
+    ShimRunFor(SECOND);
+
+    fprintf(stderr, "%u characters, %u input reports, %u consumer reports "
+            "in %u us\n", chars, input_reports, consumer_reports,
+            ShimNow() - start);
+
+    return 0;
+}
@@ -0,0 +1,360 @@
+/******************************************************************************
+ *  FILE
+ *      matrix_check.c
+ *
+ *  DESCRIPTION
+ *      Types a corpus of key strokes on the key matrix of the PIO controller
+ *      model, with bouncing contacts and overlapping key strokes, into the
+ *      application connected to a simulated HID host. It checks that each
+ *      key stroke is reported as one key press in the input reports, and
+ *      that no key is left pressed, then prints how many times the PIO
+ *      controller woke the application up. Pauses now and then in the
+ *      typing let the key scan slow down and sleep. Two of the keys are
+ *      swapped in the key map over GATT first. The latencies of the key
+ *      strokes are printed for every stage.
+ *
+ *      Usage: matrix_check [-s seed] [-n key strokes]
+ *
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "shim.h"
+#include "sdk/app_gatt_db.h"
+#include "user_config.h"
+#include "key_map_service.h"
+
+#ifdef KEY_LATENCY_STATS
+#include "latency_service.h"
+#endif /* KEY_LATENCY_STATS */
+
+/*============================================================================*
+ *  Private Definitions
+ *============================================================================*/
+
+/* Step of the virtual clock while typing */
+#define STEP_TIME                   (MILLISECOND)
+
+/* Time for which the contacts of a key bounce when it is pressed or
+ * released, less than a scan cycle
+ */
+#define BOUNCE_TIME                 (3 * MILLISECOND)
+
+/* Range of the time a key is held down for */
+#define MIN_HOLD_TIME               (40 * MILLISECOND)
+#define MAX_HOLD_TIME               (150 * MILLISECOND)
+
+/* Range of the time between two key presses. It is more than half the longest
+ * hold, so that at most two keys are held at once and no key can be taken
+ * for a ghost key.
+ */
+#define MIN_PRESS_GAP               (80 * MILLISECOND)
+#define MAX_PRESS_GAP               (200 * MILLISECOND)
+
+/* One key stroke in PAUSE_ODDS is followed by a pause in the typing, long
+ * enough for the key scan to slow down, or to sleep
+ */
+#define PAUSE_ODDS                  (25)
+#define MIN_PAUSE                   (1 * SECOND)
+#define MAX_PAUSE                   (40 * SECOND)
+
+/* Length of the input report and offset of its key codes */
+#define INPUT_REPORT_SIZE           (8)
+#define INPUT_REPORT_KEYS           (2)
+
+/* Number of keyboard usages */
+#define USAGES                      (256)
+
+#ifdef KEY_LATENCY_STATS
+/* Unit of the latency percentiles, in microseconds */
+#define LATENCY_UNIT                (1 << LATENCY_UNIT_SHIFT)
+#endif /* KEY_LATENCY_STATS */
+
+/*============================================================================*
+ *  Private Data Types
+ *============================================================================*/
+
+/* A key of the key matrix and the usage it is reported with */
+typedef struct
+{
+    uint16 scan_code;
+    uint8  usage;
+
+} MATRIX_KEY_T;
+
+/* A key stroke of the corpus */
+typedef struct
+{
+    const MATRIX_KEY_T *p_key;
+    uint32 press_time;
+    uint32 release_time;
+
+} KEY_STROKE_T;
+
+/*============================================================================*
+ *  Private Data
+ *============================================================================*/
+
+/* Letter keys of the default key map, each with its own usage, outside the
+ * first row which the PIO controller program does not drive. The usages of
+ * the last two are swapped in the key map by the check.
+ */
+static MATRIX_KEY_T matrix_keys[] =
+{
+    {0x3F, 0x0D}, {0x40, 0x0B}, {0x45, 0x0C}, {0x48, 0x05}, {0x4D, 0x18},
+    {0x4E, 0x1C}, {0x4F, 0x0A}, {0x54, 0x15}, {0x55, 0x17}, {0x56, 0x07},
+    {0x57, 0x09}, {0x58, 0x1B}, {0x5C, 0x1A}, {0x5D, 0x08}, {0x5E, 0x16},
+    {0x5F, 0x1D}, {0x60, 0x19}, {0x66, 0x04}, {0x68, 0x06}
+};
+
+#define MATRIX_KEYS  (sizeof(matrix_keys) / sizeof(matrix_keys[0]))
+
+#ifdef KEY_LATENCY_STATS
+static const char *const latency_stage_names[] =
+{
+    "queue", "accept", "air", "total", "scan", "debounce", "queue wait",
+    "fw buffer"
+};
+#endif /* KEY_LATENCY_STATS */
+
+static uint32 random_state;
+
+/* Key presses of each usage typed and reported */
+static uint32 typed[USAGES];
+static uint32 reported[USAGES];
+
+/* Keys pressed in the last input report */
+static bool report_keys[USAGES];
+
+/*============================================================================*
+ *  Private Function Implementations
+ *============================================================================*/
+
+/* xorshift32, so runs are repeatable whatever the C library */
+static uint32 nextRandom(void)
+{
+    random_state ^= random_state << 13;
+    random_state ^= random_state >> 17;
+    random_state ^= random_state << 5;
+
+    return random_state;
+}
+
+static uint32 randomTime(uint32 min, uint32 max)
+{
+    return min + nextRandom() % (max - min + 1);
+}
+
+/* Count the keys newly pressed in each input report */
+static void countReport(uint16 cid, uint16 handle, uint16 size,
+                        const uint8 *p_value)
+{
+    bool keys[USAGES];
+    uint16 i;
+
+    (void)cid;
+
+    if(handle != HANDLE_HID_INPUT_REPORT || size < INPUT_REPORT_SIZE)
+    {
+        return;
+    }
+
+    memset(keys, 0, sizeof(keys));
+    for(i = INPUT_REPORT_KEYS; i < INPUT_REPORT_SIZE; i++)
+    {
+        keys[p_value[i]] = TRUE;
+    }
+    keys[0] = FALSE;
+
+    for(i = 0; i < USAGES; i++)
+    {
+        if(keys[i] && !report_keys[i])
+        {
+            ++ reported[i];
+        }
+        report_keys[i] = keys[i];
+    }
+}
+
+/* Whether the contacts of a key stroke are closed at 'time' */
+static bool isKeyClosed(const KEY_STROKE_T *p_stroke, uint32 time)
+{
+    if(time < p_stroke->press_time || time >= p_stroke->release_time +
+                                              BOUNCE_TIME)
+    {
+        return FALSE;
+    }
+
+    if(time < p_stroke->press_time + BOUNCE_TIME ||
+       time >= p_stroke->release_time)
+    {
+        /* Bouncing */
+        return (nextRandom() & 1) != 0;
+    }
+
+    return TRUE;
+}
+
+/*============================================================================*
+ *  Public Function Implementations
+ *============================================================================*/
+
+int main(int argc, char *argv[])
+{
+    const uint8 key_map_swap[] =
+    {
+        KEY_MAP_OP_ADD,
+        0, 0x66, 0x06,
+        0, 0x68, 0x04
+    };
+    SHIM_PIO_CTRLR_STATS_T stats;
+    KEY_STROKE_T *p_strokes;
+    uint8 rows[SHIM_KEY_ROWS];
+    uint32 seed = 1;
+    uint32 n_strokes = 500;
+    uint32 start;
+    uint32 time;
+    uint32 end;
+    uint32 first = 0;
+    uint32 i;
+    uint32 typed_total = 0;
+    uint32 reported_total = 0;
+    int errors = 0;
+
+    for(i = 1; i < (uint32)argc; i++)
+    {
+        if(strcmp(argv[i], "-s") == 0 && i + 1 < (uint32)argc)
+        {
+            seed = (uint32)strtoul(argv[++i], NULL, 0);
+        }
+        else if(strcmp(argv[i], "-n") == 0 && i + 1 < (uint32)argc)
+        {
+            n_strokes = (uint32)strtoul(argv[++i], NULL, 0);
+        }
+        else
+        {
+            fprintf(stderr, "usage: %s [-s seed] [-n key strokes]\n",
+                    argv[0]);
+            return 2;
+        }
+    }
+
+    random_state = seed ? seed : 1;
+
+    ShimSetNotificationHook(countReport);
+
+    ShimStartSession(6, 0, MILLISECOND);
+
+    /* Swap A and C in the base layer */
+    ShimGattWrite(HANDLE_KEY_MAP, key_map_swap, sizeof(key_map_swap));
+    ShimRunFor(SHIM_SETTLE_TIME);
+    matrix_keys[MATRIX_KEYS - 2].usage = 0x06;
+    matrix_keys[MATRIX_KEYS - 1].usage = 0x04;
+
+    /* Generate the corpus */
+    p_strokes = calloc(n_strokes ? n_strokes : 1, sizeof(*p_strokes));
+    if(p_strokes == NULL)
+    {
+        return 2;
+    }
+
+    start = ShimNow();
+    time = start;
+    for(i = 0; i < n_strokes; i++)
+    {
+        /* A key stroke may overlap the one before, which is on another key */
+        do
+        {
+            p_strokes[i].p_key = &matrix_keys[nextRandom() % MATRIX_KEYS];
+        }
+        while(i && p_strokes[i].p_key == p_strokes[i - 1].p_key);
+
+        p_strokes[i].press_time = time;
+        p_strokes[i].release_time = time + randomTime(MIN_HOLD_TIME,
+                                                      MAX_HOLD_TIME);
+        ++ typed[p_strokes[i].p_key->usage];
+
+        time += randomTime(MIN_PRESS_GAP, MAX_PRESS_GAP);
+        if(nextRandom() % PAUSE_ODDS == 0)
+        {
+            time += randomTime(MIN_PAUSE, MAX_PAUSE);
+        }
+    }
+    end = time + MAX_HOLD_TIME;
+
+    ShimClearPioCtrlrStats();
+
+    /* Type it */
+    for(time = start; time < end; time += STEP_TIME)
+    {
+        memset(rows, 0, sizeof(rows));
+
+        while(first < n_strokes &&
+              p_strokes[first].release_time + BOUNCE_TIME <= time)
+        {
+            ++ first;
+        }
+
+        for(i = first; i < n_strokes && p_strokes[i].press_time <= time; i++)
+        {
+            if(isKeyClosed(&p_strokes[i], time))
+            {
+                const uint16 bit = p_strokes[i].p_key->scan_code - 1;
+
+                rows[bit / 8] |= 1 << (bit % 8);
+            }
+        }
+
+        ShimSetKeys(rows);
+        ShimRunFor(STEP_TIME);
+    }
+
+    memset(rows, 0, sizeof(rows));
+    ShimSetKeys(rows);
+    ShimRunFor(SECOND);
+
+    ShimGetPioCtrlrStats(&stats);
+
+    for(i = 0; i < USAGES; i++)
+    {
+        typed_total += typed[i];
+        reported_total += reported[i];
+
+        if(typed[i] != reported[i])
+        {
+            fprintf(stderr, "usage 0x%02x: %u key strokes, %u reported\n",
+                    (unsigned)i, typed[i], reported[i]);
+            ++ errors;
+        }
+        if(report_keys[i])
+        {
+            fprintf(stderr, "usage 0x%02x: left pressed\n", (unsigned)i);
+            ++ errors;
+        }
+    }
+
+    printf("%u key strokes, %u reported\n", typed_total, reported_total);
+    printf("%u scans, %u with a key held, %u events\n",
+           stats.scans, stats.held_scans, stats.events);
+    printf("%u slow scans, stopped %u times for %u ms of %u ms\n",
+           stats.slow_scans, stats.stops, stats.stopped_time / MILLISECOND,
+           (ShimNow() - start) / MILLISECOND);
+
+#ifdef KEY_LATENCY_STATS
+    for(i = 0; i < latency_stage_count; i++)
+    {
+        printf("%-10s %5u key strokes, 50%% < %6.2f ms, 99%% < %6.2f ms\n",
+               latency_stage_names[i], LatencyGetCount((latency_stage)i),
+               LatencyGetPercentile((latency_stage)i, 50) * LATENCY_UNIT /
+                                                                      1000.0,
+               LatencyGetPercentile((latency_stage)i, 99) * LATENCY_UNIT /
+                                                                      1000.0);
+    }
+#endif /* KEY_LATENCY_STATS */
+
+    free(p_strokes);
+
+    return errors ? 1 : 0;
+}
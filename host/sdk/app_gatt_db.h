@@ -0,0 +1,122 @@
+/******************************************************************************
+ *  FILE
+ *      app_gatt_db.h
+ *
+ *  DESCRIPTION
+ *      Host build stand-in for the header the SDK generates from
+ *      app_gatt_db.db. The handles follow the order of the services and
+ *      characteristics in the .db files, with every optional service
+ *      present. They only need to be distinct and to fall within the range of
+ *      their service, so they must be kept in step with the .db files by hand
+ *      when a characteristic is added.
+ *
+ *****************************************************************************/
+
+#ifndef __APP_GATT_DB_H__
+#define __APP_GATT_DB_H__
+
+#include "sdk_shim.h"
+
+/* gatt_service_db.db */
+#define HANDLE_GATT_SERVICE                             (0x0001)
+#define HANDLE_SERVICE_CHANGED                          (0x0003)
+#define HANDLE_SERVICE_CHANGED_CLIENT_CONFIG            (0x0004)
+#define HANDLE_GATT_SERVICE_END                         (0x0004)
+
+/* gap_service_db.db */
+#define HANDLE_GAP_SERVICE                              (0x0005)
+#define HANDLE_DEVICE_NAME                              (0x0007)
+#define HANDLE_DEVICE_APPEARANCE                        (0x0009)
+#define HANDLE_DEVICE_PREF_CONN_PARAMS                  (0x000b)
+#define HANDLE_PERIPHERAL_PRIVACY_FLAG                  (0x000d)
+#define HANDLE_RECONNECTION_ADDRESS                     (0x000f)
+#define HANDLE_GAP_SERVICE_END                          (0x000f)
+
+/* hid_service_db.db */
+#define HANDLE_HID_SERVICE                              (0x0010)
+#define HANDLE_HID_INFORMATION                          (0x0012)
+#define HANDLE_HID_REPORT_MAP                           (0x0014)
+#define HANDLE_HID_BOOT_INPUT_REPORT                    (0x0017)
+#define HANDLE_HID_BOOT_INPUT_RPT_CLIENT_CONFIG         (0x0018)
+#define HANDLE_HID_BOOT_OUTPUT_REPORT                   (0x001a)
+#define HANDLE_HID_INPUT_REPORT                         (0x001c)
+#define HANDLE_HID_INPUT_RPT_CLIENT_CONFIG              (0x001d)
+#define HANDLE_HID_CONSUMER_REPORT                      (0x0020)
+#define HANDLE_HID_CONSUMER_RPT_CLIENT_CONFIG           (0x0021)
+#define HANDLE_HID_NKRO_REPORT                          (0x0024)
+#define HANDLE_HID_NKRO_RPT_CLIENT_CONFIG               (0x0025)
+#define HANDLE_HID_OUTPUT_REPORT                        (0x0028)
+#define HANDLE_HID_CONTROL_POINT                        (0x002b)
+#define HANDLE_HID_PROTOCOL_MODE                        (0x002d)
+#define HANDLE_HID_SERVICE_END                          (0x002d)
+
+/* hid_boot_service_db.db */
+#define HANDLE_HID_PROP_BOOT_SERVICE                    (0x002e)
+#define HANDLE_HID_PROP_BOOT_REPORT                     (0x0030)
+#define HANDLE_HID_PROP_BOOT_RPT_CLIENT_CONFIG          (0x0031)
+#define HANDLE_HID_PROP_BOOT_SERVICE_END                (0x0031)
+
+/* battery_service_db.db */
+#define HANDLE_BATTERY_SERVICE                          (0x0032)
+#define HANDLE_BATT_LEVEL                               (0x0034)
+#define HANDLE_BATT_LEVEL_C_CFG                         (0x0035)
+#define HANDLE_BATTERY_SERVICE_END                      (0x0036)
+
+/* scan_parameters_db.db */
+#define HANDLE_SCAN_PARAMS_SERVICE                      (0x0037)
+#define HANDLE_SCAN_INTERVAL_WINDOW                     (0x0039)
+#define HANDLE_SCAN_REFRESH                             (0x003b)
+#define HANDLE_SCAN_REFRESH_C_CFG                       (0x003c)
+#define HANDLE_SCAN_PARAMS_SERVICE_END                  (0x003c)
+
+/* csr_ota_db.db */
+#define HANDLE_CSR_OTA_SERVICE                          (0x003d)
+#define HANDLE_CSR_OTA_CURRENT_APP                      (0x003f)
+#define HANDLE_CSR_OTA_READ_CS_BLOCK                    (0x0041)
+#define HANDLE_CSR_OTA_DATA_TRANSFER                    (0x0043)
+#define HANDLE_CSR_OTA_DATA_TRANSFER_CLIENT_CONFIG      (0x0044)
+#define HANDLE_CSR_OTA_VERSION                          (0x0046)
+#define HANDLE_CSR_OTA_SERVICE_END                      (0x0046)
+
+/* bond_mgmt_service_db.db */
+#define HANDLE_BOND_MGMT_SERVICE                        (0x0047)
+#define HANDLE_BOND_MGMT_CONTROL_POINT                  (0x0049)
+#define HANDLE_BOND_MGMT_FEATURE                        (0x004b)
+#define HANDLE_BOND_MGMT_SERVICE_END                    (0x004b)
+
+/* dev_info_service_db.db */
+#define HANDLE_DEVICE_INFO_SERVICE                      (0x004c)
+#define HANDLE_DEVICE_INFO_SERIAL_NUMBER                (0x004e)
+#define HANDLE_DEVICE_INFO_MODEL_NUMBER                 (0x0050)
+#define HANDLE_DEVICE_INFO_HARDWARE_REVISION            (0x0052)
+#define HANDLE_DEVICE_INFO_FIRMWARE_REVISION            (0x0054)
+#define HANDLE_DEVICE_INFO_SOFTWARE_REVISION            (0x0056)
+#define HANDLE_DEVICE_INFO_MANUFACTURER_NAME            (0x0058)
+#define HANDLE_DEVICE_INFO_PNP_ID                       (0x005a)
+#define HANDLE_DEVICE_INFO_SERVICE_END                  (0x005a)
+
+/* latency_service_db.db */
+#define HANDLE_KEY_LATENCY_SERVICE                      (0x005b)
+#define HANDLE_KEY_LATENCY                              (0x005d)
+#define HANDLE_KEY_LATENCY_SERVICE_END                  (0x005d)
+
+/* key_map_service_db.db */
+#define HANDLE_KEY_MAP_SERVICE                          (0x005e)
+#define HANDLE_KEY_MAP                                  (0x0060)
+#define HANDLE_KEY_MAP_SERVICE_END                      (0x0060)
+
+/* Lengths of the characteristic values */
+#define ATTR_LEN_DEVICE_APPEARANCE                      (2)
+#define ATTR_LEN_HID_BOOT_INPUT_REPORT                  (8)
+#define ATTR_LEN_HID_BOOT_OUTPUT_REPORT                 (1)
+#define ATTR_LEN_HID_INPUT_REPORT                       (8)
+#define ATTR_LEN_HID_CONSUMER_REPORT                    (8)
+#define ATTR_LEN_HID_NKRO_REPORT                        (20)
+#define ATTR_LEN_HID_OUTPUT_REPORT                      (1)
+#define ATTR_LEN_HID_PROTOCOL_MODE                      (1)
+#define ATTR_LEN_HID_PROP_BOOT_REPORT                   (8)
+#define ATTR_LEN_HID_PROP_BOOT_OUTPUT_REPORT            (1)
+#define ATTR_LEN_KEY_LATENCY                            (32)
+#define ATTR_LEN_KEY_MAP                                (19)
+
+#endif /* __APP_GATT_DB_H__ */
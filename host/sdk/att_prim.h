@@ -0,0 +1,2 @@
+/* Host build stand-in for the SDK header att_prim.h, see sdk_shim.h */
+#include "sdk_shim.h"
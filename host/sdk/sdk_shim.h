@@ -0,0 +1,790 @@
+/******************************************************************************
+ *  FILE
+ *      sdk_shim.h
+ *
+ *  DESCRIPTION
+ *      Declarations of the part of the CSR uEnergy SDK firmware library used
+ *      by the keyboard application, for building it on a Linux host. Every
+ *      SDK header the application includes from this directory pulls in this
+ *      file, so the application builds unchanged. The functions are
+ *      implemented in sdk_shim.c on top of a virtual clock.
+ *
+ *      Only what the application uses is declared. Types keep the names and
+ *      members of the SDK, but not necessarily their layout or the values of
+ *      the constants.
+ *
+ *      Unlike the XAP, where every type is at least 16 bits wide, uint8 is 8
+ *      bits wide on the host, so sizes given in uint8 units and sizeof agree.
+ *
+ *****************************************************************************/
+
+#ifndef __SDK_SHIM_H__
+#define __SDK_SHIM_H__
+
+/*============================================================================*
+ *  types.h
+ *============================================================================*/
+
+typedef unsigned char       uint8;
+typedef unsigned short      uint16;
+typedef unsigned int        uint24;
+typedef unsigned int        uint32;
+typedef signed char         int8;
+typedef signed short        int16;
+typedef signed int          int32;
+
+typedef uint16              bool;
+
+#define TRUE                (1)
+#define FALSE               (0)
+
+#ifndef NULL
+#define NULL                ((void *)0)
+#endif
+
+#define WORD_MSB(x)         (((x) >> 8) & 0xFF)
+#define WORD_LSB(x)         ((x) & 0xFF)
+
+/*============================================================================*
+ *  status.h
+ *============================================================================*/
+
+typedef uint16 sys_status;
+
+#define sys_status_success                      (0x0000)
+
+#define gatt_status_success                     (0x0000)
+#define gatt_status_invalid_handle              (0x0101)
+#define gatt_status_read_not_permitted          (0x0102)
+#define gatt_status_write_not_permitted         (0x0103)
+#define gatt_status_invalid_pdu                 (0x0104)
+#define gatt_status_insufficient_authentication (0x0105)
+#define gatt_status_request_not_supported       (0x0106)
+#define gatt_status_invalid_offset              (0x0107)
+#define gatt_status_insufficient_authorization  (0x0108)
+#define gatt_status_invalid_length              (0x010d)
+#define gatt_status_invalid_param_value         (0x0113)
+#define gatt_status_insufficient_encryption     (0x010f)
+#define gatt_status_app_mask                    (0x0180)
+#define gatt_status_busy                        (0x0203)
+#define gatt_status_irq_proceed                 (0x0219)
+
+#define sm_status_repeated_attempts             (0x0409)
+
+/*============================================================================*
+ *  panic.h
+ *============================================================================*/
+
+extern void Panic(uint16 panic_code);
+
+/*============================================================================*
+ *  mem.h, memory.h, buf_utils.h
+ *============================================================================*/
+
+extern void MemCopy(void *dst, const void *src, uint16 length);
+extern void MemSet(void *dst, uint16 value, uint16 length);
+extern int16 MemCmp(const void *a, const void *b, uint16 length);
+extern void MemCopyPack(void *dst, const void *src, uint16 length);
+extern void MemCopyUnPack(void *dst, const void *src, uint16 length);
+extern uint16 StrLen(const char *s);
+
+extern uint8 BufReadUint8(uint8 **p_buf);
+extern uint16 BufReadUint16(uint8 **p_buf);
+extern uint32 BufReadUint32(uint8 **p_buf);
+extern void BufWriteUint8(uint8 **p_buf, uint8 value);
+extern void BufWriteUint16(uint8 **p_buf, uint16 value);
+extern void BufWriteUint32(uint8 **p_buf, uint32 *p_value);
+
+/*============================================================================*
+ *  time.h, timer.h
+ *============================================================================*/
+
+#define MILLISECOND                 ((uint32)1000)
+#define SECOND                      ((uint32)1000 * MILLISECOND)
+#define MINUTE                      ((uint32)60 * SECOND)
+
+extern uint32 TimeGet32(void);
+extern uint16 TimeGet16(void);
+
+typedef uint16 timer_id;
+typedef void (*timer_callback_arg)(timer_id tid);
+
+#define TIMER_INVALID               ((timer_id)0xFFFF)
+
+/* Words of memory TimerInit needs per timer */
+#define SIZEOF_APP_TIMER            (4)
+
+extern void TimerInit(uint16 max_timers, void *p_timer_array);
+extern timer_id TimerCreate(uint32 timeout, bool rel,
+                            timer_callback_arg handler);
+extern bool TimerDelete(timer_id tid);
+
+/*============================================================================*
+ *  bluetooth.h, gap_types.h
+ *============================================================================*/
+
+typedef struct
+{
+    uint24  lap;
+    uint8   uap;
+    uint16  nap;
+
+} BD_ADDR_T;
+
+#define L_PUBLIC_ADDRESS            (0x0000)
+#define L_RANDOM_ADDRESS            (0x0001)
+
+#define L2CA_PUBLIC_ADDR_TYPE       L_PUBLIC_ADDRESS
+#define L2CA_RANDOM_ADDR_TYPE       L_RANDOM_ADDRESS
+
+#define BD_ADDR_NAP_RANDOM_TYPE_MASK        (0xC000)
+#define BD_ADDR_NAP_RANDOM_TYPE_NONRESOLV   (0x0000)
+#define BD_ADDR_NAP_RANDOM_TYPE_RESOLVABLE  (0x4000)
+#define BD_ADDR_NAP_RANDOM_TYPE_STATIC      (0xC000)
+
+typedef struct
+{
+    uint16      type;
+    BD_ADDR_T   addr;
+
+} TYPED_BD_ADDR_T;
+
+typedef uint16 hci_connection_handle_t;
+typedef uint16 hci_return_t;
+
+#define HCI_SUCCESS                             (0x00)
+#define HCI_ERROR_AUTH_FAIL                     (0x05)
+#define HCI_ERROR_CONN_TIMEOUT                  (0x08)
+#define HCI_ERROR_OETC_USER                     (0x13)
+#define HCI_ERROR_CONN_TERM_LOCAL_HOST          (0x16)
+#define HCI_ERROR_DIRECTED_ADVERTISING_TIMEOUT  (0x3C)
+
+typedef enum
+{
+    gap_role_peripheral = 0,
+    gap_role_central,
+    gap_role_broadcaster,
+    gap_role_observer
+
+} gap_role;
+
+typedef enum
+{
+    gap_mode_discover_no = 0,
+    gap_mode_discover_limited,
+    gap_mode_discover_general
+
+} gap_mode_discover;
+
+typedef enum
+{
+    gap_mode_connect_no = 0,
+    gap_mode_connect_directed,
+    gap_mode_connect_undirected
+
+} gap_mode_connect;
+
+typedef enum
+{
+    gap_mode_bond_no = 0,
+    gap_mode_bond_yes
+
+} gap_mode_bond;
+
+typedef enum
+{
+    gap_mode_security_none = 0,
+    gap_mode_security_unauthenticate,
+    gap_mode_security_authenticate
+
+} gap_mode_security;
+
+typedef struct
+{
+    uint16 con_min_interval;
+    uint16 con_max_interval;
+    uint16 con_slave_latency;
+    uint16 con_super_timeout;
+
+} ble_con_params;
+
+#define AD_TYPE_FLAGS                           (0x01)
+#define AD_TYPE_SERVICE_UUID_16BIT_LIST         (0x03)
+#define AD_TYPE_LOCAL_NAME_SHORT                (0x08)
+#define AD_TYPE_LOCAL_NAME_COMPLETE             (0x09)
+#define AD_TYPE_TX_POWER                        (0x0A)
+#define AD_TYPE_APPEARANCE                      (0x19)
+
+#define ADV_ADTYPE_MAX_LEN                      (31)
+
+typedef enum
+{
+    ad_src_advertise = 0,
+    ad_src_scan_rsp
+
+} ad_src;
+
+/*============================================================================*
+ *  ls_app_if.h, gap_app_if.h
+ *============================================================================*/
+
+typedef uint16 ls_err;
+
+typedef enum
+{
+    ls_addr_type_public = 0,
+    ls_addr_type_random
+
+} ls_addr_type;
+
+#define ls_err_none                 (0x0000)
+#define ls_err_arg                  (0x0001)
+#define ls_err_authentication       (0x0005)
+
+typedef enum
+{
+    radio_event_none = 0,
+    radio_event_connection_event,
+    radio_event_tx_data,
+    radio_event_rx_data,
+    radio_event_first_tx
+
+} radio_event;
+
+extern ls_err LsConnectionParamUpdateReq(TYPED_BD_ADDR_T *p_bd_addr,
+                                         ble_con_params *p_new_params);
+extern ls_err LsConnectionParamUpdateRsp(uint16 id, bool accept);
+extern ls_err LsRadioEventNotification(uint16 cid, radio_event event);
+extern ls_err LsResetWhiteList(void);
+extern ls_err LsAddWhiteListDevice(TYPED_BD_ADDR_T *p_addr);
+extern ls_err LsStoreAdvScanData(uint16 len, const uint8 *p_data,
+                                 ad_src src);
+extern ls_err LsDeleteAdvertisingReport(ad_src src);
+extern ls_err LsStartStopAdvertise(bool start, uint16 whitelist,
+                                   uint16 addr_type);
+extern ls_err LsSetTransmitPowerLevel(int8 level);
+extern ls_err LsReadTransmitPowerLevel(int8 *p_level);
+
+extern ls_err GapSetMode(gap_role role, gap_mode_discover discover,
+                         gap_mode_connect connect, gap_mode_bond bond,
+                         gap_mode_security security);
+extern ls_err GapSetAdvInterval(uint32 min, uint32 max);
+extern ls_err GapSetAdvAddress(TYPED_BD_ADDR_T *p_addr);
+extern ls_err GapSetRandomAddress(BD_ADDR_T *p_addr);
+extern void GapLtkAvailable(TYPED_BD_ADDR_T *p_addr, bool available);
+
+/*============================================================================*
+ *  security.h
+ *============================================================================*/
+
+#define MAX_WORDS_IRK               (8)
+
+#define SM_KEY_TYPE_NONE            (0x0000)
+#define SM_KEY_TYPE_ENC_CENTRAL     (0x0001)
+#define SM_KEY_TYPE_DIV             (0x0002)
+#define SM_KEY_TYPE_SIGN            (0x0003)
+#define SM_KEY_TYPE_ID              (0x0004)
+
+#define SM_IO_CAP_DISPLAY_ONLY      (0)
+#define SM_IO_CAP_DISPLAY_YES_NO    (1)
+#define SM_IO_CAP_KEYBOARD_ONLY     (2)
+#define SM_IO_CAP_NO_INPUT_NO_OUTPUT (3)
+#define SM_IO_CAP_KEYBOARD_DISPLAY  (4)
+
+typedef struct
+{
+    uint16 keys_present;
+    uint16 encryption_key_size;
+    uint16 div;
+    uint16 irk[MAX_WORDS_IRK];
+
+} SM_KEYSET_T;
+
+typedef struct
+{
+    TYPED_BD_ADDR_T remote_addr;
+    uint16          cid;
+    uint16          bond;
+    uint16          data;
+
+} SM_PAIRING_AUTH_DATA_T;
+
+extern void SMInit(uint16 diversifier);
+extern void SMSetIOCapabilities(uint16 io_capability);
+extern void SMPasskeyInput(const TYPED_BD_ADDR_T *p_addr,
+                           const uint32 *p_passkey);
+extern void SMPasskeyInputNeg(const TYPED_BD_ADDR_T *p_addr);
+extern int16 SMPrivacyMatchAddress(const TYPED_BD_ADDR_T *p_addr,
+                                  const uint16 *p_irks, uint16 num_irks,
+                                  uint16 irk_size);
+extern void SMRequestSecurityLevel(const TYPED_BD_ADDR_T *p_addr);
+extern void SMPairingAuthRsp(void *p_data, bool accept);
+
+typedef enum
+{
+    SM_DIV_APPROVED = 0,
+    SM_DIV_REVOKED
+
+} sm_div_verdict;
+
+extern void SMDivApproval(uint16 cid, sm_div_verdict approval);
+
+/*============================================================================*
+ *  gatt.h, gatt_prim.h, att_prim.h, gatt_uuid.h
+ *============================================================================*/
+
+#define ATT_ACCESS_READ             (0x0001)
+#define ATT_ACCESS_WRITE            (0x0002)
+#define ATT_ACCESS_PERMISSION       (0x8000)
+#define ATT_ACCESS_WRITE_COMPLETE   (0x4000)
+
+/* Hands the notification to the firmware. GATT_CHAR_VAL_NOT_CFM tells
+ * whether it has been queued for transmission.
+ */
+extern void GattCharValueNotification(uint16 cid, uint16 handle,
+                                      uint16 size, const uint8 *p_value);
+extern void GattCharValueIndication(uint16 cid, uint16 handle,
+                                    uint16 size, const uint8 *p_value);
+extern void GattInit(void);
+extern void GattInstallServerWrite(void);
+extern void GattInstallServerWriteLongReliable(void);
+extern void GattAddDatabaseReq(uint16 length, uint16 *p_database);
+extern void GattAccessRsp(uint16 cid, uint16 handle, sys_status rc,
+                          uint16 size_value, const uint8 *p_value);
+extern void GattConnectReq(TYPED_BD_ADDR_T *p_addr, uint16 flags);
+extern void GattCancelConnectReq(void);
+extern void GattDisconnectReq(uint16 cid);
+extern void GattDisconnectReasonReq(uint16 cid, uint16 reason);
+
+/* Generated from app_gatt_db.db by the SDK */
+extern uint16 *GattGetDatabase(uint16 *p_length);
+
+/* Flags of GattConnectReq */
+#define L2CAP_CONNECTION_SLAVE_UNDIRECTED       (0x0001)
+#define L2CAP_CONNECTION_SLAVE_DIRECTED         (0x0002)
+#define L2CAP_CONNECTION_SLAVE_WHITELIST        (0x0004)
+#define L2CAP_OWN_ADDR_TYPE_PUBLIC              (0x0000)
+#define L2CAP_OWN_ADDR_TYPE_RANDOM              (0x0010)
+#define L2CAP_PEER_ADDR_TYPE_PUBLIC             (0x0000)
+#define L2CAP_PEER_ADDR_TYPE_RANDOM             (0x0020)
+
+/*============================================================================*
+ *  nvm.h
+ *============================================================================*/
+
+extern sys_status NvmRead(uint16 *p_buffer, uint16 length, uint16 offset);
+extern sys_status NvmWrite(uint16 *p_buffer, uint16 length, uint16 offset);
+extern sys_status NvmDisable(void);
+extern sys_status NvmErase(bool erase_all);
+extern void NvmConfigureI2cEeprom(void);
+extern void NvmConfigureSpiFlash(void);
+
+/* Configuration store, read directly from memory by csr_ota_service.c */
+#define CSTORE_SIZE                 (0x0040)
+extern uint16 ShimCsStore[CSTORE_SIZE];
+#define DATA_CSTORE_START           (ShimCsStore)
+
+/*============================================================================*
+ *  sleep.h
+ *============================================================================*/
+
+typedef enum
+{
+    sleep_state_cold_powerup = 0,
+    sleep_state_warm_powerup,
+    sleep_state_dormant,
+    sleep_state_hibernate,
+    sleep_state_warm_reset,
+    sleep_state_last
+
+} sleep_state;
+
+typedef enum
+{
+    sleep_mode_never = 0,
+    sleep_mode_shallow,
+    sleep_mode_deep
+
+} sleep_mode;
+
+extern void SleepModeChange(sleep_mode mode);
+
+/*============================================================================*
+ *  pio.h, pio_ctrlr.h, i2c.h
+ *============================================================================*/
+
+typedef enum
+{
+    pio_mode_user = 0,
+    pio_mode_pio_controller,
+    pio_mode_pwm0,
+    pio_mode_pwm1,
+    pio_mode_pwm2,
+    pio_mode_pwm3,
+    pio_mode_uart,
+    pio_mode_strong_pull_up,
+    pio_mode_weak_pull_up,
+    pio_mode_strong_pull_down,
+    pio_mode_weak_pull_down,
+    pio_mode_no_pulls
+
+} pio_mode;
+
+typedef enum
+{
+    pio_event_mode_disable = 0,
+    pio_event_mode_rising,
+    pio_event_mode_falling,
+    pio_event_mode_both
+
+} pio_event_mode;
+
+typedef enum
+{
+    pio_pwm_mode_push_pull = 0,
+    pio_pwm_mode_open_drain
+
+} pio_pwm_mode;
+
+typedef enum
+{
+    pio_i2c_pull_mode_no_pulls = 0,
+    pio_i2c_pull_mode_strong_pull_down,
+    pio_i2c_pull_mode_strong_pull_up
+
+} pio_i2c_pull_mode;
+
+extern void PioSetMode(uint16 pio, pio_mode mode);
+extern void PioSetModes(uint32 mask, pio_mode mode);
+extern void PioSetDir(uint16 pio, bool output);
+extern void PioSetDirs(uint32 mask, uint32 outputs);
+extern void PioSetPullModes(uint32 mask, pio_mode mode);
+extern void PioSetEventMask(uint32 mask, pio_event_mode mode);
+extern void PioSet(uint16 pio, bool value);
+extern void PioSets(uint32 mask, uint32 values);
+extern bool PioGet(uint16 pio);
+extern uint32 PioGets(void);
+extern bool PioConfigPWM(uint16 pwm_id, pio_pwm_mode mode,
+                         uint8 dull_off_time, uint8 dull_on_time,
+                         uint8 dull_hold_time, uint8 bright_off_time,
+                         uint8 bright_on_time, uint8 bright_hold_time,
+                         uint8 ramp_rate);
+extern void PioEnablePWM(uint16 pwm_id, bool enable);
+extern void PioSetI2CPullMode(pio_i2c_pull_mode mode);
+
+extern void PioCtrlrInit(uint16 *p_code);
+extern void PioCtrlrStart(void);
+extern void PioCtrlrStop(void);
+extern void PioCtrlrClock(bool fast);
+
+/*============================================================================*
+ *  battery.h
+ *============================================================================*/
+
+extern uint16 BatteryReadVoltage(void);
+extern uint16 BatteryReadLowThreshold(void);
+
+/*============================================================================*
+ *  uart.h
+ *============================================================================*/
+
+typedef enum
+{
+    uart_data_unpacked = 0,
+    uart_data_packed
+
+} uart_data_mode;
+
+typedef uint16 (*uart_data_in_fn)(void *p_data, uint16 data_count,
+                                  uint16 *p_req_data_length);
+typedef void (*uart_data_out_fn)(void);
+
+#define UART_BUF_SIZE_BYTES_32      (32)
+#define UART_BUF_SIZE_BYTES_64      (64)
+#define UART_BUF_SIZE_BYTES_128     (128)
+
+#define UART_DECLARE_BUFFER(name, size)     uint16 name[(size)]
+
+#define UART_RATE_9K6               (0x0028)
+#define UART_RATE_115K2             (0x01d9)
+#define UART_RATE_921K6             (0x0ebf)
+
+extern void UartInit(uart_data_in_fn rx_fn, uart_data_out_fn tx_fn,
+                     uint16 *p_rx_buffer, uint16 rx_size,
+                     uint16 *p_tx_buffer, uint16 tx_size,
+                     uart_data_mode mode);
+extern void UartConfig(uint16 baud_rate, uint16 flags);
+extern void UartEnable(bool enable);
+extern void UartRead(uint16 length, uint16 timeout);
+extern bool UartWrite(const uint8 *p_data, uint16 length);
+
+/*============================================================================*
+ *  csr_ota.h
+ *============================================================================*/
+
+typedef enum
+{
+    csr_application_ota = 0,
+    csr_application_app1,
+    csr_application_app2
+
+} csr_application_id;
+
+#define CSR_OTA_KEY_NOT_READ        (0xFFFF)
+
+extern sys_status OtaReset(void);
+extern csr_application_id OtaReadCurrentApp(void);
+extern sys_status OtaWriteCurrentApp(csr_application_id id, bool bonded,
+                                     TYPED_BD_ADDR_T *p_host,
+                                     uint16 diversifier,
+                                     BD_ADDR_T *p_local_addr,
+                                     uint16 *p_irk, bool service_changed);
+extern sys_status CsReadUserKey(uint16 index, uint16 *p_value);
+
+/*============================================================================*
+ *  sys_events.h
+ *============================================================================*/
+
+typedef enum
+{
+    sys_event_wakeup = 0,
+    sys_event_battery_low,
+    sys_event_pio_changed,
+    sys_event_pio_ctrlr,
+    sys_event_last
+
+} sys_event_id;
+
+typedef struct
+{
+    uint32 pio_cause;
+    uint32 pio_state;
+
+} pio_changed_data;
+
+/*============================================================================*
+ *  bt_event_types.h
+ *============================================================================*/
+
+typedef enum
+{
+    GATT_ADD_DB_CFM = 0x100,
+    GATT_CONNECT_CFM,
+    GATT_CANCEL_CONNECT_CFM,
+    GATT_ACCESS_IND,
+    GATT_DISCONNECT_IND,
+    GATT_CHAR_VAL_NOT_CFM,
+    GATT_CHAR_VAL_IND_CFM,
+
+    LM_EV_CONNECTION_COMPLETE = 0x200,
+    LM_EV_DISCONNECT_COMPLETE,
+    LM_EV_ENCRYPTION_CHANGE,
+    LM_EV_CONNECTION_UPDATE,
+
+    SM_KEYS_IND = 0x300,
+    SM_PAIRING_AUTH_IND,
+    SM_SIMPLE_PAIRING_COMPLETE_IND,
+    SM_PASSKEY_INPUT_IND,
+    SM_DIV_APPROVE_IND,
+
+    LS_CONNECTION_PARAM_UPDATE_CFM = 0x400,
+    LS_CONNECTION_PARAM_UPDATE_IND,
+    LS_RADIO_EVENT_IND
+
+} lm_event_code;
+
+typedef struct
+{
+    sys_status      result;
+
+} GATT_ADD_DB_CFM_T;
+
+typedef struct
+{
+    TYPED_BD_ADDR_T bd_addr;
+    uint16          cid;
+    sys_status      result;
+
+} GATT_CONNECT_CFM_T;
+
+typedef struct
+{
+    sys_status      result;
+
+} GATT_CANCEL_CONNECT_CFM_T;
+
+typedef struct
+{
+    uint16          cid;
+    uint16          handle;
+    uint16          flags;
+    uint16          offset;
+    uint16          size_value;
+    uint8          *value;
+
+} GATT_ACCESS_IND_T;
+
+typedef struct
+{
+    uint16          cid;
+    uint16          handle;
+    sys_status      result;
+
+} GATT_CHAR_VAL_IND_CFM_T;
+
+typedef struct
+{
+    hci_return_t            status;
+    hci_connection_handle_t connection_handle;
+    uint16                  role;
+    TYPED_BD_ADDR_T         peer_address;
+    uint16                  conn_interval;
+    uint16                  conn_latency;
+    uint16                  supervision_timeout;
+    uint16                  clock_accuracy;
+
+} HCI_EV_DATA_ULP_CONNECTION_COMPLETE_T;
+
+typedef struct
+{
+    HCI_EV_DATA_ULP_CONNECTION_COMPLETE_T data;
+
+} LM_EV_CONNECTION_COMPLETE_T;
+
+typedef struct
+{
+    hci_return_t            status;
+    hci_connection_handle_t handle;
+    uint16                  reason;
+
+} HCI_EV_DATA_DISCONNECT_COMPLETE_T;
+
+typedef struct
+{
+    HCI_EV_DATA_DISCONNECT_COMPLETE_T data;
+
+} LM_EV_DISCONNECT_COMPLETE_T;
+
+typedef struct
+{
+    hci_return_t            status;
+    hci_connection_handle_t handle;
+    bool                    enc_enable;
+
+} HCI_EV_DATA_ENCRYPTION_CHANGE_T;
+
+typedef struct
+{
+    HCI_EV_DATA_ENCRYPTION_CHANGE_T data;
+
+} LM_EV_ENCRYPTION_CHANGE_T;
+
+typedef struct
+{
+    hci_return_t            status;
+    hci_connection_handle_t connection_handle;
+    uint16                  conn_interval;
+    uint16                  conn_latency;
+    uint16                  supervision_timeout;
+
+} HCI_EV_DATA_ULP_CONNECTION_UPDATE_T;
+
+typedef struct
+{
+    HCI_EV_DATA_ULP_CONNECTION_UPDATE_T data;
+
+} LM_EV_CONNECTION_UPDATE_T;
+
+typedef struct
+{
+    TYPED_BD_ADDR_T remote_addr;
+    SM_KEYSET_T    *keys;
+
+} SM_KEYS_IND_T;
+
+typedef struct
+{
+    SM_PAIRING_AUTH_DATA_T *data;
+
+} SM_PAIRING_AUTH_IND_T;
+
+typedef struct
+{
+    TYPED_BD_ADDR_T bd_addr;
+    sys_status      status;
+    uint16          security_level;
+
+} SM_SIMPLE_PAIRING_COMPLETE_IND_T;
+
+typedef struct
+{
+    TYPED_BD_ADDR_T bd_addr;
+
+} SM_PASSKEY_INPUT_IND_T;
+
+typedef struct
+{
+    uint16          cid;
+    uint16          div;
+
+} SM_DIV_APPROVE_IND_T;
+
+typedef struct
+{
+    TYPED_BD_ADDR_T address;
+    ls_err          status;
+
+} LS_CONNECTION_PARAM_UPDATE_CFM_T;
+
+typedef struct
+{
+    uint16          cid;
+    uint16          sig_identifier;
+    uint16          conn_interval_min;
+    uint16          conn_interval_max;
+    uint16          slave_latency;
+    uint16          supervision_timeout;
+
+} LS_CONNECTION_PARAM_UPDATE_IND_T;
+
+typedef struct
+{
+    uint16          cid;
+    radio_event     event;
+
+} LS_RADIO_EVENT_IND_T;
+
+typedef union
+{
+    GATT_ADD_DB_CFM_T                   add_db_cfm;
+    GATT_CONNECT_CFM_T                  connect_cfm;
+    GATT_CANCEL_CONNECT_CFM_T           cancel_connect_cfm;
+    GATT_ACCESS_IND_T                   access_ind;
+    GATT_CHAR_VAL_IND_CFM_T             char_val_cfm;
+    LM_EV_CONNECTION_COMPLETE_T         connection_complete;
+    LM_EV_DISCONNECT_COMPLETE_T         disconnect_complete;
+    LM_EV_ENCRYPTION_CHANGE_T           enc_change;
+    LM_EV_CONNECTION_UPDATE_T           connection_update;
+    SM_KEYS_IND_T                       keys_ind;
+    SM_PAIRING_AUTH_IND_T               pairing_auth_ind;
+    SM_SIMPLE_PAIRING_COMPLETE_IND_T    pairing_complete_ind;
+    SM_PASSKEY_INPUT_IND_T              passkey_input_ind;
+    SM_DIV_APPROVE_IND_T                div_approve_ind;
+    LS_CONNECTION_PARAM_UPDATE_CFM_T    param_update_cfm;
+    LS_CONNECTION_PARAM_UPDATE_IND_T    param_update_ind;
+    LS_RADIO_EVENT_IND_T                radio_event_ind;
+
+} LM_EVENT_T;
+
+/*============================================================================*
+ *  main.h
+ *============================================================================*/
+
+/* Entry points of the application, called by the firmware */
+extern void AppPowerOnReset(void);
+extern void AppInit(sleep_state last_sleep_state);
+extern void AppProcessSystemEvent(sys_event_id id, void *data);
+extern bool AppProcessLmEvent(lm_event_code event_code,
+                              LM_EVENT_T *p_event_data);
+
+#endif /* __SDK_SHIM_H__ */
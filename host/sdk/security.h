@@ -0,0 +1,2 @@
+/* Host build stand-in for the SDK header security.h, see sdk_shim.h */
+#include "sdk_shim.h"
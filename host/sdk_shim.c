@@ -0,0 +1,1639 @@
+/******************************************************************************
+ *  FILE
+ *      sdk_shim.c
+ *
+ *  DESCRIPTION
+ *      Host build implementation of the part of the CSR uEnergy SDK firmware
+ *      library used by the keyboard application. See shim.h for how it is
+ *      driven.
+ *
+ *      The PIOs and the security manager are not modelled beyond what keeps
+ *      the application going: requests which the firmware would confirm are
+ *      confirmed straight away through the event queue. Notifications go
+ *      through the simulated link, and the key matrix through the PIO
+ *      controller model, described in shim.h.
+ *
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sdk/sdk_shim.h"
+#include "sdk/app_gatt_db.h"
+#include "shim.h"
+
+/*============================================================================*
+ *  Private Definitions
+ *============================================================================*/
+
+/* Number of timers the shim can hold, whatever TimerInit asks for */
+#define SHIM_MAX_TIMERS             (32)
+
+/* Number of events which can be waiting for delivery */
+#define SHIM_EVENT_QUEUE_SIZE       (128)
+
+/* Size of the UART receive buffer */
+#define SHIM_UART_RX_SIZE           (256)
+
+/* NVM offsets and lengths are in XAP words, but the application passes sizeof
+ * for the lengths, which is in bytes on the host. Every word of NVM is given
+ * NVM_STRIDE bytes, which is more than the host size of any type per XAP
+ * word, so records never overlap.
+ */
+#define NVM_WORDS                   (0x0800)
+#define NVM_STRIDE                  (8)
+
+/* Connection interval unit of the HCI events, in microseconds */
+#define CONN_INTERVAL_UNIT          (1250)
+
+/* Link settings until ShimSetLink is called */
+#define DEFAULT_PACKETS_PER_EVENT   (4)
+#define DEFAULT_TX_BUFFERS          (8)
+
+/* Words of the shared memory of the PIO controller program: the buffer in
+ * use, two buffers of one byte per row, the scan sequence number, the scan
+ * profile set by the application, the tick count of scan cycles, the tick of
+ * the last scan with a change and the ticks since the scan before that one
+ */
+#define PIO_CTRLR_BUFFER_WORDS      ((SHIM_KEY_ROWS + 1) / 2)
+#define PIO_CTRLR_SEQ_WORD          (1 + 2 * PIO_CTRLR_BUFFER_WORDS)
+#define PIO_CTRLR_PROFILE_WORD      (PIO_CTRLR_SEQ_WORD + 1)
+#define PIO_CTRLR_TICK_WORD         (PIO_CTRLR_PROFILE_WORD + 1)
+#define PIO_CTRLR_CHANGE_TICK_WORD  (PIO_CTRLR_TICK_WORD + 1)
+#define PIO_CTRLR_GAP_WORD          (PIO_CTRLR_CHANGE_TICK_WORD + 1)
+#define PIO_CTRLR_SHARED_WORDS      (PIO_CTRLR_GAP_WORD + 1)
+
+/* SETTLE_SCANS, KEEPALIVE_SCANS and SLOW_SCAN_WAIT of pio_ctrlr_code.asm */
+#define PIO_CTRLR_SETTLE_SCANS      (6)
+#define PIO_CTRLR_KEEPALIVE_SCANS   (16)
+#define PIO_CTRLR_SLOW_SCAN_WAIT    (3)
+
+/* PIOs of the columns of the key matrix, the eight bits of a row */
+#define KEY_COLUMNS_PIO_SHIFT       (24)
+#define KEY_COLUMNS_PIO_MASK        (0xFF000000UL)
+
+/* Kinds of queued event */
+typedef enum
+{
+    shim_event_lm = 0,
+    shim_event_sys,
+    shim_event_uart_rx,
+    shim_event_uart_tx
+
+} shim_event_kind;
+
+/*============================================================================*
+ *  Private Data Types
+ *============================================================================*/
+
+typedef struct
+{
+    bool                active;
+    uint32              expiry;
+    uint32              seq;        /* Orders timers expiring together */
+    timer_callback_arg  handler;
+
+} SHIM_TIMER_T;
+
+typedef struct
+{
+    shim_event_kind     kind;
+    uint16              code;       /* lm_event_code or sys_event_id */
+    LM_EVENT_T          event;
+
+    /* Storage for what the event points at */
+    uint8               value[SHIM_VALUE_MAX];
+    SM_KEYSET_T         keys;
+
+} SHIM_EVENT_T;
+
+/* Notification held in a firmware transmit buffer */
+typedef struct
+{
+    uint16              cid;
+    uint16              handle;
+    uint16              size;
+    uint8               value[SHIM_MAX_NOTIFICATION];
+
+} SHIM_TX_BUFFER_T;
+
+/*============================================================================*
+ *  Private Data
+ *============================================================================*/
+
+/* Virtual clock in microseconds */
+static uint32 now;
+
+static SHIM_TIMER_T timers[SHIM_MAX_TIMERS];
+static uint16 max_timers;
+static uint32 timer_seq;
+
+static SHIM_EVENT_T events[SHIM_EVENT_QUEUE_SIZE];
+static uint16 event_start;
+static uint16 event_num;
+
+/* Radio events the application has asked for */
+static radio_event radio_events = radio_event_none;
+
+/* Simulated link */
+static SHIM_LINK_T link_settings =
+{
+    DEFAULT_PACKETS_PER_EVENT, DEFAULT_TX_BUFFERS, 0, FALSE, TRUE, 1
+};
+static SHIM_LINK_STATS_T link_stats;
+static bool connected;
+static uint16 conn_interval;
+static uint16 conn_latency;
+static uint32 next_conn_event;
+static uint16 events_skipped;
+static uint32 busy_random = 1;
+static bool busy_until_event;
+
+static SHIM_TX_BUFFER_T tx_buffers[SHIM_MAX_TX_BUFFERS];
+static uint16 tx_start;
+static uint16 tx_num;
+
+/* UART driver state */
+static uart_data_in_fn uart_rx_fn;
+static uart_data_out_fn uart_tx_fn;
+static uint8 uart_rx_fifo[SHIM_UART_RX_SIZE];
+static uint16 uart_rx_num;
+static uint16 uart_rx_wanted;
+static bool uart_tx_pending;
+
+static uint8 nvm[NVM_WORDS * NVM_STRIDE];
+static bool nvm_initialised;
+
+static shim_notification_fn notification_hook;
+static shim_uart_tx_fn uart_tx_hook;
+
+/* PIO controller model, with the registers of pio_ctrlr_code.asm */
+static bool pio_ctrlr_running;
+static uint32 last_scan;
+static bool pio_ctrlr_stopped;       /* Stopped after running */
+static uint32 pio_ctrlr_stop_time;
+static uint8 keys[SHIM_KEY_ROWS];
+static uint16 pio_ctrlr_shared[PIO_CTRLR_SHARED_WORDS];
+static uint16 settle_scans;         /* R5 */
+static uint16 keepalive_scans;      /* R6 */
+static uint16 last_tick;            /* LAST_TICK */
+static SHIM_PIO_CTRLR_STATS_T pio_ctrlr_stats;
+
+/* PIOs given to the PIO controller, set as outputs and driven high */
+static uint32 pio_ctrlr_pios;
+static uint32 pio_outputs;
+static uint32 pio_levels = 0xFFFFFFFF;
+
+/* PIOs raising sys_event_pio_changed on a falling edge */
+static uint32 pio_falling_events;
+
+/* PIO driving each row of the key matrix */
+static const uint16 row_pios[SHIM_KEY_ROWS] =
+{
+    0, 3, 4, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23
+};
+
+uint16 ShimCsStore[CSTORE_SIZE];
+
+/*============================================================================*
+ *  Private Function Implementations
+ *============================================================================*/
+
+static SHIM_EVENT_T *queueEvent(shim_event_kind kind, uint16 code)
+{
+    SHIM_EVENT_T *p_event;
+
+    if(event_num == SHIM_EVENT_QUEUE_SIZE)
+    {
+        fprintf(stderr, "shim: event queue full\n");
+        abort();
+    }
+
+    p_event = &events[(event_start + event_num) % SHIM_EVENT_QUEUE_SIZE];
+    ++ event_num;
+
+    memset(p_event, 0, sizeof(*p_event));
+    p_event->kind = kind;
+    p_event->code = code;
+
+    return p_event;
+}
+
+static void deliverUartRx(void)
+{
+    uint8 data[SHIM_UART_RX_SIZE];
+    uint16 length = uart_rx_num;
+    uint16 wanted = 1;
+    uint16 used;
+
+    if(uart_rx_fn == NULL || uart_rx_wanted == 0 || length < uart_rx_wanted)
+    {
+        return;
+    }
+
+    /* The callback may receive more data into the FIFO */
+    memcpy(data, uart_rx_fifo, length);
+    uart_rx_wanted = 0;
+
+    used = uart_rx_fn(data, length, &wanted);
+    if(used > length)
+    {
+        used = length;
+    }
+
+    memmove(uart_rx_fifo, uart_rx_fifo + used, uart_rx_num - used);
+    uart_rx_num -= used;
+    uart_rx_wanted = wanted;
+}
+
+static void deliverEvent(SHIM_EVENT_T *p_event)
+{
+    switch(p_event->kind)
+    {
+        case shim_event_lm:
+            if(p_event->code == GATT_ACCESS_IND)
+            {
+                p_event->event.access_ind.value = p_event->value;
+            }
+            else if(p_event->code == SM_KEYS_IND)
+            {
+                p_event->event.keys_ind.keys = &p_event->keys;
+            }
+            AppProcessLmEvent((lm_event_code)p_event->code, &p_event->event);
+        break;
+
+        case shim_event_sys:
+            /* The PIO controller event points to its live shared memory */
+            AppProcessSystemEvent((sys_event_id)p_event->code,
+                                  p_event->code == sys_event_pio_ctrlr ?
+                                      (void *)pio_ctrlr_shared :
+                                      (void *)p_event->value);
+        break;
+
+        case shim_event_uart_rx:
+            deliverUartRx();
+        break;
+
+        case shim_event_uart_tx:
+            uart_tx_pending = FALSE;
+            if(uart_tx_fn != NULL)
+            {
+                uart_tx_fn();
+            }
+        break;
+    }
+}
+
+/* Deliver the queued events, including those raised on the way */
+static void drainEvents(void)
+{
+    SHIM_EVENT_T event;
+
+    while(event_num)
+    {
+        event = events[event_start];
+        event_start = (event_start + 1) % SHIM_EVENT_QUEUE_SIZE;
+        -- event_num;
+
+        deliverEvent(&event);
+    }
+}
+
+/* Returns the timer expiring first at or before 'limit', if any */
+static SHIM_TIMER_T *nextTimer(uint32 limit)
+{
+    SHIM_TIMER_T *p_next = NULL;
+    uint16 i;
+
+    for(i = 0; i < max_timers; i++)
+    {
+        SHIM_TIMER_T *p_timer = &timers[i];
+
+        if(!p_timer->active || (int32)(p_timer->expiry - limit) > 0)
+        {
+            continue;
+        }
+
+        if(p_next == NULL ||
+           (int32)(p_timer->expiry - p_next->expiry) < 0 ||
+           (p_timer->expiry == p_next->expiry && p_timer->seq < p_next->seq))
+        {
+            p_next = p_timer;
+        }
+    }
+
+    return p_next;
+}
+
+/* xorshift32, so runs are repeatable whatever the C library */
+static uint32 nextRandom(void)
+{
+    busy_random ^= busy_random << 13;
+    busy_random ^= busy_random >> 17;
+    busy_random ^= busy_random << 5;
+
+    return busy_random;
+}
+
+static void linkUp(uint16 interval, uint16 latency)
+{
+    connected = TRUE;
+    conn_interval = interval ? interval : 1;
+    conn_latency = latency;
+    next_conn_event = now + (uint32)conn_interval * CONN_INTERVAL_UNIT;
+    events_skipped = 0;
+    tx_start = 0;
+    tx_num = 0;
+    busy_until_event = FALSE;
+}
+
+/* Run the connection event falling due now */
+static void connectionEvent(void)
+{
+    LM_EVENT_T event;
+    uint16 sent = 0;
+
+    next_conn_event += (uint32)conn_interval * CONN_INTERVAL_UNIT;
+
+    /* With nothing to send the device sleeps through as many connection
+     * events as the slave latency allows
+     */
+    if(tx_num == 0 && events_skipped < conn_latency)
+    {
+        ++ events_skipped;
+        return;
+    }
+
+    events_skipped = 0;
+    ++ link_stats.connection_events;
+    busy_until_event = FALSE;
+
+    while(tx_num && sent < link_settings.packets_per_event)
+    {
+        SHIM_TX_BUFFER_T *p_buffer = &tx_buffers[tx_start];
+
+        if(notification_hook != NULL)
+        {
+            notification_hook(p_buffer->cid, p_buffer->handle, p_buffer->size,
+                              p_buffer->value);
+        }
+
+        tx_start = (tx_start + 1) % SHIM_MAX_TX_BUFFERS;
+        -- tx_num;
+        ++ sent;
+        ++ link_stats.notifications_sent;
+    }
+
+    /* The slave transmits in every connection event it wakes up for, if only
+     * an empty packet, so the buffers are known to be free from then on
+     */
+    if(radio_events == radio_event_tx_data)
+    {
+        memset(&event, 0, sizeof(event));
+        event.radio_event_ind.cid = SHIM_CID;
+        event.radio_event_ind.event = radio_event_tx_data;
+        ShimInjectLmEvent(LS_RADIO_EVENT_IND, &event);
+    }
+}
+
+/* Time of the next scan of the PIO controller model. In the slow scan
+ * profile the program waits between two scans, until the application sets
+ * the fast one.
+ */
+static uint32 nextScan(void)
+{
+    if(pio_ctrlr_shared[PIO_CTRLR_PROFILE_WORD])
+    {
+        return last_scan + (PIO_CTRLR_SLOW_SCAN_WAIT + 1) *
+                           SHIM_SCAN_CYCLE_TIME;
+    }
+
+    return last_scan + SHIM_SCAN_CYCLE_TIME;
+}
+
+/* Levels of the columns of the key matrix as read on their PIOs, pulled low
+ * by the keys held on the rows driven low by the application
+ */
+static uint32 columnLevels(void)
+{
+    uint32 levels = KEY_COLUMNS_PIO_MASK;
+    uint32 row_pio;
+    uint16 row;
+
+    for(row = 0; row < SHIM_KEY_ROWS; row++)
+    {
+        row_pio = 1UL << row_pios[row];
+
+        if((pio_outputs & row_pio) && !(pio_ctrlr_pios & row_pio) &&
+           !(pio_levels & row_pio))
+        {
+            levels &= ~((uint32)keys[row] << KEY_COLUMNS_PIO_SHIFT);
+        }
+    }
+
+    return levels;
+}
+
+/* Raise sys_event_pio_changed for the columns of the key matrix which went
+ * low since they were at 'before'
+ */
+static void columnEdges(uint32 before)
+{
+    pio_changed_data data;
+    const uint32 falling = before & ~columnLevels() & pio_falling_events;
+
+    if(falling)
+    {
+        data.pio_cause = falling;
+        data.pio_state = PioGets();
+        ShimInjectSysEvent(sys_event_pio_changed, &data, sizeof(data));
+    }
+}
+
+/* Run the scan of the PIO controller model falling due now, into the buffer
+ * not in use, and raise an event when the program would
+ */
+static void pioCtrlrScan(void)
+{
+    const uint16 buffer = pio_ctrlr_shared[0] ? 0 : 1;
+    uint16 *p_scan = &pio_ctrlr_shared[1 + buffer * PIO_CTRLR_BUFFER_WORDS];
+    const uint16 *p_last =
+                   &pio_ctrlr_shared[1 + (1 - buffer) * PIO_CTRLR_BUFFER_WORDS];
+    uint16 changed = 0;
+    uint16 held = 0;
+    uint16 row;
+    uint8 bits;
+
+    if(pio_ctrlr_shared[PIO_CTRLR_PROFILE_WORD])
+    {
+        ++ pio_ctrlr_stats.slow_scans;
+    }
+
+    /* The scan cycle, and those waited before it, are counted as ticks */
+    pio_ctrlr_shared[PIO_CTRLR_TICK_WORD] +=
+                                   (uint16)((now - last_scan) /
+                                            SHIM_SCAN_CYCLE_TIME);
+    last_scan = now;
+    ++ pio_ctrlr_stats.scans;
+
+    /* A pressed key reads low. The program does not drive the first row. */
+    for(row = 0; row < SHIM_KEY_ROWS; row++)
+    {
+        bits = row ? keys[row] : 0;
+        held |= bits;
+
+        if(row & 1)
+        {
+            p_scan[row / 2] = (p_scan[row / 2] & 0x00FF) |
+                              ((uint16)(uint8)~bits << 8);
+        }
+        else
+        {
+            p_scan[row / 2] = (p_scan[row / 2] & 0xFF00) | (uint8)~bits;
+        }
+    }
+
+    for(row = 0; row < PIO_CTRLR_BUFFER_WORDS; row++)
+    {
+        changed |= p_scan[row] ^ p_last[row];
+    }
+
+    if(held)
+    {
+        ++ pio_ctrlr_stats.held_scans;
+    }
+
+    if(changed)
+    {
+        pio_ctrlr_shared[PIO_CTRLR_CHANGE_TICK_WORD] =
+                                         pio_ctrlr_shared[PIO_CTRLR_TICK_WORD];
+        pio_ctrlr_shared[PIO_CTRLR_GAP_WORD] =
+                   (pio_ctrlr_shared[PIO_CTRLR_TICK_WORD] - last_tick) & 0x00FF;
+    }
+    last_tick = pio_ctrlr_shared[PIO_CTRLR_TICK_WORD] & 0x00FF;
+
+    pio_ctrlr_shared[0] = buffer;
+    pio_ctrlr_shared[PIO_CTRLR_SEQ_WORD] =
+                           (pio_ctrlr_shared[PIO_CTRLR_SEQ_WORD] + 1) & 0x00FF;
+
+    if(changed)
+    {
+        settle_scans = PIO_CTRLR_SETTLE_SCANS;
+    }
+    else if(settle_scans)
+    {
+        -- settle_scans;
+    }
+    else if(!held || -- keepalive_scans)
+    {
+        return;
+    }
+
+    keepalive_scans = PIO_CTRLR_KEEPALIVE_SCANS;
+    ++ pio_ctrlr_stats.events;
+    ShimInjectSysEvent(sys_event_pio_ctrlr, pio_ctrlr_shared,
+                       sizeof(pio_ctrlr_shared));
+}
+
+/*============================================================================*
+ *  Control Interface
+ *============================================================================*/
+
+extern void ShimBoot(void)
+{
+    AppPowerOnReset();
+    AppInit(sleep_state_cold_powerup);
+    drainEvents();
+}
+
+extern uint32 ShimNow(void)
+{
+    return now;
+}
+
+extern void ShimRunFor(uint32 duration)
+{
+    const uint32 end = now + duration;
+    SHIM_TIMER_T *p_timer;
+    timer_callback_arg handler;
+    bool conn_event_due;
+    uint32 next_scan;
+    bool scan_due;
+
+    drainEvents();
+
+    for(;;)
+    {
+        p_timer = nextTimer(end);
+        conn_event_due = connected && (int32)(next_conn_event - end) <= 0;
+        next_scan = nextScan();
+        scan_due = pio_ctrlr_running && (int32)(next_scan - end) <= 0;
+
+        /* Scans go before the connection events and timers falling due with
+         * them, and connection events before the timers
+         */
+        if(scan_due && (p_timer == NULL ||
+                        (int32)(next_scan - p_timer->expiry) <= 0) &&
+                       (!conn_event_due ||
+                        (int32)(next_scan - next_conn_event) <= 0))
+        {
+            if((int32)(next_scan - now) > 0)
+            {
+                now = next_scan;
+            }
+            pioCtrlrScan();
+        }
+        else if(conn_event_due && (p_timer == NULL ||
+                         (int32)(next_conn_event - p_timer->expiry) <= 0))
+        {
+            now = next_conn_event;
+            connectionEvent();
+        }
+        else if(p_timer != NULL)
+        {
+            if((int32)(p_timer->expiry - now) > 0)
+            {
+                now = p_timer->expiry;
+            }
+
+            /* The firmware frees the timer before calling its handler */
+            handler = p_timer->handler;
+            p_timer->active = FALSE;
+            handler((timer_id)(p_timer - timers));
+        }
+        else
+        {
+            break;
+        }
+
+        drainEvents();
+    }
+
+    now = end;
+}
+
+extern void ShimInjectLmEvent(lm_event_code code, const LM_EVENT_T *p_event)
+{
+    SHIM_EVENT_T *p_queued = queueEvent(shim_event_lm, code);
+
+    p_queued->event = *p_event;
+
+    if(code == GATT_ACCESS_IND)
+    {
+        uint16 size = p_event->access_ind.size_value;
+
+        if(size > SHIM_VALUE_MAX)
+        {
+            size = SHIM_VALUE_MAX;
+        }
+        memcpy(p_queued->value, p_event->access_ind.value, size);
+        p_queued->event.access_ind.size_value = size;
+    }
+    else if(code == SM_KEYS_IND && p_event->keys_ind.keys != NULL)
+    {
+        p_queued->keys = *p_event->keys_ind.keys;
+    }
+}
+
+extern void ShimInjectSysEvent(sys_event_id id, const void *data,
+                               uint16 length)
+{
+    SHIM_EVENT_T *p_queued = queueEvent(shim_event_sys, id);
+
+    if(length > SHIM_VALUE_MAX)
+    {
+        length = SHIM_VALUE_MAX;
+    }
+    if(data != NULL)
+    {
+        memcpy(p_queued->value, data, length);
+    }
+}
+
+extern void ShimConnect(uint16 interval, uint16 latency, uint16 timeout)
+{
+    LM_EVENT_T event;
+
+    memset(&event, 0, sizeof(event));
+    event.connection_complete.data.status = HCI_SUCCESS;
+    event.connection_complete.data.role = gap_role_peripheral;
+    event.connection_complete.data.peer_address.type = L2CA_PUBLIC_ADDR_TYPE;
+    event.connection_complete.data.peer_address.addr.lap = 0x123456;
+    event.connection_complete.data.peer_address.addr.uap = 0x78;
+    event.connection_complete.data.peer_address.addr.nap = 0x0002;
+    event.connection_complete.data.conn_interval = interval;
+    event.connection_complete.data.conn_latency = latency;
+    event.connection_complete.data.supervision_timeout = timeout;
+    ShimInjectLmEvent(LM_EV_CONNECTION_COMPLETE, &event);
+
+    memset(&event, 0, sizeof(event));
+    event.connect_cfm.bd_addr.type = L2CA_PUBLIC_ADDR_TYPE;
+    event.connect_cfm.bd_addr.addr.lap = 0x123456;
+    event.connect_cfm.bd_addr.addr.uap = 0x78;
+    event.connect_cfm.bd_addr.addr.nap = 0x0002;
+    event.connect_cfm.cid = SHIM_CID;
+    event.connect_cfm.result = sys_status_success;
+    ShimInjectLmEvent(GATT_CONNECT_CFM, &event);
+
+    linkUp(interval, latency);
+}
+
+extern void ShimGattWrite(uint16 handle, const uint8 *p_value, uint16 size)
+{
+    LM_EVENT_T event;
+
+    memset(&event, 0, sizeof(event));
+    event.access_ind.cid = SHIM_CID;
+    event.access_ind.handle = handle;
+    event.access_ind.flags = ATT_ACCESS_WRITE | ATT_ACCESS_PERMISSION |
+                             ATT_ACCESS_WRITE_COMPLETE;
+    event.access_ind.size_value = size;
+    event.access_ind.value = (uint8 *)p_value;
+    ShimInjectLmEvent(GATT_ACCESS_IND, &event);
+}
+
+extern void ShimStartSession(uint16 interval, uint16 latency,
+                             uint32 byte_time)
+{
+    const uint8 enable[] = {0x01, 0x00};
+    const char *p_passkey = SHIM_PASSKEY;
+
+    ShimBoot();
+    ShimRunFor(SHIM_SETTLE_TIME);
+
+    ShimConnect(interval, latency, SHIM_SUPERVISION_TIMEOUT);
+    ShimRunFor(SHIM_SETTLE_TIME);
+
+    ShimGattWrite(HANDLE_HID_INPUT_RPT_CLIENT_CONFIG, enable, sizeof(enable));
+    ShimGattWrite(HANDLE_HID_CONSUMER_RPT_CLIENT_CONFIG, enable,
+                  sizeof(enable));
+    ShimRunFor(SHIM_SETTLE_TIME);
+
+    /* Honour the flow control of the UART driver */
+    while(*p_passkey)
+    {
+        p_passkey += ShimUartRx((const uint8 *)p_passkey, 1);
+        ShimRunFor(byte_time);
+    }
+    ShimRunFor(SHIM_SETTLE_TIME);
+}
+
+extern uint16 ShimUartRx(const uint8 *p_data, uint16 length)
+{
+    const uint16 room = SHIM_UART_RX_SIZE - uart_rx_num;
+
+    if(length > room)
+    {
+        length = room;
+    }
+
+    memcpy(uart_rx_fifo + uart_rx_num, p_data, length);
+    uart_rx_num += length;
+
+    if(uart_rx_num > link_stats.uart_rx_high_water)
+    {
+        link_stats.uart_rx_high_water = uart_rx_num;
+    }
+
+    if(length)
+    {
+        queueEvent(shim_event_uart_rx, 0);
+    }
+
+    return length;
+}
+
+extern void ShimSetLink(const SHIM_LINK_T *p_link)
+{
+    link_settings = *p_link;
+
+    if(link_settings.tx_buffers > SHIM_MAX_TX_BUFFERS)
+    {
+        link_settings.tx_buffers = SHIM_MAX_TX_BUFFERS;
+    }
+
+    /* xorshift32 never leaves 0 */
+    busy_random = link_settings.seed ? link_settings.seed : 1;
+}
+
+extern void ShimSetKeys(const uint8 *rows)
+{
+    const uint32 before = columnLevels();
+
+    memcpy(keys, rows, sizeof(keys));
+    columnEdges(before);
+}
+
+extern void ShimGetPioCtrlrStats(SHIM_PIO_CTRLR_STATS_T *p_stats)
+{
+    *p_stats = pio_ctrlr_stats;
+}
+
+extern void ShimClearPioCtrlrStats(void)
+{
+    memset(&pio_ctrlr_stats, 0, sizeof(pio_ctrlr_stats));
+    pio_ctrlr_stop_time = now;
+}
+
+extern void ShimGetLinkStats(SHIM_LINK_STATS_T *p_stats)
+{
+    *p_stats = link_stats;
+}
+
+extern void ShimClearLinkStats(void)
+{
+    memset(&link_stats, 0, sizeof(link_stats));
+}
+
+extern void ShimSetNotificationHook(shim_notification_fn hook)
+{
+    notification_hook = hook;
+}
+
+extern void ShimSetUartTxHook(shim_uart_tx_fn hook)
+{
+    uart_tx_hook = hook;
+}
+
+/*============================================================================*
+ *  panic.h
+ *============================================================================*/
+
+extern void Panic(uint16 panic_code)
+{
+    fprintf(stderr, "shim: application panic 0x%04x at %u us\n",
+            panic_code, now);
+    abort();
+}
+
+/*============================================================================*
+ *  mem.h, memory.h, buf_utils.h
+ *============================================================================*/
+
+extern void MemCopy(void *dst, const void *src, uint16 length)
+{
+    memmove(dst, src, length);
+}
+
+extern void MemSet(void *dst, uint16 value, uint16 length)
+{
+    memset(dst, value, length);
+}
+
+extern int16 MemCmp(const void *a, const void *b, uint16 length)
+{
+    return (int16)memcmp(a, b, length);
+}
+
+/* Packed data holds two bytes per word, least significant first, which is
+ * the byte order of the host
+ */
+extern void MemCopyPack(void *dst, const void *src, uint16 length)
+{
+    memmove(dst, src, length);
+}
+
+extern void MemCopyUnPack(void *dst, const void *src, uint16 length)
+{
+    memmove(dst, src, length);
+}
+
+extern uint16 StrLen(const char *s)
+{
+    return (uint16)strlen(s);
+}
+
+extern uint8 BufReadUint8(uint8 **p_buf)
+{
+    return *(*p_buf)++;
+}
+
+extern uint16 BufReadUint16(uint8 **p_buf)
+{
+    uint16 value = (*p_buf)[0] | ((*p_buf)[1] << 8);
+
+    *p_buf += 2;
+    return value;
+}
+
+extern uint32 BufReadUint32(uint8 **p_buf)
+{
+    uint32 value = BufReadUint16(p_buf);
+
+    return value | ((uint32)BufReadUint16(p_buf) << 16);
+}
+
+extern void BufWriteUint8(uint8 **p_buf, uint8 value)
+{
+    *(*p_buf)++ = value;
+}
+
+extern void BufWriteUint16(uint8 **p_buf, uint16 value)
+{
+    *(*p_buf)++ = WORD_LSB(value);
+    *(*p_buf)++ = WORD_MSB(value);
+}
+
+extern void BufWriteUint32(uint8 **p_buf, uint32 *p_value)
+{
+    BufWriteUint16(p_buf, (uint16)(*p_value & 0xFFFF));
+    BufWriteUint16(p_buf, (uint16)(*p_value >> 16));
+}
+
+/*============================================================================*
+ *  time.h, timer.h
+ *============================================================================*/
+
+extern uint32 TimeGet32(void)
+{
+    return now;
+}
+
+extern uint16 TimeGet16(void)
+{
+    return (uint16)now;
+}
+
+extern void TimerInit(uint16 max, void *p_timer_array)
+{
+    (void)p_timer_array;
+
+    max_timers = (max < SHIM_MAX_TIMERS) ? max : SHIM_MAX_TIMERS;
+    memset(timers, 0, sizeof(timers));
+}
+
+extern timer_id TimerCreate(uint32 timeout, bool rel,
+                            timer_callback_arg handler)
+{
+    uint16 i;
+
+    for(i = 0; i < max_timers; i++)
+    {
+        if(!timers[i].active)
+        {
+            timers[i].active = TRUE;
+            timers[i].expiry = rel ? now + timeout : timeout;
+            timers[i].seq = timer_seq++;
+            timers[i].handler = handler;
+
+            return (timer_id)i;
+        }
+    }
+
+    /* Out of timers, as the firmware would be */
+    return TIMER_INVALID;
+}
+
+extern bool TimerDelete(timer_id tid)
+{
+    if(tid >= max_timers || !timers[tid].active)
+    {
+        return FALSE;
+    }
+
+    timers[tid].active = FALSE;
+    return TRUE;
+}
+
+/*============================================================================*
+ *  ls_app_if.h, gap_app_if.h
+ *============================================================================*/
+
+extern ls_err LsConnectionParamUpdateReq(TYPED_BD_ADDR_T *p_bd_addr,
+                                         ble_con_params *p_new_params)
+{
+    LM_EVENT_T event;
+
+    if(!link_settings.accept_param_updates)
+    {
+        memset(&event, 0, sizeof(event));
+        event.param_update_cfm.address = *p_bd_addr;
+        event.param_update_cfm.status = ls_err_arg;
+        ShimInjectLmEvent(LS_CONNECTION_PARAM_UPDATE_CFM, &event);
+
+        return ls_err_none;
+    }
+
+    /* The remote host accepts the slowest interval it is offered, from the
+     * next connection event on
+     */
+    conn_interval = p_new_params->con_max_interval;
+    conn_latency = p_new_params->con_slave_latency;
+
+    memset(&event, 0, sizeof(event));
+    event.connection_update.data.status = HCI_SUCCESS;
+    event.connection_update.data.conn_interval =
+                                            p_new_params->con_max_interval;
+    event.connection_update.data.conn_latency =
+                                            p_new_params->con_slave_latency;
+    event.connection_update.data.supervision_timeout =
+                                            p_new_params->con_super_timeout;
+    ShimInjectLmEvent(LM_EV_CONNECTION_UPDATE, &event);
+
+    memset(&event, 0, sizeof(event));
+    event.param_update_cfm.address = *p_bd_addr;
+    event.param_update_cfm.status = ls_err_none;
+    ShimInjectLmEvent(LS_CONNECTION_PARAM_UPDATE_CFM, &event);
+
+    return ls_err_none;
+}
+
+extern ls_err LsConnectionParamUpdateRsp(uint16 id, bool accept)
+{
+    (void)id;
+    (void)accept;
+    return ls_err_none;
+}
+
+extern ls_err LsRadioEventNotification(uint16 cid, radio_event event)
+{
+    (void)cid;
+    radio_events = event;
+    return ls_err_none;
+}
+
+extern ls_err LsResetWhiteList(void)
+{
+    return ls_err_none;
+}
+
+extern ls_err LsAddWhiteListDevice(TYPED_BD_ADDR_T *p_addr)
+{
+    (void)p_addr;
+    return ls_err_none;
+}
+
+extern ls_err LsStoreAdvScanData(uint16 len, const uint8 *p_data,
+                                 ad_src src)
+{
+    (void)len;
+    (void)p_data;
+    (void)src;
+    return ls_err_none;
+}
+
+extern ls_err LsDeleteAdvertisingReport(ad_src src)
+{
+    (void)src;
+    return ls_err_none;
+}
+
+extern ls_err LsStartStopAdvertise(bool start, uint16 whitelist,
+                                   uint16 addr_type)
+{
+    (void)start;
+    (void)whitelist;
+    (void)addr_type;
+    return ls_err_none;
+}
+
+extern ls_err LsSetTransmitPowerLevel(int8 level)
+{
+    (void)level;
+    return ls_err_none;
+}
+
+extern ls_err LsReadTransmitPowerLevel(int8 *p_level)
+{
+    *p_level = 0;
+    return ls_err_none;
+}
+
+extern ls_err GapSetMode(gap_role role, gap_mode_discover discover,
+                         gap_mode_connect connect, gap_mode_bond bond,
+                         gap_mode_security security)
+{
+    (void)role;
+    (void)discover;
+    (void)connect;
+    (void)bond;
+    (void)security;
+    return ls_err_none;
+}
+
+extern ls_err GapSetAdvInterval(uint32 min, uint32 max)
+{
+    (void)min;
+    (void)max;
+    return ls_err_none;
+}
+
+extern ls_err GapSetAdvAddress(TYPED_BD_ADDR_T *p_addr)
+{
+    (void)p_addr;
+    return ls_err_none;
+}
+
+extern ls_err GapSetRandomAddress(BD_ADDR_T *p_addr)
+{
+    (void)p_addr;
+    return ls_err_none;
+}
+
+extern void GapLtkAvailable(TYPED_BD_ADDR_T *p_addr, bool available)
+{
+    (void)p_addr;
+    (void)available;
+}
+
+/*============================================================================*
+ *  security.h
+ *============================================================================*/
+
+extern void SMInit(uint16 diversifier)
+{
+    (void)diversifier;
+}
+
+extern void SMSetIOCapabilities(uint16 io_capability)
+{
+    (void)io_capability;
+}
+
+/* Any passkey is right: the link is encrypted and pairing completes */
+extern void SMPasskeyInput(const TYPED_BD_ADDR_T *p_addr,
+                           const uint32 *p_passkey)
+{
+    LM_EVENT_T event;
+
+    (void)p_passkey;
+
+    memset(&event, 0, sizeof(event));
+    event.enc_change.data.status = HCI_SUCCESS;
+    event.enc_change.data.enc_enable = TRUE;
+    ShimInjectLmEvent(LM_EV_ENCRYPTION_CHANGE, &event);
+
+    memset(&event, 0, sizeof(event));
+    event.pairing_complete_ind.bd_addr = *p_addr;
+    event.pairing_complete_ind.status = sys_status_success;
+    ShimInjectLmEvent(SM_SIMPLE_PAIRING_COMPLETE_IND, &event);
+}
+
+extern void SMPasskeyInputNeg(const TYPED_BD_ADDR_T *p_addr)
+{
+    (void)p_addr;
+}
+
+extern int16 SMPrivacyMatchAddress(const TYPED_BD_ADDR_T *p_addr,
+                                   const uint16 *p_irks, uint16 num_irks,
+                                   uint16 irk_size)
+{
+    (void)p_addr;
+    (void)p_irks;
+    (void)num_irks;
+    (void)irk_size;
+    return -1;
+}
+
+extern void SMRequestSecurityLevel(const TYPED_BD_ADDR_T *p_addr)
+{
+    (void)p_addr;
+}
+
+extern void SMPairingAuthRsp(void *p_data, bool accept)
+{
+    (void)p_data;
+    (void)accept;
+}
+
+extern void SMDivApproval(uint16 cid, sm_div_verdict approval)
+{
+    (void)cid;
+    (void)approval;
+}
+
+/*============================================================================*
+ *  gatt.h
+ *============================================================================*/
+
+extern void GattCharValueNotification(uint16 cid, uint16 handle,
+                                      uint16 size, const uint8 *p_value)
+{
+    LM_EVENT_T event;
+    SHIM_TX_BUFFER_T *p_buffer;
+    sys_status result = sys_status_success;
+
+    if(!connected)
+    {
+        result = gatt_status_invalid_handle;
+    }
+    else if(tx_num >= link_settings.tx_buffers)
+    {
+        result = gatt_status_busy;
+        ++ link_stats.busy_full;
+    }
+    else if(busy_until_event ||
+            (link_settings.busy_per_mille &&
+             nextRandom() % 1000 < link_settings.busy_per_mille))
+    {
+        /* The firmware frees buffers when it transmits, so it goes on
+         * refusing notifications until the next connection event, unless
+         * told to accept the next one
+         */
+        result = gatt_status_busy;
+        busy_until_event = !link_settings.busy_once;
+        ++ link_stats.busy_injected;
+    }
+    else
+    {
+        p_buffer = &tx_buffers[(tx_start + tx_num) % SHIM_MAX_TX_BUFFERS];
+        ++ tx_num;
+
+        if(tx_num > link_stats.tx_buffers_high_water)
+        {
+            link_stats.tx_buffers_high_water = tx_num;
+        }
+
+        if(size > SHIM_MAX_NOTIFICATION)
+        {
+            size = SHIM_MAX_NOTIFICATION;
+        }
+        p_buffer->cid = cid;
+        p_buffer->handle = handle;
+        p_buffer->size = size;
+        memcpy(p_buffer->value, p_value, size);
+    }
+
+    memset(&event, 0, sizeof(event));
+    event.char_val_cfm.cid = cid;
+    event.char_val_cfm.handle = handle;
+    event.char_val_cfm.result = result;
+    ShimInjectLmEvent(GATT_CHAR_VAL_NOT_CFM, &event);
+}
+
+extern void GattCharValueIndication(uint16 cid, uint16 handle,
+                                    uint16 size, const uint8 *p_value)
+{
+    LM_EVENT_T event;
+
+    if(notification_hook != NULL)
+    {
+        notification_hook(cid, handle, size, p_value);
+    }
+
+    memset(&event, 0, sizeof(event));
+    event.char_val_cfm.cid = cid;
+    event.char_val_cfm.handle = handle;
+    event.char_val_cfm.result = sys_status_success;
+    ShimInjectLmEvent(GATT_CHAR_VAL_IND_CFM, &event);
+}
+
+extern void GattInit(void)
+{
+}
+
+extern void GattInstallServerWrite(void)
+{
+}
+
+extern void GattInstallServerWriteLongReliable(void)
+{
+}
+
+extern void GattAddDatabaseReq(uint16 length, uint16 *p_database)
+{
+    LM_EVENT_T event;
+
+    (void)length;
+    (void)p_database;
+
+    memset(&event, 0, sizeof(event));
+    event.add_db_cfm.result = sys_status_success;
+    ShimInjectLmEvent(GATT_ADD_DB_CFM, &event);
+}
+
+extern void GattAccessRsp(uint16 cid, uint16 handle, sys_status rc,
+                          uint16 size_value, const uint8 *p_value)
+{
+    (void)cid;
+    (void)handle;
+    (void)rc;
+    (void)size_value;
+    (void)p_value;
+}
+
+extern void GattConnectReq(TYPED_BD_ADDR_T *p_addr, uint16 flags)
+{
+    (void)p_addr;
+    (void)flags;
+}
+
+extern void GattCancelConnectReq(void)
+{
+    LM_EVENT_T event;
+
+    memset(&event, 0, sizeof(event));
+    event.cancel_connect_cfm.result = sys_status_success;
+    ShimInjectLmEvent(GATT_CANCEL_CONNECT_CFM, &event);
+}
+
+extern void GattDisconnectReq(uint16 cid)
+{
+    GattDisconnectReasonReq(cid, HCI_ERROR_CONN_TERM_LOCAL_HOST);
+}
+
+extern void GattDisconnectReasonReq(uint16 cid, uint16 reason)
+{
+    LM_EVENT_T event;
+
+    (void)cid;
+
+    connected = FALSE;
+
+    memset(&event, 0, sizeof(event));
+    event.disconnect_complete.data.status = HCI_SUCCESS;
+    event.disconnect_complete.data.reason = reason;
+    ShimInjectLmEvent(LM_EV_DISCONNECT_COMPLETE, &event);
+}
+
+extern uint16 *GattGetDatabase(uint16 *p_length)
+{
+    static uint16 database[1];
+
+    *p_length = 0;
+    return database;
+}
+
+/*============================================================================*
+ *  nvm.h
+ *============================================================================*/
+
+static void nvmInit(void)
+{
+    if(!nvm_initialised)
+    {
+        /* Erased memory */
+        memset(nvm, 0xFF, sizeof(nvm));
+        nvm_initialised = TRUE;
+    }
+}
+
+extern sys_status NvmRead(uint16 *p_buffer, uint16 length, uint16 offset)
+{
+    nvmInit();
+
+    if((uint32)offset * NVM_STRIDE + length > sizeof(nvm))
+    {
+        Panic(0xFFFF);
+    }
+
+    memcpy(p_buffer, nvm + (uint32)offset * NVM_STRIDE, length);
+    return sys_status_success;
+}
+
+extern sys_status NvmWrite(uint16 *p_buffer, uint16 length, uint16 offset)
+{
+    nvmInit();
+
+    if((uint32)offset * NVM_STRIDE + length > sizeof(nvm))
+    {
+        Panic(0xFFFF);
+    }
+
+    memcpy(nvm + (uint32)offset * NVM_STRIDE, p_buffer, length);
+    return sys_status_success;
+}
+
+extern sys_status NvmDisable(void)
+{
+    return sys_status_success;
+}
+
+extern sys_status NvmErase(bool erase_all)
+{
+    (void)erase_all;
+
+    nvm_initialised = FALSE;
+    nvmInit();
+    return sys_status_success;
+}
+
+extern void NvmConfigureI2cEeprom(void)
+{
+}
+
+extern void NvmConfigureSpiFlash(void)
+{
+}
+
+/*============================================================================*
+ *  sleep.h
+ *============================================================================*/
+
+extern void SleepModeChange(sleep_mode mode)
+{
+    (void)mode;
+}
+
+/*============================================================================*
+ *  pio.h, pio_ctrlr.h, i2c.h
+ *============================================================================*/
+
+/* Stand-in for the PIO controller program of pio_ctrlr_code.asm */
+void pio_ctrlr_code(void)
+{
+}
+
+extern void PioSetMode(uint16 pio, pio_mode mode)
+{
+    (void)pio;
+    (void)mode;
+}
+
+extern void PioSetModes(uint32 mask, pio_mode mode)
+{
+    if(mode == pio_mode_pio_controller)
+    {
+        pio_ctrlr_pios |= mask;
+    }
+    else if(mode == pio_mode_user)
+    {
+        pio_ctrlr_pios &= ~mask;
+    }
+}
+
+extern void PioSetDir(uint16 pio, bool output)
+{
+    PioSetDirs(1UL << pio, output ? 1UL << pio : 0);
+}
+
+extern void PioSetDirs(uint32 mask, uint32 outputs)
+{
+    pio_outputs = (pio_outputs & ~mask) | (outputs & mask);
+}
+
+extern void PioSetPullModes(uint32 mask, pio_mode mode)
+{
+    (void)mask;
+    (void)mode;
+}
+
+/* Only the falling edges of the key matrix columns raise events */
+extern void PioSetEventMask(uint32 mask, pio_event_mode mode)
+{
+    if(mode == pio_event_mode_falling || mode == pio_event_mode_both)
+    {
+        pio_falling_events |= mask;
+    }
+    else
+    {
+        pio_falling_events &= ~mask;
+    }
+}
+
+extern void PioSet(uint16 pio, bool value)
+{
+    PioSets(1UL << pio, value ? 1UL << pio : 0);
+}
+
+extern void PioSets(uint32 mask, uint32 values)
+{
+    const uint32 before = columnLevels();
+
+    pio_levels = (pio_levels & ~mask) | (values & mask);
+    columnEdges(before);
+}
+
+extern bool PioGet(uint16 pio)
+{
+    return (PioGets() >> pio) & 1;
+}
+
+/* Inputs are pulled up, so no button is pressed, but the columns of the key
+ * matrix
+ */
+extern uint32 PioGets(void)
+{
+    return (0xFFFFFFFF & ~KEY_COLUMNS_PIO_MASK) | columnLevels();
+}
+
+extern bool PioConfigPWM(uint16 pwm_id, pio_pwm_mode mode,
+                         uint8 dull_off_time, uint8 dull_on_time,
+                         uint8 dull_hold_time, uint8 bright_off_time,
+                         uint8 bright_on_time, uint8 bright_hold_time,
+                         uint8 ramp_rate)
+{
+    (void)pwm_id;
+    (void)mode;
+    (void)dull_off_time;
+    (void)dull_on_time;
+    (void)dull_hold_time;
+    (void)bright_off_time;
+    (void)bright_on_time;
+    (void)bright_hold_time;
+    (void)ramp_rate;
+    return TRUE;
+}
+
+extern void PioEnablePWM(uint16 pwm_id, bool enable)
+{
+    (void)pwm_id;
+    (void)enable;
+}
+
+extern void PioSetI2CPullMode(pio_i2c_pull_mode mode)
+{
+    (void)mode;
+}
+
+extern void PioCtrlrInit(uint16 *p_code)
+{
+    (void)p_code;
+}
+
+extern void PioCtrlrStart(void)
+{
+    uint16 i;
+
+    /* The program starts with no key read in either buffer */
+    for(i = 1; i < PIO_CTRLR_SEQ_WORD; i++)
+    {
+        pio_ctrlr_shared[i] = 0xFFFF;
+    }
+    pio_ctrlr_shared[0] = 1;
+    pio_ctrlr_shared[PIO_CTRLR_SEQ_WORD] = 0;
+    pio_ctrlr_shared[PIO_CTRLR_PROFILE_WORD] = 0;
+    pio_ctrlr_shared[PIO_CTRLR_TICK_WORD] = 0;
+    pio_ctrlr_shared[PIO_CTRLR_CHANGE_TICK_WORD] = 0;
+    pio_ctrlr_shared[PIO_CTRLR_GAP_WORD] = 0;
+    last_tick = 0;
+    settle_scans = PIO_CTRLR_SETTLE_SCANS;
+    keepalive_scans = PIO_CTRLR_KEEPALIVE_SCANS;
+
+    if(pio_ctrlr_stopped)
+    {
+        pio_ctrlr_stats.stopped_time += now - pio_ctrlr_stop_time;
+    }
+
+    pio_ctrlr_running = TRUE;
+    pio_ctrlr_stopped = FALSE;
+    last_scan = now;
+}
+
+extern void PioCtrlrStop(void)
+{
+    if(pio_ctrlr_running)
+    {
+        ++ pio_ctrlr_stats.stops;
+        pio_ctrlr_stop_time = now;
+        pio_ctrlr_stopped = TRUE;
+    }
+    pio_ctrlr_running = FALSE;
+}
+
+extern void PioCtrlrClock(bool fast)
+{
+    (void)fast;
+}
+
+/*============================================================================*
+ *  battery.h
+ *============================================================================*/
+
+extern uint16 BatteryReadVoltage(void)
+{
+    return 3000;
+}
+
+extern uint16 BatteryReadLowThreshold(void)
+{
+    return 1800;
+}
+
+/*============================================================================*
+ *  uart.h
+ *============================================================================*/
+
+extern void UartInit(uart_data_in_fn rx_fn, uart_data_out_fn tx_fn,
+                     uint16 *p_rx_buffer, uint16 rx_size,
+                     uint16 *p_tx_buffer, uint16 tx_size,
+                     uart_data_mode mode)
+{
+    (void)p_rx_buffer;
+    (void)rx_size;
+    (void)p_tx_buffer;
+    (void)tx_size;
+    (void)mode;
+
+    uart_rx_fn = rx_fn;
+    uart_tx_fn = tx_fn;
+    uart_rx_num = 0;
+    uart_rx_wanted = 0;
+    uart_tx_pending = FALSE;
+}
+
+extern void UartConfig(uint16 baud_rate, uint16 flags)
+{
+    (void)baud_rate;
+    (void)flags;
+}
+
+extern void UartEnable(bool enable)
+{
+    (void)enable;
+}
+
+/* The receive callback is called once 'length' bytes are waiting */
+extern void UartRead(uint16 length, uint16 timeout)
+{
+    (void)timeout;
+
+    uart_rx_wanted = length;
+    queueEvent(shim_event_uart_rx, 0);
+}
+
+/* Data is sent as soon as it is written, so there is always room */
+extern bool UartWrite(const uint8 *p_data, uint16 length)
+{
+    if(uart_tx_hook != NULL)
+    {
+        uart_tx_hook(p_data, length);
+    }
+
+    if(!uart_tx_pending)
+    {
+        uart_tx_pending = TRUE;
+        queueEvent(shim_event_uart_tx, 0);
+    }
+
+    return TRUE;
+}
+
+/*============================================================================*
+ *  csr_ota.h
+ *============================================================================*/
+
+extern sys_status OtaReset(void)
+{
+    fprintf(stderr, "shim: OTA reset requested\n");
+    exit(0);
+}
+
+extern csr_application_id OtaReadCurrentApp(void)
+{
+    return csr_application_app1;
+}
+
+extern sys_status OtaWriteCurrentApp(csr_application_id id, bool bonded,
+                                     TYPED_BD_ADDR_T *p_host,
+                                     uint16 diversifier,
+                                     BD_ADDR_T *p_local_addr,
+                                     uint16 *p_irk, bool service_changed)
+{
+    (void)id;
+    (void)bonded;
+    (void)p_host;
+    (void)diversifier;
+    (void)p_local_addr;
+    (void)p_irk;
+    (void)service_changed;
+    return sys_status_success;
+}
+
+extern sys_status CsReadUserKey(uint16 index, uint16 *p_value)
+{
+    (void)index;
+    *p_value = 0;
+    return sys_status_success;
+}
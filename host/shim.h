@@ -0,0 +1,214 @@
+/******************************************************************************
+ *  FILE
+ *      shim.h
+ *
+ *  DESCRIPTION
+ *      Control interface of the host build SDK shim. The shim stands in for
+ *      the firmware: it owns a virtual clock, runs the application timers
+ *      against it and delivers firmware events to the application entry
+ *      points one at a time, in the order they were raised, as the firmware
+ *      scheduler does. Events the application causes itself, such as the
+ *      confirmation of a notification, are queued rather than delivered from
+ *      within the call, so a handler is never re-entered.
+ *
+ *      A host program boots the application with ShimBoot, injects the events
+ *      a remote host or the hardware would raise and advances the clock with
+ *      ShimRunFor.
+ *
+ *      Once connected, notifications go through a simulated link. The
+ *      firmware holds them in a limited number of transmit buffers and
+ *      refuses them with gatt_status_busy when these are full, or at random
+ *      when asked to. Every connection interval, a connection event sends up
+ *      to a budget of packets. With slave latency, the device only wakes up
+ *      for a connection event when it has something to send or when it has
+ *      skipped as many as the latency allows.
+ *
+ *      Once started by the application, the PIO controller program of
+ *      pio_ctrlr_code.asm is modelled too. It scans the keys set with
+ *      ShimSetKeys every scan cycle into its shared memory, and raises
+ *      sys_event_pio_ctrlr on the same scans as the program does. In the
+ *      slow scan profile it waits the scan cycles the program does between
+ *      two scans. While it is stopped, the rows the application drives low
+ *      pull the columns of the keys held low, which raises
+ *      sys_event_pio_changed for the columns with falling edge events.
+ *
+ *****************************************************************************/
+
+#ifndef __SHIM_H__
+#define __SHIM_H__
+
+#include "sdk/sdk_shim.h"
+
+/*============================================================================*
+ *  Public Definitions
+ *============================================================================*/
+
+/* Connection identifier of the connection made by ShimConnect */
+#define SHIM_CID                    (0x0040)
+
+/* Passkey typed on the keyboard by ShimStartSession when the host asks for
+ * it
+ */
+#define SHIM_PASSKEY                "123456\r"
+
+/* Supervision timeout of the connection made by ShimStartSession, in 10 ms
+ * units
+ */
+#define SHIM_SUPERVISION_TIMEOUT    (400)
+
+/* Time given to the application to settle after each setup step */
+#define SHIM_SETTLE_TIME            (100 * MILLISECOND)
+
+/* Largest value ShimGattWrite and ShimInjectSysEvent can carry */
+#define SHIM_VALUE_MAX              (64)
+
+/* Largest number of firmware transmit buffers of the simulated link */
+#define SHIM_MAX_TX_BUFFERS         (32)
+
+/* Largest notification the simulated link carries, the ATT_MTU of 23 less
+ * the 3 byte header
+ */
+#define SHIM_MAX_NOTIFICATION       (20)
+
+/* Rows of the key matrix scanned by the PIO controller model, ROWS of
+ * keyboard_hw.h. The keys of a row are one bit per column.
+ */
+#define SHIM_KEY_ROWS               (18)
+
+/* Time between two scans of the PIO controller model */
+#define SHIM_SCAN_CYCLE_TIME        (5 * MILLISECOND)
+
+/*============================================================================*
+ *  Public Data Types
+ *============================================================================*/
+
+/* Simulated link settings */
+typedef struct
+{
+    /* Packets sent per connection event */
+    uint16 packets_per_event;
+
+    /* Notifications the firmware can hold waiting to be sent, at most
+     * SHIM_MAX_TX_BUFFERS
+     */
+    uint16 tx_buffers;
+
+    /* Chance in 1000 of refusing a notification with gatt_status_busy even
+     * though a buffer is free. The notifications following it are refused as
+     * well until the next connection event, unless 'busy_once' is set.
+     */
+    uint16 busy_per_mille;
+
+    /* Refuse the notifications picked at random one at a time, so that the
+     * ones following a refused one can be accepted ahead of it
+     */
+    bool busy_once;
+
+    /* Whether the remote host accepts connection parameter updates. If not,
+     * the parameters given to ShimConnect are kept.
+     */
+    bool accept_param_updates;
+
+    /* Seed of the busy injection */
+    uint32 seed;
+
+} SHIM_LINK_T;
+
+/* Counters of the simulated link and the UART driver */
+typedef struct
+{
+    uint32 notifications_sent;      /* Sent over the air */
+    uint32 busy_full;               /* Refused, all buffers were in use */
+    uint32 busy_injected;           /* Refused at random, up to the next
+                                     * connection event
+                                     */
+    uint32 connection_events;       /* Connection events woken up for */
+    uint16 tx_buffers_high_water;   /* Most buffers in use at once */
+    uint16 uart_rx_high_water;      /* Most bytes waiting in the UART driver */
+
+} SHIM_LINK_STATS_T;
+
+/* Counters of the PIO controller model */
+typedef struct
+{
+    uint32 scans;                   /* Scans of the key matrix */
+    uint32 held_scans;              /* Scans which found a key held down */
+    uint32 events;                  /* sys_event_pio_ctrlr raised */
+    uint32 slow_scans;              /* Scans in the slow scan profile */
+    uint32 stops;                   /* Times the program was stopped */
+    uint32 stopped_time;            /* Time spent stopped, in microseconds */
+
+} SHIM_PIO_CTRLR_STATS_T;
+
+/* Called when a notification is sent over the air */
+typedef void (*shim_notification_fn)(uint16 cid, uint16 handle, uint16 size,
+                                     const uint8 *p_value);
+
+/* Called when the application writes to the UART */
+typedef void (*shim_uart_tx_fn)(const uint8 *p_data, uint16 length);
+
+/*============================================================================*
+ *  Public Function Prototypes
+ *============================================================================*/
+
+/* Power the application on and run it until it has nothing left to do */
+extern void ShimBoot(void);
+
+/* Current virtual time in microseconds */
+extern uint32 ShimNow(void);
+
+/* Advance the virtual clock, delivering the queued events and firing the
+ * timers falling due on the way
+ */
+extern void ShimRunFor(uint32 duration);
+
+/* Queue a firmware event for the application. The event is copied. */
+extern void ShimInjectLmEvent(lm_event_code code, const LM_EVENT_T *p_event);
+
+/* Queue a system event for the application. 'length' bytes of 'data' are
+ * copied.
+ */
+extern void ShimInjectSysEvent(sys_event_id id, const void *data,
+                               uint16 length);
+
+/* Connect a remote host to the advertising application with the given
+ * connection parameters, in the units of the HCI events
+ */
+extern void ShimConnect(uint16 interval, uint16 latency, uint16 timeout);
+
+/* Write a characteristic value or descriptor from the remote host */
+extern void ShimGattWrite(uint16 handle, const uint8 *p_value, uint16 size);
+
+/* Boot the application, connect a remote host to it with the given interval
+ * and slave latency, enable the input and consumer report notifications and
+ * type SHIM_PASSKEY over the UART, one byte every 'byte_time'. The
+ * application is given SHIM_SETTLE_TIME to settle after each step.
+ */
+extern void ShimStartSession(uint16 interval, uint16 latency,
+                             uint32 byte_time);
+
+/* Receive bytes over the UART. Returns the number of bytes the UART driver
+ * has room for, as a sender honouring flow control would see it.
+ */
+extern uint16 ShimUartRx(const uint8 *p_data, uint16 length);
+
+/* Change the simulated link settings. They can be changed at any time. */
+extern void ShimSetLink(const SHIM_LINK_T *p_link);
+
+/* Set the keys held down on the key matrix, SHIM_KEY_ROWS rows, from the
+ * next scan of the PIO controller model
+ */
+extern void ShimSetKeys(const uint8 *rows);
+
+extern void ShimGetPioCtrlrStats(SHIM_PIO_CTRLR_STATS_T *p_stats);
+extern void ShimClearPioCtrlrStats(void);
+
+/* Read and clear the counters of the simulated link */
+extern void ShimGetLinkStats(SHIM_LINK_STATS_T *p_stats);
+extern void ShimClearLinkStats(void);
+
+/* Install the hooks observing what the application sends */
+extern void ShimSetNotificationHook(shim_notification_fn hook);
+extern void ShimSetUartTxHook(shim_uart_tx_fn hook);
+
+#endif /* __SHIM_H__ */
@@ -0,0 +1,844 @@
+/*******************************************************************************
+ *  Copyright (c) 2012 - 2016 Qualcomm Technologies International, Ltd.
+ *  Part of CSR uEnergy SDK 2.6.1
+ *  Application version 2.6.1.0
+ *
+ *  FILE
+ *    key_map_service.c
+ *
+ * DESCRIPTION
+ *    This file defines routines for using the vendor specific Key Map
+ *    service. The base layer is the default map of the key matrix. Every
+ *    layer, the base one included, holds a sparse list of the keys it
+ *    overrides, indexed by a hash table so that a key is looked up in
+ *    constant time. The overrides are written over GATT and kept in NVM.
+ *
+ ******************************************************************************/
+
+/*=============================================================================*
+ *  SDK Header Files
+ *============================================================================*/
+
+#include <gatt.h>
+#include <gatt_prim.h>
+#include <mem.h>
+#include <buf_utils.h>
+
+/*=============================================================================*
+ *  Local Header Files
+ *============================================================================*/
+
+#include "app_gatt.h"
+#include "key_map_service.h"
+#include "keyboard_hw.h"
+#include "nvm_access.h"
+#include "app_gatt_db.h"
+
+/*=============================================================================*
+ *  Private Definitions
+ *============================================================================*/
+
+/* Number of scan codes of the key matrix. Scan code 0 is not used. */
+#define KEY_MAP_SCAN_CODES              (ROWS * COLUMNS + 1)
+
+/* Number of words of the bitmap of the scan codes */
+#define KEY_MAP_BITMAP_WORDS            ((KEY_MAP_SCAN_CODES + 15) / 16)
+
+/* Scan code of the function key, the layer key of layer 1 by default */
+#define KEY_MAP_FN_KEY                  (0x8D)
+
+/* Number of slots of the hash table of the overrides, a power of two. It is
+ * kept at most half full so that a look up ends within a few slots.
+ */
+#define KEY_MAP_SLOTS                   (64)
+
+#if KEY_MAP_SLOTS < 2 * KEY_MAP_MAX_OVERRIDES
+#error "KEY_MAP_SLOTS must be at least twice KEY_MAP_MAX_OVERRIDES"
+#endif
+
+/* First slot looked at for the override of a key in a layer */
+#define KEY_MAP_HASH(layer, scan_code)  \
+                    (((scan_code) * 7 + (layer) * 41) & (KEY_MAP_SLOTS - 1))
+
+/* An override is held in one word: the scan code of the key in the upper
+ * byte and its usage in the lower byte
+ */
+#define KEY_MAP_OVERRIDE(scan_code, usage)  \
+                    ((uint16)(((scan_code) << 8) | (usage)))
+#define KEY_MAP_SCAN_CODE(override)     ((override) >> 8)
+#define KEY_MAP_USAGE(override)         ((override) & 0xFF)
+
+/* The offsets of the data being stored in NVM for the key map. They are added
+ * to the key map offset to NVM region (see key_map_data.nvm_offset) to get
+ * the absolute offsets at which the data is stored in NVM.
+ */
+#define KEY_MAP_NVM_LAYER_KEY_OFFSET    (0)
+#define KEY_MAP_NVM_LAYER_END_OFFSET    (KEY_MAP_NVM_LAYER_KEY_OFFSET + \
+                                         KEY_MAP_LAYERS)
+#define KEY_MAP_NVM_OVERRIDES_OFFSET    (KEY_MAP_NVM_LAYER_END_OFFSET + \
+                                         KEY_MAP_LAYERS)
+
+/* Number of words of NVM memory used by the key map */
+#define KEY_MAP_NVM_MEMORY_WORDS        (KEY_MAP_NVM_OVERRIDES_OFFSET + \
+                                         KEY_MAP_MAX_OVERRIDES)
+
+/*=============================================================================*
+ *  Private Data Types
+ *============================================================================*/
+
+/* Key Map service data type */
+typedef struct
+{
+    /* Scan code of the layer key of each layer, 0 if it has none. The base
+     * layer has none.
+     */
+    uint16 layer_key[KEY_MAP_LAYERS];
+
+    /* The overrides of the layers, one layer after the other. Those of layer
+     * 'l' end before index layer_end[l] and start at the end of layer l - 1.
+     */
+    uint16 layer_end[KEY_MAP_LAYERS];
+    uint16 overrides[KEY_MAP_MAX_OVERRIDES];
+
+    /* Hash table of the overrides. A slot holds the index of an override
+     * plus one, 0 if it is free.
+     */
+    uint8  slots[KEY_MAP_SLOTS];
+
+    /* Bitmap of the scan codes overridden in any layer, or used as a layer
+     * key
+     */
+    uint16 overridden[KEY_MAP_BITMAP_WORDS];
+
+    /* Count incremented on every change of the key map */
+    uint16 version;
+
+    /* NVM offset at which the key map is stored */
+    uint16 nvm_offset;
+
+} KEY_MAP_DATA_T;
+
+/*=============================================================================*
+ *  Private Data
+ *============================================================================*/
+
+/* Key Map service data instance */
+static KEY_MAP_DATA_T key_map_data;
+
+/* USB HID codes of the scan codes, the default base layer */
+static const uint8 default_key_map[KEY_MAP_SCAN_CODES] = {
+/*0     1     2     3     4    5      6     7     8     9    0A    0B    0C    0D    0E    0F*/
+0x00, 0x00, 0x4A, 0x4B, 0x4E, 0x00, 0x4D, 0x51, 0x00, 0xE6, 0x4D, 0x5A, 0x42, 0x58, 0x72, 0x14, /* 00-0F */
+0x00, 0xE4, 0xA1, 0x00, 0x7B, 0x00, 0x00, 0x00, 0x00, 0x4C, 0x49, 0x2A, 0x52, 0x00, 0x4F, 0x65, /* 10-1F */
+0x00, 0x46, 0x31, 0x28, 0x73, 0x00, 0x50, 0x36, 0x10, 0x53, 0x30, 0x00, 0x34, 0x33, 0x38, 0x37, /* 20-2F */
+0x00, 0x45, 0x2E, 0xA3, 0x0E, 0x0F, 0x2C, 0x00, 0x11, 0x44, 0x43, 0x27, 0x2D, 0x13, 0x2F, 0x0D, /* 30-3F */
+0x0B, 0x42, 0x41, 0x25, 0x26, 0x0C, 0x12, 0x00, 0x05, 0x40, 0x3F, 0x23, 0x24, 0x18, 0x1C, 0x0A, /* 40-4F */
+0x00, 0x3E, 0x21, 0x22, 0x15, 0x17, 0x07, 0x09, 0x1B, 0x3D, 0x3C, 0x20, 0x1A, 0x08, 0x16, 0x1D, /* 50-5F */
+0x19, 0x3B, 0x3A, 0x1E, 0x1F, 0x14, 0x04, 0x08, 0x06, 0x00, 0xE1, 0x23, 0xE5, 0x6A, 0x22, 0x00, /* 60-6F */
+0x00, 0x00, 0xE0, 0x26, 0x00, 0x00, 0x00, 0x00, 0x00, 0x50, 0xE3, 0x24, 0x56, 0x6D, 0x21, 0x4E, /* 70-7F */
+0x00, 0x6B, 0xE2, 0x00, 0x37, 0x00, 0x00, 0x00, 0x00, 0x29, 0x32, 0x35, 0x39, 0x60, 0x2B, 0x28, /* 80-8F */
+0x00                                                                                            /* 90    */
+};
+
+/* Keys overridden by default in layer 1, switched on by the function key:
+ * an embedded numeric keypad, and consumer keys on F3 to F7.
+ *
+ *      Fn + F3 = Mute                  -> 0xF1
+ *      Fn + F4 = Volume Down           -> 0xF2
+ *      Fn + F5 = Volume Up             -> 0xF3
+ *      Fn + F6 = Home Page             -> 0xF4
+ *      Fn + F7 = Outlook(Mail Reader)  -> 0xF5
+ */
+static const uint16 default_fn_overrides[] = {
+    KEY_MAP_OVERRIDE(0x1A, 0x48),   /* Insert     -> Pause          */
+    KEY_MAP_OVERRIDE(0x28, 0x62),   /* M          -> Keypad 0       */
+    KEY_MAP_OVERRIDE(0x29, 0x47),   /* Num Lock   -> Scroll Lock    */
+    KEY_MAP_OVERRIDE(0x2D, 0x57),   /* ;          -> Keypad +       */
+    KEY_MAP_OVERRIDE(0x2E, 0x54),   /* /          -> Keypad /       */
+    KEY_MAP_OVERRIDE(0x2F, 0x63),   /* .          -> Keypad .       */
+    KEY_MAP_OVERRIDE(0x34, 0x5A),   /* K          -> Keypad 2       */
+    KEY_MAP_OVERRIDE(0x35, 0x5B),   /* L          -> Keypad 3       */
+    KEY_MAP_OVERRIDE(0x3B, 0x55),   /* 0          -> Keypad *       */
+    KEY_MAP_OVERRIDE(0x3D, 0x56),   /* P          -> Keypad -       */
+    KEY_MAP_OVERRIDE(0x3F, 0x59),   /* J          -> Keypad 1       */
+    KEY_MAP_OVERRIDE(0x43, 0x60),   /* 8          -> Keypad 8       */
+    KEY_MAP_OVERRIDE(0x44, 0x61),   /* 9          -> Keypad 9       */
+    KEY_MAP_OVERRIDE(0x45, 0x5D),   /* I          -> Keypad 5       */
+    KEY_MAP_OVERRIDE(0x46, 0x5E),   /* O          -> Keypad 6       */
+    KEY_MAP_OVERRIDE(0x49, 0xF5),   /* F7         -> Mail Reader    */
+    KEY_MAP_OVERRIDE(0x4A, 0xF4),   /* F6         -> Home Page      */
+    KEY_MAP_OVERRIDE(0x4C, 0x5F),   /* 7          -> Keypad 7       */
+    KEY_MAP_OVERRIDE(0x4D, 0x5C),   /* U          -> Keypad 4       */
+    KEY_MAP_OVERRIDE(0x51, 0xF3),   /* F5         -> Volume Up      */
+    KEY_MAP_OVERRIDE(0x59, 0xF2),   /* F4         -> Volume Down    */
+    KEY_MAP_OVERRIDE(0x5A, 0xF1),   /* F3         -> Mute           */
+    KEY_MAP_OVERRIDE(0x73, 0x61),   /* 9          -> Keypad 9       */
+    KEY_MAP_OVERRIDE(0x7B, 0x5F),   /* 7          -> Keypad 7       */
+    KEY_MAP_OVERRIDE(0x84, 0x63)    /* .          -> Keypad .       */
+};
+
+#define DEFAULT_FN_OVERRIDES    (sizeof(default_fn_overrides) / \
+                                 sizeof(default_fn_overrides[0]))
+
+/*=============================================================================*
+ *  Private Function Prototypes
+ *============================================================================*/
+
+static uint16 layerStart(uint16 layer);
+static uint16 findSlot(uint16 layer, uint16 scan_code);
+static void buildKeyMapIndex(void);
+static void loadDefaultKeyMap(void);
+static bool isKeyMapValid(void);
+static void writeKeyMapToNvm(void);
+static sys_status clearKeyMap(uint8 *p_value, uint16 size);
+static sys_status addOverrides(uint8 *p_value, uint16 size);
+
+/*=============================================================================*
+ *  Private Function Implementations
+ *============================================================================*/
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      layerStart
+ *
+ *  DESCRIPTION
+ *      This function returns the index of the first override of a layer.
+ *
+ *  RETURNS
+ *      Index in key_map_data.overrides.
+ *
+ *----------------------------------------------------------------------------*/
+
+static uint16 layerStart(uint16 layer)
+{
+    return layer ? key_map_data.layer_end[layer - 1] : 0;
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      findSlot
+ *
+ *  DESCRIPTION
+ *      This function looks the override of a key in a layer up in the hash
+ *      table.
+ *
+ *  RETURNS
+ *      The slot of the override, or the free slot it would go in.
+ *
+ *----------------------------------------------------------------------------*/
+
+static uint16 findSlot(uint16 layer, uint16 scan_code)
+{
+    uint16 slot = KEY_MAP_HASH(layer, scan_code);
+    uint16 index;
+
+    while((index = key_map_data.slots[slot]) != 0)
+    {
+        -- index;
+
+        if(KEY_MAP_SCAN_CODE(key_map_data.overrides[index]) == scan_code &&
+           index >= layerStart(layer) &&
+           index < key_map_data.layer_end[layer])
+        {
+            break;
+        }
+
+        slot = (slot + 1) & (KEY_MAP_SLOTS - 1);
+    }
+
+    return slot;
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      buildKeyMapIndex
+ *
+ *  DESCRIPTION
+ *      This function builds the hash table and the bitmap of the overridden
+ *      keys again from the lists of overrides, after they have changed.
+ *
+ *  RETURNS
+ *      Nothing.
+ *
+ *----------------------------------------------------------------------------*/
+
+static void buildKeyMapIndex(void)
+{
+    uint16 layer;
+    uint16 index;
+    uint16 scan_code;
+
+    MemSet(key_map_data.slots, 0, sizeof(key_map_data.slots));
+    MemSet(key_map_data.overridden, 0, sizeof(key_map_data.overridden));
+
+    for(layer = 0; layer < KEY_MAP_LAYERS; layer++)
+    {
+        for(index = layerStart(layer); index < key_map_data.layer_end[layer];
+            index++)
+        {
+            scan_code = KEY_MAP_SCAN_CODE(key_map_data.overrides[index]);
+
+            key_map_data.slots[findSlot(layer, scan_code)] = index + 1;
+            key_map_data.overridden[scan_code >> 4] |= 1 << (scan_code & 0x0F);
+        }
+
+        scan_code = key_map_data.layer_key[layer];
+        key_map_data.overridden[scan_code >> 4] |= 1 << (scan_code & 0x0F);
+    }
+
+    /* Scan code 0 stands for no layer key */
+    key_map_data.overridden[0] &= ~0x0001;
+
+    ++ key_map_data.version;
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      loadDefaultKeyMap
+ *
+ *  DESCRIPTION
+ *      This function sets the default key map up: the function key switches
+ *      layer 1 on, which holds the default function key overrides.
+ *
+ *  RETURNS
+ *      Nothing.
+ *
+ *----------------------------------------------------------------------------*/
+
+static void loadDefaultKeyMap(void)
+{
+    uint16 layer;
+
+    MemSet(key_map_data.layer_key, 0, sizeof(key_map_data.layer_key));
+    key_map_data.layer_key[1] = KEY_MAP_FN_KEY;
+
+    key_map_data.layer_end[0] = 0;
+    for(layer = 1; layer < KEY_MAP_LAYERS; layer++)
+    {
+        key_map_data.layer_end[layer] = DEFAULT_FN_OVERRIDES;
+    }
+
+    MemCopy(key_map_data.overrides, default_fn_overrides,
+            sizeof(default_fn_overrides));
+
+    buildKeyMapIndex();
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      isKeyMapValid
+ *
+ *  DESCRIPTION
+ *      This function checks the key map read from NVM.
+ *
+ *  RETURNS
+ *      TRUE if every layer key and override is in range.
+ *
+ *----------------------------------------------------------------------------*/
+
+static bool isKeyMapValid(void)
+{
+    uint16 layer;
+    uint16 index;
+    uint16 scan_code;
+
+    if(key_map_data.layer_key[0] != 0)
+    {
+        return FALSE;
+    }
+
+    for(layer = 0; layer < KEY_MAP_LAYERS; layer++)
+    {
+        if(key_map_data.layer_key[layer] >= KEY_MAP_SCAN_CODES ||
+           key_map_data.layer_end[layer] < layerStart(layer) ||
+           key_map_data.layer_end[layer] > KEY_MAP_MAX_OVERRIDES)
+        {
+            return FALSE;
+        }
+    }
+
+    for(index = 0; index < key_map_data.layer_end[KEY_MAP_LAYERS - 1];
+        index++)
+    {
+        scan_code = KEY_MAP_SCAN_CODE(key_map_data.overrides[index]);
+
+        if(scan_code == 0 || scan_code >= KEY_MAP_SCAN_CODES)
+        {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      writeKeyMapToNvm
+ *
+ *  DESCRIPTION
+ *      This function writes the key map to NVM.
+ *
+ *  RETURNS
+ *      Nothing.
+ *
+ *----------------------------------------------------------------------------*/
+
+static void writeKeyMapToNvm(void)
+{
+    Nvm_Write(key_map_data.layer_key, KEY_MAP_LAYERS,
+              key_map_data.nvm_offset + KEY_MAP_NVM_LAYER_KEY_OFFSET);
+    Nvm_Write(key_map_data.layer_end, KEY_MAP_LAYERS,
+              key_map_data.nvm_offset + KEY_MAP_NVM_LAYER_END_OFFSET);
+    Nvm_Write(key_map_data.overrides, KEY_MAP_MAX_OVERRIDES,
+              key_map_data.nvm_offset + KEY_MAP_NVM_OVERRIDES_OFFSET);
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      clearKeyMap
+ *
+ *  DESCRIPTION
+ *      This function handles a KEY_MAP_OP_CLEAR write: it removes all the
+ *      overrides and sets the layer keys of the overlay layers.
+ *
+ *  RETURNS
+ *      Status of the write.
+ *
+ *----------------------------------------------------------------------------*/
+
+static sys_status clearKeyMap(uint8 *p_value, uint16 size)
+{
+    uint16 layer_key[KEY_MAP_LAYERS];
+    uint16 layer;
+
+    if(size != KEY_MAP_LAYERS - 1)
+    {
+        return gatt_status_invalid_length;
+    }
+
+    layer_key[0] = 0;
+    for(layer = 1; layer < KEY_MAP_LAYERS; layer++)
+    {
+        layer_key[layer] = BufReadUint8(&p_value);
+
+        if(layer_key[layer] >= KEY_MAP_SCAN_CODES)
+        {
+            return gatt_status_att_val_oor;
+        }
+    }
+
+    MemCopy(key_map_data.layer_key, layer_key, sizeof(layer_key));
+    MemSet(key_map_data.layer_end, 0, sizeof(key_map_data.layer_end));
+
+    buildKeyMapIndex();
+
+    return sys_status_success;
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      addOverrides
+ *
+ *  DESCRIPTION
+ *      This function handles a KEY_MAP_OP_ADD write. An override of a key
+ *      which the layer already overrides replaces it, otherwise it is inserted
+ *      at the end of the overrides of its layer.
+ *
+ *  RETURNS
+ *      Status of the write. On an error, the overrides before the one in
+ *      error are kept.
+ *
+ *----------------------------------------------------------------------------*/
+
+static sys_status addOverrides(uint8 *p_value, uint16 size)
+{
+    sys_status rc = sys_status_success;
+    uint16 layer;
+    uint16 scan_code;
+    uint16 usage;
+    uint16 index;
+    uint16 i;
+
+    if(size == 0 || size % 3 != 0 ||
+       size > KEY_MAP_MAX_WRITE_OVERRIDES * 3)
+    {
+        return gatt_status_invalid_length;
+    }
+
+    for(; size; size -= 3)
+    {
+        layer = BufReadUint8(&p_value);
+        scan_code = BufReadUint8(&p_value);
+        usage = BufReadUint8(&p_value);
+
+        if(layer >= KEY_MAP_LAYERS || scan_code == 0 ||
+           scan_code >= KEY_MAP_SCAN_CODES)
+        {
+            rc = gatt_status_att_val_oor;
+            break;
+        }
+
+        index = key_map_data.slots[findSlot(layer, scan_code)];
+
+        if(index)
+        {
+            key_map_data.overrides[index - 1] =
+                                          KEY_MAP_OVERRIDE(scan_code, usage);
+            continue;
+        }
+
+        if(key_map_data.layer_end[KEY_MAP_LAYERS - 1] == KEY_MAP_MAX_OVERRIDES)
+        {
+            /* No room left */
+            rc = gatt_status_att_val_oor;
+            break;
+        }
+
+        /* Make room at the end of the layer, the hash table is built again
+         * below
+         */
+        for(i = key_map_data.layer_end[KEY_MAP_LAYERS - 1];
+            i > key_map_data.layer_end[layer]; i--)
+        {
+            key_map_data.overrides[i] = key_map_data.overrides[i - 1];
+        }
+        key_map_data.overrides[i] = KEY_MAP_OVERRIDE(scan_code, usage);
+
+        for(i = layer; i < KEY_MAP_LAYERS; i++)
+        {
+            ++ key_map_data.layer_end[i];
+        }
+
+        buildKeyMapIndex();
+    }
+
+    /* Count a replaced override as a change too */
+    ++ key_map_data.version;
+
+    return rc;
+}
+
+/*=============================================================================*
+ *  Public Function Implementations
+ *============================================================================*/
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      KeyMapLookup
+ *
+ *  DESCRIPTION
+ *      This function returns the usage of a key with the overlay layers
+ *      'layers' switched on, bit 'l' standing for layer 'l'. The highest layer
+ *      switched on which overrides the key gives its usage, the base layer
+ *      being always on. A key no layer overrides is found with one bit test.
+ *
+ *  RETURNS
+ *      The usage of the key, or KEY_MAP_LAYER_KEY if it is a layer key.
+ *
+ *----------------------------------------------------------------------------*/
+
+extern uint16 KeyMapLookup(uint8 scan_code, uint16 layers)
+{
+    uint16 layer;
+    uint16 index;
+
+    if(!(key_map_data.overridden[scan_code >> 4] & (1 << (scan_code & 0x0F))))
+    {
+        return default_key_map[scan_code];
+    }
+
+    for(layer = 1; layer < KEY_MAP_LAYERS; layer++)
+    {
+        if(key_map_data.layer_key[layer] == scan_code)
+        {
+            return KEY_MAP_LAYER_KEY;
+        }
+    }
+
+    layers |= 0x0001;
+
+    for(layer = KEY_MAP_LAYERS; layer-- > 0; )
+    {
+        if(layers & (1 << layer))
+        {
+            index = key_map_data.slots[findSlot(layer, scan_code)];
+
+            if(index)
+            {
+                return KEY_MAP_USAGE(key_map_data.overrides[index - 1]);
+            }
+        }
+    }
+
+    return default_key_map[scan_code];
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      KeyMapHeldLayers
+ *
+ *  DESCRIPTION
+ *      This function finds the overlay layers whose layer key is held in
+ *      'rows', the keys held in each row of the key matrix.
+ *
+ *  RETURNS
+ *      The layers switched on, bit 'l' standing for layer 'l'.
+ *
+ *----------------------------------------------------------------------------*/
+
+extern uint16 KeyMapHeldLayers(const uint8 *rows)
+{
+    uint16 layers = 0;
+    uint16 layer;
+    uint16 bit;
+
+    for(layer = 1; layer < KEY_MAP_LAYERS; layer++)
+    {
+        if(key_map_data.layer_key[layer])
+        {
+            bit = key_map_data.layer_key[layer] - 1;
+
+            if(rows[bit / COLUMNS] & (1 << (bit % COLUMNS)))
+            {
+                layers |= 1 << layer;
+            }
+        }
+    }
+
+    return layers;
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      KeyMapGetVersion
+ *
+ *  DESCRIPTION
+ *      This function returns a count incremented on every change of the key
+ *      map, for the users which keep the usages of the keys held.
+ *
+ *  RETURNS
+ *      Version of the key map.
+ *
+ *----------------------------------------------------------------------------*/
+
+extern uint16 KeyMapGetVersion(void)
+{
+    return key_map_data.version;
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      KeyMapReadDataFromNVM
+ *
+ *  DESCRIPTION
+ *      This function reads the key map from NVM. The default key map is used
+ *      if NVM does not hold a valid one.
+ *
+ *  RETURNS
+ *      Nothing.
+ *
+ *----------------------------------------------------------------------------*/
+
+extern void KeyMapReadDataFromNVM(uint16 *p_offset)
+{
+    key_map_data.nvm_offset = *p_offset;
+
+    Nvm_Read(key_map_data.layer_key, KEY_MAP_LAYERS,
+             key_map_data.nvm_offset + KEY_MAP_NVM_LAYER_KEY_OFFSET);
+    Nvm_Read(key_map_data.layer_end, KEY_MAP_LAYERS,
+             key_map_data.nvm_offset + KEY_MAP_NVM_LAYER_END_OFFSET);
+    Nvm_Read(key_map_data.overrides, KEY_MAP_MAX_OVERRIDES,
+             key_map_data.nvm_offset + KEY_MAP_NVM_OVERRIDES_OFFSET);
+
+    if(isKeyMapValid())
+    {
+        buildKeyMapIndex();
+    }
+    else
+    {
+        loadDefaultKeyMap();
+    }
+
+    *p_offset += KEY_MAP_NVM_MEMORY_WORDS;
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      KeyMapInitWriteDataToNVM
+ *
+ *  DESCRIPTION
+ *      This function writes the default key map to NVM for the first time
+ *      during application initialisation.
+ *
+ *  RETURNS
+ *      Nothing.
+ *
+ *----------------------------------------------------------------------------*/
+
+extern void KeyMapInitWriteDataToNVM(uint16 *p_offset)
+{
+    key_map_data.nvm_offset = *p_offset;
+
+    loadDefaultKeyMap();
+    writeKeyMapToNvm();
+
+    *p_offset += KEY_MAP_NVM_MEMORY_WORDS;
+}
+
+#ifdef NVM_TYPE_FLASH
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      WriteKeyMapDataInNvm
+ *
+ *  DESCRIPTION
+ *      This function writes the key map to NVM after it has been erased.
+ *
+ *  RETURNS
+ *      Nothing.
+ *
+ *----------------------------------------------------------------------------*/
+
+extern void WriteKeyMapDataInNvm(void)
+{
+    writeKeyMapToNvm();
+}
+#endif /* NVM_TYPE_FLASH */
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      KeyMapHandleAccessRead
+ *
+ *  DESCRIPTION
+ *      This function handles read operation on Key Map service attributes
+ *      maintained by the application and responds with the GATT_ACCESS_RSP
+ *      message. The Key Map characteristic holds the maximum number of
+ *      overrides, the layer key of each overlay layer and the number of
+ *      overrides of each layer.
+ *
+ *  RETURNS
+ *      Nothing.
+ *
+ *----------------------------------------------------------------------------*/
+
+extern void KeyMapHandleAccessRead(GATT_ACCESS_IND_T *p_ind)
+{
+    uint16 length = 0;
+    uint8  value[KEY_MAP_VALUE_LENGTH];
+    uint8 *p_val = value;
+    sys_status rc = sys_status_success;
+    uint16 layer;
+
+    switch(p_ind->handle)
+    {
+
+        case HANDLE_KEY_MAP:
+        {
+            length = KEY_MAP_VALUE_LENGTH;
+
+            BufWriteUint8(&p_val, KEY_MAP_MAX_OVERRIDES);
+
+            for(layer = 1; layer < KEY_MAP_LAYERS; layer++)
+            {
+                BufWriteUint8(&p_val, key_map_data.layer_key[layer]);
+            }
+
+            for(layer = 0; layer < KEY_MAP_LAYERS; layer++)
+            {
+                BufWriteUint8(&p_val, key_map_data.layer_end[layer] -
+                                      layerStart(layer));
+            }
+        }
+        break;
+
+        default:
+            rc = gatt_status_read_not_permitted;
+        break;
+
+    }
+
+    GattAccessRsp(p_ind->cid, p_ind->handle, rc, length, value);
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      KeyMapHandleAccessWrite
+ *
+ *  DESCRIPTION
+ *      This function handles write operation on Key Map service attributes
+ *      maintained by the application and responds with the GATT_ACCESS_RSP
+ *      message. See KEY_MAP_OP_CLEAR for the operations written to the Key
+ *      Map characteristic.
+ *
+ *  RETURNS
+ *      Nothing.
+ *
+ *----------------------------------------------------------------------------*/
+
+extern void KeyMapHandleAccessWrite(GATT_ACCESS_IND_T *p_ind)
+{
+    uint8 *p_value = p_ind->value;
+    sys_status rc = sys_status_success;
+    uint8 op;
+
+    switch(p_ind->handle)
+    {
+        case HANDLE_KEY_MAP:
+        {
+            if(p_ind->size_value == 0)
+            {
+                rc = gatt_status_invalid_length;
+                break;
+            }
+
+            op = BufReadUint8(&p_value);
+
+            if(op == KEY_MAP_OP_CLEAR)
+            {
+                rc = clearKeyMap(p_value, p_ind->size_value - 1);
+            }
+            else if(op == KEY_MAP_OP_ADD)
+            {
+                rc = addOverrides(p_value, p_ind->size_value - 1);
+            }
+            else if(op == KEY_MAP_OP_SAVE)
+            {
+                writeKeyMapToNvm();
+            }
+            else if(op == KEY_MAP_OP_DEFAULT)
+            {
+                loadDefaultKeyMap();
+            }
+            else
+            {
+                rc = gatt_status_opcode_not_supported;
+            }
+        }
+        break;
+
+        default:
+            rc = gatt_status_write_not_permitted;
+        break;
+    }
+
+    GattAccessRsp(p_ind->cid, p_ind->handle, rc, 0, NULL);
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      KeyMapCheckHandleRange
+ *
+ *  DESCRIPTION
+ *      This function is used to check if the handle belongs to the Key Map
+ *      service
+ *
+ *  RETURNS
+ *      Boolean - Indicating whether handle falls in range or not.
+ *
+ *----------------------------------------------------------------------------*/
+
+extern bool KeyMapCheckHandleRange(uint16 handle)
+{
+    return ((handle >= HANDLE_KEY_MAP_SERVICE) &&
+            (handle <= HANDLE_KEY_MAP_SERVICE_END))
+            ? TRUE : FALSE;
+}
@@ -0,0 +1,117 @@
+/*******************************************************************************
+ *  Copyright (c) 2012 - 2016 Qualcomm Technologies International, Ltd.
+ *  Part of CSR uEnergy SDK 2.6.1
+ *  Application version 2.6.1.0
+ *
+ *  FILE
+ *      key_map_service.h
+ *
+ *  DESCRIPTION
+ *      Header definitions for the vendor specific Key Map service. It maps the
+ *      scan codes of the key matrix to keyboard usages through a base layer
+ *      and overlay layers, which can be changed over GATT and are kept in
+ *      NVM.
+ *
+ ******************************************************************************/
+
+#ifndef __KEY_MAP_SERVICE_H__
+#define __KEY_MAP_SERVICE_H__
+
+/*=============================================================================*
+ *  SDK Header Files
+ *============================================================================*/
+
+#include <types.h>
+#include <bt_event_types.h>
+
+/*=============================================================================*
+ *  Public Definitions
+ *============================================================================*/
+
+/* Number of layers: the base layer, layer 0, and the overlay layers. An
+ * overlay layer is switched on while its layer key is held, and overrides the
+ * layers below it.
+ */
+#define KEY_MAP_LAYERS                  (4)
+
+/* Maximum number of keys overridden over all the layers */
+#define KEY_MAP_MAX_OVERRIDES           (32)
+
+/* Usage returned by KeyMapLookup() for a layer key, which is not reported */
+#define KEY_MAP_LAYER_KEY               (0xFFFF)
+
+/* Operations written as the first byte of the Key Map characteristic.
+ *
+ * KEY_MAP_OP_CLEAR   Removes all the overrides. It is followed by the scan
+ *                    code of the layer key of each overlay layer, from layer
+ *                    1, or 0 for a layer with no layer key.
+ * KEY_MAP_OP_ADD     Adds overrides. It is followed by up to
+ *                    KEY_MAP_MAX_WRITE_OVERRIDES times the layer, the scan
+ *                    code and the usage of a key. An override replaces the
+ *                    one of the same key in the same layer.
+ * KEY_MAP_OP_SAVE    Saves the key map to NVM.
+ * KEY_MAP_OP_DEFAULT Goes back to the default key map. It is not saved to NVM
+ *                    until KEY_MAP_OP_SAVE.
+ *
+ * The key map is used as it is written. Usages from 0xE8 up are the consumer
+ * keys of keyboard_hw.c.
+ */
+#define KEY_MAP_OP_CLEAR                (0x00)
+#define KEY_MAP_OP_ADD                  (0x01)
+#define KEY_MAP_OP_SAVE                 (0x02)
+#define KEY_MAP_OP_DEFAULT              (0x03)
+
+/* Maximum number of overrides in one KEY_MAP_OP_ADD write, which fits in the
+ * default ATT MTU
+ */
+#define KEY_MAP_MAX_WRITE_OVERRIDES     (6)
+
+/* Length of the Key Map characteristic value read: the maximum number of
+ * overrides, the scan code of the layer key of each overlay layer and the
+ * number of overrides of each layer
+ */
+#define KEY_MAP_VALUE_LENGTH            (1 + (KEY_MAP_LAYERS - 1) + \
+                                         KEY_MAP_LAYERS)
+
+/*=============================================================================*
+ *  Public Function Prototypes
+ *============================================================================*/
+
+/* This function returns the usage of a key with the overlay layers 'layers'
+ * switched on
+ */
+extern uint16 KeyMapLookup(uint8 scan_code, uint16 layers);
+
+/* This function returns the overlay layers switched on by the keys held */
+extern uint16 KeyMapHeldLayers(const uint8 *rows);
+
+/* This function returns a count incremented on every change of the key map */
+extern uint16 KeyMapGetVersion(void);
+
+/* This function reads the key map from NVM */
+extern void KeyMapReadDataFromNVM(uint16 *p_offset);
+
+/* This function writes the default key map to NVM for the first time */
+extern void KeyMapInitWriteDataToNVM(uint16 *p_offset);
+
+#ifdef NVM_TYPE_FLASH
+/* This function writes the key map to NVM after it has been erased */
+extern void WriteKeyMapDataInNvm(void);
+#endif /* NVM_TYPE_FLASH */
+
+/* This function handles read operation on Key Map service attributes
+ * maintained by the application
+ */
+extern void KeyMapHandleAccessRead(GATT_ACCESS_IND_T *p_ind);
+
+/* This function handles write operation on Key Map service attributes
+ * maintained by the application
+ */
+extern void KeyMapHandleAccessWrite(GATT_ACCESS_IND_T *p_ind);
+
+/* This function is used to check if the handle belongs to the Key Map
+ * service
+ */
+extern bool KeyMapCheckHandleRange(uint16 handle);
+
+#endif /* __KEY_MAP_SERVICE_H__ */
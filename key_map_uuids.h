@@ -0,0 +1,32 @@
+/*******************************************************************************
+ *  Copyright (c) 2012 - 2016 Qualcomm Technologies International, Ltd.
+ *  Part of CSR uEnergy SDK 2.6.1
+ *  Application version 2.6.1.0
+ *
+ *  FILE
+ *      key_map_uuids.h
+ *
+ * DESCRIPTION
+ *      UUID MACROs for the vendor specific Key Map service
+ *
+ ******************************************************************************/
+
+#ifndef __KEY_MAP_UUIDS_H__
+#define __KEY_MAP_UUIDS_H__
+
+/*=============================================================================*
+ *         Public Definitions
+ *============================================================================*/
+
+/* Brackets should not be used around the value of a macro. The parser which
+ * creates .c and .h files from .db file doesn't understand brackets and will
+ * raise syntax errors.
+ */
+
+/* Key Map Service UUID */
+#define KEY_MAP_SERVICE_UUID          0x8a3c00116b2f4c5e9d1a3f7e2b9c4d10
+
+/* Key Map UUID */
+#define KEY_MAP_UUID                  0x8a3c00126b2f4c5e9d1a3f7e2b9c4d10
+
+#endif /* __KEY_MAP_UUIDS_H__ */
@@ -43,7 +43,8 @@
 #include "csr_ota_service.h"
 #include "bond_mgmt_service.h"
 #include "uartio.h"
-#include "byte_queue.h"
+#include "char_map.h"
+#include "key_map_service.h"
 
 #ifdef __PROPRIETARY_HID_SUPPORT__
 
@@ -51,17 +52,55 @@
 
 #endif /* __PROPRIETARY_HID_SUPPORT__ */
 
+#ifdef KEY_LATENCY_STATS
+
+#include "latency_service.h"
+
+#endif /* KEY_LATENCY_STATS */
+
 /*=============================================================================*
  *  Private Definitions
  *============================================================================*/
 
 /******** TIMERS ********/
 
-/* Maximum number of timers */
-#define MAX_APP_TIMERS                      (7)
+/* Maximum number of timers. One more is added for the UART receive idle
+ * flush timer when UART burst receive mode is enabled, one for the
+ * connection quiet timer when adaptive connection parameters are enabled,
+ * one for the key scan idle timer when the adaptive key scan is enabled, and
+ * one for the key release timer when key presses are debounced eagerly.
+ */
+#ifdef UART_RX_BURST_MODE
+#define UART_RX_BURST_TIMERS                (1)
+#else
+#define UART_RX_BURST_TIMERS                (0)
+#endif /* UART_RX_BURST_MODE */
+
+#ifdef ADAPTIVE_CONN_PARAMS
+#define ADAPTIVE_CONN_PARAMS_TIMERS         (1)
+#else
+#define ADAPTIVE_CONN_PARAMS_TIMERS         (0)
+#endif /* ADAPTIVE_CONN_PARAMS */
+
+#ifdef ADAPTIVE_KEY_SCAN
+#define ADAPTIVE_KEY_SCAN_TIMERS            (1)
+#else
+#define ADAPTIVE_KEY_SCAN_TIMERS            (0)
+#endif /* ADAPTIVE_KEY_SCAN */
+
+#ifdef DEBOUNCE_EAGER_PRESS
+#define DEBOUNCE_EAGER_PRESS_TIMERS         (1)
+#else
+#define DEBOUNCE_EAGER_PRESS_TIMERS         (0)
+#endif /* DEBOUNCE_EAGER_PRESS */
+
+#define MAX_APP_TIMERS                      (7 + UART_RX_BURST_TIMERS + \
+                                             ADAPTIVE_CONN_PARAMS_TIMERS + \
+                                             ADAPTIVE_KEY_SCAN_TIMERS + \
+                                             DEBOUNCE_EAGER_PRESS_TIMERS)
 
 /* Magic value to check the sanity of NVM region used by the application */
-#define NVM_SANITY_MAGIC                    (0xAB06)
+#define NVM_SANITY_MAGIC                    (0xAB08)
 
 /* NVM offset for NVM sanity word */
 #define NVM_OFFSET_SANITY_WORD              (0)
@@ -110,6 +149,26 @@
 /* Size of each buffer associated with the shared memory of PIO controller. */
 #define KEYWORDS                            ((ROWS >> 1) + (ROWS % 2))
 
+/* Word of the shared memory of PIO controller after its two buffers, which
+ * holds the number of scans made modulo 256.
+ */
+#define SCAN_SEQ_WORD                       (2 * KEYWORDS + 1)
+
+/* Word of the shared memory of PIO controller which selects its scan profile
+ */
+#define SCAN_PROFILE_WORD                   (SCAN_SEQ_WORD + 1)
+
+/* Words of the shared memory of PIO controller after the scan profile: the
+ * free running count of scan cycles, the tick of the last scan which saw the
+ * keys change, and the ticks between that scan and the one before it
+ */
+#define SCAN_TICK_WORD                      (SCAN_PROFILE_WORD + 1)
+#define SCAN_CHANGE_TICK_WORD               (SCAN_TICK_WORD + 1)
+#define SCAN_GAP_WORD                       (SCAN_CHANGE_TICK_WORD + 1)
+
+/* Value of 'last_scan_seq' before any scan is handled */
+#define SCAN_SEQ_NONE                       (0xFFFF)
+
 /* Maximum revoke count allowed before moving to idle state */
 #define MAX_REVOKE_COUNT                    (2)
 
@@ -120,9 +179,25 @@
 #define USAGE_ID_KEY_Z                      (0x1D)
 #define USAGE_ID_KEY_ENTER                  (0x28)
 
+/* Usage IDs of the first and last modifier keys, in the order of the modifier
+ * bits of the input report
+ */
+#define USAGE_ID_LEFT_CONTROL               (0xE0)
+#define USAGE_ID_RIGHT_GUI                  (0xE7)
+
 /* Maximum number of passkey digits that must be entered during pairing. */
 #define PASSKEY_DIGITS_COUNT                (6)
 
+/* Number of free queue slots needed before characters held back under
+ * key_queue_policy_reject are accepted again
+ */
+#define KEY_QUEUE_RESUME_SLOTS              (MAX_PENDING_KEY_STROKES / 2)
+
+/* Get the queue index of the key stroke 'n' places after the oldest one */
+#define CQUEUE_IDX(n) \
+             ((g_kbd_data.pending_key_strokes.start_idx + (n)) % \
+                                                    MAX_PENDING_KEY_STROKES)
+
 /*=============================================================================*
  *  Private Data
  *============================================================================*/
@@ -140,11 +215,68 @@ uint16 g_Revoke_Count = 0;
 
 static bool flgPassed = FALSE;//パス認証後TRUE
 
+/* Key typed over UART which is still held down, as a character map entry.
+ * It is released together with the press of the next key, so it is 0 only
+ * when no typed key is held.
+ */
+static uint16 typed_key_held = 0;
+
+/* Strings typed over UART waiting for their last key stroke to be sent,
+ * oldest first
+ */
+static TYPED_STRING_T typed_strings[UART_MAX_PENDING_STRINGS];
+static uint16 n_typed_strings = 0;
+
+/* Keys held down by key down and key up events received over UART, as the
+ * input report last queued for them
+ */
+static uint8 uart_keys_report[ATTR_LEN_HID_INPUT_REPORT];
+
+/* Sequence number of the last scan of the key matrix handled */
+static uint16 last_scan_seq = SCAN_SEQ_NONE;
+
+#ifdef KEY_LATENCY_STATS
+/* Time at which the characters being typed were received over UART */
+static uint32 typed_char_rx_time = 0;
+
+/* Set from the first scan which saw the keys change since the last report
+ * formed from the key matrix, until the change is reported or has settled
+ */
+static bool key_change_pending = FALSE;
+
+/* Times at which the key of the pending change was pressed, and scanned */
+static uint32 key_press_time;
+static uint32 key_scan_time;
+
+/* Tick of the last scan seen with a change of the keys */
+static uint16 last_change_tick = 0;
+
+/* Set when a key press woke the key scan up, at 'key_wake_time', until the
+ * change it made is seen
+ */
+static bool key_wake_pending = FALSE;
+static uint32 key_wake_time;
+
+/* Set while the key strokes queued come from a change of the key matrix
+ * pressed at 'matrix_rx_time'
+ */
+static bool matrix_rx_time_valid = FALSE;
+static uint32 matrix_rx_time;
+#endif /* KEY_LATENCY_STATS */
+
 /*=============================================================================*
  *  Private Function Prototypes
  *============================================================================*/
 
 static void resetQueueData(void);
+static bool isReleaseKeyStroke(uint8 idx);
+static uint8 findPrevKeyStroke(uint8 pos, uint8 report_id);
+static void removeKeyStroke(uint8 pos, bool sent);
+static void keyStrokesRemoved(uint8 pos, uint8 count, bool sent);
+static void dropOvertakenKeyStrokes(void);
+static bool makeRoomInQueue(uint8 report_id, uint8 *report,
+                            uint8 report_length);
+static void resumeKeyStrokeProducer(void);
 static void kbdDataInit(void);
 static void readPersistentStore(void);
 
@@ -156,6 +288,13 @@ static void kbdIdleTimerHandler(timer_id tid);
 
 static void resetIdleTimer(void);
 static void requestConnParamUpdate(timer_id tid);
+static uint8 *getConnParamUpdateCnt(bool burst);
+static void sendConnParamUpdateReq(void);
+static bool connParamsComply(void);
+#ifdef ADAPTIVE_CONN_PARAMS
+static void scheduleConnParamUpdate(void);
+static void handleConnQuietTimerExpiry(timer_id tid);
+#endif /* ADAPTIVE_CONN_PARAMS */
 static void appInitStateExit(void);
 static void appSetState(kbd_state new_state);
 static void appStartAdvert(void);
@@ -186,6 +325,14 @@ static void handleSignalGattCharValNotCfm
 static void handleSignalLsRadioEventInd(void);
 static void handleSignalSmDivApproveInd(SM_DIV_APPROVE_IND_T *p_event_data);
 static void handleBondingChanceTimerExpiry(timer_id tid);
+static void handleNewKeyStrokes(void);
+static void queueTypedKey(uint16 key);
+static void queueUartReport(uint8 report_id, uint8 *report,
+                            uint8 report_length);
+static bool acceptUartKeyStrokes(uint16 n_strokes, uint16 n_items);
+#ifdef KEY_LATENCY_STATS
+static void trackKeyChange(const uint16 *p_shared_data);
+#endif /* KEY_LATENCY_STATS */
 static void handleGapCppTimerExpiry(timer_id tid);
 #ifdef __GAP_PRIVACY_SUPPORT__
 static void generatePrivateAddress(void);
@@ -219,8 +366,302 @@ static void resetQueueData(void)
 
     /* Initialise Circular Queue buffer */
     g_kbd_data.pending_key_strokes.start_idx = 0;
+    keyStrokesRemoved(0, g_kbd_data.pending_key_strokes.num, FALSE);
     g_kbd_data.pending_key_strokes.num = 0;
 
+    /* The queue is empty, so anything held back can come in now */
+    resumeKeyStrokeProducer();
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      isReleaseKeyStroke
+ *
+ *  DESCRIPTION
+ *      This function checks whether the key stroke stored in the queue at
+ *      index 'idx' releases all the keys of its report.
+ *
+ *  RETURNS/MODIFIES
+ *      TRUE if no key is pressed in the report.
+ *
+ *----------------------------------------------------------------------------*/
+
+static bool isReleaseKeyStroke(uint8 idx)
+{
+    const uint8 *p_report = GET_CQUEUE_INPUT_REPORT_REF(idx);
+    uint8 i;
+
+    /* Reports shorter than LARGEST_REPORT_SIZE are padded with zeros */
+    for(i = 0; i < LARGEST_REPORT_SIZE; i++)
+    {
+        if(p_report[i])
+        {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      findPrevKeyStroke
+ *
+ *  DESCRIPTION
+ *      This function looks for the latest key stroke with the report ID
+ *      'report_id' which was queued before the one 'pos' places after the
+ *      oldest key stroke.
+ *
+ *  RETURNS/MODIFIES
+ *      Number of places the key stroke found is after the oldest one, or
+ *      'pos' if there is none.
+ *
+ *----------------------------------------------------------------------------*/
+
+static uint8 findPrevKeyStroke(uint8 pos, uint8 report_id)
+{
+    uint8 prev = pos;
+
+    while(prev)
+    {
+        -- prev;
+
+        if(GET_CQUEUE_INPUT_REPORT_ID(CQUEUE_IDX(prev)) == report_id)
+        {
+            return prev;
+        }
+    }
+
+    return pos;
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      removeKeyStroke
+ *
+ *  DESCRIPTION
+ *      This function removes the key stroke 'pos' places after the oldest one
+ *      from the queue, 'sent' telling whether it has been sent. The key
+ *      strokes queued after it move up by one.
+ *
+ *  RETURNS/MODIFIES
+ *      Nothing.
+ *
+ *----------------------------------------------------------------------------*/
+
+static void removeKeyStroke(uint8 pos, bool sent)
+{
+    CQUEUE_KEY_STROKE_T *p_queue = &g_kbd_data.pending_key_strokes;
+
+    keyStrokesRemoved(pos, 1, sent);
+
+    for(; pos + 1 < p_queue->num; pos++)
+    {
+        p_queue->key_stroke[CQUEUE_IDX(pos)] =
+                                       p_queue->key_stroke[CQUEUE_IDX(pos + 1)];
+    }
+
+    -- p_queue->num;
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      dropOvertakenKeyStrokes
+ *
+ *  DESCRIPTION
+ *      This function is called when the key stroke following the rejected
+ *      ones at the head of the queue has been accepted by the firmware. It is
+ *      removed from the queue, and so are the rejected key strokes with the
+ *      same report ID: the host already has the newer state, and sending them
+ *      again would take it back to an older one, leaving keys held down.
+ *      Rejected key strokes with other report IDs are sent again in order.
+ *
+ *  RETURNS/MODIFIES
+ *      Nothing.
+ *
+ *----------------------------------------------------------------------------*/
+
+static void dropOvertakenKeyStrokes(void)
+{
+    CQUEUE_KEY_STROKE_T *p_queue = &g_kbd_data.pending_key_strokes;
+    const uint8 report_id = GET_CQUEUE_INPUT_REPORT_ID(
+                                         CQUEUE_IDX(g_kbd_data.tx_rejected));
+    uint8 pos = g_kbd_data.tx_rejected;
+
+    removeKeyStroke(pos, TRUE);
+
+    while(pos)
+    {
+        -- pos;
+
+        if(GET_CQUEUE_INPUT_REPORT_ID(CQUEUE_IDX(pos)) == report_id)
+        {
+            removeKeyStroke(pos, FALSE);
+            -- g_kbd_data.tx_rejected;
+            ++ p_queue->stats.dropped;
+        }
+    }
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      keyStrokesRemoved
+ *
+ *  DESCRIPTION
+ *      This function is called when 'count' key strokes are removed from the
+ *      queue, from 'pos' places after the oldest one. The strings typed over
+ *      UART whose last key stroke has left the queue are reported done, as
+ *      typed only if none of their key strokes has left it without being
+ *      sent.
+ *
+ *      A key stroke dropped from the middle of a string does not end it. Its
+ *      last key stroke is still in the queue, or the one before it if that
+ *      is the one dropped, but the string is no longer reported typed. The
+ *      key strokes queued between two strings are taken as part of the
+ *      later one.
+ *
+ *  RETURNS/MODIFIES
+ *      Nothing.
+ *
+ *----------------------------------------------------------------------------*/
+
+static void keyStrokesRemoved(uint8 pos, uint8 count, bool sent)
+{
+    uint16 i;
+    uint8 removed;
+    uint8 first = 0;    /* Position of the first key stroke of a string */
+    uint8 end;
+    TYPED_STRING_T done;
+
+    for(i = 0; i < n_typed_strings; i++)
+    {
+        end = typed_strings[i].strokes;
+
+        if(!sent && end > pos && first < pos + count)
+        {
+            /* Some of the key strokes of the string will never be sent */
+            typed_strings[i].dropped = TRUE;
+        }
+        first = end;
+
+        if(typed_strings[i].strokes > pos)
+        {
+            removed = typed_strings[i].strokes - pos;
+            typed_strings[i].strokes -= (removed < count) ? removed : count;
+        }
+    }
+
+    /* The strings are queued in order, so they are done in order */
+    while(n_typed_strings && typed_strings[0].strokes == 0)
+    {
+        done = typed_strings[0];
+
+        -- n_typed_strings;
+        for(i = 0; i < n_typed_strings; i++)
+        {
+            typed_strings[i] = typed_strings[i + 1];
+        }
+
+        UartStringDone(done.id, done.dropped ? UART_STRING_DROPPED :
+                                               UART_STRING_TYPED);
+    }
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      makeRoomInQueue
+ *
+ *  DESCRIPTION
+ *      This function is called when a key stroke is to be added to the full
+ *      queue. Every report carries the state of all its keys, so a report can
+ *      be dropped without leaving a key stuck on the host as long as the
+ *      releases following it are kept. This function drops, in this order
+ *      of preference:
+ *          - the new key stroke, if it repeats the state of the latest one
+ *            queued with the same report ID
+ *          - the latest press state in the queue, or the latest release which
+ *            repeats the release queued before it with the same report ID
+ *          - the new key stroke
+ *      Key strokes which have been handed to the firmware are left alone.
+ *
+ *  RETURNS/MODIFIES
+ *      TRUE if there is room for the new key stroke, FALSE if it has been
+ *      dropped.
+ *
+ *----------------------------------------------------------------------------*/
+
+static bool makeRoomInQueue(uint8 report_id, uint8 *report,
+                            uint8 report_length)
+{
+    CQUEUE_KEY_STROKE_T *p_queue = &g_kbd_data.pending_key_strokes;
+    uint8 first = g_kbd_data.tx_rejected + g_kbd_data.tx_in_flight;
+    uint8 pos;
+    uint8 prev;
+
+    /* A repeated state tells the host nothing new */
+    prev = findPrevKeyStroke(p_queue->num, report_id);
+    if(prev < p_queue->num &&
+       !MemCmp(GET_CQUEUE_INPUT_REPORT_REF(CQUEUE_IDX(prev)), report,
+                                                               report_length))
+    {
+        ++ p_queue->stats.coalesced;
+        return FALSE;
+    }
+
+    for(pos = p_queue->num; pos > first; )
+    {
+        -- pos;
+
+        if(!isReleaseKeyStroke(CQUEUE_IDX(pos)))
+        {
+            /* An intermediate press state. The keys it presses are released
+             * by a later key stroke.
+             */
+            removeKeyStroke(pos, FALSE);
+            ++ p_queue->stats.dropped;
+            return TRUE;
+        }
+
+        prev = findPrevKeyStroke(pos, GET_CQUEUE_INPUT_REPORT_ID(
+                                                            CQUEUE_IDX(pos)));
+        if(prev < pos && isReleaseKeyStroke(CQUEUE_IDX(prev)))
+        {
+            /* A release following another one */
+            removeKeyStroke(pos, FALSE);
+            ++ p_queue->stats.coalesced;
+            return TRUE;
+        }
+    }
+
+    /* Only the key strokes already handed to the firmware are left */
+    ++ p_queue->stats.dropped;
+    return FALSE;
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      resumeKeyStrokeProducer
+ *
+ *  DESCRIPTION
+ *      This function lets the characters held back under
+ *      key_queue_policy_reject come in again once enough of the queue is
+ *      free, or the policy has been changed.
+ *
+ *  RETURNS/MODIFIES
+ *      Nothing.
+ *
+ *----------------------------------------------------------------------------*/
+
+static void resumeKeyStrokeProducer(void)
+{
+    if(g_kbd_data.pending_key_strokes.producer_held &&
+       (GET_CQUEUE_FREE_SLOTS() >= KEY_QUEUE_RESUME_SLOTS ||
+        g_kbd_data.pending_key_strokes.policy != key_queue_policy_reject))
+    {
+        g_kbd_data.pending_key_strokes.producer_held = FALSE;
+
+        UartResumeRx();
+    }
 }
 
 /*-----------------------------------------------------------------------------*
@@ -269,11 +710,31 @@ static void kbdDataInit(void)
 
     g_kbd_data.waiting_for_fw_buffer = FALSE;
 
+    /* Notifications can not be outstanding without a connection. Start with
+     * the full window again.
+     */
+    g_kbd_data.tx_in_flight = 0;
+    g_kbd_data.tx_rejected = 0;
+    g_kbd_data.tx_window = MAX_NOTIFICATIONS_IN_FLIGHT;
+    g_kbd_data.tx_accepted_cnt = 0;
+
     /* Reset the connection parameter variables. */
     g_kbd_data.conn_interval = 0;
     g_kbd_data.conn_latency = 0;
     g_kbd_data.conn_timeout = 0;
 
+    /* A new connection starts with the preferred connection parameters, and
+     * may be asked for the burst ones again
+     */
+    g_kbd_data.conn_params_burst = FALSE;
+    g_kbd_data.burst_param_update_cnt = 0;
+    g_kbd_data.cpu_req_burst = FALSE;
+
+#ifdef ADAPTIVE_CONN_PARAMS
+    TimerDelete(g_kbd_data.conn_quiet_tid);
+    g_kbd_data.conn_quiet_tid = TIMER_INVALID;
+#endif /* ADAPTIVE_CONN_PARAMS */
+
     HwDataInit();
 
     /* LEDs need to be turned off upon disconnection and power recycle. */
@@ -376,6 +837,12 @@ static void readPersistentStore(void)
         /* Read device name and length from NVM */
         GapReadDataFromNVM(&offset);
 
+        /* Read the selected keyboard layout from NVM */
+        CharMapReadDataFromNVM(&offset);
+
+        /* Read the key map from NVM */
+        KeyMapReadDataFromNVM(&offset);
+
     }
     else /* NVM Sanity check failed means either the device is being brought up
           * for the first time or memory has got corrupted in which case discard
@@ -409,6 +876,12 @@ static void readPersistentStore(void)
         /* Write Gap data to NVM */
         GapInitWriteDataToNVM(&offset);
 
+        /* Write the default keyboard layout to NVM */
+        CharMapInitWriteDataToNVM(&offset);
+
+        /* Write the default key map to NVM */
+        KeyMapInitWriteDataToNVM(&offset);
+
     }
 
     /* Read HID service data from NVM if the devices are bonded and
@@ -556,76 +1029,273 @@ static void resetIdleTimer(void)
  *----------------------------------------------------------------------------*/
 static void requestConnParamUpdate(timer_id tid)
 {
-    ble_con_params app_pref_conn_param;
-
     if(g_kbd_data.conn_param_update_tid == tid)
     {
         g_kbd_data.conn_param_update_tid= TIMER_INVALID;
         g_kbd_data.cpu_timer_value = 0;
 
-        g_kbd_data.conn_param_update_cnt++;
+        sendConnParamUpdateReq();
+    }
+}
 
-        /* Decide which parameters values are to be requested.
-         */
-        if(g_kbd_data.conn_param_update_cnt <= CPU_SELF_PARAMS_MAX_ATTEMPTS)
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      getConnParamUpdateCnt
+ *
+ *  DESCRIPTION
+ *      This function returns the counter of the connection parameter update
+ *      requests sent for the burst or the preferred connection parameters.
+ *
+ *  RETURNS/MODIFIES
+ *      Pointer to the counter.
+ *
+ *----------------------------------------------------------------------------*/
+static uint8 *getConnParamUpdateCnt(bool burst)
+{
+    return burst ? &g_kbd_data.burst_param_update_cnt :
+                   &g_kbd_data.conn_param_update_cnt;
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      sendConnParamUpdateReq
+ *
+ *  DESCRIPTION
+ *      This function sends L2CAP_CONNECTION_PARAMETER_UPDATE_REQUEST for the
+ *      burst or the preferred connection parameters, whichever are wanted.
+ *      After CPU_SELF_PARAMS_MAX_ATTEMPTS attempts, the APPLE connection
+ *      interval is requested instead. The burst slave latency is kept then.
+ *      The attempts are counted separately for both sets.
+ *
+ *  RETURNS/MODIFIES
+ *      Nothing.
+ *
+ *----------------------------------------------------------------------------*/
+static void sendConnParamUpdateReq(void)
+{
+    ble_con_params app_pref_conn_param;
+    uint8 *p_update_cnt = getConnParamUpdateCnt(g_kbd_data.conn_params_burst);
+
+    (*p_update_cnt)++;
+    g_kbd_data.cpu_req_burst = g_kbd_data.conn_params_burst;
+
+    /* Decide which parameters values are to be requested.
+     */
+    if(*p_update_cnt <= CPU_SELF_PARAMS_MAX_ATTEMPTS)
+    {
+        if(g_kbd_data.conn_params_burst)
         {
             app_pref_conn_param.con_max_interval =
-                                        PREFERRED_MAX_CON_INTERVAL;
+                                        BURST_MAX_CON_INTERVAL;
             app_pref_conn_param.con_min_interval =
-                                        PREFERRED_MIN_CON_INTERVAL;
-            app_pref_conn_param.con_slave_latency =
-                                        PREFERRED_SLAVE_LATENCY;
-            app_pref_conn_param.con_super_timeout =
-                                        PREFERRED_SUPERVISION_TIMEOUT;
+                                        BURST_MIN_CON_INTERVAL;
         }
         else
         {
             app_pref_conn_param.con_max_interval =
-                                        APPLE_MAX_CON_INTERVAL;
+                                        PREFERRED_MAX_CON_INTERVAL;
             app_pref_conn_param.con_min_interval =
-                                        APPLE_MIN_CON_INTERVAL;
-            app_pref_conn_param.con_slave_latency =
-                                        APPLE_SLAVE_LATENCY;
-            app_pref_conn_param.con_super_timeout =
-                                        APPLE_SUPERVISION_TIMEOUT;
+                                        PREFERRED_MIN_CON_INTERVAL;
         }
+        app_pref_conn_param.con_slave_latency =
+                                        PREFERRED_SLAVE_LATENCY;
+        app_pref_conn_param.con_super_timeout =
+                                        PREFERRED_SUPERVISION_TIMEOUT;
+    }
+    else
+    {
+        app_pref_conn_param.con_max_interval =
+                                    APPLE_MAX_CON_INTERVAL;
+        app_pref_conn_param.con_min_interval =
+                                    APPLE_MIN_CON_INTERVAL;
+        app_pref_conn_param.con_slave_latency =
+                                    APPLE_SLAVE_LATENCY;
+        app_pref_conn_param.con_super_timeout =
+                                    APPLE_SUPERVISION_TIMEOUT;
+    }
 
-        /* Send a connection parameter update request only if the remote device
-         * has not entered 'suspend' state.
-         */
-        if(!HidIsStateSuspended())
-        {
-            if(LsConnectionParamUpdateReq(&(g_kbd_data.con_bd_addr),
-                                                    &app_pref_conn_param))
-            {
-                ReportPanic(app_panic_con_param_update);
-            }
+    if(g_kbd_data.conn_params_burst)
+    {
+        app_pref_conn_param.con_slave_latency =
+                                    BURST_SLAVE_LATENCY;
+        app_pref_conn_param.con_super_timeout =
+                                    BURST_SUPERVISION_TIMEOUT;
+    }
 
+    /* Send a connection parameter update request only if the remote device
+     * has not entered 'suspend' state.
+     */
+    if(!HidIsStateSuspended())
+    {
+        g_kbd_data.cpu_req_time = TimeGet32();
+
+        if(LsConnectionParamUpdateReq(&(g_kbd_data.con_bd_addr),
+                                                &app_pref_conn_param))
+        {
+            ReportPanic(app_panic_con_param_update);
         }
+
     }
 }
 
 /*-----------------------------------------------------------------------------*
  *  NAME
- *      appInitStateExit
+ *      connParamsComply
  *
  *  DESCRIPTION
- *      This function is called upon exiting from kbd_init state. The
- *      application starts advertising after exiting this state.
+ *      This function checks whether the current connection parameters comply
+ *      with the ones wanted. While the burst connection parameters are
+ *      wanted, any connection interval up to APPLE_MAX_CON_INTERVAL is
+ *      accepted as long as the slave latency is not higher than
+ *      BURST_SLAVE_LATENCY.
  *
  *  RETURNS/MODIFIES
- *      Nothing.
+ *      TRUE if the current connection parameters comply.
  *
  *----------------------------------------------------------------------------*/
-
-static void appInitStateExit(void)
+static bool connParamsComply(void)
 {
-    StartHardware();
+    if(g_kbd_data.conn_params_burst)
+    {
+        return (g_kbd_data.conn_interval <= APPLE_MAX_CON_INTERVAL &&
+                g_kbd_data.conn_latency <= BURST_SLAVE_LATENCY);
+    }
 
-    /* Application will start advertising upon exiting kbd_init state. So,
-     * update the whitelist.
-     */
-    AppUpdateWhiteList();
+    return !(g_kbd_data.conn_interval < PREFERRED_MIN_CON_INTERVAL ||
+             g_kbd_data.conn_interval > PREFERRED_MAX_CON_INTERVAL
+#if PREFERRED_SLAVE_LATENCY
+             ||  g_kbd_data.conn_latency < PREFERRED_SLAVE_LATENCY
+#endif
+            );
+}
+
+#ifdef ADAPTIVE_CONN_PARAMS
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      scheduleConnParamUpdate
+ *
+ *  DESCRIPTION
+ *      This function is called when the wanted connection parameters have
+ *      changed. It requests them straight away, unless the last request was
+ *      sent less than CONN_PARAMS_MIN_UPDATE_SPACING ago. The request is then
+ *      sent by the connection parameter update timer. While the procedure
+ *      started upon connection is waiting for TGAP(conn_pause_peripheral) or
+ *      TGAP(conn_pause_central), it is left to request them.
+ *
+ *      The attempts made for each set carry on from the previous switch to
+ *      it, so the APPLE connection interval fallback keeps its order. Once
+ *      MAX_NUM_CONN_PARAM_UPDATE_REQS requests for a set have been sent, it
+ *      is not requested again on this connection.
+ *
+ *  RETURNS/MODIFIES
+ *      Nothing.
+ *
+ *----------------------------------------------------------------------------*/
+static void scheduleConnParamUpdate(void)
+{
+    uint32 elapsed;
+
+    if(g_kbd_data.state != kbd_connected ||
+       (g_kbd_data.conn_param_update_tid != TIMER_INVALID &&
+        (g_kbd_data.cpu_timer_value == TGAP_CPP_PERIOD ||
+         g_kbd_data.cpu_timer_value == TGAP_CPC_PERIOD)))
+    {
+        return;
+    }
+
+    /* Any retry of the previous request is for the wrong parameters now */
+    TimerDelete(g_kbd_data.conn_param_update_tid);
+    g_kbd_data.conn_param_update_tid = TIMER_INVALID;
+    g_kbd_data.cpu_timer_value = 0;
+
+    if(connParamsComply() ||
+       *getConnParamUpdateCnt(g_kbd_data.conn_params_burst) >=
+                                                MAX_NUM_CONN_PARAM_UPDATE_REQS)
+    {
+        return;
+    }
+
+    elapsed = TimeGet32() - g_kbd_data.cpu_req_time;
+
+    if(elapsed >= CONN_PARAMS_MIN_UPDATE_SPACING)
+    {
+        sendConnParamUpdateReq();
+    }
+    else
+    {
+        g_kbd_data.cpu_timer_value = CONN_PARAMS_MIN_UPDATE_SPACING - elapsed;
+        g_kbd_data.conn_param_update_tid = TimerCreate(
+                                                g_kbd_data.cpu_timer_value,
+                                                TRUE, requestConnParamUpdate);
+    }
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      handleConnQuietTimerExpiry
+ *
+ *  DESCRIPTION
+ *      This function is called when the connection quiet timer expires. If
+ *      there has been no activity for CONN_PARAMS_QUIET_PERIOD and all the key
+ *      strokes have been sent, the preferred connection parameters are wanted
+ *      again. Otherwise the timer is restarted.
+ *
+ *  RETURNS/MODIFIES
+ *      Nothing.
+ *
+ *----------------------------------------------------------------------------*/
+static void handleConnQuietTimerExpiry(timer_id tid)
+{
+    uint32 quiet;
+
+    if(tid == g_kbd_data.conn_quiet_tid)
+    {
+        g_kbd_data.conn_quiet_tid = TIMER_INVALID;
+
+        quiet = TimeGet32() - g_kbd_data.last_activity_time;
+
+        if(g_kbd_data.pending_key_strokes.num)
+        {
+            g_kbd_data.conn_quiet_tid = TimerCreate(CONN_PARAMS_QUIET_PERIOD,
+                                       TRUE, handleConnQuietTimerExpiry);
+        }
+        else if(quiet < CONN_PARAMS_QUIET_PERIOD)
+        {
+            g_kbd_data.conn_quiet_tid = TimerCreate(
+                                       CONN_PARAMS_QUIET_PERIOD - quiet,
+                                       TRUE, handleConnQuietTimerExpiry);
+        }
+        else if(g_kbd_data.conn_params_burst)
+        {
+            g_kbd_data.conn_params_burst = FALSE;
+
+            scheduleConnParamUpdate();
+        }
+    } /* Else it may be due to some race condition. Ignore it. */
+}
+#endif /* ADAPTIVE_CONN_PARAMS */
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      appInitStateExit
+ *
+ *  DESCRIPTION
+ *      This function is called upon exiting from kbd_init state. The
+ *      application starts advertising after exiting this state.
+ *
+ *  RETURNS/MODIFIES
+ *      Nothing.
+ *
+ *----------------------------------------------------------------------------*/
+
+static void appInitStateExit(void)
+{
+    StartHardware();
+
+    /* Application will start advertising upon exiting kbd_init state. So,
+     * update the whitelist.
+     */
+    AppUpdateWhiteList();
 }
 
 /*-----------------------------------------------------------------------------*
@@ -855,6 +1525,11 @@ static void handleSignalLmEvConnectionComplete(
      g_kbd_data.conn_interval = p_event_data->data.conn_interval;
      g_kbd_data.conn_latency = p_event_data->data.conn_latency;
      g_kbd_data.conn_timeout = p_event_data->data.supervision_timeout;
+
+    /* Connection parameter update requests are spaced from the connection
+     * as well
+     */
+     g_kbd_data.cpu_req_time = TimeGet32();
 }
 
 
@@ -1049,13 +1724,7 @@ static void handleSignalGattConnectCfm(GATT_CONNECT_CFM_T* event_data)
                      * Update procedure
                      */
                     if((g_kbd_data.conn_param_update_tid == TIMER_INVALID) &&
-                       (g_kbd_data.conn_interval < PREFERRED_MIN_CON_INTERVAL ||
-                        g_kbd_data.conn_interval > PREFERRED_MAX_CON_INTERVAL
-#if PREFERRED_SLAVE_LATENCY
-                        ||  g_kbd_data.conn_latency < PREFERRED_SLAVE_LATENCY
-#endif
-                        )
-                      )
+                       !connParamsComply())
                     {
                         /* Set the num of conn parameter update attempts to
                          * zero
@@ -1671,14 +2340,41 @@ static void handleSignalSMpasskeyInputInd(void)
 static void handleSignalLsConnParamUpdateCfm(
                             LS_CONNECTION_PARAM_UPDATE_CFM_T *event_data)
 {
+    /* Counter of the set of parameters requested */
+    uint8 *p_update_cnt = getConnParamUpdateCnt(g_kbd_data.cpu_req_burst);
+
     /* Handling signal as per current state */
     switch(g_kbd_data.state)
     {
         case kbd_connected:
         case kbd_passkey_input:
         {
+#ifdef ADAPTIVE_CONN_PARAMS
+            if(event_data->status == ls_err_none)
+            {
+                /* The set will be requested again on the next switch to it.
+                 * Start from the parameters the remote device has taken.
+                 */
+                if(*p_update_cnt > CPU_SELF_PARAMS_MAX_ATTEMPTS)
+                {
+                    *p_update_cnt = CPU_SELF_PARAMS_MAX_ATTEMPTS;
+                }
+                else
+                {
+                    *p_update_cnt = 0;
+                }
+            }
+            else if(g_kbd_data.cpu_req_burst != g_kbd_data.conn_params_burst)
+            {
+                /* The other set is wanted now, and has been requested on
+                 * the switch to it
+                 */
+                break;
+            }
+#endif /* ADAPTIVE_CONN_PARAMS */
+
             if ((event_data->status !=
-                    ls_err_none) && (g_kbd_data.conn_param_update_cnt <
+                    ls_err_none) && (*p_update_cnt <
                     MAX_NUM_CONN_PARAM_UPDATE_REQS))
             {
                 /* Delete timer if running */
@@ -1767,12 +2463,7 @@ static void handleSignalLsConnParamUpdateInd(
              * parameter update procedure
              */
 
-            if( g_kbd_data.conn_interval < PREFERRED_MIN_CON_INTERVAL ||
-                g_kbd_data.conn_interval > PREFERRED_MAX_CON_INTERVAL
-#if PREFERRED_SLAVE_LATENCY
-               ||  g_kbd_data.conn_latency < PREFERRED_SLAVE_LATENCY
-#endif
-              )
+            if(!connParamsComply())
             {
                 /* Set the connection parameter update attempts counter to
                  * zero
@@ -1824,6 +2515,12 @@ static void handleSignalGattCharValNotCfm(GATT_CHAR_VAL_IND_CFM_T *p_event_data)
                p_event_data->handle == HANDLE_HID_INPUT_REPORT ||
                p_event_data->handle == HANDLE_HID_BOOT_INPUT_REPORT
 
+#ifdef NKRO_SUPPORT
+
+               || p_event_data->handle == HANDLE_HID_NKRO_REPORT
+
+#endif /* NKRO_SUPPORT */
+
 #ifdef __PROPRIETARY_HID_SUPPORT__
 
                || p_event_data->handle == HANDLE_HID_PROP_BOOT_REPORT
@@ -1833,26 +2530,75 @@ static void handleSignalGattCharValNotCfm(GATT_CHAR_VAL_IND_CFM_T *p_event_data)
             )
             {
                 /* Firmware has completed handling our request for queueing the
-                 * data to be sent to the remote device. If the data was
-                 * successfully queued, we can send the remaining data in the
-                 * application queue. If not, application needs to retry sending
-                 * the same data again.
+                 * data to be sent to the remote device. Confirmations arrive
+                 * in the order the notifications were sent, so this one is
+                 * for the key stroke following the rejected ones, if any.
                  */
+                if(g_kbd_data.tx_in_flight)
+                {
+                    -- g_kbd_data.tx_in_flight;
+                }
                 g_kbd_data.data_tx_in_progress = FALSE;
 
                 if(p_event_data->result == sys_status_success)
                 {
-                    /* Update the start index of the queue. */
-                    g_kbd_data.pending_key_strokes.start_idx =
-                    (g_kbd_data.pending_key_strokes.start_idx + 1) %
-                    MAX_PENDING_KEY_STROKES;
+#ifdef KEY_LATENCY_STATS
+                    if(g_kbd_data.pending_key_strokes.num >
+                                                        g_kbd_data.tx_rejected)
+                    {
+                        const KEY_STROKE_T *p_key_stroke =
+                            &g_kbd_data.pending_key_strokes.key_stroke[
+                                         CQUEUE_IDX(g_kbd_data.tx_rejected)];
+
+                        LatencyNotificationAccepted(p_key_stroke->rx_time,
+                                                    p_key_stroke->queue_time,
+                                                    p_key_stroke->send_time);
+
+                        /* The key stroke is counted as sent over the air on
+                         * the next tx_data radio event
+                         */
+                        LsRadioEventNotification(g_kbd_data.st_ucid,
+                                                           radio_event_tx_data);
+                    }
+#endif /* KEY_LATENCY_STATS */
+
+                    if(g_kbd_data.pending_key_strokes.num >
+                                                        g_kbd_data.tx_rejected)
+                    {
+                        if(g_kbd_data.tx_rejected)
+                        {
+                            /* This key stroke has overtaken the ones rejected
+                             * ahead of it. Only this one has been sent, the
+                             * rejected ones stay at the head of the queue to
+                             * be sent again once no confirmations are
+                             * outstanding.
+                             */
+                            dropOvertakenKeyStrokes();
+                        }
+                        else
+                        {
+                            /* Remove the key stroke sent from the queue */
+                            keyStrokesRemoved(0, 1, TRUE);
+                            g_kbd_data.pending_key_strokes.start_idx =
+                               (g_kbd_data.pending_key_strokes.start_idx + 1)
+                                                     % MAX_PENDING_KEY_STROKES;
+                            -- g_kbd_data.pending_key_strokes.num;
+                        }
+                    }
+
+                    resumeKeyStrokeProducer();
 
-                    /* Decrement the number of pending key strokes. If more
-                     * key strokes are in queue, send them
+                    /* Open the window by one after a full window of
+                     * notifications has been accepted.
                      */
-                    if(g_kbd_data.pending_key_strokes.num)
+                    if(++ g_kbd_data.tx_accepted_cnt >= g_kbd_data.tx_window)
                     {
-                        -- g_kbd_data.pending_key_strokes.num;
+                        g_kbd_data.tx_accepted_cnt = 0;
+
+                        if(g_kbd_data.tx_window < MAX_NOTIFICATIONS_IN_FLIGHT)
+                        {
+                            ++ g_kbd_data.tx_window;
+                        }
                     }
 
                     /* If all the data from the application queue is emptied,
@@ -1866,16 +2612,6 @@ static void handleSignalGattCharValNotCfm(GATT_CHAR_VAL_IND_CFM_T *p_event_data)
                         resetIdleTimer();
                         g_kbd_data.data_pending = FALSE;
                     }
-
-                    /* If more data is there in the queue, send it. */
-                    if(g_kbd_data.data_pending)
-                    {
-                        if(g_kbd_data.encrypt_enabled &&
-                                                   AppCheckNotificationStatus())
-                        {
-                            SendKeyStrokesFromQueue();
-                        }
-                    }
                 }
 
                 else /* The firmware has not added the data in it's queue to be
@@ -1886,14 +2622,42 @@ static void handleSignalGattCharValNotCfm(GATT_CHAR_VAL_IND_CFM_T *p_event_data)
                       * tx_data
                       */
                 {
-                    g_kbd_data.waiting_for_fw_buffer = TRUE;
+                    /* The key stroke stays in the queue to be sent again */
+                    ++ g_kbd_data.tx_rejected;
 
-                    /* Enable the application to receive confirmation that the
-                     * data has been transmitted to the remote device by
-                     * configuring notifications on tx_data radio events
-                     */
-                    LsRadioEventNotification(g_kbd_data.st_ucid,
+                    if(!g_kbd_data.waiting_for_fw_buffer)
+                    {
+                        /* The firmware could not take this many notifications.
+                         * Halve the window, but only once for all the
+                         * notifications rejected in one go.
+                         */
+                        g_kbd_data.tx_window = (g_kbd_data.tx_window > 1) ?
+                                               (g_kbd_data.tx_window >> 1) : 1;
+                        g_kbd_data.tx_accepted_cnt = 0;
+
+                        g_kbd_data.waiting_for_fw_buffer = TRUE;
+
+                        /* Enable the application to receive confirmation that
+                         * the data has been transmitted to the remote device
+                         * by configuring notifications on tx_data radio events
+                         */
+                        LsRadioEventNotification(g_kbd_data.st_ucid,
                                                            radio_event_tx_data);
+                    }
+                }
+
+                /* If more data is there in the queue, send it. Rejected key
+                 * strokes are only sent again once all the outstanding
+                 * confirmations have been received, to keep them in order.
+                 */
+                if(g_kbd_data.data_pending &&
+                   !g_kbd_data.waiting_for_fw_buffer)
+                {
+                    if(g_kbd_data.encrypt_enabled &&
+                                               AppCheckNotificationStatus())
+                    {
+                        SendKeyStrokesFromQueue();
+                    }
                 }
             }
         }
@@ -1918,6 +2682,11 @@ static void handleSignalGattCharValNotCfm(GATT_CHAR_VAL_IND_CFM_T *p_event_data)
 
 static void handleSignalLsRadioEventInd(void)
 {
+#ifdef KEY_LATENCY_STATS
+    /* The notifications accepted so far have been sent */
+    LatencyRadioTxData();
+#endif /* KEY_LATENCY_STATS */
+
     /* Radio events notification would have been enabled after the firmware
      * buffers are full and hence incapable of receiving any more notification
      * requests from the application. Disable them now
@@ -1929,9 +2698,8 @@ static void handleSignalLsRadioEventInd(void)
         g_kbd_data.waiting_for_fw_buffer = FALSE;
         if(g_kbd_data.data_pending)
         {
-            /* Not necessary to check the data_tx_in_progress flag as this
-             * shouldn't be set when we are waiting for firmware to free it's
-             * buffers.
+            /* If confirmations are still outstanding, the rejected key strokes
+             * will be sent again when the last of them is received.
              */
             if(g_kbd_data.encrypt_enabled && AppCheckNotificationStatus())
             {
@@ -2029,6 +2797,218 @@ static void handleBondingChanceTimerExpiry(timer_id tid)
     }/* Else it may be due to some race condition. Ignore it. */
 }
 
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      handleNewKeyStrokes
+ *
+ *  DESCRIPTION
+ *      This function is called when new key strokes have been added to the
+ *      queue. It starts sending them if the keyboard is connected, or gets
+ *      the keyboard (back) into a state in which it can connect otherwise.
+ *
+ *  RETURNS/MODIFIES
+ *      Nothing.
+ *
+ *----------------------------------------------------------------------------*/
+
+static void handleNewKeyStrokes(void)
+{
+#ifdef ADAPTIVE_CONN_PARAMS
+    AppConnParamsActivity();
+#endif /* ADAPTIVE_CONN_PARAMS */
+
+    if(g_kbd_data.state == kbd_connected &&
+                                     g_kbd_data.encrypt_enabled)
+    {
+        /* If the data transmission is not already in progress,
+         * then send the stored keys from queue
+         */
+        if(AppCheckNotificationStatus()&&
+           !g_kbd_data.data_tx_in_progress &&
+           !g_kbd_data.waiting_for_fw_buffer)
+        {
+            SendKeyStrokesFromQueue();
+        }
+    }
+    /* If the keyboard is slow advertising, start fast
+     * advertisements
+     */
+    else if(g_kbd_data.state == kbd_slow_advertising)
+    {
+        g_kbd_data.start_adverts = TRUE;
+
+        /* Delete the advertisement timer */
+        TimerDelete(g_kbd_data.app_tid);
+        g_kbd_data.app_tid = TIMER_INVALID;
+        g_kbd_data.advert_timer_value = TIMER_INVALID;
+
+        GattStopAdverts();
+    }
+
+    /* If the keyboard is already fast advertising, we need
+     * not do anything. If the keyboard state is kbd_init,
+     * it will start advertising. If the keyboard is in
+     * kbd_disconnecting state, it will start advertising
+     * after disconnection is complete and it finds that
+     * data is pending in the queue.
+     */
+    else if(g_kbd_data.state == kbd_idle)
+    {
+        appStartAdvert();
+    }
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      queueTypedKey
+ *
+ *  DESCRIPTION
+ *      This function adds an input report holding down the key and modifiers
+ *      of a character map entry, and nothing else, to the queue.
+ *
+ *  RETURNS/MODIFIES
+ *      Nothing.
+ *
+ *----------------------------------------------------------------------------*/
+
+static void queueTypedKey(uint16 key)
+{
+    uint8 input_report[ATTR_LEN_HID_INPUT_REPORT];
+
+    MemSet(input_report, 0, ATTR_LEN_HID_INPUT_REPORT);
+    input_report[0] = CHAR_MAP_MODIFIER(key);
+    input_report[2] = CHAR_MAP_USAGE(key);
+
+    queueUartReport(HID_INPUT_REPORT_ID, input_report,
+                                                     ATTR_LEN_HID_INPUT_REPORT);
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      queueUartReport
+ *
+ *  DESCRIPTION
+ *      This function adds a report made from data received over UART to the
+ *      queue.
+ *
+ *  RETURNS/MODIFIES
+ *      Nothing.
+ *
+ *----------------------------------------------------------------------------*/
+
+static void queueUartReport(uint8 report_id, uint8 *report,
+                            uint8 report_length)
+{
+#ifdef KEY_LATENCY_STATS
+    if(AddKeyStrokeToQueue(report_id, report, report_length))
+    {
+        /* The key stroke is the newest one in the queue. Count its latency
+         * from the reception of the character instead of from now.
+         */
+        KEY_STROKE_T *p_key_stroke = &g_kbd_data.pending_key_strokes.key_stroke[
+                         CQUEUE_IDX(g_kbd_data.pending_key_strokes.num - 1)];
+
+        p_key_stroke->rx_time = typed_char_rx_time;
+        LatencyRecord(latency_stage_queue,
+                      p_key_stroke->queue_time - typed_char_rx_time);
+    }
+#else
+    AddKeyStrokeToQueue(report_id, report, report_length);
+#endif /* KEY_LATENCY_STATS */
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      acceptUartKeyStrokes
+ *
+ *  DESCRIPTION
+ *      This function checks whether the queue can take 'n_strokes' key
+ *      strokes for 'n_items' characters or reports received over UART. Under
+ *      key_queue_policy_reject they are held back unless the queue has room
+ *      for all of them. Held back items are counted, and UartResumeRx is
+ *      called once the queue has room again.
+ *
+ *  RETURNS/MODIFIES
+ *      TRUE if the key strokes can be queued.
+ *
+ *----------------------------------------------------------------------------*/
+
+static bool acceptUartKeyStrokes(uint16 n_strokes, uint16 n_items)
+{
+    if(g_kbd_data.pending_key_strokes.policy == key_queue_policy_reject &&
+       GET_CQUEUE_FREE_SLOTS() < n_strokes)
+    {
+        g_kbd_data.pending_key_strokes.stats.rejected += n_items;
+        g_kbd_data.pending_key_strokes.producer_held = TRUE;
+
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+#ifdef KEY_LATENCY_STATS
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      trackKeyChange
+ *
+ *  DESCRIPTION
+ *      This function is called for each scan of the key matrix handled. It
+ *      notes when the first change of the keys since the last report was
+ *      scanned, from the ticks of the PIO controller, and when its key was
+ *      pressed. A change which settles without a report is forgotten.
+ *
+ *  RETURNS/MODIFIES
+ *      Nothing.
+ *
+ *----------------------------------------------------------------------------*/
+
+static void trackKeyChange(const uint16 *p_shared_data)
+{
+    const uint32 now = TimeGet32();
+    uint16 tick;
+    uint16 change_tick;
+
+    /* The PIO controller may be counting a tick while it is read */
+    do
+    {
+        tick = p_shared_data[SCAN_TICK_WORD];
+    }
+    while(tick != p_shared_data[SCAN_TICK_WORD]);
+    change_tick = p_shared_data[SCAN_CHANGE_TICK_WORD];
+
+    if(key_change_pending &&
+       (uint16)(tick - last_change_tick) > PIO_CTRLR_SETTLE_SCANS)
+    {
+        key_change_pending = FALSE;
+    }
+
+    if(change_tick != last_change_tick)
+    {
+        if(!key_change_pending)
+        {
+            key_change_pending = TRUE;
+            key_scan_time = now - (uint32)(uint16)(tick - change_tick) *
+                                  KEY_SCAN_CYCLE_TIME;
+
+            if(key_wake_pending)
+            {
+                key_press_time = key_wake_time;
+            }
+            else
+            {
+                key_press_time = key_scan_time -
+                                 (uint32)(p_shared_data[SCAN_GAP_WORD] &
+                                          0x00FF) * KEY_SCAN_CYCLE_TIME;
+            }
+        }
+
+        last_change_tick = change_tick;
+        key_wake_pending = FALSE;
+    }
+}
+#endif /* KEY_LATENCY_STATS */
+
 /*=============================================================================*
  *  Public Function Implementations
  *============================================================================*/
@@ -2095,6 +3075,12 @@ extern void WriteApplicationAndServiceDataToNVM(void)
 
     /* Write GAP service data into NVM */
     WriteGapServiceDataInNVM();
+
+    /* Write the selected keyboard layout into NVM */
+    WriteCharMapDataInNvm();
+
+    /* Write the key map into NVM */
+    WriteKeyMapDataInNvm();
     
     /* Write Gatt service data into NVM. */
     WriteGattServiceDataInNvm();   
@@ -2273,49 +3259,10 @@ extern void ProcessReport(uint8* raw_report)
     {
         if(FormulateReportsFromRaw(raw_report))
         {
-
-            if(g_kbd_data.state == kbd_connected &&
-                                             g_kbd_data.encrypt_enabled)
-            {
-                /* If the data transmission is not already in progress,
-                 * then send the stored keys from queue
-                 */
-                if(AppCheckNotificationStatus()&&
-                   !g_kbd_data.data_tx_in_progress &&
-                   !g_kbd_data.waiting_for_fw_buffer)
-                {
-                    SendKeyStrokesFromQueue();
-                }
-            }
-             /* If the keyboard is slow advertising, start fast
-             * advertisements
-             */
-            else if(g_kbd_data.state == kbd_slow_advertising)
-            {
-                g_kbd_data.start_adverts = TRUE;
-
-                /* Delete the advertisement timer */
-                TimerDelete(g_kbd_data.app_tid);
-                g_kbd_data.app_tid = TIMER_INVALID;
-                g_kbd_data.advert_timer_value = TIMER_INVALID;
-
-                GattStopAdverts();
-            }
-
-            /* If the keyboard is already fast advertising, we need
-             * not do anything. If the keyboard state is kbd_init,
-             * it will start advertising. If the keyboard is in
-             * kbd_disconnecting state, it will start advertising
-             * after disconnection is complete and it finds that
-             * data is pending in the queue.
-             */
-            else if(g_kbd_data.state == kbd_idle)
-            {
-                appStartAdvert();
-            }
-        }
-    }
-}
+            handleNewKeyStrokes();
+        }
+    }
+}
 
 
 /*-----------------------------------------------------------------------------*
@@ -2325,24 +3272,62 @@ extern void ProcessReport(uint8* raw_report)
  *  DESCRIPTION
  *      This function is used to add key strokes to circular queue maintained
  *      by application. The key strokes will get notified to Host machine once
- *      notifications are enabled by the remote client.
+ *      notifications are enabled by the remote client. If the queue is full,
+ *      the oldest key stroke not yet handed to the firmware is overwritten
+ *      under key_queue_policy_overwrite, and the new one is dropped if there
+ *      is none. Otherwise an intermediate key stroke is dropped, see
+ *      makeRoomInQueue.
  *
  *  RETURNS/MODIFIES
- *      Nothing.
+ *      TRUE if the key stroke has been added at the end of the queue, FALSE if
+ *      it has been dropped or merged into the previous one.
  *
  *----------------------------------------------------------------------------*/
 
-extern void AddKeyStrokeToQueue(uint8 report_id, uint8 *report,
+extern bool AddKeyStrokeToQueue(uint8 report_id, uint8 *report,
                                                             uint8 report_length)
 {
+    CQUEUE_KEY_STROKE_T *p_queue = &g_kbd_data.pending_key_strokes;
+    const uint8 first = g_kbd_data.tx_rejected + g_kbd_data.tx_in_flight;
     uint8 *p_temp_input_report = NULL;
     uint8 add_idx;
 
-    /* Add new key stroke to the end of circular queue. If Max circular queue
-     * length has reached the oldest key stroke will get overwritten
-     */
-    add_idx = (g_kbd_data.pending_key_strokes.start_idx +
-    g_kbd_data.pending_key_strokes.num)% MAX_PENDING_KEY_STROKES;
+    if(p_queue->num >= MAX_PENDING_KEY_STROKES)
+    {
+        if(p_queue->policy != key_queue_policy_overwrite)
+        {
+            if(!makeRoomInQueue(report_id, report, report_length))
+            {
+                return FALSE;
+            }
+        }
+        else if(first >= p_queue->num)
+        {
+            /* Every key stroke has been handed to the firmware */
+            ++ p_queue->stats.dropped;
+            return FALSE;
+        }
+        else if(first == 0)
+        {
+            /* Oldest key stroke overwritten, move the index */
+            keyStrokesRemoved(0, 1, FALSE);
+            p_queue->start_idx = (p_queue->start_idx + 1)
+                                                  % MAX_PENDING_KEY_STROKES;
+            -- p_queue->num;
+            ++ p_queue->stats.overwritten;
+        }
+        else
+        {
+            /* The key strokes in flight or to be resent stay at the head of
+             * the queue, so the oldest one after them is overwritten
+             */
+            removeKeyStroke(first, FALSE);
+            ++ p_queue->stats.overwritten;
+        }
+    }
+
+    /* Add new key stroke to the end of circular queue */
+    add_idx = CQUEUE_IDX(g_kbd_data.pending_key_strokes.num);
 
     SET_CQUEUE_INPUT_REPORT_ID(add_idx, report_id);
 
@@ -2350,13 +3335,34 @@ extern void AddKeyStrokeToQueue(uint8 report_id, uint8 *report,
 
     MemCopy(p_temp_input_report, report, report_length);
 
-    if(g_kbd_data.pending_key_strokes.num < MAX_PENDING_KEY_STROKES)
-        ++ g_kbd_data.pending_key_strokes.num;
-    else /* Oldest key stroke overwritten, move the index */
-        g_kbd_data.pending_key_strokes.start_idx = (add_idx + 1)
-                                                  % MAX_PENDING_KEY_STROKES;
+    /* Pad the report with zeros so that key strokes can be compared as a
+     * whole
+     */
+    if(report_length < LARGEST_REPORT_SIZE)
+    {
+        MemSet(p_temp_input_report + report_length, 0,
+                                         LARGEST_REPORT_SIZE - report_length);
+    }
+
+#ifdef KEY_LATENCY_STATS
+    g_kbd_data.pending_key_strokes.key_stroke[add_idx].queue_time =
+                                                                   TimeGet32();
+    g_kbd_data.pending_key_strokes.key_stroke[add_idx].rx_time =
+               matrix_rx_time_valid ? matrix_rx_time :
+               g_kbd_data.pending_key_strokes.key_stroke[add_idx].queue_time;
+    g_kbd_data.pending_key_strokes.key_stroke[add_idx].handed_to_fw = FALSE;
+#endif /* KEY_LATENCY_STATS */
+
+    ++ p_queue->num;
+
+    if(p_queue->num > p_queue->stats.high_water)
+    {
+        p_queue->stats.high_water = p_queue->num;
+    }
 
     g_kbd_data.data_pending = TRUE;
+
+    return TRUE;
 }
 
 
@@ -2508,7 +3514,8 @@ extern void HandleDeleteBonding(void)
  *
  *  DESCRIPTION
  *      This function is used to send key strokes in circular queue
- *      maintained by application.
+ *      maintained by application. Up to 'tx_window' key strokes are handed to
+ *      the firmware before their GATT_CHAR_VAL_NOT_CFM is received.
  *
  *  RETURNS/MODIFIES
  *      Nothing.
@@ -2517,38 +3524,79 @@ extern void HandleDeleteBonding(void)
 
 extern void SendKeyStrokesFromQueue(void)
 {
-    uint8 start_idx = g_kbd_data.pending_key_strokes.start_idx;
+    uint8 send_idx;
+    bool sent;
 
-#ifdef __PROPRIETARY_HID_SUPPORT__
-    /* If notifications are enabled on proprietary HID report handle, it
-     * means that only boot mode data has to be sent on this handle.
+    /* Rejected key strokes at the head of the queue have to be sent first.
+     * This is only done once no confirmations are outstanding, otherwise
+     * they could overtake key strokes already handed to the firmware.
      */
-
-    if(HidBootGetNotificationStatus())
+    if(g_kbd_data.tx_rejected)
     {
-        if(HidSendBootInputReport(g_kbd_data.st_ucid,
-            GET_CQUEUE_INPUT_REPORT_ID(start_idx),
-            GET_CQUEUE_INPUT_REPORT_REF(start_idx)))
+        if(g_kbd_data.tx_in_flight)
         {
-
-            /* Set the data being transferred flag to TRUE */
-            g_kbd_data.data_tx_in_progress = TRUE;
+            return;
         }
+        g_kbd_data.tx_rejected = 0;
     }
-    else
+
+    /* Hand key strokes to the firmware until the window is full or there are
+     * no more key strokes to send.
+     */
+    while(!g_kbd_data.waiting_for_fw_buffer &&
+          g_kbd_data.tx_in_flight < g_kbd_data.tx_window &&
+          g_kbd_data.tx_in_flight < g_kbd_data.pending_key_strokes.num)
+    {
+        send_idx = (g_kbd_data.pending_key_strokes.start_idx +
+                    g_kbd_data.tx_in_flight) % MAX_PENDING_KEY_STROKES;
+
+#ifdef __PROPRIETARY_HID_SUPPORT__
+        /* If notifications are enabled on proprietary HID report handle, it
+         * means that only boot mode data has to be sent on this handle.
+         */
+
+        if(HidBootGetNotificationStatus())
+        {
+            sent = HidSendBootInputReport(g_kbd_data.st_ucid,
+                                     GET_CQUEUE_INPUT_REPORT_ID(send_idx),
+                                     GET_CQUEUE_INPUT_REPORT_REF(send_idx));
+        }
+        else
 
 #endif /* __PROPRIETARY_HID_SUPPORT__ */
 
-    {
-        if(HidSendInputReport(g_kbd_data.st_ucid,
-                           GET_CQUEUE_INPUT_REPORT_ID(start_idx),
-                           GET_CQUEUE_INPUT_REPORT_REF(start_idx)))
         {
+            sent = HidSendInputReport(g_kbd_data.st_ucid,
+                                 GET_CQUEUE_INPUT_REPORT_ID(send_idx),
+                                 GET_CQUEUE_INPUT_REPORT_REF(send_idx));
+        }
+
+        if(!sent)
+        {
+            break;
+        }
 
-            /* Set the data being transferred flag to TRUE */
-            g_kbd_data.data_tx_in_progress = TRUE;
+#ifdef KEY_LATENCY_STATS
+        /* A key stroke rejected by the firmware is handed to it again, its
+         * wait for a firmware buffer is counted from the first time
+         */
+        if(!g_kbd_data.pending_key_strokes.key_stroke[send_idx].handed_to_fw)
+        {
+            g_kbd_data.pending_key_strokes.key_stroke[send_idx].send_time =
+                                                                   TimeGet32();
+            g_kbd_data.pending_key_strokes.key_stroke[send_idx].handed_to_fw =
+                                                                          TRUE;
         }
+#endif /* KEY_LATENCY_STATS */
+
+        ++ g_kbd_data.tx_in_flight;
     }
+
+    /* Set the data being transferred flag while no more notifications can be
+     * handed to the firmware
+     */
+    g_kbd_data.data_tx_in_progress =
+                          (g_kbd_data.tx_in_flight >= g_kbd_data.tx_window);
 }
 
 /*-----------------------------------------------------------------------------*
@@ -2701,6 +3749,11 @@ void AppInit(sleep_state LastSleepState)
     /* Scan Parameter Service Initialisation on Chip reset */
     ScanParamInitChipReset();
 
+#ifdef KEY_LATENCY_STATS
+    /* Key Latency Service Initialisation on Chip reset */
+    LatencyInitChipReset();
+#endif /* KEY_LATENCY_STATS */
+
     /* Read persistent storage */
     readPersistentStore();
 
@@ -2717,6 +3770,12 @@ void AppInit(sleep_state LastSleepState)
     /* Initialise Keyboard application data structure */
     kbdDataInit();
 
+    /* Initialize the queue overflow policy and its counters */
+    g_kbd_data.pending_key_strokes.policy = DEFAULT_KEY_QUEUE_POLICY;
+    g_kbd_data.pending_key_strokes.producer_held = FALSE;
+    MemSet(&g_kbd_data.pending_key_strokes.stats, 0,
+                                     sizeof(g_kbd_data.pending_key_strokes.stats));
+
     /* Initialize the queue related variables */
     resetQueueData();
 
@@ -2785,11 +3844,14 @@ void AppProcessSystemEvent(sys_event_id id, void *data)
 
         /* Array to hold the keys copied from the PIO controller. */
         uint8  rows[ROWS];
-        uint8  raw_report[LARGEST_REPORT_SIZE];
+        uint8  raw_report[RAW_REPORT_SIZE];
         bool   new_report = FALSE;
         uint16 i;
         uint16 c;
         uint16 *p_shared_data = NULL;
+#ifdef ADAPTIVE_KEY_SCAN
+        uint8  keys_held = 0;
+#endif /* ADAPTIVE_KEY_SCAN */
 
         /* Copy shared data to a safe area before it gets over written by the
          * PIO controller. They are 16 bit words copy back into 2 * 8 bit row
@@ -2797,6 +3859,21 @@ void AppProcessSystemEvent(sys_event_id id, void *data)
          */
         p_shared_data = (uint16*)data;
 
+        /* When an event is handled after the PIO controller has made its
+         * next scan, that scan is read instead, and has to be ignored when
+         * its own event comes. Debouncing it twice would count it as two
+         * scans.
+         */
+        if((p_shared_data[SCAN_SEQ_WORD] & 0x00FF) == last_scan_seq)
+        {
+            break;
+        }
+        last_scan_seq = p_shared_data[SCAN_SEQ_WORD] & 0x00FF;
+
+#ifdef KEY_LATENCY_STATS
+        trackKeyChange(p_shared_data);
+#endif /* KEY_LATENCY_STATS */
+
         /* First word in memory points to which key buffer is in use. 0 = first
          * buffer.
          */
@@ -2821,15 +3898,34 @@ void AppProcessSystemEvent(sys_event_id id, void *data)
             ++ p_shared_data;
         }
 
+#ifdef ADAPTIVE_KEY_SCAN
+        /* Scan at the fast rate while the keys are in use */
+        for(i = 0; i < ROWS; i++)
+        {
+            keys_held |= rows[i];
+        }
+        KeyScanActivity(&((uint16*)data)[SCAN_PROFILE_WORD], keys_held != 0);
+#endif /* ADAPTIVE_KEY_SCAN */
+
+#ifdef SUPPRESS_GHOST_KEYS_ONLY
+        /* Keys which may be ghost keys keep the state they were debounced
+         * to, the other keys go through
+         */
+        SuppressGhostKeys(rows);
+
+        /* Filter bouncing key press */
+        DebounceFX(rows);
+#else
         /* PIO event need not be processed further if Ghost Keys are detected */
-        if (GhostFX(rows)) break;
+        if (GhostFX(rows, NULL, NULL)) break;
 
         /* Filter bouncing key press */
         DebounceFX(rows);
 
-        if (GhostFX(rows)) break;
+        if (GhostFX(rows, NULL, NULL)) break;
+#endif /* SUPPRESS_GHOST_KEYS_ONLY */
 
-        MemSet(raw_report, 0, LARGEST_REPORT_SIZE);
+        MemSet(raw_report, 0, RAW_REPORT_SIZE);
 
         /* A single key press generates many PIO Controller events. So, it's
          * important to verify whether this system event is because of a new
@@ -2839,8 +3935,29 @@ void AppProcessSystemEvent(sys_event_id id, void *data)
 
         if(new_report)
         {
+#ifdef KEY_LATENCY_STATS
+            /* The key strokes of the report are counted from the key press
+             * which made the change
+             */
+            if(key_change_pending)
+            {
+                LatencyRecord(latency_stage_scan,
+                              key_scan_time - key_press_time);
+                LatencyRecord(latency_stage_debounce,
+                              TimeGet32() - key_scan_time);
+
+                matrix_rx_time = key_press_time;
+                matrix_rx_time_valid = TRUE;
+                key_change_pending = FALSE;
+            }
+#endif /* KEY_LATENCY_STATS */
+
             /* Process new report */
             ProcessReport(raw_report);
+
+#ifdef KEY_LATENCY_STATS
+            matrix_rx_time_valid = FALSE;
+#endif /* KEY_LATENCY_STATS */
         }
     }
     break;
@@ -3006,107 +4123,485 @@ extern void SetStateDisconnect(void)
 
 
 
-extern void test(uint16* data)
+#ifdef ADAPTIVE_CONN_PARAMS
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      AppConnParamsActivity
+ *
+ *  DESCRIPTION
+ *      This function is called when key strokes have been generated or data
+ *      has been received over UART. The burst connection parameters are
+ *      wanted until the keyboard has been quiet for CONN_PARAMS_QUIET_PERIOD.
+ *
+ *  RETURNS/MODIFIES
+ *      Nothing.
+ *
+ *----------------------------------------------------------------------------*/
+
+extern void AppConnParamsActivity(void)
 {
-	uint16 ucid = AppGetConnectionCid();
-	uint8 report_id = HID_INPUT_REPORT_ID;
-	uint8 input_report[ATTR_LEN_HID_INPUT_REPORT];
-//	uint8 *p_input_report = input_report;
-	const uint8 *p_event_msg;
-	uint8        event_msg_len;
-	int8        pass_num = -1;
-	MemSet(input_report, 0, ATTR_LEN_HID_INPUT_REPORT);
-	bool flgEnter = FALSE;
-	uint8 tmp_char = (uint8)(data[0] & 0x00FF);
-	
-	
-	
-	switch(tmp_char)
-	{
-	case '1':
-		input_report[2] = 0x1E;
-		pass_num = 1;
-		break;
-	case '2':
-		input_report[2] = 0x1F;
-		pass_num = 2;
-		break;
-	case '3':
-		input_report[2] = 0x20;
-		pass_num = 3;
-		break;
-	case '4':
-		input_report[2] = 0x21;
-		pass_num = 4;
-		break;
-	case '5':
-		input_report[2] = 0x22;
-		pass_num = 5;
-		break;
-	case '6':
-		input_report[2] = 0x23;
-		pass_num = 6;
-		break;
-	case '7':
-		input_report[2] = 0x24;
-		pass_num = 7;
-		break;
-	case '8':
-		input_report[2] = 0x25;
-		pass_num = 8;
-		break;
-	case '9':
-		input_report[2] = 0x26;
-		pass_num = 9;
-		break;
-	case '0':
-		input_report[2] = 0x27;
-		pass_num = 0;
-		break;
-	case 0x0d://CR
-		input_report[2] = USAGE_ID_KEY_ENTER;//Keyboard Return (ENTER)
-		flgEnter = TRUE;
-		break;
-	case 0x0a://LF
-		input_report[2] = USAGE_ID_KEY_ENTER;//Keyboard Return (ENTER)
-		flgEnter = TRUE;
-		break;
-	default:
-		input_report[2] = USAGE_ID_KEY_ENTER;//Keyboard Return (ENTER)
-		break;
-	}
+    if(g_kbd_data.state != kbd_connected)
+    {
+        return;
+    }
+
+    /* Rather than restarting the quiet timer on every key stroke, its expiry
+     * handler checks how long ago the last activity was
+     */
+    g_kbd_data.last_activity_time = TimeGet32();
+
+    if(g_kbd_data.conn_quiet_tid == TIMER_INVALID)
+    {
+        g_kbd_data.conn_quiet_tid = TimerCreate(CONN_PARAMS_QUIET_PERIOD,
+                                       TRUE, handleConnQuietTimerExpiry);
+    }
+
+    if(!g_kbd_data.conn_params_burst)
+    {
+        g_kbd_data.conn_params_burst = TRUE;
+
+        scheduleConnParamUpdate();
+    }
+}
+#endif /* ADAPTIVE_CONN_PARAMS */
+
+#ifdef ADAPTIVE_KEY_SCAN
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      AppKeyScanWoken
+ *
+ *  DESCRIPTION
+ *      This function is called when a key press wakes the key scan up, on
+ *      whichever path. The PIO controller program is restarted, and counts
+ *      its scans from 0 again.
+ *
+ *  RETURNS/MODIFIES
+ *      Nothing.
+ *
+ *----------------------------------------------------------------------------*/
+
+extern void AppKeyScanWoken(void)
+{
+    last_scan_seq = SCAN_SEQ_NONE;
+
+#ifdef KEY_LATENCY_STATS
+    /* Its ticks start from 0 again too. The key was pressed now. */
+    last_change_tick = 0;
+    key_change_pending = FALSE;
+    key_wake_pending = TRUE;
+    key_wake_time = TimeGet32();
+#endif /* KEY_LATENCY_STATS */
+}
+#endif /* ADAPTIVE_KEY_SCAN */
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      AppSetKeyQueuePolicy
+ *
+ *  DESCRIPTION
+ *      This function selects the policy applied when a key stroke is added to
+ *      the full queue. Characters held back under key_queue_policy_reject
+ *      come in again when another policy is selected.
+ *
+ *  RETURNS/MODIFIES
+ *      TRUE if the policy is known and has been selected.
+ *
+ *----------------------------------------------------------------------------*/
+
+extern bool AppSetKeyQueuePolicy(uint16 policy)
+{
+    if(policy >= key_queue_policy_count)
+    {
+        return FALSE;
+    }
+
+    g_kbd_data.pending_key_strokes.policy = (key_queue_policy)policy;
+
+    resumeKeyStrokeProducer();
+
+    return TRUE;
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      AppAcceptTypedChars
+ *
+ *  DESCRIPTION
+ *      This function checks whether 'n_chars' characters received over UART
+ *      can be typed. Under key_queue_policy_reject they are held back unless
+ *      the queue has room for all the key strokes they may need, including
+ *      the one releasing the last of them. Held back characters are counted,
+ *      and UartResumeRx is called once the queue has room again.
+ *
+ *  RETURNS/MODIFIES
+ *      TRUE if the characters can be passed to AppTypeChar.
+ *
+ *----------------------------------------------------------------------------*/
+
+extern bool AppAcceptTypedChars(uint8 n_chars)
+{
+    return acceptUartKeyStrokes(
+                    (uint16)n_chars * KEY_STROKES_PER_TYPED_CHAR + 1, n_chars);
+}
+
+#ifdef KEY_LATENCY_STATS
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      AppSetTypedCharRxTime
+ *
+ *  DESCRIPTION
+ *      This function sets the time at which the characters passed next to
+ *      AppTypeChar, or the release by AppReleaseTypedKey, were received over
+ *      UART. The latencies of their key strokes are counted from it.
+ *
+ *  RETURNS/MODIFIES
+ *      Nothing.
+ *
+ *----------------------------------------------------------------------------*/
+
+extern void AppSetTypedCharRxTime(uint32 rx_time)
+{
+    typed_char_rx_time = rx_time;
+}
+#endif /* KEY_LATENCY_STATS */
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      AppTypeChar
+ *
+ *  DESCRIPTION
+ *      This function types a character received over UART. The key is left
+ *      held down and only released by the report pressing the next key, so
+ *      a run of characters needing Shift keeps Shift held. An explicit
+ *      release is only queued when the same key is typed twice in a row.
+ *      AppReleaseTypedKey must be called once no more characters follow.
+ *      AppAcceptTypedChars must have accepted the character.
+ *
+ *      Until the passkey has been entered, digits are collected into the
+ *      passkey and Enter submits it instead.
+ *
+ *  RETURNS/MODIFIES
+ *      TRUE if the character has been consumed, FALSE if there is no key for
+ *      the character.
+ *
+ *----------------------------------------------------------------------------*/
+
+extern bool AppTypeChar(uint8 ch)
+{
+	uint8 tmp_char = (uint8)(ch & 0x00FF);
+	uint16 key = CharMapLookup(tmp_char);
 	
 	if(flgPassed != TRUE)
 	{
-		if(pass_num != -1)
+		if(tmp_char >= '0' && tmp_char <= '9')
 		{
-			g_kbd_data.pass_key = g_kbd_data.pass_key * 10 + pass_num;
+			g_kbd_data.pass_key = g_kbd_data.pass_key * 10 +
+				(tmp_char - '0');
 		}
-		if(flgEnter == TRUE)
+		else if(tmp_char == '\r' || tmp_char == '\n')
 		{
 			SMPasskeyInput(&g_kbd_data.con_bd_addr,
 				&g_kbd_data.pass_key);
 				flgPassed = TRUE;
 		}
-		return;
+		return TRUE;
 	}
 	
+	if(key == 0)
+	{
+		/* There is no key for this character */
+		return FALSE;
+	}
+	
+	if(typed_key_held != 0 &&
+		CHAR_MAP_USAGE(key) == CHAR_MAP_USAGE(typed_key_held))
+	{
+		/* The host only sees a new key press if the key has been released
+		 * in between. Keep the modifiers the next press needs held.
+		 */
+		queueTypedKey(CHAR_MAP_ENTRY(CHAR_MAP_MODIFIER(key), 0));
+	}
+	
+	/* This releases the previous key and presses the new one */
+	queueTypedKey(key);
+	typed_key_held = key;
 	
+	handleNewKeyStrokes();
+	
+	return TRUE;
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      AppReleaseTypedKey
+ *
+ *  DESCRIPTION
+ *      This function releases the key left held down by AppTypeChar, if any.
+ *      It is called when no more characters are waiting to be typed.
+ *
+ *  RETURNS/MODIFIES
+ *      Nothing.
+ *
+ *----------------------------------------------------------------------------*/
+
+extern void AppReleaseTypedKey(void)
+{
+	if(typed_key_held != 0)
+	{
+		queueTypedKey(0);
+		typed_key_held = 0;
+		
+		handleNewKeyStrokes();
+	}
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      AppTypeString
+ *
+ *  DESCRIPTION
+ *      This function types a string received over UART, releasing the last
+ *      key at the end. Once the last key stroke of the string has been
+ *      confirmed by the firmware, or has been dropped from the queue, the
+ *      string is reported done through UartStringDone.
+ *
+ *  RETURNS/MODIFIES
+ *      TRUE if the string has been accepted, FALSE if there is no room for it
+ *      in the queue or too many strings are waiting to be reported done.
+ *
+ *----------------------------------------------------------------------------*/
+
+extern bool AppTypeString(uint8 id, const uint8 *p_chars, uint8 n_chars)
+{
+	const KEY_QUEUE_STATS_T *p_stats = &g_kbd_data.pending_key_strokes.stats;
+	uint16 removed;
+	uint8 idx;
+	
+	if(n_typed_strings >= UART_MAX_PENDING_STRINGS ||
+		!AppAcceptTypedChars(n_chars))
+	{
+		return FALSE;
+	}
+	
+	/* Key strokes dropped while the string is queued are not tracked yet */
+	removed = p_stats->dropped + p_stats->coalesced + p_stats->overwritten;
+	
+	for(idx = 0; idx < n_chars; idx++)
+	{
+		AppTypeChar(p_chars[idx] & 0xFF);
+	}
+	
+	AppReleaseTypedKey();
+	
+	/* The last key stroke of the string is the newest one in the queue */
+	typed_strings[n_typed_strings].id = id;
+	typed_strings[n_typed_strings].strokes =
+						g_kbd_data.pending_key_strokes.num;
+	typed_strings[n_typed_strings].dropped =
+		(removed != p_stats->dropped + p_stats->coalesced +
+					p_stats->overwritten);
+	++ n_typed_strings;
+	
+	/* A string which queued nothing, or only key strokes which have been
+	 * dropped already, is done now
+	 */
+	keyStrokesRemoved(0, 0, TRUE);
+	
+	return TRUE;
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      AppSendReport
+ *
+ *  DESCRIPTION
+ *      This function queues a report received over UART as it is. It becomes
+ *      the last report generated for its report ID, which the next report
+ *      formed from the keys held is compared with. An input report also
+ *      replaces the keys held down by AppSetUartKeys, and a consumer report
+ *      the consumer keys held by AppSetConsumerKeys.
+ *
+ *  RETURNS/MODIFIES
+ *      TRUE if the report has been accepted, FALSE if there is no room for it
+ *      in the queue.
+ *
+ *----------------------------------------------------------------------------*/
+
+extern bool AppSendReport(uint8 report_id, const uint8 *p_report,
+                          uint8 report_length)
+{
+    uint8 report[LARGEST_REPORT_SIZE];
+
+    if(!acceptUartKeyStrokes(1, 1))
+    {
+        return FALSE;
+    }
+
+    MemCopy(report, p_report, report_length);
+    queueUartReport(report_id, report, report_length);
+    SetReportQueued(report_id, report);
+
+    if(report_id == HID_INPUT_REPORT_ID)
+    {
+        MemCopy(uart_keys_report, report, ATTR_LEN_HID_INPUT_REPORT);
+    }
+
+    handleNewKeyStrokes();
+
+    return TRUE;
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      AppSetUartKeys
+ *
+ *  DESCRIPTION
+ *      This function presses or releases the keys of the keyboard page whose
+ *      usages are received over UART. The modifiers are given by their usages
+ *      0xE0 to 0xE7. Releasing no key releases all of them. A key pressed
+ *      while six keys are held is ignored. An input report is queued only if
+ *      the keys held have changed.
+ *
+ *  RETURNS/MODIFIES
+ *      TRUE if the keys have been accepted, FALSE if there is no room for the
+ *      input report in the queue.
+ *
+ *----------------------------------------------------------------------------*/
+
+extern bool AppSetUartKeys(const uint8 *p_usages, uint8 n_usages, bool down)
+{
+    uint8 report[ATTR_LEN_HID_INPUT_REPORT];
+    uint8 usage;
+    uint8 i;
+    uint8 k;
+
+    MemCopy(report, uart_keys_report, ATTR_LEN_HID_INPUT_REPORT);
+
+    if(!down && n_usages == 0)
+    {
+        MemSet(report, 0, ATTR_LEN_HID_INPUT_REPORT);
+    }
+
+    for(i = 0; i < n_usages; i++)
+    {
+        usage = p_usages[i] & 0xFF;
+
+        if(usage >= USAGE_ID_LEFT_CONTROL && usage <= USAGE_ID_RIGHT_GUI)
+        {
+            k = 1 << (usage - USAGE_ID_LEFT_CONTROL);
+            report[0] = down ? (report[0] | k) : (report[0] & ~k & 0xFF);
+            continue;
+        }
+
+        if(usage == 0)
+        {
+            continue;
+        }
+
+        /* Look for the key among those held */
+        for(k = 2; k < ATTR_LEN_HID_INPUT_REPORT && report[k] != usage; k++)
+        {
+        }
+
+        if(down && k == ATTR_LEN_HID_INPUT_REPORT)
+        {
+            /* Take the first free slot, if any */
+            for(k = 2; k < ATTR_LEN_HID_INPUT_REPORT && report[k] != 0; k++)
+            {
+            }
+
+            if(k < ATTR_LEN_HID_INPUT_REPORT)
+            {
+                report[k] = usage;
+            }
+        }
+        else if(!down && k < ATTR_LEN_HID_INPUT_REPORT)
+        {
+            /* Keep the keys still held in the first slots */
+            for(; k + 1 < ATTR_LEN_HID_INPUT_REPORT; k++)
+            {
+                report[k] = report[k + 1];
+            }
+            report[k] = 0;
+        }
+    }
+
+    if(!MemCmp(report, uart_keys_report, ATTR_LEN_HID_INPUT_REPORT))
+    {
+        /* The keys held have not changed */
+        return TRUE;
+    }
+
+    return AppSendReport(HID_INPUT_REPORT_ID, report,
+                         ATTR_LEN_HID_INPUT_REPORT);
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      AppSetConsumerKeys
+ *
+ *  DESCRIPTION
+ *      This function sets the consumer keys held over UART, replacing the
+ *      ones held before. They are reported together with the consumer keys
+ *      of the key matrix, and are released by setting no key.
+ *
+ *  RETURNS/MODIFIES
+ *      TRUE if the keys have been accepted, FALSE if there is no room for the
+ *      consumer report in the queue.
+ *
+ *----------------------------------------------------------------------------*/
+
+extern bool AppSetConsumerKeys(const uint16 *p_usages, uint16 count)
+{
+	if(!acceptUartKeyStrokes(1, 1))
+	{
+		return FALSE;
+	}
 	
-	input_report[LARGEST_REPORT_SIZE - 1] = 0x01;
-	FormulateReportsFromRaw(input_report);
+	if(SetConsumerKeys(p_usages, count))
+	{
+		handleNewKeyStrokes();
+	}
 	
-	if( HidSendInputReport(ucid,report_id,input_report) == TRUE )
+	return TRUE;
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      test
+ *
+ *  DESCRIPTION
+ *      This function types a character received over UART in plain text mode
+ *      and replies "OK" or "NG" once the passkey has been entered.
+ *
+ *  RETURNS/MODIFIES
+ *      Nothing.
+ *
+ *----------------------------------------------------------------------------*/
+
+extern void test(uint16* data)
+{
+	const uint8 *p_event_msg;
+	uint8        event_msg_len;
+	bool         passed = flgPassed;
+	bool         sent = AppTypeChar((uint8)(data[0] & 0x00FF));
+
+	if(passed != TRUE)
+	{
+		return;
+	}
+
+	if( sent == TRUE )
 	{
 		const uint8 event_msg[] = "OK";
 		p_event_msg = event_msg;
 		event_msg_len = (sizeof(event_msg) - 1)/sizeof(uint8);
-		BQForceQueueBytes(p_event_msg, event_msg_len);
+		UartQueueEcho(p_event_msg, event_msg_len);
 	}else{
 		const uint8 event_msg[] = "NG";
 		p_event_msg = event_msg;
 		event_msg_len = (sizeof(event_msg) - 1)/sizeof(uint8);
-		BQForceQueueBytes(p_event_msg, event_msg_len);
+		UartQueueEcho(p_event_msg, event_msg_len);
 	}
 }
 
@@ -89,8 +89,85 @@ typedef struct
     uint8 report_id;
     uint8 report[LARGEST_REPORT_SIZE];
 
+#ifdef KEY_LATENCY_STATS
+    /* Time at which the character of the key stroke was received over UART,
+     * or the key was pressed if it comes from the key matrix
+     */
+    uint32 rx_time;
+
+    /* Time at which the key stroke was queued */
+    uint32 queue_time;
+
+    /* Time at which the key stroke was first handed to the firmware, valid
+     * once 'handed_to_fw' is set
+     */
+    uint32 send_time;
+    bool   handed_to_fw;
+#endif /* KEY_LATENCY_STATS */
+
 } KEY_STROKE_T;
 
+/* String typed over UART waiting for its last key stroke to be sent */
+typedef struct
+{
+    /* ID given to the string by the host */
+    uint8 id;
+
+    /* Number of key strokes in the queue, from the oldest one up to the last
+     * one of the string
+     */
+    uint8 strokes;
+
+    /* Set once a key stroke of the string has left the queue without being
+     * sent
+     */
+    bool dropped;
+
+} TYPED_STRING_T;
+
+/* Policies applied when a key stroke is added to a full queue. The values are
+ * used over UART, so new policies must be added at the end.
+ */
+typedef enum
+{
+    key_queue_policy_reject = 0,    /* Hold back characters received over
+                                     * UART while the queue is nearly full.
+                                     * Key strokes which can not be held back
+                                     * are coalesced.
+                                     */
+    key_queue_policy_coalesce,      /* Drop intermediate press states but
+                                     * keep every release
+                                     */
+    key_queue_policy_overwrite,     /* Overwrite the oldest key stroke not
+                                     * handed to the firmware
+                                     */
+
+    key_queue_policy_count          /* Number of policies */
+
+} key_queue_policy;
+
+/* Counters kept by the queue overflow policies */
+typedef struct
+{
+    /* Characters and reports received over UART which have been held back */
+    uint16 rejected;
+
+    /* Key strokes dropped because they repeated the state of the previous key
+     * stroke with the same report ID. Nothing is lost by dropping these.
+     */
+    uint16 coalesced;
+
+    /* Intermediate press states dropped */
+    uint16 dropped;
+
+    /* Oldest key strokes overwritten */
+    uint16 overwritten;
+
+    /* Largest number of key strokes the queue has held */
+    uint16 high_water;
+
+} KEY_QUEUE_STATS_T;
+
 /* Circular queue for storing pending key strokes */
 typedef struct
 {
@@ -103,6 +180,15 @@ typedef struct
     /* Out-standing key strokes in the queue */
     uint8 num;
 
+    /* Policy applied when the queue is full */
+    key_queue_policy policy;
+
+    /* Set while characters received over UART are held back */
+    bool producer_held;
+
+    /* Key strokes dropped or held back since power on */
+    KEY_QUEUE_STATS_T stats;
+
 } CQUEUE_KEY_STROKE_T;
 
 typedef struct
@@ -133,6 +219,17 @@ typedef struct
      * update the connection parameters */
     uint8 conn_param_update_cnt;
 
+    /* The same counter for the burst connection parameters. It is kept for
+     * the whole connection, so a remote device which does not take them is
+     * not asked for them again on every burst of key strokes.
+     */
+    uint8 burst_param_update_cnt;
+
+    /* Boolean flag set if the last connection parameter update request was
+     * sent for the burst connection parameters
+     */
+    bool cpu_req_burst;
+
     /* Connection Parameter Update timer value. Upon a connection, it's started
      * for a period of TGAP_CPP_PERIOD, upon the expiry of which it's restarted
      * for TGAP_CPC_PERIOD. When this timer is running, if a GATT_ACCESS_IND is
@@ -208,6 +305,26 @@ typedef struct
      */
     bool waiting_for_fw_buffer;
 
+    /* Number of key strokes at the head of the queue which have been handed
+     * to the firmware and whose GATT_CHAR_VAL_NOT_CFM has not been received
+     * yet. They follow the 'tx_rejected' ones in the queue.
+     */
+    uint8 tx_in_flight;
+
+    /* Number of key strokes at the head of the queue which the firmware has
+     * rejected. They are sent again once the firmware has freed its buffers
+     * and no confirmations are outstanding, ahead of any other key stroke.
+     */
+    uint8 tx_rejected;
+
+    /* Number of notifications currently allowed in flight. It adapts between
+     * 1 and MAX_NOTIFICATIONS_IN_FLIGHT to what the firmware accepts.
+     */
+    uint8 tx_window;
+
+    /* Number of notifications accepted since 'tx_window' last changed */
+    uint8 tx_accepted_cnt;
+
     /* This timer will be used if the application is already bonded to the 
      * remote host address but the remote device wanted to rebond which we had 
      * declined. In this scenario, we give ample time to the remote device to 
@@ -224,6 +341,26 @@ typedef struct
 
     /*Variable to store the current connection timeout value. */
     uint16   conn_timeout;
+
+    /* Boolean flag set while the burst connection parameters are wanted
+     * rather than the preferred ones
+     */
+    bool     conn_params_burst;
+
+    /* Time at which the last connection parameter update request was sent,
+     * or the connection was established
+     */
+    uint32   cpu_req_time;
+
+#ifdef ADAPTIVE_CONN_PARAMS
+    /* Time of the last key stroke or UART activity */
+    uint32   last_activity_time;
+
+    /* Timer to request the preferred connection parameters again once the
+     * keyboard has been quiet for CONN_PARAMS_QUIET_PERIOD
+     */
+    timer_id conn_quiet_tid;
+#endif /* ADAPTIVE_CONN_PARAMS */
 	
     /* This timer will be used to send pending reports if any, after the
 	 * remote host has configured for notifications.
@@ -264,6 +401,29 @@ extern KBD_DATA_T g_kbd_data;
 #define SET_CQUEUE_INPUT_REPORT_ID(i, j) \
              (g_kbd_data.pending_key_strokes.key_stroke[(i)].report_id = (j))
 
+/* Largest number of key strokes queued for a character typed over UART. A
+ * key typed twice in a row needs a release before the press. One more key
+ * stroke is needed to release the last character typed.
+ */
+#define KEY_STROKES_PER_TYPED_CHAR          (2)
+
+/* Largest number of characters which can be typed at once under
+ * key_queue_policy_reject, all their key strokes having to fit in the empty
+ * queue. It is 14 for the default MAX_PENDING_KEY_STROKES of 30.
+ */
+#define MAX_TYPED_CHARS_AT_ONCE             ((MAX_PENDING_KEY_STROKES - 1) / \
+                                             KEY_STROKES_PER_TYPED_CHAR)
+
+/* Get the number of free entries in the queue */
+#define GET_CQUEUE_FREE_SLOTS() \
+             (MAX_PENDING_KEY_STROKES - g_kbd_data.pending_key_strokes.num)
+
+/* Get the policy applied when the queue is full */
+#define GET_CQUEUE_POLICY() (g_kbd_data.pending_key_strokes.policy)
+
+/* Get the pointer to the counters kept by the queue overflow policies */
+#define GET_CQUEUE_STATS_REF() (&g_kbd_data.pending_key_strokes.stats)
+
 /*=============================================================================*
  *  Public Function Prototypes
  *============================================================================*/
@@ -283,7 +443,7 @@ extern bool AppCheckNotificationStatus(void);
 extern void ProcessReport(uint8* raw_report);
 
 /* This function adds new reports to the application queue */
-extern void AddKeyStrokeToQueue(uint8 report_id, uint8 *report,
+extern bool AddKeyStrokeToQueue(uint8 report_id, uint8 *report,
                                 uint8 report_length);
 
 /* This function is used for changing the application state to disconnecting */
@@ -292,6 +452,50 @@ extern void SetStateDisconnect(void);
 /* This function deletes the bonding with the connected device */
 extern void HandleDeleteBonding(void);
 
+/* This function selects the policy applied when the queue is full */
+extern bool AppSetKeyQueuePolicy(uint16 policy);
+
+/* This function checks whether characters received over UART can be typed */
+extern bool AppAcceptTypedChars(uint8 n_chars);
+
+#ifdef ADAPTIVE_CONN_PARAMS
+/* This function is called when key strokes or UART data are to be sent */
+extern void AppConnParamsActivity(void);
+#endif /* ADAPTIVE_CONN_PARAMS */
+
+#ifdef ADAPTIVE_KEY_SCAN
+/* This function is called when a key press wakes the key scan up */
+extern void AppKeyScanWoken(void);
+#endif /* ADAPTIVE_KEY_SCAN */
+
+#ifdef KEY_LATENCY_STATS
+/* This function sets the time at which the characters being typed were
+ * received over UART
+ */
+extern void AppSetTypedCharRxTime(uint32 rx_time);
+#endif /* KEY_LATENCY_STATS */
+
+/* This function types a character received over UART */
+extern bool AppTypeChar(uint8 ch);
+
+/* This function releases the key left held down by AppTypeChar */
+extern void AppReleaseTypedKey(void);
+
+/* This function sets the consumer keys held over UART */
+extern bool AppSetConsumerKeys(const uint16 *p_usages, uint16 count);
+
+/* This function types a string received over UART and reports when its last
+ * key stroke has been sent
+ */
+extern bool AppTypeString(uint8 id, const uint8 *p_chars, uint8 n_chars);
+
+/* This function queues a report received over UART as it is */
+extern bool AppSendReport(uint8 report_id, const uint8 *p_report,
+                          uint8 report_length);
+
+/* This function presses or releases keys received over UART */
+extern bool AppSetUartKeys(const uint8 *p_usages, uint8 n_usages, bool down);
+
 extern void test(uint16* data);
 
 
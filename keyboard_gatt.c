@@ -59,6 +59,14 @@
 
 #endif /* __PROPRIETARY_HID_SUPPORT__ */
 
+#ifdef KEY_LATENCY_STATS
+
+#include "latency_service.h"
+
+#endif /* KEY_LATENCY_STATS */
+
+#include "key_map_service.h"
+
 /*=============================================================================*
  *  Private Definitions
  *============================================================================*/
@@ -479,6 +487,20 @@ static void handleAccessRead(GATT_ACCESS_IND_T *p_ind)
     {
         BondMgmtHandleAccessRead(p_ind);
     }
+
+#ifdef KEY_LATENCY_STATS
+
+    else if(LatencyCheckHandleRange(p_ind->handle))
+    {
+        LatencyHandleAccessRead(p_ind);
+    }
+
+#endif /* KEY_LATENCY_STATS */
+
+    else if(KeyMapCheckHandleRange(p_ind->handle))
+    {
+        KeyMapHandleAccessRead(p_ind);
+    }
     else
     {
         GattAccessRsp(p_ind->cid, p_ind->handle,
@@ -547,6 +569,10 @@ static void handleAccessWrite(GATT_ACCESS_IND_T *p_ind)
     {
         BondMgmtHandleAccessWrite(p_ind);
     }
+    else if(KeyMapCheckHandleRange(p_ind->handle))
+    {
+        KeyMapHandleAccessWrite(p_ind);
+    }
     else
     {
         GattAccessRsp(p_ind->cid, p_ind->handle,
@@ -20,6 +20,7 @@
 #include "app_gatt_db.h"
 #include "user_config.h"
 #include "keyboard.h"
+#include "key_map_service.h"
 
 #ifdef __PROPRIETARY_HID_SUPPORT__
 
@@ -49,39 +50,33 @@
 /* Maximum number of HID codes */
 #define HIDKEYS                           (6)
 
-/* Number of consumer keys supported by the keyboard application. */
-#define N_CONSUMER_KEYS                   (5)
+/* Number of consumer keys the key map can map keys of the key matrix to */
+#define N_CONSUMER_KEYS                   (24)
 
 /* Maximum number of scan codes possible for a given keyboard. */
 #define MAXMATRIX                         (ROWS * COLUMNS + 1)
 
-/* Maximum size of a look up table made to extract a different HID code based
- * on detection of a special scan code(FUNCTION_KEY here).
- */
-#define MAXHIDLUT                         (256)
-
 /* RAWKEYS are used to output the actual scan code in the HID report rather than
  * a HID value. This is used to find out what the mapping is for all the keys on
  * a new keyboard.
  */
 #ifndef RAWKEYS
 
-#define FUNCTION_KEY                      (0x8D)
-#define CONSUMER_KEYS_BASE                (0xF1)
+/* Usages of the key map from which the keys are consumer keys, up to 0xFF.
+ * The keyboard page reserves them.
+ */
+#define CONSUMER_KEYS_BASE                (0x100 - N_CONSUMER_KEYS)
 
-/* Maximum number of consumer keys that can be sent in one consumer report. */
-#define MAX_CONSUMER_KEYS                 (1)
+#endif /* RAWKEYS */
 
 /* If consumer reports with usage ID less than or equal to 0xFF from table 17 of
  * USB HID Usage tables 1.11 is supported, then this length can be reduced to 1.
  */ 
 #define ONE_CONSUMER_KEY_REPORT_SIZE      (2)
 
-#else
-
-#define FUNCTION_KEY                      (0x00)
-
-#endif /* RAWKEYS */
+#if CONSUMER_REPORT_SIZE != CONSUMER_REPORT_KEYS * ONE_CONSUMER_KEY_REPORT_SIZE
+#error "CONSUMER_REPORT_SIZE does not match CONSUMER_REPORT_KEYS"
+#endif
 
 /* De-bouncing timer for the pairing removal button */
 #define PAIRING_BUTTON_DEBOUNCE_TIME      (100 * MILLISECOND)
@@ -115,8 +110,95 @@
  * 'KEY_PRESS_DEBOUNCE_TIME' which is now 25 ms should be changed to 30 ms
  * (increased by 5 ms which is the time duration of one scan cycle).
  */
+#ifdef DEBOUNCE_EAGER_PRESS
+
+/* A key press is reported on the first scan cycle it is seen in, the key being
+ * moved from 'IDLE' straight to 'DOWN'. Only its release is debounced.
+ */
+#define N_SCAN_CYCLES_IN_DOWN_STATE       (DEBOUNCE_PRESS_LOCKOUT_SCANS)
+
+/* Number of scan cycles a key in the 'RELEASING' state has to be seen
+ * released in a row before it goes back to 'IDLE'.
+ */
+#define N_SCAN_CYCLES_IN_RELEASING_STATE  (DEBOUNCE_RELEASE_SCANS)
+
+#if (DEBOUNCE_PRESS_LOCKOUT_SCANS < 1) || (DEBOUNCE_RELEASE_SCANS < 1)
+#error "DEBOUNCE_EAGER_PRESS needs at least one scan cycle of each lockout"
+#endif
+
+/* The press lockout has to end before KEY_PRESS_DEBOUNCE_TIME, 5 scan cycles */
+#if (DEBOUNCE_PRESS_LOCKOUT_SCANS > 4)
+#error "DEBOUNCE_PRESS_LOCKOUT_SCANS must end before KEY_PRESS_DEBOUNCE_TIME"
+#endif
+
+#else
+
 #define N_SCAN_CYCLES_IN_DOWN_STATE       (3)
 
+/* A key in the 'RELEASING' state goes back to 'IDLE' as soon as it is seen
+ * released.
+ */
+#define N_SCAN_CYCLES_IN_RELEASING_STATE  (1)
+
+#endif /* DEBOUNCE_EAGER_PRESS */
+
+/* Once a change of the keys has settled, the PIO controller raises no more
+ * events for it, so each key has to be through the 'PRESSING' and 'DOWN'
+ * states, or through the 'DOWN' and 'RELEASING' states, within the scans it
+ * raises events for after the change. One more scan is needed to stop the
+ * debounce timer once no key is left in the 'DOWN' state, or it would expire
+ * and release the keys held.
+ */
+#if (N_SCAN_CYCLES_IN_PRESSING_STATE + N_SCAN_CYCLES_IN_DOWN_STATE >= \
+     PIO_CTRLR_SETTLE_SCANS) || \
+    (N_SCAN_CYCLES_IN_DOWN_STATE + N_SCAN_CYCLES_IN_RELEASING_STATE >= \
+     PIO_CTRLR_SETTLE_SCANS)
+#error "The debouncing must complete within PIO_CTRLR_SETTLE_SCANS scans"
+#endif
+
+/* The PIO controller stops raising events once it has scanned the matrix with
+ * no key pressed, so a key release still being debounced then is completed by
+ * the expiry of the key release timer. It is restarted with this time on every
+ * scan cycle leaving a key release to be confirmed.
+ */
+#define KEY_RELEASE_DEBOUNCE_TIME         (N_SCAN_CYCLES_IN_RELEASING_STATE * \
+                                           KEY_SCAN_CYCLE_TIME)
+
+#ifdef DEBOUNCE_BIT_PARALLEL
+
+/* The bit parallel engine keeps the scan cycle count less one in two bit
+ * planes, so it can count up to 4 scan cycles in a state.
+ */
+#if (N_SCAN_CYCLES_IN_PRESSING_STATE > 4) || \
+    (N_SCAN_CYCLES_IN_DOWN_STATE > 4) || (N_SCAN_CYCLES_IN_RELEASING_STATE > 4)
+#error "DEBOUNCE_BIT_PARALLEL counts at most 4 scan cycles in a state"
+#endif
+
+/* Mask of the keys of a row whose count, held in the bit planes 'lo' and 'hi',
+ * has reached 'n' scan cycles
+ */
+#define COUNT_REACHED(lo, hi, n)  ((((n) - 1) & 0x01 ? (lo) : ~(lo)) & \
+                                   (((n) - 1) & 0x02 ? (hi) : ~(hi)))
+
+#endif /* DEBOUNCE_BIT_PARALLEL */
+
+#ifdef NKRO_SUPPORT
+
+/* Number of words of the bitmap of pressed keys, one bit for each of the 256
+ * keyboard usages
+ */
+#define NKRO_BITMAP_WORDS                 (256 / 16)
+
+/* The modifier usages 0xE0 to 0xE7 are the low byte of this word of the
+ * bitmap
+ */
+#define NKRO_MODIFIER_WORD                (0xE0 / 16)
+
+/* Lowest keyboard usage of a key, below which are the error codes */
+#define NKRO_MIN_USAGE                    (0x04)
+
+#endif /* NKRO_SUPPORT */
+
 /*=============================================================================*
  *  Private Data Types
  *============================================================================*/
@@ -129,11 +211,14 @@ typedef struct
     /* Last report formed by ProcessKeyPress() from the raw data received from
      * the PIO controller shared memory.
      */
-    uint8 last_report[LARGEST_REPORT_SIZE];
+    uint8 last_report[RAW_REPORT_SIZE];
 
      /* Different types of reports formed from the last raw_report */
     uint8 last_input_report[ATTR_LEN_HID_INPUT_REPORT];
     uint8 last_consumer_report[ATTR_LEN_HID_CONSUMER_REPORT];
+#ifdef NKRO_SUPPORT
+    uint8 last_nkro_report[ATTR_LEN_HID_NKRO_REPORT];
+#endif /* NKRO_SUPPORT */
 }LAST_REPORTS_T;
 
 /* Key press debounce structure which holds the key press state and tmaintains 
@@ -145,6 +230,24 @@ typedef struct
     uint8 count:8;
 } debounce;
 
+#ifdef DEBOUNCE_BIT_PARALLEL
+
+/* Debounce state of the keys of one row, as bit planes with one bit per
+ * column. The state of a key is (state_hi, state_lo), taking the values of the
+ * key press states, and its count less one is (count_hi, count_lo). This lets
+ * all the keys of a row be stepped through the state machine of
+ * handleDebounceKey() at once.
+ */
+typedef struct
+{
+    uint8 state_lo;
+    uint8 state_hi;
+    uint8 count_lo;
+    uint8 count_hi;
+} debounce_row;
+
+#endif /* DEBOUNCE_BIT_PARALLEL */
+
 /*=============================================================================*
  *  Private Data
  *============================================================================*/
@@ -158,89 +261,144 @@ LAST_REPORTS_T last_generated_reports;
  */
 timer_id pairing_removal_tid;
 
+#ifdef DEBOUNCE_BIT_PARALLEL
+
+/* Debounce state of each row of the keyboard */
+debounce_row debounce_rows[ROWS];
+
+/* Set when a key is in the 'DOWN' or 'RELEASING' state */
+static bool debounce_keys_held = FALSE;
+
+/* Set when a key is in the 'PRESSING' state */
+static bool debounce_keys_pressing = FALSE;
+
+#else
+
 /* Debounce structure for each scan code for the keyboard */
 debounce debounce_keys[MAXMATRIX];
 
+#endif /* DEBOUNCE_BIT_PARALLEL */
+
 /* Timer to hold the debouncing timer for the keys of the keyboard */
 static timer_id debounce_reset_timer_id = TIMER_INVALID;
 
-#ifndef RAWKEYS
+/* Timer completing the key releases still being debounced when the scans
+ * stop. It is kept apart from 'debounce_reset_timer_id' so that it leaves the
+ * keys in the 'DOWN' state alone.
+ */
+static timer_id debounce_release_timer_id = TIMER_INVALID;
 
-/* USB HID codes */
-static uint8 KEYBOARDKEYMATRIX[MAXMATRIX] = {
-/*0     1     2     3     4    5      6     7     8     9    0A    0B    0C    0D    0E    0F*/
-0x00, 0x00, 0x4A, 0x4B, 0x4E, 0x00, 0x4D, 0x51, 0x00, 0xE6, 0x4D, 0x5A, 0x42, 0x58, 0x72, 0x14, /* 00-0F */
-0x00, 0xE4, 0xA1, 0x00, 0x7B, 0x00, 0x00, 0x00, 0x00, 0x4C, 0x49, 0x2A, 0x52, 0x00, 0x4F, 0x65, /* 10-1F */
-0x00, 0x46, 0x31, 0x28, 0x73, 0x00, 0x50, 0x36, 0x10, 0x53, 0x30, 0x00, 0x34, 0x33, 0x38, 0x37, /* 20-2F */
-0x00, 0x45, 0x2E, 0xA3, 0x0E, 0x0F, 0x2C, 0x00, 0x11, 0x44, 0x43, 0x27, 0x2D, 0x13, 0x2F, 0x0D, /* 30-3F */
-0x0B, 0x42, 0x41, 0x25, 0x26, 0x0C, 0x12, 0x00, 0x05, 0x40, 0x3F, 0x23, 0x24, 0x18, 0x1C, 0x0A, /* 40-4F */
-0x00, 0x3E, 0x21, 0x22, 0x15, 0x17, 0x07, 0x09, 0x1B, 0x3D, 0x3C, 0x20, 0x1A, 0x08, 0x16, 0x1D, /* 50-5F */
-0x19, 0x3B, 0x3A, 0x1E, 0x1F, 0x14, 0x04, 0x08, 0x06, 0x00, 0xE1, 0x23, 0xE5, 0x6A, 0x22, 0x00, /* 60-6F */
-0x00, 0x00, 0xE0, 0x26, 0x00, 0x00, 0x00, 0x00, 0x00, 0x50, 0xE3, 0x24, 0x56, 0x6D, 0x21, 0x4E, /* 70-7F */
-0x00, 0x6B, 0xE2, 0x00, 0x37, 0x00, 0x00, 0x00, 0x00, 0x29, 0x32, 0x35, 0x39, 0x60, 0x2B, 0x28, /* 80-8F */
-0x00                                                                                            /* 90    */
-};
+#ifdef NKRO_SUPPORT
 
-/* Map Function key USB HID codes to the actual function keys used 
- *
- * Mapped combinations:
- *      Fn + F3 = Mute                  -> 0xF1
- *      Fn + F4 = Volume Down           -> 0xF2
- *      Fn + F5 = Volume Up             -> 0xF3
- *      Fn + F6 = Home Page             -> 0xF4
- *      Fn + F7 = Outlook(Mail Reader)  -> 0xF5
+/* Bitmap of the keyboard usages of the keys held down. It is updated from the
+ * keys which changed since the last scan, held in 'nkro_rows'.
  */
-/* If more consumer keys are to be added, place the next codes - 0xF6, 0xF7 and
- * so on at appropriate positions in this array.
+static uint16 nkro_keys[NKRO_BITMAP_WORDS];
+
+/* Keys of each row the bitmap was last updated with */
+static uint8 nkro_rows[ROWS];
+
+/* Overlay layers switched on, and version of the key map, when the bitmap
+ * was last updated
  */
-static uint8 HIDLUT[MAXHIDLUT] = {
-0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x5D, 0x59, 0x5A, 0x5B, /* 00 - 0F */
-0x62, 0x11, 0x5E, 0x56, 0x14, 0x15, 0x16, 0x17, 0x5C, 0x19, 0x1A, 0x1B, 0x1C, 0x1D, 0x1E, 0x1F, /* 10 - 1F */
-0x20, 0x21, 0x22, 0x23, 0x5F, 0x60, 0x61, 0x55, 0x28, 0x29, 0x2A, 0x2B, 0x2C, 0x2D, 0x2E, 0x2F, /* 20 - 2F */
-0x30, 0x31, 0x32, 0x57, 0x34, 0x35, 0x36, 0x63, 0x54, 0x39, 0x3A, 0x3B, 0xF1, 0xF2, 0xF3, 0xF4, /* 30 - 3F */
-0xF5, 0x41, 0x42, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x48, 0x4A, 0x4B, 0x4C, 0x4D, 0x4E, 0x4F, /* 40 - 4F */
-0x50, 0x51, 0x52, 0x47, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5A, 0x5B, 0x5C, 0x5D, 0x5E, 0x5F, /* 50 - 5F */
-0x60, 0x61, 0x62, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6A, 0x6B, 0x6C, 0x6D, 0x6E, 0x6F, /* 60 - 6F */
-0x70, 0x71, 0x72, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7A, 0x7B, 0x7C, 0x7D, 0x7E, 0xF1, /* 70 - 7F */
-0xF2, 0xF3, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89, 0x8A, 0x8B, 0x8C, 0x8D, 0x8E, 0x8F, /* 80 - 8F */
-0x90, 0x91, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9A, 0x9B, 0x9C, 0x9D, 0x9E, 0x9F, /* 90 - 9F */
-0xA0, 0xA1, 0xA2, 0xA3, 0xA4, 0xA5, 0xA6, 0xA7, 0xA8, 0xA9, 0xAA, 0xAB, 0xAC, 0xAD, 0xAE, 0xAF, /* A0 - AF */
-0xB0, 0xB1, 0xB2, 0xB3, 0xB4, 0xB5, 0xB6, 0xB7, 0xB8, 0xB9, 0x00, 0x00, 0xBC, 0xBD, 0xBE, 0x00, /* B0 - BF */
-0xC0, 0xC1, 0xC2, 0xC3, 0xC4, 0xC5, 0xC6, 0xC7, 0xC8, 0xC9, 0xCA, 0xCB, 0xCC, 0xCD, 0xCE, 0xCF, /* C0 - CF */
-0xD0, 0xD1, 0xD2, 0xD3, 0xD4, 0xD5, 0xD6, 0xD7, 0xD8, 0xD9, 0xDA, 0xDB, 0xDC, 0xDD, 0xDE, 0xDF, /* D0 - DF */
-0xE0, 0xE1, 0xE2, 0xE3, 0xE4, 0xE5, 0xE6, 0xE7, 0xE8, 0xE9, 0xEA, 0xEB, 0xEC, 0xED, 0xEE, 0xEF, /* E0 - EF */
-0xF0, 0xF1, 0xF2, 0xF3, 0xF4, 0xF5, 0xF6, 0xF7, 0xF8, 0xF9, 0xFA, 0xFB, 0xFC, 0xFD, 0xFE, 0xFF, /* F0 - FF */
-};
+static uint16 nkro_layers = 0;
+static uint16 nkro_key_map_version = 0;
+
+#endif /* NKRO_SUPPORT */
+
+#ifdef ADAPTIVE_KEY_SCAN
+
+/* Scan profile word in the shared memory of the PIO controller, known from
+ * the first scan handled
+ */
+static uint16 *p_key_scan_profile = NULL;
+
+/* Timer lowering the scan rate, and then stopping the scan, while no key is
+ * held
+ */
+static timer_id key_scan_tid = TIMER_INVALID;
+
+/* Set while the PIO controller is stopped until a key is pressed */
+static bool key_scan_sleeping = FALSE;
+
+#endif /* ADAPTIVE_KEY_SCAN */
+
+#ifndef RAWKEYS
 
 /* The array from which the consumer keys are picked and populated to the
- * consumer report array. These values are the Usage IDs Table 17: Consumer
- * usage page of USB HID usage table 1.1.
- *
- * Value from HIDLUT         Corresponding consumer key
- *      F1                          MUTE
- *      F2                          VOLUME DOWN
- *      F3                          VOLUME UP
- *      F4                          HOME PAGE
- *      F5                          EMAIL READER
+ * consumer report array, indexed by the usage from the key map less
+ * CONSUMER_KEYS_BASE. These values are the Usage IDs Table 17: Consumer
+ * usage page of USB HID usage table 1.1. Any other usage of the page can be
+ * set over UART.
  */
-static uint16 CONSUMERKEYS[N_CONSUMER_KEYS] = {
-              0x00E2, /* Mute */
-              0x00EA, /* Volume down */
-              0x00E9, /* Volume Up */
-              0x0223, /* AC Home Page */
-              0x018A  /* AL Email Reader */
+static const uint16 CONSUMERKEYS[N_CONSUMER_KEYS] = {
+              0x00CD, /* E8 Play/Pause */
+              0x00B5, /* E9 Scan Next Track */
+              0x00B6, /* EA Scan Previous Track */
+              0x00B7, /* EB Stop */
+              0x00B3, /* EC Fast Forward */
+              0x00B4, /* ED Rewind */
+              0x00B8, /* EE Eject */
+              0x006F, /* EF Display Brightness Increment */
+              0x0070, /* F0 Display Brightness Decrement */
+              0x00E2, /* F1 Mute */
+              0x00EA, /* F2 Volume down */
+              0x00E9, /* F3 Volume Up */
+              0x0223, /* F4 AC Home Page */
+              0x018A, /* F5 AL Email Reader */
+              0x0192, /* F6 AL Calculator */
+              0x0194, /* F7 AL Local Machine Browser */
+              0x0196, /* F8 AL Internet Browser */
+              0x0221, /* F9 AC Search */
+              0x0224, /* FA AC Back */
+              0x0225, /* FB AC Forward */
+              0x0227, /* FC AC Refresh */
+              0x022A, /* FD AC Bookmarks */
+              0x0183, /* FE AL Consumer Control Configuration */
+              0x019E  /* FF AL Terminal Lock/Screensaver */
 };
 
 #endif /* !RAWKEYS */
 
+/* Consumer keys held as set by SetConsumerKeys() */
+static uint16 held_consumer_keys[CONSUMER_REPORT_KEYS];
+static uint16 n_held_consumer_keys = 0;
+
 /*=============================================================================*
  *  Private Function Prototypes
  *============================================================================*/
 
 void pio_ctrlr_code(void);  /* Included externally in PIO controller code.*/
 static void handlePairPioStatusChange(timer_id tid);
-static bool handleDebounceKey(bool key,uint8 scan_code, bool* press_to_down, bool* is_in_down);
+#ifdef DEBOUNCE_BIT_PARALLEL
+static uint8 handleDebounceRow(uint8 keys, debounce_row *p_row,
+                               bool *press_to_down, bool *is_in_down,
+                               bool *release_pending);
+#else
+static bool handleDebounceKey(bool key,uint8 scan_code, bool* press_to_down, bool* is_in_down,
+                              bool* release_pending);
+#endif /* DEBOUNCE_BIT_PARALLEL */
 static void debounceResetTimer(timer_id tid);
+static void restartDebounceTimer(uint32 duration);
+static void debounceReleaseTimer(timer_id tid);
+static void restartReleaseTimer(uint32 duration);
+static uint8 debouncedKeys(uint16 row);
+static void resetDebounceState(void);
+static void completeKeyReleases(void);
+static void addConsumerKey(uint8 *consumer_report, uint16 usage);
+#ifdef NKRO_SUPPORT
+static uint8 nkroUsage(uint8 scan_code, uint16 layers);
+static bool isNkroUsageHeld(const uint8 *rows, uint8 usage, uint16 layers);
+static bool updateNkroKeys(const uint8 *rows, uint16 layers);
+static void resetNkroKeys(void);
+static void formNkroReport(uint8 *nkro_report);
+#endif /* NKRO_SUPPORT */
+#ifdef ADAPTIVE_KEY_SCAN
+static void restartKeyScanTimer(uint32 duration);
+static void handleKeyScanIdle(timer_id tid);
+static void sleepKeyScan(void);
+static void wakeKeyScan(void);
+#endif /* ADAPTIVE_KEY_SCAN */
 
 
 /*=============================================================================*
@@ -295,6 +453,8 @@ static void handlePairPioStatusChange(timer_id tid)
     } /* Else ignore the function call as it may be due to a race condition */
 }
  
+#ifndef DEBOUNCE_BIT_PARALLEL
+
 /*-----------------------------------------------------------------------------*
  *  NAME
  *      handleDebounceKey
@@ -308,7 +468,8 @@ static void handlePairPioStatusChange(timer_id tid)
  *
  *----------------------------------------------------------------------------*/
 
-static bool handleDebounceKey(bool key,uint8 scan_code, bool* press_to_down, bool* is_in_down)
+static bool handleDebounceKey(bool key,uint8 scan_code, bool* press_to_down, bool* is_in_down,
+                              bool* release_pending)
 {
     bool out_key = FALSE;
     
@@ -317,12 +478,25 @@ static bool handleDebounceKey(bool key,uint8 scan_code, bool* press_to_down, boo
     {
         case IDLE:
         {
+#ifdef DEBOUNCE_EAGER_PRESS
+            /* Report a key press straight away and lock the key in the
+             * 'DOWN' state to ignore its bouncing
+             */
+            if(key)
+            {
+                debounce_keys[scan_code].state = DOWN;
+                debounce_keys[scan_code].count = 1;
+                out_key = TRUE;
+                *press_to_down = TRUE;
+            }
+#else
             /* If a key press is detected, move the state to 'PRESSING' */
             if(key)
             {
                 debounce_keys[scan_code].state = PRESSING;
                 debounce_keys[scan_code].count = 1;
             }
+#endif /* DEBOUNCE_EAGER_PRESS */
         }
         break;
         
@@ -380,53 +554,704 @@ static bool handleDebounceKey(bool key,uint8 scan_code, bool* press_to_down, boo
         case RELEASING:
         {
             /* If a key press is received in this state, stay in the same state.
-             * Upon receiving a key release, move back to 'IDLE' state
+             * Upon receiving key releases for N_SCAN_CYCLES_IN_RELEASING_STATE
+             * continuous scan cycles, move back to 'IDLE' state
              */
             if(key)
             {
                 out_key = TRUE;
+                debounce_keys[scan_code].count = 1;
             }
-            else  /* key up */
+            else if(debounce_keys[scan_code].count++ >=
+                                            N_SCAN_CYCLES_IN_RELEASING_STATE)
             {
                 debounce_keys[scan_code].state = IDLE;
                 debounce_keys[scan_code].count = 1;
             }
+            else  /* key up, not for long enough yet */
+            {
+                out_key = TRUE;
+                *release_pending = TRUE;
+            }
         }
         break;
     }
 
-    return(out_key);
-}
+    return(out_key);
+}
+
+#else
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      handleDebounceRow
+ *
+ *  DESCRIPTION
+ *      This function handles debouncing for all the keys of a row at once. It
+ *      makes the same transitions as handleDebounceKey() does for each key,
+ *      worked out on the bit planes of the row with one bit per column.
+ *
+ *  RETURNS
+ *      The keys of the row seen as pressed
+ *
+ *----------------------------------------------------------------------------*/
+
+static uint8 handleDebounceRow(uint8 keys, debounce_row *p_row,
+                               bool *press_to_down, bool *is_in_down,
+                               bool *release_pending)
+{
+    const uint8 idle      = ~p_row->state_hi & ~p_row->state_lo;
+    const uint8 pressing  = ~p_row->state_hi &  p_row->state_lo;
+    const uint8 down      =  p_row->state_hi & ~p_row->state_lo;
+    const uint8 releasing =  p_row->state_hi &  p_row->state_lo;
+
+#ifdef DEBOUNCE_EAGER_PRESS
+    /* Key presses go from 'IDLE' straight to 'DOWN' */
+    const uint8 to_pressing = 0;
+    const uint8 to_down = idle & keys;
+#else
+    const uint8 to_pressing = idle & keys;
+    const uint8 to_down = pressing & keys &
+                 COUNT_REACHED(p_row->count_lo, p_row->count_hi,
+                               N_SCAN_CYCLES_IN_PRESSING_STATE);
+#endif /* DEBOUNCE_EAGER_PRESS */
+    const uint8 to_releasing = down &
+                 COUNT_REACHED(p_row->count_lo, p_row->count_hi,
+                               N_SCAN_CYCLES_IN_DOWN_STATE);
+    const uint8 released = releasing & ~keys &
+                 COUNT_REACHED(p_row->count_lo, p_row->count_hi,
+                               N_SCAN_CYCLES_IN_RELEASING_STATE);
+    const uint8 releases_pending = releasing & ~keys & ~released;
+
+    /* Keys staying in 'PRESSING' or 'DOWN', or seen released again in
+     * 'RELEASING', count one more scan cycle. Keys entering a state, or seen
+     * pressed in 'RELEASING', start counting again.
+     */
+    const uint8 count_up = (pressing & keys & ~to_down) |
+                           (down & ~to_releasing) | releases_pending;
+    const uint8 count_restart = to_pressing | to_down | to_releasing |
+                                (releasing & keys) | released;
+
+    /* New states, the 'PRESSING' and 'RELEASING' keys having state_lo set and
+     * the 'DOWN' and 'RELEASING' keys having state_hi set. Keys released in
+     * 'PRESSING', or for long enough in 'RELEASING', go back to 'IDLE'.
+     */
+    p_row->state_lo = to_pressing | (pressing & keys & ~to_down) |
+                      to_releasing | (releasing & ~released);
+    p_row->state_hi = to_down | down | (releasing & ~released);
+
+    p_row->count_hi = (p_row->count_hi ^ (p_row->count_lo & count_up)) &
+                      ~count_restart;
+    p_row->count_lo = (p_row->count_lo ^ count_up) & ~count_restart;
+
+    if(to_down)
+    {
+        *press_to_down = TRUE;
+    }
+
+    if(down)
+    {
+        *is_in_down = TRUE;
+    }
+
+    if(releases_pending)
+    {
+        *release_pending = TRUE;
+    }
+
+    return to_down | down | (releasing & ~released);
+}
+
+#endif /* DEBOUNCE_BIT_PARALLEL */
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      debouncedKeys
+ *
+ *  DESCRIPTION
+ *      This function returns the keys of a row which were passed on as
+ *      pressed by the last call to DebounceFX(), those in the 'DOWN' or
+ *      'RELEASING' state
+ *
+ *  RETURNS
+ *      The keys of the row, one bit per column
+ *
+ *----------------------------------------------------------------------------*/
+
+static uint8 debouncedKeys(uint16 row)
+{
+#ifdef DEBOUNCE_BIT_PARALLEL
+    return debounce_rows[row].state_hi;
+#else
+    const debounce *p_key = &debounce_keys[1 + row * COLUMNS];
+    uint8 keys = 0;
+    uint16 c;
+
+    for (c = 0; c < COLUMNS; c++)
+    {
+        if (p_key[c].state >= DOWN)
+        {
+            keys |= 1 << c;
+        }
+    }
+
+    return keys;
+#endif /* DEBOUNCE_BIT_PARALLEL */
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      resetDebounceState
+ *
+ *  DESCRIPTION
+ *      This function brings all the keys back to the 'IDLE' state
+ *
+ *  RETURNS
+ *      Nothing
+ *
+ *----------------------------------------------------------------------------*/
+
+static void resetDebounceState(void)
+{
+#ifdef DEBOUNCE_BIT_PARALLEL
+    MemSet(debounce_rows, 0, sizeof(debounce_rows));
+    debounce_keys_held = FALSE;
+    debounce_keys_pressing = FALSE;
+#else
+    MemSet(debounce_keys, 0, sizeof(debounce_keys));
+#endif /* DEBOUNCE_BIT_PARALLEL */
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      completeKeyReleases
+ *
+ *  DESCRIPTION
+ *      This function brings the keys in the 'RELEASING' state back to the
+ *      'IDLE' state, leaving the other keys in the state they are in
+ *
+ *  RETURNS
+ *      Nothing
+ *
+ *----------------------------------------------------------------------------*/
+
+static void completeKeyReleases(void)
+{
+#ifdef DEBOUNCE_BIT_PARALLEL
+    uint8 releasing;
+    uint8 held = 0;
+    uint16 i;
+
+    for (i = 0; i < ROWS; i++)
+    {
+        releasing = debounce_rows[i].state_hi & debounce_rows[i].state_lo;
+
+        debounce_rows[i].state_lo &= ~releasing;
+        debounce_rows[i].state_hi &= ~releasing;
+        debounce_rows[i].count_lo &= ~releasing;
+        debounce_rows[i].count_hi &= ~releasing;
+
+        held |= debounce_rows[i].state_hi;
+    }
+
+    debounce_keys_held = (held != 0);
+#else
+    uint16 i;
+
+    for (i = 0; i < MAXMATRIX; i++)
+    {
+        if (debounce_keys[i].state == RELEASING)
+        {
+            debounce_keys[i].state = IDLE;
+            debounce_keys[i].count = 1;
+        }
+    }
+#endif /* DEBOUNCE_BIT_PARALLEL */
+}
+
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      addConsumerKey
+ *
+ *  DESCRIPTION
+ *      This function adds a consumer key to the first free slot of a consumer
+ *      report, unless it is already in the report. It is dropped when the
+ *      report is full.
+ *
+ *  RETURNS
+ *      Nothing
+ *
+ *----------------------------------------------------------------------------*/
+
+static void addConsumerKey(uint8 *consumer_report, uint16 usage)
+{
+    uint16 slot;
+    uint16 slot_usage;
+
+    for(slot = 0; slot < ATTR_LEN_HID_CONSUMER_REPORT;
+        slot += ONE_CONSUMER_KEY_REPORT_SIZE)
+    {
+        slot_usage = consumer_report[slot] | (consumer_report[slot + 1] << 8);
+
+        if(slot_usage == usage)
+        {
+            return;
+        }
+
+        if(slot_usage == 0)
+        {
+            consumer_report[slot] = usage & 0xFF;
+            consumer_report[slot + 1] = (usage >> 8) & 0xFF;
+            return;
+        }
+    }
+}
+
+#ifdef NKRO_SUPPORT
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      nkroUsage
+ *
+ *  DESCRIPTION
+ *      This function looks up the keyboard usage a key is reported with in the
+ *      N-key rollover report, in the same way as ProcessKeyPress() does
+ *
+ *  RETURNS
+ *      The keyboard usage of the key, or 0 if it is not reported in the N-key
+ *      rollover report: the layer keys and the consumer keys.
+ *
+ *----------------------------------------------------------------------------*/
+
+static uint8 nkroUsage(uint8 scan_code, uint16 layers)
+{
+    uint16 hid_code;
+
+#ifdef RAWKEYS
+
+    hid_code = scan_code; /* raw scan code */
+
+#else
+
+    hid_code = KeyMapLookup(scan_code, layers);
+
+    if (hid_code == KEY_MAP_LAYER_KEY || hid_code >= CONSUMER_KEYS_BASE)
+    {
+        return 0;
+    }
+
+#endif /* RAWKEYS */
+
+    return (hid_code >= NKRO_MIN_USAGE) ? hid_code : 0;
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      isNkroUsageHeld
+ *
+ *  DESCRIPTION
+ *      This function checks whether any key held down in 'rows' is reported
+ *      with the keyboard usage 'usage'. More than one key of the key matrix
+ *      can share a usage.
+ *
+ *  RETURNS
+ *      TRUE if a key held down has the usage
+ *
+ *----------------------------------------------------------------------------*/
+
+static bool isNkroUsageHeld(const uint8 *rows, uint8 usage, uint16 layers)
+{
+    uint16 i;
+    uint16 j;
+    uint8  row;
+
+    for (i = 0; i < ROWS; i++)
+    {
+        for (row = rows[i], j = 0; row; row >>= 1, j++)
+        {
+            if ((row & 0x01) &&
+                nkroUsage(1 + i * COLUMNS + j, layers) == usage)
+            {
+                return TRUE;
+            }
+        }
+    }
+
+    return FALSE;
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      updateNkroKeys
+ *
+ *  DESCRIPTION
+ *      This function updates the bitmap of the keyboard usages held down with
+ *      the keys which were pressed or released since it was last updated.
+ *      When a layer key is pressed or released, or the key map changes, the
+ *      usages of the other keys change, and the bitmap is built again from all
+ *      the keys held.
+ *
+ *  RETURNS
+ *      TRUE if the bitmap may have changed
+ *
+ *----------------------------------------------------------------------------*/
+
+static bool updateNkroKeys(const uint8 *rows, uint16 layers)
+{
+    uint16 i;
+    uint16 j;
+    uint8  changed_keys;
+    uint8  usage;
+    bool   updated = FALSE;
+
+    if (layers != nkro_layers || KeyMapGetVersion() != nkro_key_map_version)
+    {
+        resetNkroKeys();
+        nkro_layers = layers;
+        nkro_key_map_version = KeyMapGetVersion();
+        updated = TRUE;
+    }
+
+    for (i = 0; i < ROWS; i++)
+    {
+        changed_keys = rows[i] ^ nkro_rows[i];
+
+        if (!changed_keys)
+        {
+            continue;
+        }
+
+        nkro_rows[i] = rows[i];
+
+        for (j = 0; changed_keys; changed_keys >>= 1, j++)
+        {
+            if (!(changed_keys & 0x01))
+            {
+                continue;
+            }
+
+            usage = nkroUsage(1 + i * COLUMNS + j, layers);
+
+            if (!usage)
+            {
+                continue;
+            }
+
+            if (rows[i] & (1 << j))
+            {
+                nkro_keys[usage >> 4] |= 1 << (usage & 0x0F);
+            }
+            else if (!isNkroUsageHeld(rows, usage, layers))
+            {
+                nkro_keys[usage >> 4] &= ~(1 << (usage & 0x0F));
+            }
+
+            updated = TRUE;
+        }
+    }
+
+    return updated;
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      resetNkroKeys
+ *
+ *  DESCRIPTION
+ *      This function clears the bitmap of the keyboard usages held down
+ *
+ *  RETURNS
+ *      Nothing
+ *
+ *----------------------------------------------------------------------------*/
+
+static void resetNkroKeys(void)
+{
+    MemSet(nkro_keys, 0, sizeof(nkro_keys));
+    MemSet(nkro_rows, 0, sizeof(nkro_rows));
+    nkro_layers = 0;
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      formNkroReport
+ *
+ *  DESCRIPTION
+ *      This function forms the N-key rollover report from the bitmap of the
+ *      keyboard usages held down: the modifier byte followed by the bits of
+ *      the usages 0x00 to NKRO_MAX_USAGE, eight to a byte
+ *
+ *  RETURNS
+ *      Nothing
+ *
+ *----------------------------------------------------------------------------*/
+
+static void formNkroReport(uint8 *nkro_report)
+{
+    uint16 i;
+
+    nkro_report[0] = nkro_keys[NKRO_MODIFIER_WORD] & 0xFF;
+
+    for (i = 0; i < ATTR_LEN_HID_NKRO_REPORT - 1; i++)
+    {
+        nkro_report[i + 1] = (nkro_keys[i >> 1] >> ((i & 0x01) * 8)) & 0xFF;
+    }
+}
+#endif /* NKRO_SUPPORT */
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      debounceResetTimer
+ *
+ *  DESCRIPTION
+ *      This function handles expiry of debounce timer
+ *
+ *  RETURNS
+ *      Nothing
+ *
+ *----------------------------------------------------------------------------*/
+
+static void debounceResetTimer(timer_id tid)
+{
+    uint8  raw_report[RAW_REPORT_SIZE];
+
+    if (debounce_reset_timer_id == tid)
+    {
+        debounce_reset_timer_id = TIMER_INVALID;
+
+        /* No release is left to complete once all the keys are reset */
+        if(debounce_release_timer_id != TIMER_INVALID)
+        {
+            TimerDelete(debounce_release_timer_id);
+            debounce_release_timer_id = TIMER_INVALID;
+        }
+        
+        /* Reset the keys to IDLE state and send the zeroed HID report */
+        resetDebounceState();
+#ifdef NKRO_SUPPORT
+        resetNkroKeys();
+#endif /* NKRO_SUPPORT */
+
+        MemSet(raw_report, 0, sizeof(raw_report));
+        ProcessReport(raw_report);
+    }
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      restartDebounceTimer
+ *
+ *  DESCRIPTION
+ *      This function (re)starts the debounce timer, on the expiry of which
+ *      all the keys are brought back to the 'IDLE' state
+ *
+ *  RETURNS
+ *      Nothing
+ *
+ *----------------------------------------------------------------------------*/
+
+static void restartDebounceTimer(uint32 duration)
+{
+    if(debounce_reset_timer_id != TIMER_INVALID)
+    {
+        TimerDelete(debounce_reset_timer_id);
+    }
+
+    debounce_reset_timer_id = TimerCreate(duration, TRUE,
+                                          debounceResetTimer);
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      debounceReleaseTimer
+ *
+ *  DESCRIPTION
+ *      This function handles expiry of the key release timer. The keys in
+ *      the 'RELEASING' state go back to 'IDLE' and the report is formed again
+ *      from the keys still held, so a key in the 'DOWN' state stays pressed.
+ *
+ *  RETURNS
+ *      Nothing
+ *
+ *----------------------------------------------------------------------------*/
+
+static void debounceReleaseTimer(timer_id tid)
+{
+    uint8  raw_report[RAW_REPORT_SIZE];
+    uint8  rows[ROWS];
+    uint16 i;
+
+    if (debounce_release_timer_id == tid)
+    {
+        debounce_release_timer_id = TIMER_INVALID;
+
+        completeKeyReleases();
+
+        for (i = 0; i < ROWS; i++)
+        {
+            rows[i] = debouncedKeys(i);
+        }
+
+        MemSet(raw_report, 0, sizeof(raw_report));
+
+        if(ProcessKeyPress(rows, raw_report))
+        {
+            ProcessReport(raw_report);
+        }
+    }
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      restartReleaseTimer
+ *
+ *  DESCRIPTION
+ *      This function (re)starts the key release timer, on the expiry of which
+ *      the keys in the 'RELEASING' state are brought back to the 'IDLE' state
+ *
+ *  RETURNS
+ *      Nothing
+ *
+ *----------------------------------------------------------------------------*/
+
+static void restartReleaseTimer(uint32 duration)
+{
+    if(debounce_release_timer_id != TIMER_INVALID)
+    {
+        TimerDelete(debounce_release_timer_id);
+    }
+
+    debounce_release_timer_id = TimerCreate(duration, TRUE,
+                                            debounceReleaseTimer);
+}
+
+#ifdef ADAPTIVE_KEY_SCAN
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      restartKeyScanTimer
+ *
+ *  DESCRIPTION
+ *      This function (re)starts the timer lowering the scan rate of the key
+ *      matrix
+ *
+ *  RETURNS
+ *      Nothing
+ *
+ *----------------------------------------------------------------------------*/
+
+static void restartKeyScanTimer(uint32 duration)
+{
+    if(key_scan_tid != TIMER_INVALID)
+    {
+        TimerDelete(key_scan_tid);
+    }
+
+    key_scan_tid = TimerCreate(duration, TRUE, handleKeyScanIdle);
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      handleKeyScanIdle
+ *
+ *  DESCRIPTION
+ *      This function handles the expiry of the key scan timer. The first time
+ *      the keys are found idle the slow scan profile is set, the next time
+ *      the key scan goes to sleep.
+ *
+ *  RETURNS
+ *      Nothing
+ *
+ *----------------------------------------------------------------------------*/
+
+static void handleKeyScanIdle(timer_id tid)
+{
+    if(key_scan_tid == tid)
+    {
+        key_scan_tid = TIMER_INVALID;
+
+        if(*p_key_scan_profile == KEY_SCAN_PROFILE_FAST)
+        {
+            *p_key_scan_profile = KEY_SCAN_PROFILE_SLOW;
+            key_scan_tid = TimerCreate(KEY_SCAN_SLEEP_IDLE_TIME, TRUE,
+                                       handleKeyScanIdle);
+        }
+        else
+        {
+            sleepKeyScan();
+        }
+    }
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      sleepKeyScan
+ *
+ *  DESCRIPTION
+ *      This function stops the PIO controller and drives all the rows of the
+ *      key matrix low, so that a key pressed pulls its column low and raises
+ *      a PIO changed event.
+ *
+ *  RETURNS
+ *      Nothing
+ *
+ *----------------------------------------------------------------------------*/
+
+static void sleepKeyScan(void)
+{
+    PioCtrlrStop();
+
+    PioSetModes(KEY_MATRIX_ROWS_PIO_MASK | KEY_MATRIX_COLUMNS_PIO_MASK,
+                pio_mode_user);
+    PioSetDirs(KEY_MATRIX_ROWS_PIO_MASK | KEY_MATRIX_COLUMNS_PIO_MASK,
+               KEY_MATRIX_ROWS_PIO_MASK);
 
+    /* A row driven low would draw current through its own pull up */
+    PioSetPullModes(KEY_MATRIX_ROWS_PIO_MASK, pio_mode_no_pulls);
+    PioSets(KEY_MATRIX_ROWS_PIO_MASK, (uint32)PIO_STATE_LOW);
+
+    PioSetEventMask(KEY_MATRIX_COLUMNS_PIO_MASK, pio_event_mode_falling);
+    key_scan_sleeping = TRUE;
+
+    /* A key pressed since the last scan has already pulled its column low,
+     * and raises no event
+     */
+    if((PioGets() & KEY_MATRIX_COLUMNS_PIO_MASK) !=
+                                                   KEY_MATRIX_COLUMNS_PIO_MASK)
+    {
+        wakeKeyScan();
+    }
+}
 
 /*-----------------------------------------------------------------------------*
  *  NAME
- *      debounceResetTimer
+ *      wakeKeyScan
  *
  *  DESCRIPTION
- *      This function handles expiry of debounce timer
+ *      This function gives the key matrix back to the PIO controller and
+ *      restarts it, at the fast scan rate.
  *
  *  RETURNS
  *      Nothing
  *
  *----------------------------------------------------------------------------*/
 
-static void debounceResetTimer(timer_id tid)
+static void wakeKeyScan(void)
 {
-    uint8  raw_report[LARGEST_REPORT_SIZE];
+    PioSetEventMask(KEY_MATRIX_COLUMNS_PIO_MASK, pio_event_mode_disable);
+    PioSetPullModes(KEY_MATRIX_ROWS_PIO_MASK, pio_mode_strong_pull_up);
+    PioSetModes(KEY_MATRIX_ROWS_PIO_MASK | KEY_MATRIX_COLUMNS_PIO_MASK,
+                pio_mode_pio_controller);
+    key_scan_sleeping = FALSE;
 
-    if (debounce_reset_timer_id == tid)
-    {
-        debounce_reset_timer_id = TIMER_INVALID;
-        
-        /* Reset the keys to IDLE state and send the zeroed HID report */
-        MemSet(debounce_keys, 0, sizeof(debounce_keys));
+    PioCtrlrStart();
 
-        MemSet(raw_report, 0, sizeof(raw_report));
-        ProcessReport(raw_report);
-    }
+    /* Every path waking the key scan restarts the scan count */
+    AppKeyScanWoken();
 }
 
+#endif /* ADAPTIVE_KEY_SCAN */
+
 /*=============================================================================*
  *  Public Function Implementations
  *============================================================================*/
@@ -447,7 +1272,7 @@ static void debounceResetTimer(timer_id tid)
 void InitHardware(void)
 {
     /* Initialise debounce keys structure to zero */
-    MemSet(debounce_keys, 0, sizeof(debounce_keys));
+    resetDebounceState();
 
     /* Set up the PIO controller. */
     PioCtrlrInit((uint16*)&pio_ctrlr_code);
@@ -592,11 +1417,17 @@ void StartHardware(void)
 
 extern void HwDataInit(void)
 {
-    MemSet(last_generated_reports.last_report, 0, LARGEST_REPORT_SIZE);
+    MemSet(last_generated_reports.last_report, 0, RAW_REPORT_SIZE);
     MemSet(last_generated_reports.last_input_report, 0,
                                                   ATTR_LEN_HID_INPUT_REPORT);
     MemSet(last_generated_reports.last_consumer_report, 0,
                                                   ATTR_LEN_HID_CONSUMER_REPORT);
+    n_held_consumer_keys = 0;
+#ifdef NKRO_SUPPORT
+    MemSet(last_generated_reports.last_nkro_report, 0,
+                                                  ATTR_LEN_HID_NKRO_REPORT);
+    resetNkroKeys();
+#endif /* NKRO_SUPPORT */
 
 }
 
@@ -616,11 +1447,51 @@ extern void HwDataInit(void)
 extern void DebounceFX(uint8 *rows)
 {
     uint16 i;
+#ifdef DEBOUNCE_BIT_PARALLEL
+    uint8 any_key = 0;
+    uint8 pressing = 0;
+    uint8 held = 0;
+#else
     uint16 j;
     uint8 row,scan_code=1;
     bool key,out_key, found_key_pressed = FALSE;
+#endif /* DEBOUNCE_BIT_PARALLEL */
     bool press_to_down = FALSE, is_in_down = FALSE;
+    bool release_pending = FALSE;
+
+#ifdef DEBOUNCE_BIT_PARALLEL
+    for (i=0; i<ROWS; i++)
+    {
+        any_key |= rows[i];
+    }
+
+    if(!any_key && !debounce_keys_held)
+    {
+        /* Nothing pressed and nothing to hold on to. Keys still in 'PRESSING'
+         * go back to 'IDLE', and no key is in the 'DOWN' state, so the timer
+         * is not running.
+         */
+        if(debounce_keys_pressing)
+        {
+            resetDebounceState();
+        }
+        return;
+    }
+
+    /* Step the keys of each row through the state machine at once */
+    for (i=0; i<ROWS; i++)
+    {
+        rows[i] = handleDebounceRow(rows[i], &debounce_rows[i],
+                                    &press_to_down, &is_in_down,
+                                    &release_pending);
+
+        pressing |= debounce_rows[i].state_lo & ~debounce_rows[i].state_hi;
+        held |= debounce_rows[i].state_hi;
+    }
 
+    debounce_keys_pressing = (pressing != 0);
+    debounce_keys_held = (held != 0);
+#else
     /* Check the key matrix for keys pressed */
     for (i=0; i<ROWS; i++)
     {
@@ -643,7 +1514,8 @@ extern void DebounceFX(uint8 *rows)
             }
 
             /* Deal with state and count per bit update matrix*/
-            out_key = handleDebounceKey(key,scan_code, &press_to_down, &is_in_down);
+            out_key = handleDebounceKey(key,scan_code, &press_to_down, &is_in_down,
+                                        &release_pending);
             
             /* Update rows[i] */
             if(out_key)
@@ -660,6 +1532,7 @@ extern void DebounceFX(uint8 *rows)
         }
 
      }
+#endif /* DEBOUNCE_BIT_PARALLEL */
 
     if(!is_in_down)
     {
@@ -674,13 +1547,23 @@ extern void DebounceFX(uint8 *rows)
     if(press_to_down)
     {
         /* (Re)start the clean-up timer for the keys entering the DOWN state */
-        if(debounce_reset_timer_id != TIMER_INVALID)
-        {
-            TimerDelete(debounce_reset_timer_id);
-        }
+        restartDebounceTimer(KEY_PRESS_DEBOUNCE_TIME);
+    }
 
-        debounce_reset_timer_id = TimerCreate(KEY_PRESS_DEBOUNCE_TIME, TRUE, 
-                                              debounceResetTimer);
+    if(release_pending)
+    {
+        /* Confirm the releases if no scan comes before the time another
+         * N_SCAN_CYCLES_IN_RELEASING_STATE scan cycles would have taken, the
+         * PIO controller having stopped scanning with all the keys released.
+         * The clean-up timer of the keys in the DOWN state is left running.
+         */
+        restartReleaseTimer(KEY_RELEASE_DEBOUNCE_TIME);
+    }
+    else if(debounce_release_timer_id != TIMER_INVALID)
+    {
+        /* No key release is left to confirm */
+        TimerDelete(debounce_release_timer_id);
+        debounce_release_timer_id = TIMER_INVALID;
     }
     
 }
@@ -690,7 +1573,18 @@ extern void DebounceFX(uint8 *rows)
  *      GhostFX
  *
  *  DESCRIPTION
- *      This function is used to filter ghost keys 
+ *      This function is used to filter ghost keys. A ghost key shows up at the
+ *      fourth corner of a rectangle of pressed keys, so a pressed key can only
+ *      be a ghost key if its row and its column each have another key
+ *      pressed. Such keys are ambiguous. They are found in a single pass over
+ *      the rows, accumulating the columns pressed in any row, the columns
+ *      pressed in two rows or more and the columns of the rows with two keys
+ *      or more.
+ *
+ *      If 'p_ambiguous_rows' and 'p_ambiguous_cols' are not NULL, they are
+ *      given the rows, one bit per row, and the columns of the ambiguous keys.
+ *      A pressed key in one of these rows and one of these columns is
+ *      ambiguous.
  *
  *  RETURNS/MODIFIES
  *      BOOLEAN - TRUE: Ghost key detected
@@ -698,48 +1592,96 @@ extern void DebounceFX(uint8 *rows)
  *
  *----------------------------------------------------------------------------*/
 
-extern bool GhostFX(uint8 *rows)
+extern bool GhostFX(const uint8 *rows, uint32 *p_ambiguous_rows,
+                    uint8 *p_ambiguous_cols)
 {
     uint16 r;
-    uint16 c,k;
-    uint8 row_out;
-    bool ghost = FALSE;
-    uint8 row_shorted;
-        
-    /* Check the key matrix for keys pressed */
+    uint8 row;
+    uint8 cols_pressed = 0;         /* Columns pressed in any row */
+    uint8 cols_shared = 0;          /* Columns pressed in two rows or more */
+    uint8 cols_of_multi_rows = 0;   /* Columns of rows with two keys or more */
+    uint8 ambiguous_cols;
+    uint32 ambiguous_rows = 0;
+
     for (r = 0; r < ROWS; r++)
     {
-        if (rows[r])  /* see if there is a key pressed in the row */
+        row = rows[r];
+
+        cols_shared |= cols_pressed & row;
+        cols_pressed |= row;
+
+        /* Clearing the lowest key leaves a key if there were two or more */
+        if (row & (row - 1))
+        {
+            cols_of_multi_rows |= row;
+        }
+    }
+
+    /* A column shared by rows, one of which has another key pressed */
+    ambiguous_cols = cols_shared & cols_of_multi_rows;
+
+    if (ambiguous_cols && p_ambiguous_rows != NULL &&
+        p_ambiguous_cols != NULL)
+    {
+        for (r = 0; r < ROWS; r++)
         {
-            row_shorted = 0;
-            row_out = 0;
-            /* look for pressed keys */
-            for (c = 0; c < COLUMNS; c++)
-            {
-                /* check each bit of the row for pressed keys */
-                if (rows[r] & (1 << c))  
-                {
-                    row_shorted++;
+            row = rows[r];
 
-                    if (row_shorted >= 2) /* 2 or more keys in row */
-                    {
-                        /* check all other rows to see if there is a shorted 
-                         * column 
-                         */
-                        for (k = 0; k < ROWS; k++)
-                        {
-                           if ((rows[k] & rows[r]) && (k != r))
-                           {
-                                ghost = TRUE;
-                                return ghost;
-                           }
-                        }
-                    }
-                }
+            if ((row & (row - 1)) && (row & ambiguous_cols))
+            {
+                ambiguous_rows |= (uint32)1 << r;
             }
         }
+
+        *p_ambiguous_rows = ambiguous_rows;
+        *p_ambiguous_cols = ambiguous_cols;
+    }
+    else if (p_ambiguous_rows != NULL && p_ambiguous_cols != NULL)
+    {
+        *p_ambiguous_rows = 0;
+        *p_ambiguous_cols = 0;
+    }
+
+    return (ambiguous_cols != 0);
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      SuppressGhostKeys
+ *
+ *  DESCRIPTION
+ *      This function is used to suppress the ambiguous keys of a scan of the
+ *      key matrix, rather than the whole scan. An ambiguous key keeps the
+ *      state it has been debounced to, so a key held down is not released
+ *      while a chord makes it ambiguous and a ghost key is never pressed.
+ *      It is called before DebounceFX().
+ *
+ *  RETURNS/MODIFIES
+ *      BOOLEAN - TRUE: Ambiguous keys suppressed
+ *                FALSE: No ambiguous key
+ *
+ *----------------------------------------------------------------------------*/
+
+extern bool SuppressGhostKeys(uint8 *rows)
+{
+    uint16 r;
+    uint32 ambiguous_rows;
+    uint8 ambiguous_cols;
+
+    if (!GhostFX(rows, &ambiguous_rows, &ambiguous_cols))
+    {
+        return FALSE;
+    }
+
+    for (r = 0; r < ROWS; r++)
+    {
+        if (ambiguous_rows & ((uint32)1 << r))
+        {
+            rows[r] &= ~ambiguous_cols | debouncedKeys(r);
+        }
     }
-    return ghost;
+
+    return TRUE;
 }
 
 
@@ -750,7 +1692,9 @@ extern bool GhostFX(uint8 *rows)
  *  DESCRIPTION
  *      This function is when the user presses a key on the keyboard and hence 
  *      there is a "sys_event_pio_ctrlr" event that has to be handled by the
- *      application. The function also checks for ghost keys.
+ *      application. The function also checks for ghost keys. The keys are
+ *      looked up in the key map with the overlay layers switched on by the
+ *      layer keys held.
  *
  *  RETURNS/MODIFIES
  *      True if there is new data to be sent.
@@ -765,12 +1709,12 @@ extern bool ProcessKeyPress(uint8 *rows, uint8 *raw_report)
     uint8  *p = NULL;
     uint8  *p_modifier = NULL;
 
-    bool   function_key = FALSE;
     bool   report_changed = FALSE;
     
     uint8  scan_code=1;  /* don't use the 0 scan code */
     uint8  keys_added = 0;
-    uint8  hid_code;
+    uint16 hid_code;
+    uint16 layers = 0;
     uint8  row;
 
     /* 
@@ -785,6 +1729,15 @@ extern bool ProcessKeyPress(uint8 *rows, uint8 *raw_report)
 
     /* Skip reserved byte of the report */
     p = &raw_report[2]; /* set a pointer to the HID codes */
+
+#ifndef RAWKEYS
+
+    /* The layers are known before any key is looked up, whatever the scan
+     * code of their layer keys
+     */
+    layers = KeyMapHeldLayers(rows);
+
+#endif /* RAWKEYS */
     
     /* Check the PIO controller key matrix for keys pressed */
     for (i=0; i < ROWS; i++)
@@ -803,30 +1756,27 @@ extern bool ProcessKeyPress(uint8 *rows, uint8 *raw_report)
                 /* check each bit of the word for pressed keys */
                 if (row & 0x01)  /* mask bottom bit */
                 {
-                    if (scan_code == FUNCTION_KEY)
-                    {
-                        function_key = TRUE;
-                    }
-                    else
-                    {
-                        /* if new key bit is set then we have a new key pressed */
-                        /* if there is room save key.
-                         */
-                        if (keys_added < HIDKEYS)
-                        {
-                            keys_added++;
-                            
 #ifdef RAWKEYS
 
-                            hid_code = scan_code; /* raw scan code */
+                    hid_code = scan_code; /* raw scan code */
 
 #else
 
-                            /* look up HID code */
-                            hid_code = KEYBOARDKEYMATRIX[scan_code];
+                    /* look up HID code */
+                    hid_code = KeyMapLookup(scan_code, layers);
 
 #endif /* RAWKEYS */
 
+                    /* Layer keys are not reported */
+                    if (hid_code != KEY_MAP_LAYER_KEY)
+                    {
+                        /* if new key bit is set then we have a new key pressed */
+                        /* if there is room save key.
+                         */
+                        if (keys_added < HIDKEYS)
+                        {
+                            keys_added++;
+
                             /* Is it a modifier? */
                             if (hid_code >= 224 && hid_code <= 231) 
                             {
@@ -847,7 +1797,7 @@ extern bool ProcessKeyPress(uint8 *rows, uint8 *raw_report)
                         else 
                         {
                             /* set roll over for last HID char */
-                            raw_report[LARGEST_REPORT_SIZE - 1] = 0x01;
+                            raw_report[RAW_REPORT_SIZE - 1] = 0x01;
                         }
                     }
                 }
@@ -862,33 +1812,28 @@ extern bool ProcessKeyPress(uint8 *rows, uint8 *raw_report)
         }
     }
 
-#ifndef RAWKEYS
-
-    /* look up new HID keys to overlay keys that are valid when the
-     * function key is pressed
-     */
-    if (function_key)
-    {
-        for (i = 2; i < LARGEST_REPORT_SIZE; i++)
-        {
-            raw_report[i] = HIDLUT[raw_report[i]];
-        }
-    }
-
-#endif /* RAWKEYS */
-
     /* Check if the last sent report is not the same as the new raw
      * report
      */
     if(MemCmp(raw_report, last_generated_reports.last_report,
-                                                   LARGEST_REPORT_SIZE))
+                                                   RAW_REPORT_SIZE))
     {
         report_changed = TRUE;
 
         /* Update the last generated report */
         MemCopy(last_generated_reports.last_report, raw_report,
-                                                   LARGEST_REPORT_SIZE);
+                                                   RAW_REPORT_SIZE);
+    }
+
+#ifdef NKRO_SUPPORT
+    /* Keys beyond the six of the raw report only change the bitmap of the
+     * keys held down
+     */
+    if(updateNkroKeys(rows, layers))
+    {
+        report_changed = TRUE;
     }
+#endif /* NKRO_SUPPORT */
 
     /* Return true if there is a new report generated. */
     return report_changed;
@@ -900,7 +1845,9 @@ extern bool ProcessKeyPress(uint8 *rows, uint8 *raw_report)
  *
  *  DESCRIPTION
  *      This function is to generate different kinds of reports supported by
- *      the keyboard from the raw report generated in ProcessKeyPress()
+ *      the keyboard from the raw report generated in ProcessKeyPress(). The
+ *      consumer report also holds the consumer keys set by SetConsumerKeys().
+ *      A report is only queued if it differs from the one last generated.
  *
  *  RETURNS/MODIFIES
  *      True if there is new data in the application queue to be sent to the
@@ -916,12 +1863,11 @@ extern bool FormulateReportsFromRaw(uint8 *raw_report)
     uint8 i;
     bool new_data = FALSE;
 
-#ifndef RAWKEYS
-    
-    uint8 *p_consumer_report = consumer_report;
-    uint8 n_consumer_keys_added = 0;
+#ifdef NKRO_SUPPORT
 
-#endif /* RAWKEYS */
+    uint8 nkro_report[ATTR_LEN_HID_NKRO_REPORT];
+
+#endif /* NKRO_SUPPORT */
 
     MemSet(input_report, 0, ATTR_LEN_HID_INPUT_REPORT);
     MemSet(consumer_report, 0, ATTR_LEN_HID_CONSUMER_REPORT);
@@ -935,21 +1881,15 @@ extern bool FormulateReportsFromRaw(uint8 *raw_report)
     /* Parse through the raw_report and populate the different types of report
      * supported by the keyboard.
      */
-    for(i = 2; i < LARGEST_REPORT_SIZE; i++)
+    for(i = 2; i < RAW_REPORT_SIZE; i++)
     {
 
 #ifndef RAWKEYS
 
         if(raw_report[i] >= CONSUMER_KEYS_BASE)
         {
-            if(n_consumer_keys_added < MAX_CONSUMER_KEYS)
-            {
-                MemCopyUnPack(p_consumer_report,
-                            &(CONSUMERKEYS[raw_report[i] - CONSUMER_KEYS_BASE]),
-                              ONE_CONSUMER_KEY_REPORT_SIZE);
-                ++n_consumer_keys_added;
-                p_consumer_report += ONE_CONSUMER_KEY_REPORT_SIZE;
-            }
+            addConsumerKey(consumer_report,
+                           CONSUMERKEYS[raw_report[i] - CONSUMER_KEYS_BASE]);
         }
 
         else
@@ -961,6 +1901,45 @@ extern bool FormulateReportsFromRaw(uint8 *raw_report)
         }
     }
 
+    for(i = 0; i < n_held_consumer_keys; i++)
+    {
+        addConsumerKey(consumer_report, held_consumer_keys[i]);
+    }
+
+#ifdef NKRO_SUPPORT
+
+    if(HidIsNkroReportEnabled())
+    {
+        /* The keys are reported in the N-key rollover report alone. The
+         * input report is left with no key pressed, which releases any keys
+         * it held when the host enabled the N-key rollover report.
+         */
+        formNkroReport(nkro_report);
+        MemSet(input_report, 0, ATTR_LEN_HID_INPUT_REPORT);
+
+        if(MemCmp(nkro_report, last_generated_reports.last_nkro_report,
+                                                     ATTR_LEN_HID_NKRO_REPORT))
+        {
+            AddKeyStrokeToQueue(HID_NKRO_REPORT_ID, nkro_report,
+                                                     ATTR_LEN_HID_NKRO_REPORT);
+            MemCopy(last_generated_reports.last_nkro_report, nkro_report,
+                                                     ATTR_LEN_HID_NKRO_REPORT);
+            new_data = TRUE;
+        }
+    }
+    else
+    {
+        /* In boot mode, or when the host does not use the N-key rollover
+         * report, the keys fall back to the input report with its six keys.
+         * The host no longer reads the N-key rollover report, so it is
+         * forgotten without sending a release.
+         */
+        MemSet(last_generated_reports.last_nkro_report, 0,
+                                                     ATTR_LEN_HID_NKRO_REPORT);
+    }
+
+#endif /* NKRO_SUPPORT */
+
     /* If a new input report is created, add it to queue and update the last
      * generated input report.
      */
@@ -991,6 +1970,85 @@ extern bool FormulateReportsFromRaw(uint8 *raw_report)
     return new_data;
 }
 
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      SetConsumerKeys
+ *
+ *  DESCRIPTION
+ *      This function sets the consumer keys held besides the keys of the key
+ *      matrix, such as the ones set over UART, as 'count' usages of the
+ *      consumer page. They replace the ones set before, and are released by
+ *      setting no key.
+ *
+ *  RETURNS/MODIFIES
+ *      True if there is new data in the application queue to be sent to the
+ *      remote device
+ *
+ *----------------------------------------------------------------------------*/
+
+extern bool SetConsumerKeys(const uint16 *p_usages, uint16 count)
+{
+    if(count > CONSUMER_REPORT_KEYS)
+    {
+        count = CONSUMER_REPORT_KEYS;
+    }
+
+    MemCopy(held_consumer_keys, p_usages, count * sizeof(uint16));
+    n_held_consumer_keys = count;
+
+    /* The reports other than the consumer report are formed again as they
+     * were, so they are not queued again
+     */
+    return FormulateReportsFromRaw(last_generated_reports.last_report);
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      SetReportQueued
+ *
+ *  DESCRIPTION
+ *      This function records a report which has been queued as it is, such
+ *      as one received over UART, as the last report generated for its report
+ *      ID, so that the next report formed from the keys held is compared with
+ *      what the host has been sent. The usages of a consumer report replace
+ *      the consumer keys set by SetConsumerKeys().
+ *
+ *  RETURNS/MODIFIES
+ *      Nothing.
+ *
+ *----------------------------------------------------------------------------*/
+
+extern void SetReportQueued(uint8 report_id, const uint8 *p_report)
+{
+    uint16 slot;
+    uint16 usage;
+
+    if(report_id == HID_INPUT_REPORT_ID)
+    {
+        MemCopy(last_generated_reports.last_input_report, p_report,
+                                                     ATTR_LEN_HID_INPUT_REPORT);
+    }
+    else if(report_id == HID_CONSUMER_REPORT_ID)
+    {
+        n_held_consumer_keys = 0;
+
+        for(slot = 0; slot < ATTR_LEN_HID_CONSUMER_REPORT;
+            slot += ONE_CONSUMER_KEY_REPORT_SIZE)
+        {
+            usage = (p_report[slot] & 0xFF) |
+                    ((p_report[slot + 1] & 0xFF) << 8);
+
+            if(usage != 0)
+            {
+                held_consumer_keys[n_held_consumer_keys++] = usage;
+            }
+        }
+
+        MemCopy(last_generated_reports.last_consumer_report, p_report,
+                                                  ATTR_LEN_HID_CONSUMER_REPORT);
+    }
+}
+
 /*-----------------------------------------------------------------------------*
  *  NAME
  *      UpdateKbLedsStatus
@@ -1024,6 +2082,14 @@ extern void UpdateKbLeds(uint8 output_report)
 
 extern void HandlePIOChangedEvent(uint32 pio_changed)
 {
+#ifdef ADAPTIVE_KEY_SCAN
+    if(key_scan_sleeping && (pio_changed & KEY_MATRIX_COLUMNS_PIO_MASK))
+    {
+        /* A key has been pressed, scan it */
+        wakeKeyScan();
+    }
+#endif /* ADAPTIVE_KEY_SCAN */
+
     if(pio_changed & PAIRING_BUTTON_PIO_MASK)
     {
         /* Get the PIOs status to check whether the pairing button is
@@ -1054,3 +2120,70 @@ extern void HandlePIOChangedEvent(uint32 pio_changed)
         }                
     }
 }
+
+#ifdef ADAPTIVE_KEY_SCAN
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      KeyScanActivity
+ *
+ *  DESCRIPTION
+ *      This function is called for each scan of the key matrix handled. It
+ *      sets the fast scan profile, and starts the timer lowering the scan
+ *      rate if no key is held.
+ *
+ *  RETURNS
+ *      Nothing.
+ *
+ *---------------------------------------------------------------------------*/
+
+extern void KeyScanActivity(uint16 *p_scan_profile, bool keys_held)
+{
+    p_key_scan_profile = p_scan_profile;
+
+    if(*p_key_scan_profile != KEY_SCAN_PROFILE_FAST)
+    {
+        *p_key_scan_profile = KEY_SCAN_PROFILE_FAST;
+    }
+
+    if(keys_held)
+    {
+        /* The scan rate is not lowered while a key is held */
+        if(key_scan_tid != TIMER_INVALID)
+        {
+            TimerDelete(key_scan_tid);
+            key_scan_tid = TIMER_INVALID;
+        }
+    }
+    else
+    {
+        restartKeyScanTimer(HidIsStateSuspended() ?
+                                KEY_SCAN_SUSPENDED_IDLE_TIME :
+                                KEY_SCAN_SLOW_IDLE_TIME);
+    }
+}
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      KeyScanHostSuspended
+ *
+ *  DESCRIPTION
+ *      This function is called when the host suspends. If the keys are idle
+ *      and still scanned at the fast rate, the slow rate is used after
+ *      KEY_SCAN_SUSPENDED_IDLE_TIME rather than KEY_SCAN_SLOW_IDLE_TIME.
+ *
+ *  RETURNS
+ *      Nothing.
+ *
+ *---------------------------------------------------------------------------*/
+
+extern void KeyScanHostSuspended(void)
+{
+    if(key_scan_tid != TIMER_INVALID &&
+       *p_key_scan_profile == KEY_SCAN_PROFILE_FAST)
+    {
+        restartKeyScanTimer(KEY_SCAN_SUSPENDED_IDLE_TIME);
+    }
+}
+
+#endif /* ADAPTIVE_KEY_SCAN */
@@ -22,6 +22,13 @@
 #include <pio.h>
 #include <pio_ctrlr.h>
 #include <timer.h>
+#include <time.h>
+
+/*=============================================================================*
+ *  Local Header File
+ *============================================================================*/
+
+#include "user_config.h"
 
 /*=============================================================================*
  *   Public Definitions
@@ -120,6 +127,40 @@
 /* Number of columns in PIO controller key matrix */
 #define COLUMNS                       (8)
 
+/* Time between two scans of the key matrix by the PIO controller, which is
+ * also the tick of its free running count of scan cycles
+ */
+#define KEY_SCAN_CYCLE_TIME           (5 * MILLISECOND)
+
+/* Number of scans after a change of the keys on which the PIO controller
+ * raises an event, SETTLE_SCANS in pio_ctrlr_code.asm. Otherwise, it only
+ * raises one now and then while keys are held. The debouncing of a change has
+ * to complete within these scans.
+ */
+#define PIO_CTRLR_SETTLE_SCANS        (6)
+
+/* Number of scan cycles the PIO controller waits between two scans in the
+ * slow scan profile, SLOW_SCAN_WAIT in pio_ctrlr_code.asm
+ */
+#define PIO_CTRLR_SLOW_SCAN_WAIT      (3)
+
+/* Scan profiles of the PIO controller program, set in the word of its shared
+ * memory after the scan sequence number
+ */
+#define KEY_SCAN_PROFILE_FAST         (0)
+#define KEY_SCAN_PROFILE_SLOW         (1)
+
+/* PIOs of the key matrix rows driven by the PIO controller program, PIO3,
+ * PIO4 and PIO9 to PIO23, and of its columns, PIO24 to PIO31
+ */
+#define KEY_MATRIX_ROWS_PIO_MASK      (0x00fffe18UL)
+#define KEY_MATRIX_COLUMNS_PIO_MASK   (0xff000000UL)
+
+/* Size of the raw report formed by ProcessKeyPress(): the modifier byte, a
+ * reserved byte and six key codes
+ */
+#define RAW_REPORT_SIZE               (8)
+
 /*============================================================================*
  *  Public Data Declarations
  *============================================================================*/
@@ -150,6 +191,16 @@ extern bool ProcessKeyPress(uint8 *rows, uint8 *report);
  */
 extern bool FormulateReportsFromRaw(uint8 *raw_report);
 
+/* This function sets the consumer keys held besides the keys of the key
+ * matrix
+ */
+extern bool SetConsumerKeys(const uint16 *p_usages, uint16 count);
+
+/* This function records a report queued as it is as the last one generated
+ * for its report ID
+ */
+extern void SetReportQueued(uint8 report_id, const uint8 *p_report);
+
 /* This function updates the status of LEDs in keyboard */
 extern void UpdateKbLeds(uint8 output_report);
 
@@ -160,6 +211,22 @@ extern void HandlePIOChangedEvent(uint32 pio_changed);
 extern void DebounceFX(uint8 *rows);
 
 /* This function is used to filter ghost keys */
-extern bool GhostFX(uint8 *rows);
+extern bool GhostFX(const uint8 *rows, uint32 *p_ambiguous_rows,
+                    uint8 *p_ambiguous_cols);
+
+/* This function is used to suppress the keys which can not be told from ghost
+ * keys
+ */
+extern bool SuppressGhostKeys(uint8 *rows);
+
+#ifdef ADAPTIVE_KEY_SCAN
+
+/* This function picks the scan profile of the key matrix after a scan */
+extern void KeyScanActivity(uint16 *p_scan_profile, bool keys_held);
+
+/* This function lowers the scan rate sooner once the host has suspended */
+extern void KeyScanHostSuspended(void);
+
+#endif /* ADAPTIVE_KEY_SCAN */
 
 #endif /* _KEYBOARD_HW_ */
@@ -0,0 +1,363 @@
+/*******************************************************************************
+ *  Copyright (c) 2012 - 2016 Qualcomm Technologies International, Ltd.
+ *  Part of CSR uEnergy SDK 2.6.1
+ *  Application version 2.6.1.0
+ *
+ *  FILE
+ *    latency_service.c
+ *
+ * DESCRIPTION
+ *    This file defines routines for using the vendor specific Key Latency
+ *    service. The latencies of the stages a key stroke goes through are
+ *    counted in histograms with buckets growing in powers of two, from which
+ *    the percentiles are read over UART or GATT.
+ *
+ ******************************************************************************/
+
+/*=============================================================================*
+ *  SDK Header Files
+ *============================================================================*/
+
+#include <gatt.h>
+#include <gatt_prim.h>
+#include <mem.h>
+#include <time.h>
+#include <buf_utils.h>
+
+/*=============================================================================*
+ *  Local Header Files
+ *============================================================================*/
+
+#include "app_gatt.h"
+#include "latency_service.h"
+#include "app_gatt_db.h"
+
+/*=============================================================================*
+ *  Private Definitions
+ *============================================================================*/
+
+/* Number of notifications accepted by the firmware which can be waiting to
+ * be sent over the air. If more are accepted before the next tx_data radio
+ * event, the oldest ones are not counted.
+ */
+#define LATENCY_AIR_WAIT_SLOTS                      (8)
+
+/*=============================================================================*
+ *  Private Data Types
+ *============================================================================*/
+
+/* Key Latency service data type */
+typedef struct
+{
+    /* Histogram of every stage */
+    uint16 histogram[latency_stage_count][LATENCY_BUCKETS];
+
+    /* Times at which the key strokes of the notifications waiting to be sent
+     * over the air were received and accepted by the firmware
+     */
+    uint32 air_wait_rx_time[LATENCY_AIR_WAIT_SLOTS];
+    uint32 air_wait_accept_time[LATENCY_AIR_WAIT_SLOTS];
+
+    /* Slot of the oldest notification waiting to be sent over the air */
+    uint8  air_wait_start;
+
+    /* Number of notifications waiting to be sent over the air */
+    uint8  air_wait_num;
+
+} LATENCY_DATA_T;
+
+/*=============================================================================*
+ *  Private Data
+ *============================================================================*/
+
+/* Key Latency service data instance */
+static LATENCY_DATA_T g_latency_data;
+
+/*=============================================================================*
+ *  Public Function Implementations
+ *============================================================================*/
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      LatencyInitChipReset
+ *
+ *  DESCRIPTION
+ *      This function is used to clear the histograms at chip reset. They are
+ *      kept across connections.
+ *
+ *  RETURNS
+ *      Nothing.
+ *
+ *----------------------------------------------------------------------------*/
+
+extern void LatencyInitChipReset(void)
+{
+    MemSet(&g_latency_data, 0, sizeof(g_latency_data));
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      LatencyRecord
+ *
+ *  DESCRIPTION
+ *      This function adds a latency in microseconds to the histogram of a
+ *      stage. When a bucket is full, all the buckets of the stage are halved
+ *      so that the percentiles stay right.
+ *
+ *  RETURNS
+ *      Nothing.
+ *
+ *----------------------------------------------------------------------------*/
+
+extern void LatencyRecord(latency_stage stage, uint32 latency)
+{
+    uint16 *p_histogram = g_latency_data.histogram[stage];
+    uint32 units = latency >> LATENCY_UNIT_SHIFT;
+    uint16 bucket = 0;
+    uint16 i;
+
+    /* The bucket is the number of bits needed for the latency in units */
+    while(units && bucket < LATENCY_BUCKETS - 1)
+    {
+        units >>= 1;
+        ++ bucket;
+    }
+
+    if(p_histogram[bucket] == 0xFFFF)
+    {
+        for(i = 0; i < LATENCY_BUCKETS; i++)
+        {
+            p_histogram[i] >>= 1;
+        }
+    }
+
+    ++ p_histogram[bucket];
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      LatencyNotificationAccepted
+ *
+ *  DESCRIPTION
+ *      This function is called when the firmware has accepted the notification
+ *      of a key stroke, first handed to it at 'send_time'. The key stroke
+ *      waits to be counted as sent until the next tx_data radio event.
+ *
+ *  RETURNS
+ *      Nothing.
+ *
+ *----------------------------------------------------------------------------*/
+
+extern void LatencyNotificationAccepted(uint32 rx_time, uint32 queue_time,
+                                        uint32 send_time)
+{
+    const uint32 now = TimeGet32();
+    uint8 slot;
+
+    LatencyRecord(latency_stage_accept, now - queue_time);
+    LatencyRecord(latency_stage_queue_wait, send_time - queue_time);
+    LatencyRecord(latency_stage_fw_buffer, now - send_time);
+
+    if(g_latency_data.air_wait_num == LATENCY_AIR_WAIT_SLOTS)
+    {
+        /* Give up on the oldest one */
+        g_latency_data.air_wait_start = (g_latency_data.air_wait_start + 1) %
+                                                         LATENCY_AIR_WAIT_SLOTS;
+        -- g_latency_data.air_wait_num;
+    }
+
+    slot = (g_latency_data.air_wait_start + g_latency_data.air_wait_num) %
+                                                         LATENCY_AIR_WAIT_SLOTS;
+    g_latency_data.air_wait_rx_time[slot] = rx_time;
+    g_latency_data.air_wait_accept_time[slot] = now;
+    ++ g_latency_data.air_wait_num;
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      LatencyRadioTxData
+ *
+ *  DESCRIPTION
+ *      This function is called on a tx_data radio event. The firmware does not
+ *      tell which notifications have been sent, so all the ones it has
+ *      accepted are taken as sent in this connection event.
+ *
+ *  RETURNS
+ *      Nothing.
+ *
+ *----------------------------------------------------------------------------*/
+
+extern void LatencyRadioTxData(void)
+{
+    const uint32 now = TimeGet32();
+    uint8 slot;
+
+    while(g_latency_data.air_wait_num)
+    {
+        slot = g_latency_data.air_wait_start;
+
+        LatencyRecord(latency_stage_air,
+                      now - g_latency_data.air_wait_accept_time[slot]);
+        LatencyRecord(latency_stage_total,
+                      now - g_latency_data.air_wait_rx_time[slot]);
+
+        g_latency_data.air_wait_start = (slot + 1) % LATENCY_AIR_WAIT_SLOTS;
+        -- g_latency_data.air_wait_num;
+    }
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      LatencyGetCount
+ *
+ *  DESCRIPTION
+ *      This function returns the number of latencies in the histogram of a
+ *      stage. It is limited to 0xFFFF.
+ *
+ *  RETURNS
+ *      Number of latencies.
+ *
+ *----------------------------------------------------------------------------*/
+
+extern uint16 LatencyGetCount(latency_stage stage)
+{
+    const uint16 *p_histogram = g_latency_data.histogram[stage];
+    uint32 count = 0;
+    uint16 i;
+
+    for(i = 0; i < LATENCY_BUCKETS; i++)
+    {
+        count += p_histogram[i];
+    }
+
+    return (count > 0xFFFF) ? 0xFFFF : (uint16)count;
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      LatencyGetPercentile
+ *
+ *  DESCRIPTION
+ *      This function returns the 'percent' percentile of the latencies of a
+ *      stage, rounded up to the upper limit of its bucket.
+ *
+ *  RETURNS
+ *      Percentile in units of 2^LATENCY_UNIT_SHIFT microseconds, 0 if no
+ *      latency has been recorded.
+ *
+ *----------------------------------------------------------------------------*/
+
+extern uint16 LatencyGetPercentile(latency_stage stage, uint16 percent)
+{
+    const uint16 *p_histogram = g_latency_data.histogram[stage];
+    uint32 count = 0;
+    uint32 target;
+    uint16 bucket;
+
+    for(bucket = 0; bucket < LATENCY_BUCKETS; bucket++)
+    {
+        count += p_histogram[bucket];
+    }
+
+    if(count == 0)
+    {
+        return 0;
+    }
+
+    /* Number of latencies at or below the percentile, rounded up */
+    target = (count * percent + 99) / 100;
+
+    count = 0;
+    for(bucket = 0; bucket < LATENCY_BUCKETS - 1; bucket++)
+    {
+        count += p_histogram[bucket];
+
+        if(count >= target)
+        {
+            break;
+        }
+    }
+
+    return (uint16)(1U << bucket);
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      LatencyHandleAccessRead
+ *
+ *  DESCRIPTION
+ *      This function handles read operation on Key Latency service attributes
+ *      maintained by the application and responds with the GATT_ACCESS_RSP
+ *      message. The Key Latency characteristic holds the 50th and the 99th
+ *      percentile of every stage, in the order of latency_stage.
+ *
+ *  RETURNS
+ *      Nothing.
+ *
+ *----------------------------------------------------------------------------*/
+
+extern void LatencyHandleAccessRead(GATT_ACCESS_IND_T *p_ind)
+{
+    uint16 length = 0;
+    uint8  value[LATENCY_VALUE_LENGTH];
+    uint8 *p_val = value;
+    sys_status rc = sys_status_success;
+    uint16 stage;
+
+    switch(p_ind->handle)
+    {
+
+        case HANDLE_KEY_LATENCY:
+        {
+            /* The value is longer than a read returns with the default MTU,
+             * so the rest is read from an offset with Read Blob
+             */
+            if(p_ind->offset <= LATENCY_VALUE_LENGTH)
+            {
+                for(stage = 0; stage < latency_stage_count; stage++)
+                {
+                    BufWriteUint16(&p_val,
+                          LatencyGetPercentile((latency_stage)stage, 50));
+                    BufWriteUint16(&p_val,
+                          LatencyGetPercentile((latency_stage)stage, 99));
+                }
+
+                length = LATENCY_VALUE_LENGTH - p_ind->offset;
+                p_val = value + p_ind->offset;
+            }
+            else
+            {
+                rc = gatt_status_invalid_offset;
+            }
+        }
+        break;
+
+        default:
+            /* No more IRQ characteristics */
+            rc = gatt_status_read_not_permitted;
+        break;
+
+    }
+
+    GattAccessRsp(p_ind->cid, p_ind->handle, rc, length, p_val);
+}
+
+/*-----------------------------------------------------------------------------*
+ *  NAME
+ *      LatencyCheckHandleRange
+ *
+ *  DESCRIPTION
+ *      This function is used to check if the handle belongs to the Key
+ *      Latency service
+ *
+ *  RETURNS
+ *      Boolean - Indicating whether handle falls in range or not.
+ *
+ *----------------------------------------------------------------------------*/
+
+extern bool LatencyCheckHandleRange(uint16 handle)
+{
+    return ((handle >= HANDLE_KEY_LATENCY_SERVICE) &&
+            (handle <= HANDLE_KEY_LATENCY_SERVICE_END))
+            ? TRUE : FALSE;
+}
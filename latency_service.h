@@ -0,0 +1,116 @@
+/*******************************************************************************
+ *  Copyright (c) 2012 - 2016 Qualcomm Technologies International, Ltd.
+ *  Part of CSR uEnergy SDK 2.6.1
+ *  Application version 2.6.1.0
+ *
+ *  FILE
+ *      latency_service.h
+ *
+ *  DESCRIPTION
+ *      Header definitions for the vendor specific Key Latency service. It
+ *      keeps a histogram of every stage a key stroke goes through on its way
+ *      to the host.
+ *
+ ******************************************************************************/
+
+#ifndef __LATENCY_SERVICE_H__
+#define __LATENCY_SERVICE_H__
+
+/*=============================================================================*
+ *  SDK Header Files
+ *============================================================================*/
+
+#include <types.h>
+#include <bt_event_types.h>
+
+/*=============================================================================*
+ *  Public Definitions
+ *============================================================================*/
+
+/* Latencies are reported in units of 2^LATENCY_UNIT_SHIFT microseconds, which
+ * is 128 us.
+ */
+#define LATENCY_UNIT_SHIFT              (7)
+
+/* Number of histogram buckets per stage. Bucket 'b' counts the latencies
+ * shorter than 2^b units, bucket 0 the ones shorter than one unit. The last
+ * bucket also counts everything longer, so a percentile reported as
+ * 2^(LATENCY_BUCKETS - 1) units (4.2 seconds) is at least that long.
+ */
+#define LATENCY_BUCKETS                 (16)
+
+/* Length of the Key Latency characteristic value */
+#define LATENCY_VALUE_LENGTH            (latency_stage_count * 4)
+
+/*=============================================================================*
+ *  Public Data Types
+ *============================================================================*/
+
+/* Stages of a key stroke. The values are used over UART and in the Key
+ * Latency characteristic, so new stages must be added at the end.
+ */
+typedef enum
+{
+    latency_stage_queue = 0,    /* Character received over UART to key
+                                 * stroke queued
+                                 */
+    latency_stage_accept,       /* Key stroke queued to notification accepted
+                                 * by the firmware
+                                 */
+    latency_stage_air,          /* Notification accepted to sent over the
+                                 * air
+                                 */
+    latency_stage_total,        /* Character received over UART, or key
+                                 * pressed on the key matrix, to sent over
+                                 * the air
+                                 */
+    latency_stage_scan,         /* Key pressed on the key matrix to scanned.
+                                 * It is taken as pressed just after the scan
+                                 * before, or when it woke the key scan up.
+                                 */
+    latency_stage_debounce,     /* Key press scanned to key stroke queued */
+    latency_stage_queue_wait,   /* Key stroke queued to notification first
+                                 * handed to the firmware
+                                 */
+    latency_stage_fw_buffer,    /* Notification first handed to the firmware
+                                 * to accepted by it
+                                 */
+
+    latency_stage_count         /* Number of stages */
+
+} latency_stage;
+
+/*=============================================================================*
+ *  Public Function Prototypes
+ *============================================================================*/
+
+/* This function clears the histograms at chip reset */
+extern void LatencyInitChipReset(void);
+
+/* This function adds a latency to the histogram of a stage */
+extern void LatencyRecord(latency_stage stage, uint32 latency);
+
+/* This function is called when the firmware has accepted a notification */
+extern void LatencyNotificationAccepted(uint32 rx_time, uint32 queue_time,
+                                        uint32 send_time);
+
+/* This function is called when data has been sent over the air */
+extern void LatencyRadioTxData(void);
+
+/* This function returns the number of latencies recorded for a stage */
+extern uint16 LatencyGetCount(latency_stage stage);
+
+/* This function returns a percentile of the latencies of a stage */
+extern uint16 LatencyGetPercentile(latency_stage stage, uint16 percent);
+
+/* This function handles read operation on Key Latency service attributes
+ * maintained by the application
+ */
+extern void LatencyHandleAccessRead(GATT_ACCESS_IND_T *p_ind);
+
+/* This function is used to check if the handle belongs to the Key Latency
+ * service
+ */
+extern bool LatencyCheckHandleRange(uint16 handle);
+
+#endif /* __LATENCY_SERVICE_H__ */
@@ -0,0 +1,32 @@
+/*******************************************************************************
+ *  Copyright (c) 2012 - 2016 Qualcomm Technologies International, Ltd.
+ *  Part of CSR uEnergy SDK 2.6.1
+ *  Application version 2.6.1.0
+ *
+ *  FILE
+ *      latency_uuids.h
+ *
+ * DESCRIPTION
+ *      UUID MACROs for the vendor specific Key Latency service
+ *
+ ******************************************************************************/
+
+#ifndef __LATENCY_UUIDS_H__
+#define __LATENCY_UUIDS_H__
+
+/*=============================================================================*
+ *         Public Definitions
+ *============================================================================*/
+
+/* Brackets should not be used around the value of a macro. The parser which
+ * creates .c and .h files from .db file doesn't understand brackets and will
+ * raise syntax errors.
+ */
+
+/* Key Latency Service UUID */
+#define KEY_LATENCY_SERVICE_UUID      0x8a3c00016b2f4c5e9d1a3f7e2b9c4d10
+
+/* Key Latency Percentiles UUID */
+#define KEY_LATENCY_UUID              0x8a3c00026b2f4c5e9d1a3f7e2b9c4d10
+
+#endif /* __LATENCY_UUIDS_H__ */
@@ -18,6 +18,30 @@
 .equ VALID_BASE   ,0x40 ; Pointer to valid dual port RAM with XAP
 .equ KEYPTR_BASE  ,0x42 ; Pointer to shared dual port 0 RAM with XAP
 .equ KEYPTR_BASE2 ,0x54 ; Pointer to shared dual port 1 RAM with XAP
+.equ SEQ_BASE     ,0x66 ; Pointer to scan sequence number shared with XAP
+.equ SCAN_MODE_BASE ,0x68 ; Pointer to scan profile set by XAP, 0 = fast
+.equ TICK_BASE    ,0x6A ; Pointer to free running count of scan cycles
+.equ CHANGE_TICK_BASE ,0x6C ; Pointer to tick of the last scan with a change
+.equ SCAN_GAP_BASE ,0x6E ; Pointer to ticks between that scan and the one before
+.equ LAST_TICK    ,0x20 ; Tick of the last scan, low byte
+
+; Number of scans after a change of the keys on which the XAP is woken up, so
+; that it sees the scans it needs to debounce the change. Keep it in step with
+; PIO_CTRLR_SETTLE_SCANS in keyboard_hw.h.
+.equ SETTLE_SCANS    ,6
+
+; Number of scans between two wake ups of the XAP while keys are held down and
+; do not change
+.equ KEEPALIVE_SCANS ,16
+
+; Number of scan cycles waited between two scans in the slow scan profile, so
+; that the keys are scanned at a quarter of the fast rate. Keep it in step with
+; PIO_CTRLR_SLOW_SCAN_WAIT in keyboard_hw.h.
+.equ SLOW_SCAN_WAIT  ,3
+
+; Passes of the wait loop taking about as long as a scan, which is about 200
+; machine cycles
+.equ SCAN_CYCLE_LOOPS ,40
 
 
 START:
@@ -34,14 +58,39 @@ START:
 ; use registers to speed up scan cycles
 ;
       mov      R0, #P3                  ; setup a register to point to PIO24 to 31
-      mov      R3, #0                   ; Button state variable
+      mov      R5, #SETTLE_SCANS        ; wake up the XAP on the first scans
+      mov      R6, #KEEPALIVE_SCANS     ; scans left before the next keep alive
       mov      VALID_BASE+1, #0         ; SET BUFFER 0 VALID
+      mov      SEQ_BASE, #0             ; no scan yet
+      mov      SEQ_BASE+1, #0
+      mov      SCAN_MODE_BASE, #0       ; scan at the fast rate
+      mov      SCAN_MODE_BASE+1, #0
+      mov      TICK_BASE, #0            ; no scan cycle yet
+      mov      TICK_BASE+1, #0
+      mov      CHANGE_TICK_BASE, #0
+      mov      CHANGE_TICK_BASE+1, #0
+      mov      SCAN_GAP_BASE, #0
+      mov      SCAN_GAP_BASE+1, #0
+      mov      LAST_TICK, #0
       
 ; There are 2 copies of the scanned keys in the shared RAM between the
 ; PIO Controller and the XAP. They flip between one buffer and the other so that
 ; the first set of scan keys are not over written by the scanning of the
 ; 2nd set of keys. The first word in the buffer defines the which buffer
 ; contains the latest scanned keys.
+;
+; The XAP is only woken up when the keys change, while the change settles,
+; and now and then while keys are held. The word after the buffers holds the
+; number of scans made, modulo 256, so that the XAP can tell a new scan from
+; one it has already handled.
+;
+; The XAP sets the word after it to scan at the slow rate while the keys are
+; idle, and clears it again to go back to the fast rate.
+;
+; The next word counts the scan cycles, scanned or waited, as a free running
+; tick. The scan which last saw the keys change is stamped with it in the word
+; after, and the ticks since the scan before it in the last word, so that the
+; XAP can tell how long a key change took to be scanned and debounced.
 
 SCANLOOP:
 ; BUFFER 0 SCAN
@@ -156,6 +205,75 @@ SCANLOOP:
       setb     P2.7
 
 ;*******************************************************************************
+; compare the scan with the previous one, held in the other buffer
+       mov     A, KEYPTR_BASE+01
+       xrl     A, KEYPTR_BASE2+01
+       mov     R4, A
+       mov     A, KEYPTR_BASE+02
+       xrl     A, KEYPTR_BASE2+02
+       orl     A, R4
+       mov     R4, A
+       mov     A, KEYPTR_BASE+03
+       xrl     A, KEYPTR_BASE2+03
+       orl     A, R4
+       mov     R4, A
+       mov     A, KEYPTR_BASE+04
+       xrl     A, KEYPTR_BASE2+04
+       orl     A, R4
+       mov     R4, A
+       mov     A, KEYPTR_BASE+05
+       xrl     A, KEYPTR_BASE2+05
+       orl     A, R4
+       mov     R4, A
+       mov     A, KEYPTR_BASE+06
+       xrl     A, KEYPTR_BASE2+06
+       orl     A, R4
+       mov     R4, A
+       mov     A, KEYPTR_BASE+07
+       xrl     A, KEYPTR_BASE2+07
+       orl     A, R4
+       mov     R4, A
+       mov     A, KEYPTR_BASE+08
+       xrl     A, KEYPTR_BASE2+08
+       orl     A, R4
+       mov     R4, A
+       mov     A, KEYPTR_BASE+09
+       xrl     A, KEYPTR_BASE2+09
+       orl     A, R4
+       mov     R4, A
+       mov     A, KEYPTR_BASE+10
+       xrl     A, KEYPTR_BASE2+10
+       orl     A, R4
+       mov     R4, A
+       mov     A, KEYPTR_BASE+11
+       xrl     A, KEYPTR_BASE2+11
+       orl     A, R4
+       mov     R4, A
+       mov     A, KEYPTR_BASE+12
+       xrl     A, KEYPTR_BASE2+12
+       orl     A, R4
+       mov     R4, A
+       mov     A, KEYPTR_BASE+13
+       xrl     A, KEYPTR_BASE2+13
+       orl     A, R4
+       mov     R4, A
+       mov     A, KEYPTR_BASE+14
+       xrl     A, KEYPTR_BASE2+14
+       orl     A, R4
+       mov     R4, A
+       mov     A, KEYPTR_BASE+15
+       xrl     A, KEYPTR_BASE2+15
+       orl     A, R4
+       mov     R4, A
+       mov     A, KEYPTR_BASE+16
+       xrl     A, KEYPTR_BASE2+16
+       orl     A, R4
+       mov     R4, A
+       mov     A, KEYPTR_BASE+17
+       xrl     A, KEYPTR_BASE2+17
+       orl     A, R4
+       mov     R4, A
+
 ; look for a button being pressed low (NAND)
 ;Go through table ANDing together entries for port 1
        mov     A, KEYPTR_BASE+00
@@ -178,22 +296,77 @@ SCANLOOP:
        anl     A, KEYPTR_BASE+17
        cpl     A                        ; invert from 0's to 1's
        mov     R2, A                    ; save  port 1 bits
-       
-       orl     A, R3                    ; OR in the last button state to check for key up
-
-      jz    SKIPWAKE
 
-;Wake up XAP with an interrupt on button press or button release
-      mov      VALID_BASE, #0  ; SET BUFFER 0 VALID
-      mov      A, #1
-      mov      WAKEUP, A
-      mov      A, #0
-      mov      WAKEUP, A
+; count the scan cycle on the tick counter
+       inc     TICK_BASE
+       mov     A, TICK_BASE
+       jnz     TICKED0
+       inc     TICK_BASE+1
+TICKED0:
+
+; stamp a change of the keys with the tick of the scan, and the ticks since the
+; scan before it, within which the change happened
+       mov     A, R4
+       jz      STAMPED0
+       mov     CHANGE_TICK_BASE, TICK_BASE
+       mov     CHANGE_TICK_BASE+1, TICK_BASE+1
+       mov     A, TICK_BASE
+       clr     C
+       subb    A, LAST_TICK
+       mov     SCAN_GAP_BASE, A
+STAMPED0:
+       mov     LAST_TICK, TICK_BASE
+
+; publish the scan, whether the XAP is woken up or not
+       mov     VALID_BASE, #0  ; SET BUFFER 0 VALID
+       inc     SEQ_BASE                 ; count the scan
+
+; Wake up XAP with an interrupt when the keys differ from the last scan, on
+; each of the next SETTLE_SCANS scans so that the debouncing of the change can
+; complete, and every KEEPALIVE_SCANS scans while a key is held
+       mov     A, R4
+       jz      NOCHANGE0
+       mov     R5, #SETTLE_SCANS        ; keys changed, settle again
+       sjmp    WAKE
+
+NOCHANGE0:
+       mov     A, R5
+       jz      SETTLED0
+       dec     R5                       ; still settling
+       sjmp    WAKE
+
+SETTLED0:
+       mov     A, R2
+       jz      SKIPWAKE               ; no key held
+       djnz    R6, SKIPWAKE           ; key held, wake up now and then
+
+WAKE:
+       mov     R6, #KEEPALIVE_SCANS
+       mov     A, #1
+       mov     WAKEUP, A
+       mov     A, #0
+       mov     WAKEUP, A
 
 SKIPWAKE:
-; Update the previous value
-          mov      A, R2
-      mov      R3, A
+; In the slow scan profile, wait SLOW_SCAN_WAIT scan cycles before the next
+; scan, unless the XAP switches back to the fast one meanwhile
+       mov     A, SCAN_MODE_BASE
+       jz      FASTSCAN
+       mov     R3, #SLOW_SCAN_WAIT
+SLOWCYCLE:
+       mov     R7, #SCAN_CYCLE_LOOPS
+SLOWLOOP:
+       mov     A, SCAN_MODE_BASE
+       jz      FASTSCAN
+       djnz    R7, SLOWLOOP
+       inc     TICK_BASE                ; a scan cycle has been waited
+       mov     A, TICK_BASE
+       jnz     WAITED
+       inc     TICK_BASE+1
+WAITED:
+       djnz    R3, SLOWCYCLE
+
+FASTSCAN:
 ;
 ;
 ; BUFFER 1 SCAN
@@ -308,6 +481,75 @@ SKIPWAKE:
       setb     P2.7
 
 ;*******************************************************************************
+; compare the scan with the previous one, held in the other buffer
+       mov     A, KEYPTR_BASE2+01
+       xrl     A, KEYPTR_BASE+01
+       mov     R4, A
+       mov     A, KEYPTR_BASE2+02
+       xrl     A, KEYPTR_BASE+02
+       orl     A, R4
+       mov     R4, A
+       mov     A, KEYPTR_BASE2+03
+       xrl     A, KEYPTR_BASE+03
+       orl     A, R4
+       mov     R4, A
+       mov     A, KEYPTR_BASE2+04
+       xrl     A, KEYPTR_BASE+04
+       orl     A, R4
+       mov     R4, A
+       mov     A, KEYPTR_BASE2+05
+       xrl     A, KEYPTR_BASE+05
+       orl     A, R4
+       mov     R4, A
+       mov     A, KEYPTR_BASE2+06
+       xrl     A, KEYPTR_BASE+06
+       orl     A, R4
+       mov     R4, A
+       mov     A, KEYPTR_BASE2+07
+       xrl     A, KEYPTR_BASE+07
+       orl     A, R4
+       mov     R4, A
+       mov     A, KEYPTR_BASE2+08
+       xrl     A, KEYPTR_BASE+08
+       orl     A, R4
+       mov     R4, A
+       mov     A, KEYPTR_BASE2+09
+       xrl     A, KEYPTR_BASE+09
+       orl     A, R4
+       mov     R4, A
+       mov     A, KEYPTR_BASE2+10
+       xrl     A, KEYPTR_BASE+10
+       orl     A, R4
+       mov     R4, A
+       mov     A, KEYPTR_BASE2+11
+       xrl     A, KEYPTR_BASE+11
+       orl     A, R4
+       mov     R4, A
+       mov     A, KEYPTR_BASE2+12
+       xrl     A, KEYPTR_BASE+12
+       orl     A, R4
+       mov     R4, A
+       mov     A, KEYPTR_BASE2+13
+       xrl     A, KEYPTR_BASE+13
+       orl     A, R4
+       mov     R4, A
+       mov     A, KEYPTR_BASE2+14
+       xrl     A, KEYPTR_BASE+14
+       orl     A, R4
+       mov     R4, A
+       mov     A, KEYPTR_BASE2+15
+       xrl     A, KEYPTR_BASE+15
+       orl     A, R4
+       mov     R4, A
+       mov     A, KEYPTR_BASE2+16
+       xrl     A, KEYPTR_BASE+16
+       orl     A, R4
+       mov     R4, A
+       mov     A, KEYPTR_BASE2+17
+       xrl     A, KEYPTR_BASE+17
+       orl     A, R4
+       mov     R4, A
+
 ; look for a button being pressed low (NAND)
 ;Go through table ANDing together entries for port 1
        mov     A, KEYPTR_BASE2+00
@@ -330,22 +572,77 @@ SKIPWAKE:
        anl     A, KEYPTR_BASE2+17
        cpl     A                        ; invert from 0's to 1's
        mov     R2, A                    ; save  port 1 bits
-       
-       orl     A, R3                    ; OR in the last button state to check for key up
 
-       jz    SKIPWAKE2
-      
-;Wake up XAP with an interrupt on button press or button release
-       mov      VALID_BASE, #1  ; SET BUFFER 1 VALID
-       mov      A, #1
-       mov      WAKEUP, A
-       mov      A, #0
-       mov      WAKEUP, A
+; count the scan cycle on the tick counter
+       inc     TICK_BASE
+       mov     A, TICK_BASE
+       jnz     TICKED1
+       inc     TICK_BASE+1
+TICKED1:
+
+; stamp a change of the keys with the tick of the scan, and the ticks since the
+; scan before it, within which the change happened
+       mov     A, R4
+       jz      STAMPED1
+       mov     CHANGE_TICK_BASE, TICK_BASE
+       mov     CHANGE_TICK_BASE+1, TICK_BASE+1
+       mov     A, TICK_BASE
+       clr     C
+       subb    A, LAST_TICK
+       mov     SCAN_GAP_BASE, A
+STAMPED1:
+       mov     LAST_TICK, TICK_BASE
+
+; publish the scan, whether the XAP is woken up or not
+       mov     VALID_BASE, #1  ; SET BUFFER 1 VALID
+       inc     SEQ_BASE                 ; count the scan
+
+; Wake up XAP with an interrupt when the keys differ from the last scan, on
+; each of the next SETTLE_SCANS scans so that the debouncing of the change can
+; complete, and every KEEPALIVE_SCANS scans while a key is held
+       mov     A, R4
+       jz      NOCHANGE1
+       mov     R5, #SETTLE_SCANS        ; keys changed, settle again
+       sjmp    WAKE2
+
+NOCHANGE1:
+       mov     A, R5
+       jz      SETTLED1
+       dec     R5                       ; still settling
+       sjmp    WAKE2
+
+SETTLED1:
+       mov     A, R2
+       jz      SKIPWAKE2               ; no key held
+       djnz    R6, SKIPWAKE2           ; key held, wake up now and then
+
+WAKE2:
+       mov     R6, #KEEPALIVE_SCANS
+       mov     A, #1
+       mov     WAKEUP, A
+       mov     A, #0
+       mov     WAKEUP, A
 
 SKIPWAKE2:
-; Update the previous value
-       mov A, R2
-       mov      R3, A
+; In the slow scan profile, wait SLOW_SCAN_WAIT scan cycles before the next
+; scan, unless the XAP switches back to the fast one meanwhile
+       mov     A, SCAN_MODE_BASE
+       jz      FASTSCAN2
+       mov     R3, #SLOW_SCAN_WAIT
+SLOWCYCLE2:
+       mov     R7, #SCAN_CYCLE_LOOPS
+SLOWLOOP2:
+       mov     A, SCAN_MODE_BASE
+       jz      FASTSCAN2
+       djnz    R7, SLOWLOOP2
+       inc     TICK_BASE                ; a scan cycle has been waited
+       mov     A, TICK_BASE
+       jnz     WAITED2
+       inc     TICK_BASE+1
+WAITED2:
+       djnz    R3, SLOWCYCLE2
+
+FASTSCAN2:
        ljmp     SCANLOOP  ; go back to scan buffer 0
 ;;     END
 
@@ -16,6 +16,9 @@
  *============================================================================*/
 
 #include <uart.h>           /* Functions to interface with the chip's UART */
+#include <timer.h>          /* Chip timer functions */
+#include <time.h>           /* Chip time functions */
+#include <mem.h>            /* Memory library */
 
 /*============================================================================*
  *  Local Header Files
@@ -24,6 +27,11 @@
 #include "uartio.h"         /* Header file to this source file */
 #include "byte_queue.h"     /* Byte queue API */
 #include "keyboard.h"     /* Byte queue API */
+#include "char_map.h"       /* Keyboard layout selection */
+
+#ifdef KEY_LATENCY_STATS
+#include "latency_service.h" /* Key stroke latency histograms */
+#endif /* KEY_LATENCY_STATS */
 
 /*============================================================================*
  *  Private Data
@@ -47,6 +55,106 @@ UART_DECLARE_BUFFER(rx_buffer, RX_BUFFER_SIZE);
 /* Create 64-byte transmit buffer for UART data */
 UART_DECLARE_BUFFER(tx_buffer, TX_BUFFER_SIZE);
 
+/* Largest number of bytes handed to UartWrite at once. A write is only
+ * accepted if it fits in the transmit buffer as a whole, so it is kept to half
+ * the buffer to fit while the other half is still being sent.
+ */
+#define UART_TX_MAX_WRITE   (TX_BUFFER_SIZE / 2)
+
+/* Sizes of the queues of text waiting for room in the transmit buffer, which
+ * must be powers of two
+ */
+#define ECHO_QUEUE_SIZE     (64)
+#define LOG_QUEUE_SIZE      (128)
+
+#if !BQ_IS_POWER_OF_TWO(ECHO_QUEUE_SIZE) || !BQ_IS_POWER_OF_TWO(LOG_QUEUE_SIZE)
+#error "The UART text queue sizes must be powers of two"
+#endif
+
+/* Size of the queue of DONE, STATS and LATENCY frames waiting for room in
+ * the transmit buffer, a power of two with room for one DONE frame per string
+ * pending and the largest reply
+ */
+#define FRAME_QUEUE_SIZE    (128)
+
+#if !BQ_IS_POWER_OF_TWO(FRAME_QUEUE_SIZE) || (FRAME_QUEUE_SIZE < \
+    UART_MAX_PENDING_STRINGS * (UART_FRAME_OVERHEAD + UART_FRAME_DONE_PAYLOAD) \
+    + UART_FRAME_OVERHEAD + UART_FRAME_MAX_REPLY_PAYLOAD)
+#error "FRAME_QUEUE_SIZE can not hold the DONE frames and a reply"
+#endif
+
+/* A frame carrying the most characters has to fit in the empty queue */
+#if UART_FRAME_MAX_CHARS > MAX_TYPED_CHARS_AT_ONCE
+#error "UART_FRAME_MAX_CHARS characters can not be typed at once"
+#endif
+
+/* Length of a DONE frame with its overhead */
+#define DONE_FRAME_LEN      (UART_FRAME_OVERHEAD + UART_FRAME_DONE_PAYLOAD)
+
+/* Echo of the characters received and the replies to them */
+BQ_DECLARE_QUEUE(echo_queue, ECHO_QUEUE_SIZE);
+
+/* Start up banner, sleep state and system events. A burst of them drops the
+ * oldest ones without touching the echo.
+ */
+BQ_DECLARE_QUEUE(log_queue, LOG_QUEUE_SIZE);
+
+/* DONE, STATS and LATENCY frames, sent as they are in the order they were
+ * queued. Unlike ACKs and NAKs they are never replaced by a later reply.
+ */
+BQ_DECLARE_QUEUE(frame_queue, FRAME_QUEUE_SIZE);
+
+/* Framed protocol data */
+typedef struct
+{
+    /* Set once the first start of frame has been received */
+    bool            framed_mode;
+
+    /* Sequence number of the next frame to be accepted */
+    uint8           expected_seq;
+
+    /* Set when a NAK has been sent for the expected frame, so that the frames
+     * already in flight behind it do not each trigger another NAK
+     */
+    bool            nak_sent;
+
+    /* One of the UART_NAK_ reasons, for the next NAK built */
+    uint8           nak_reason;
+
+    /* ACK/NAK waiting for space in the UART transmit buffer. ACKs and NAKs
+     * are cumulative, so only the latest one needs to be kept.
+     */
+    uint8           reply[UART_FRAME_OVERHEAD + UART_FRAME_NAK_PAYLOAD];
+    uint8           reply_len;
+    bool            reply_pending;
+
+    /* Number of strings accepted whose DONE frame has not been queued yet.
+     * Room is kept in 'frame_queue' for all their DONE frames.
+     */
+    uint8           strings_pending;
+
+    /* Set when a frame has been NAKed for want of room in 'frame_queue', so
+     * that an ACK is sent unasked once the frames queued have gone out
+     */
+    bool            room_wanted;
+
+} UART_FRAME_DATA_T;
+
+/* CRC-8 (polynomial 0x07) lookup table, one entry per nibble */
+static const uint8 crc8_table[16] =
+{
+    0x00, 0x07, 0x0E, 0x09, 0x1C, 0x1B, 0x12, 0x15,
+    0x38, 0x3F, 0x36, 0x31, 0x24, 0x23, 0x2A, 0x2D
+};
+
+/* Framed protocol data */
+static UART_FRAME_DATA_T frame_data;
+
+#ifdef UART_RX_BURST_MODE
+/* Timer to flush a receive burst that stopped short of the threshold */
+static timer_id rx_idle_tid = TIMER_INVALID;
+#endif /* UART_RX_BURST_MODE */
+
 /*============================================================================*
  *  Private Function Prototypes
  *============================================================================*/
@@ -59,9 +167,51 @@ static uint16 uartRxDataCallback(void   *p_rx_buffer,
 /* UART transmit callback when a UART transmission has finished */
 static void uartTxDataCallback(void);
 
+/* Send the text held in a queue */
+static bool sendQueuedText(BYTE_QUEUE_T *p_queue);
+
+/* Send the frames held in a queue */
+static bool sendQueuedFrames(BYTE_QUEUE_T *p_queue);
+
 /* Transmit waiting data over UART */
 static void sendPendingData(void);
 
+/* Update a CRC-8 with one byte */
+static uint8 crc8Update(uint8 crc, uint8 byte);
+
+/* Work out the CRC of a frame */
+static uint8 frameCrc(const uint8 *p_frame, uint8 len);
+
+/* Pass received data to the framed protocol receiver */
+static uint16 frameRxData(const uint8 *p_data, uint16 length,
+                          uint16 *p_needed);
+
+/* Handle a frame which has passed the CRC check */
+static void handleRxFrame(const uint8 *p_frame);
+
+/* Hold the consumer keys carried by a CONSUMER frame */
+static bool handleConsumerFrame(const uint8 *p_payload, uint8 len);
+
+/* Queue the report carried by a REPORT frame */
+static bool handleReportFrame(const uint8 *p_payload, uint8 len);
+
+/* Length of a reply frame with its overhead */
+static uint8 frameReplyLength(uint8 type);
+
+/* Queue an ACK, NAK, STATS or LATENCY frame for transmission */
+static void sendFrameReply(uint8 type, uint8 seq);
+
+/* Ask for the expected frame with a NAK */
+static void sendFrameNak(uint8 reason);
+
+#ifdef UART_RX_BURST_MODE
+/* Handle the expiry of the receive idle timer */
+static void uartRxIdleTimerExpiry(timer_id tid);
+
+/* (Re)start the receive idle timer */
+static void restartRxIdleTimer(void);
+#endif /* UART_RX_BURST_MODE */
+
 /* Transmit the sleep state over UART */
 static void printSleepState(sleep_state sleepstate);
 
@@ -101,20 +251,100 @@ static uint16 uartRxDataCallback(void   *p_rx_buffer,
                                  uint16  length,
                                  uint16 *p_additional_req_data_length)
 {
-    if( length > 0 )
+    const uint8 *p_data = (const uint8 *)p_rx_buffer;
+    uint16 idx = 0;         /* Index into the received data */
+    uint16 needed = 0;      /* Bytes needed to go on with the data left */
+    uint16 ch;              /* Received byte as handed to test() */
+    
+#ifdef ADAPTIVE_CONN_PARAMS
+    /* Get the link ready for the key strokes to come */
+    AppConnParamsActivity();
+#endif /* ADAPTIVE_CONN_PARAMS */
+    
+#ifdef KEY_LATENCY_STATS
+    /* The latencies of the characters typed from this data start now */
+    AppSetTypedCharRxTime(TimeGet32());
+#endif /* KEY_LATENCY_STATS */
+    
+    /* Hand every received byte over, not just the first one. The data is
+     * used where it is in the receive buffer.
+     */
+    while(idx < length)
     {
-        /* First copy all the bytes received into the byte queue */
-        BQForceQueueBytes((const uint8 *)p_rx_buffer, length);
-        test( (uint16 *)p_rx_buffer);
+        /* The first start of frame switches to framed mode for good. Frames
+         * are neither echoed nor typed here.
+         */
+        if(frame_data.framed_mode || ((p_data[idx] & 0xFF) == UART_FRAME_SOF))
+        {
+            frame_data.framed_mode = TRUE;
+            
+            /* A frame received in part is left to the UART driver until the
+             * rest of it has been received
+             */
+            idx += frameRxData(&p_data[idx], length - idx, &needed);
+            
+            if(needed > 0)
+            {
+                break;
+            }
+        }
+        else
+        {
+            /* Leave this byte and the ones after it to the UART driver while
+             * the key stroke queue has no room for them. UartResumeRx picks
+             * them up again.
+             */
+            if(!AppAcceptTypedChars(1))
+            {
+                needed = 1;
+                break;
+            }
+            
+            /* Echo the byte and type it */
+            UartQueueEcho(&p_data[idx], 1);
+            ch = p_data[idx];
+            test(&ch);
+            idx++;
+        }
     }
     
+    /* Typed keys are held until the next key is pressed. Release the last
+     * one now that all the data received so far has been typed.
+     */
+    AppReleaseTypedKey();
+    
     /* Send any pending data waiting to be sent */
     sendPendingData();
     
+    if(idx < length)
+    {
+#ifdef UART_RX_BURST_MODE
+        /* The bytes held back are not a burst stopping short */
+        TimerDelete(rx_idle_tid);
+        rx_idle_tid = TIMER_INVALID;
+#endif /* UART_RX_BURST_MODE */
+        
+        /* Call back once the held back bytes can be used */
+        *p_additional_req_data_length = needed;
+        
+        /* Only the bytes before the held back ones have been processed */
+        return idx;
+    }
+    
+#ifdef UART_RX_BURST_MODE
+    /* Ask the UART driver to collect a whole burst before calling back
+     * again. If the sender stops short of the threshold, the idle timer will
+     * pick up what is left.
+     */
+    *p_additional_req_data_length = (uint16)UART_RX_BURST_THRESHOLD;
+    
+    restartRxIdleTimer();
+#else
     /* Inform the UART driver that we'd like to receive another byte when it
      * becomes available
      */
     *p_additional_req_data_length = (uint16)1;
+#endif /* UART_RX_BURST_MODE */
     
     /* Return the number of bytes that have been processed */
     return length;
@@ -144,80 +374,748 @@ static void uartTxDataCallback(void)
 
 /*----------------------------------------------------------------------------*
  *  NAME
- *      sendPendingData
+ *      sendQueuedText
  *
  *  DESCRIPTION
- *      Send buffered data over UART that was waiting to be sent. Perform some
- *      translation to ensured characters are properly displayed.
+ *      Send the text held in a queue over UART. Perform some translation to
+ *      ensured characters are properly displayed. The text is written straight
+ *      out of the queue, a run of characters needing no translation at a time.
  *
  * PARAMETERS
- *      None
+ *      p_queue [in]    Queue holding the text
  *
  * RETURNS
- *      Nothing
+ *      TRUE if all the text has been sent
  *----------------------------------------------------------------------------*/
-static void sendPendingData(void)
+static bool sendQueuedText(BYTE_QUEUE_T *p_queue)
 {
-    /* Loop until the byte queue is empty */
-    while (BQGetDataSize() > 0)
+    BQ_SPAN_T spans[2];     /* Text held in the queue */
+    uint16 span;            /* Index of the span being sent */
+    
+    BQPeekSpans(p_queue, spans);
+    
+    for (span = 0; span < 2; span++)
     {
-        uint8 byte = '\0';
+        const uint8 *p_data = spans[span].p_data;
+        uint16 len = spans[span].len;
         
-        /* Read the next byte in the queue */
-        if (BQPeekBytes(&byte, 1) > 0)
+        while (len > 0)
         {
-            bool ok_to_commit = FALSE;
+            uint16 run = 0;     /* Number of bytes of text sent */
+            bool ok_to_commit;
+            
+            /* Characters up to the next one needing translation are sent as
+             * they are, in a single write
+             */
+            while ((run < len) && (run < UART_TX_MAX_WRITE) &&
+                   (p_data[run] != '\r') && (p_data[run] != '\b'))
+            {
+                run++;
+            }
             
+            if (run > 0)
+            {
+                ok_to_commit = UartWrite(p_data, run);
+            }
+            else if (p_data[0] == '\r')
             /* Check if Enter key was pressed */
-            if (byte == '\r')
             {
                 /* Echo carriage return and newline */
-                const uint8 data[] = {byte, '\n'};
+                const uint8 data[] = {'\r', '\n'};
                 
                 ok_to_commit = UartWrite(data, sizeof(data)/sizeof(uint8));
+                run = 1;
             }
-            else if (byte == '\b')
+            else
             /* If backspace key was pressed */
             {
                 /* Issue backspace, overwrite previous character on the
                  * terminal, then issue another backspace
                  */
-                const uint8 data[] = {byte, ' ', byte};
+                const uint8 data[] = {'\b', ' ', '\b'};
                 
                 ok_to_commit = UartWrite(data, sizeof(data)/sizeof(uint8));
+                run = 1;
             }
-            else
+            
+            if (!ok_to_commit)
             {
-                /* Echo the character */
-                ok_to_commit = UartWrite(&byte, 1);
+                /* If UART doesn't have enough space available to accommodate
+                 * this data, postpone sending data and leave it in the buffer
+                 * to try again later.
+                 */
+                return FALSE;
             }
+            
+            /* Now that UART driver has accepted this data remove the data
+             * from the buffer
+             */
+            BQCommitBytes(p_queue, run);
+            p_data += run;
+            len -= run;
+        }
+    }
+    
+    return (BQGetDataSize(p_queue) == 0);
+}
 
-            if (ok_to_commit)
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      sendQueuedFrames
+ *
+ *  DESCRIPTION
+ *      Send the frames held in a queue over UART, without translation.
+ *
+ * PARAMETERS
+ *      p_queue [in]    Queue holding the frames
+ *
+ * RETURNS
+ *      TRUE if all the frames have been sent
+ *----------------------------------------------------------------------------*/
+static bool sendQueuedFrames(BYTE_QUEUE_T *p_queue)
+{
+    BQ_SPAN_T spans[2];     /* Frames held in the queue */
+    uint16 span;            /* Index of the span being sent */
+    uint16 run;             /* Number of bytes written at once */
+    
+    BQPeekSpans(p_queue, spans);
+    
+    for (span = 0; span < 2; span++)
+    {
+        while (spans[span].len > 0)
+        {
+            run = (spans[span].len < UART_TX_MAX_WRITE) ? spans[span].len :
+                                                          UART_TX_MAX_WRITE;
+            
+            if (!UartWrite(spans[span].p_data, run))
             {
-                /* Now that UART driver has accepted this data
-                 * remove the data from the buffer
-                 */
-                BQCommitLastPeek();
+                /* Try again once the UART has room */
+                return FALSE;
             }
-            else
+            
+            BQCommitBytes(p_queue, run);
+            spans[span].p_data += run;
+            spans[span].len -= run;
+        }
+    }
+    
+    return (BQGetDataSize(p_queue) == 0);
+}
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      sendPendingData
+ *
+ *  DESCRIPTION
+ *      Send buffered data over UART that was waiting to be sent. The echo
+ *      goes out ahead of the log, and DONE, STATS and LATENCY frames ahead
+ *      of ACKs and NAKs.
+ *
+ * PARAMETERS
+ *      None
+ *
+ * RETURNS
+ *      Nothing
+ *----------------------------------------------------------------------------*/
+static void sendPendingData(void)
+{
+    bool text_sent = sendQueuedText(&echo_queue) &&
+                     sendQueuedText(&log_queue) &&
+                     sendQueuedFrames(&frame_queue);
+    
+    /* Frame replies are sent without translation once any text queued ahead
+     * of them has gone out
+     */
+    if (frame_data.reply_pending && text_sent)
+    {
+        if (UartWrite(frame_data.reply, frame_data.reply_len))
+        {
+            frame_data.reply_pending = FALSE;
+        }
+    }
+    
+    if (frame_data.room_wanted && text_sent && !frame_data.reply_pending)
+    {
+        /* The frames queued when a frame was NAKed for want of room have
+         * gone out, so tell the host it can send it again
+         */
+        frame_data.room_wanted = FALSE;
+        sendFrameReply(UART_FRAME_TYPE_ACK,
+                       (frame_data.expected_seq - 1) & 0xFF);
+    }
+}
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      crc8Update
+ *
+ *  DESCRIPTION
+ *      Update a CRC-8 (polynomial 0x07) with one byte, one nibble at a time.
+ *
+ * PARAMETERS
+ *      crc  [in]       CRC so far
+ *      byte [in]       Byte to add to the CRC
+ *
+ * RETURNS
+ *      Updated CRC
+ *----------------------------------------------------------------------------*/
+static uint8 crc8Update(uint8 crc, uint8 byte)
+{
+    /* uint8 is not guaranteed to wrap at 8 bits, hence the masking */
+    crc = ((crc << 4) & 0xFF) ^ crc8_table[((crc >> 4) ^ (byte >> 4)) & 0x0F];
+    crc = ((crc << 4) & 0xFF) ^ crc8_table[((crc >> 4) ^ byte) & 0x0F];
+    
+    return crc;
+}
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      frameCrc
+ *
+ *  DESCRIPTION
+ *      Work out the CRC of a frame over its TYPE, SEQ, LEN and PAYLOAD.
+ *
+ * PARAMETERS
+ *      p_frame [in]    Frame, from its start of frame
+ *      len     [in]    Length of the payload
+ *
+ * RETURNS
+ *      CRC of the frame
+ *----------------------------------------------------------------------------*/
+static uint8 frameCrc(const uint8 *p_frame, uint8 len)
+{
+    uint8 crc = 0;
+    uint16 idx;
+    
+    for (idx = 1; idx < UART_FRAME_OVERHEAD - 1 + len; idx++)
+    {
+        crc = crc8Update(crc, p_frame[idx] & 0xFF);
+    }
+    
+    return crc;
+}
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      frameRxData
+ *
+ *  DESCRIPTION
+ *      Run received data through the framed protocol receiver. The frames are
+ *      parsed where they are in the UART driver's receive buffer. Parsing
+ *      stops at a frame which has not been received in full, which is left
+ *      in the receive buffer until the rest of it has been received.
+ *
+ * PARAMETERS
+ *      p_data   [in]   Received data
+ *      length   [in]   Number of bytes of received data
+ *      p_needed [out]  Number of bytes the frame left in the receive buffer
+ *                      needs to be received in full, 0 if there is none
+ *
+ * RETURNS
+ *      Number of bytes consumed
+ *----------------------------------------------------------------------------*/
+static uint16 frameRxData(const uint8 *p_data, uint16 length,
+                          uint16 *p_needed)
+{
+    uint16 used = 0;        /* Number of bytes consumed */
+    
+    *p_needed = 0;
+    
+    while (used < length)
+    {
+        const uint8 *p_frame = &p_data[used];
+        const uint16 available = length - used;
+        uint16 frame_len;   /* Length of the frame with its overhead */
+        
+        if ((p_frame[0] & 0xFF) != UART_FRAME_SOF)
+        {
+            /* Noise in between frames is dropped */
+            used++;
+            continue;
+        }
+        
+        if (available < UART_FRAME_OVERHEAD)
+        {
+            /* Not even the header has been received yet */
+            *p_needed = UART_FRAME_OVERHEAD;
+            break;
+        }
+        
+        if ((p_frame[3] & 0xFF) > UART_FRAME_MAX_PAYLOAD)
+        {
+            /* Can not be a valid frame. Ask for the expected frame again and
+             * look for the next start of frame after the header.
+             */
+            if (!frame_data.nak_sent)
             {
-                /* If UART doesn't have enough space available to accommodate
-                 * this data, postpone sending data and leave it in the buffer
-                 * to try again later.
-                 */
-                break;
+                sendFrameNak(UART_NAK_RESEND);
             }
+            used += UART_FRAME_OVERHEAD - 1;
+            continue;
         }
-        else
+        
+        frame_len = UART_FRAME_OVERHEAD + (p_frame[3] & 0xFF);
+        
+        if (available < frame_len)
         {
-            /* Couldn't read data for some reason. Postpone sending data and
-             * try again later.
-            */
+            *p_needed = frame_len;
             break;
         }
+        
+        if (frameCrc(p_frame, p_frame[3] & 0xFF) ==
+            (p_frame[frame_len - 1] & 0xFF))
+        {
+            handleRxFrame(p_frame);
+        }
+        else if (!frame_data.nak_sent)
+        {
+            /* The sequence number can not be trusted either, so ask for the
+             * expected frame again
+             */
+            sendFrameNak(UART_NAK_RESEND);
+        }
+        
+        used += frame_len;
+    }
+    
+    return used;
+}
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      handleRxFrame
+ *
+ *  DESCRIPTION
+ *      Handle a frame which has passed the CRC check. Only the frame carrying
+ *      the expected sequence number is acted upon.
+ *
+ * PARAMETERS
+ *      p_frame [in]    Frame, from its start of frame, in the receive buffer
+ *
+ * RETURNS
+ *      Nothing
+ *----------------------------------------------------------------------------*/
+static void handleRxFrame(const uint8 *p_frame)
+{
+    const uint8 type = p_frame[1] & 0xFF;
+    const uint8 seq = p_frame[2] & 0xFF;
+    const uint8 len = p_frame[3] & 0xFF;
+    const uint8 *p_payload = &p_frame[4];
+    
+    /* How far behind the expected sequence number this frame is */
+    const uint8 behind = (frame_data.expected_seq - seq) & 0xFF;
+    uint8 reply_type = UART_FRAME_TYPE_ACK;
+    uint8 nak_reason = UART_NAK_BUSY;
+    bool accepted = TRUE;
+    uint8 idx;
+    
+    if (behind == 0)
+    {
+        if ((type == UART_FRAME_TYPE_DATA) && (len > UART_FRAME_MAX_CHARS))
+        {
+            accepted = FALSE;
+            nak_reason = UART_NAK_TOO_LONG;
+        }
+        else if (type == UART_FRAME_TYPE_DATA)
+        {
+            accepted = AppAcceptTypedChars(len);
+            
+            for (idx = 0; accepted && (idx < len); idx++)
+            {
+                AppTypeChar(p_payload[idx] & 0xFF);
+            }
+        }
+        else if ((type == UART_FRAME_TYPE_LAYOUT) && (len == 1))
+        {
+            CharMapSetLayout(p_payload[0] & 0xFF);
+        }
+        else if ((type == UART_FRAME_TYPE_POLICY) && (len == 1))
+        {
+            AppSetKeyQueuePolicy(p_payload[0] & 0xFF);
+        }
+        else if (type == UART_FRAME_TYPE_CONSUMER)
+        {
+            accepted = handleConsumerFrame(p_payload, len);
+        }
+        else if ((type == UART_FRAME_TYPE_STRING) &&
+                 (len > UART_FRAME_MAX_CHARS + 1))
+        {
+            accepted = FALSE;
+            nak_reason = UART_NAK_TOO_LONG;
+        }
+        else if ((type == UART_FRAME_TYPE_STRING) && (len >= 1))
+        {
+            /* The DONE frame of every string pending has to have room,
+             * including those of strings done whose DONE frames are still
+             * waiting to be sent
+             */
+            accepted = (BQGetAvailableSize(&frame_queue) >=
+                        (frame_data.strings_pending + 1) * DONE_FRAME_LEN);
+            frame_data.room_wanted |= !accepted &&
+                                      (BQGetDataSize(&frame_queue) > 0);
+            
+            if (accepted)
+            {
+                /* Counted first, as a string queuing nothing is done before
+                 * AppTypeString returns
+                 */
+                ++ frame_data.strings_pending;
+                
+                accepted = AppTypeString(p_payload[0] & 0xFF, &p_payload[1],
+                                         len - 1);
+                if (!accepted)
+                {
+                    -- frame_data.strings_pending;
+                }
+            }
+        }
+        else if (type == UART_FRAME_TYPE_REPORT)
+        {
+            accepted = handleReportFrame(p_payload, len);
+        }
+        else if ((type == UART_FRAME_TYPE_KEY_DOWN) ||
+                 (type == UART_FRAME_TYPE_KEY_UP))
+        {
+            accepted = AppSetUartKeys(p_payload, len,
+                                      type == UART_FRAME_TYPE_KEY_DOWN);
+        }
+        else if (type == UART_FRAME_TYPE_GET_STATS)
+        {
+            reply_type = UART_FRAME_TYPE_STATS;
+        }
+#ifdef KEY_LATENCY_STATS
+        else if (type == UART_FRAME_TYPE_GET_LATENCY)
+        {
+            reply_type = UART_FRAME_TYPE_LATENCY;
+        }
+#endif /* KEY_LATENCY_STATS */
+        /* Unknown frame types are acknowledged and ignored */
+        
+        if (reply_type != UART_FRAME_TYPE_ACK)
+        {
+            /* The reply has to wait behind the frames already queued, and
+             * leave room for the DONE frames of the strings pending
+             */
+            accepted = (BQGetAvailableSize(&frame_queue) >=
+                        frameReplyLength(reply_type) +
+                        frame_data.strings_pending * DONE_FRAME_LEN);
+            frame_data.room_wanted |= !accepted &&
+                                      (BQGetDataSize(&frame_queue) > 0);
+        }
+        
+        if (!accepted)
+        {
+            /* No room in the queue, for a STRING frame no room for one more
+             * string, or no room for the reply. The host has to send the
+             * frame again once the queue has room, a DONE frame has been
+             * sent or the replies before have gone out. A frame which is
+             * too long has to be split by the host instead.
+             */
+            sendFrameNak(nak_reason);
+            return;
+        }
+        
+        frame_data.expected_seq = (frame_data.expected_seq + 1) & 0xFF;
+        frame_data.nak_sent = FALSE;
+        
+        sendFrameReply(reply_type, seq);
+    }
+    else if (behind <= 0x80)
+    {
+        /* A resent frame that has already been accepted, the ACK must have
+         * been lost. Acknowledge it again without acting on it.
+         */
+        sendFrameReply(UART_FRAME_TYPE_ACK,
+                       (frame_data.expected_seq - 1) & 0xFF);
+    }
+    else if (!frame_data.nak_sent)
+    {
+        /* A frame has been lost. Drop this one and ask for the missing one. */
+        sendFrameNak(UART_NAK_RESEND);
+    }
+}
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      handleConsumerFrame
+ *
+ *  DESCRIPTION
+ *      Hold down the consumer keys carried by a CONSUMER frame in place of
+ *      the ones held before. A frame which is not a whole number of valid
+ *      usages is ignored.
+ *
+ * PARAMETERS
+ *      p_payload [in]  Payload of the frame
+ *      len       [in]  Length of the payload
+ *
+ * RETURNS
+ *      FALSE if there is no room for the report in the queue, TRUE otherwise
+ *----------------------------------------------------------------------------*/
+static bool handleConsumerFrame(const uint8 *p_payload, uint8 len)
+{
+    uint16 usages[CONSUMER_REPORT_KEYS];
+    const uint8 count = len / 2;
+    uint8 idx;
+    
+    if ((len & 1) || (count > CONSUMER_REPORT_KEYS))
+    {
+        return TRUE;
+    }
+    
+    for (idx = 0; idx < count; idx++)
+    {
+        usages[idx] = (p_payload[2 * idx] & 0xFF) |
+                      ((p_payload[2 * idx + 1] & 0xFF) << 8);
+        
+        if (usages[idx] > CONSUMER_MAX_USAGE)
+        {
+            return TRUE;
+        }
+    }
+    
+    return AppSetConsumerKeys(usages, count);
+}
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      handleReportFrame
+ *
+ *  DESCRIPTION
+ *      Queue the report carried by a REPORT frame as it is. A frame which
+ *      does not carry an input or consumer report of the right length is
+ *      ignored.
+ *
+ * PARAMETERS
+ *      p_payload [in]  Payload of the frame
+ *      len       [in]  Length of the payload
+ *
+ * RETURNS
+ *      FALSE if there is no room for the report in the queue, TRUE otherwise
+ *----------------------------------------------------------------------------*/
+static bool handleReportFrame(const uint8 *p_payload, uint8 len)
+{
+    uint8 report[UART_FRAME_MAX_PAYLOAD];
+    const uint8 report_id = p_payload[0] & 0xFF;
+    uint8 idx;
+    
+    if (!(((report_id == HID_INPUT_REPORT_ID) &&
+           (len == ATTR_LEN_HID_INPUT_REPORT + 1)) ||
+          ((report_id == HID_CONSUMER_REPORT_ID) &&
+           (len == ATTR_LEN_HID_CONSUMER_REPORT + 1))))
+    {
+        return TRUE;
+    }
+    
+    for (idx = 1; idx < len; idx++)
+    {
+        report[idx - 1] = p_payload[idx] & 0xFF;
+    }
+    
+    return AppSendReport(report_id, report, len - 1);
+}
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      frameReplyLength
+ *
+ *  DESCRIPTION
+ *      Work out the length of a reply frame built by sendFrameReply.
+ *
+ * PARAMETERS
+ *      type [in]       UART_FRAME_TYPE_ACK, UART_FRAME_TYPE_NAK,
+ *                      UART_FRAME_TYPE_STATS or UART_FRAME_TYPE_LATENCY
+ *
+ * RETURNS
+ *      Length of the frame, with its overhead
+ *----------------------------------------------------------------------------*/
+static uint8 frameReplyLength(uint8 type)
+{
+    switch (type)
+    {
+        case UART_FRAME_TYPE_STATS:
+            return UART_FRAME_OVERHEAD + UART_FRAME_STATS_PAYLOAD;
+        case UART_FRAME_TYPE_LATENCY:
+            return UART_FRAME_OVERHEAD + UART_FRAME_LATENCY_PAYLOAD;
+        case UART_FRAME_TYPE_NAK:
+            return UART_FRAME_OVERHEAD + UART_FRAME_NAK_PAYLOAD;
+        default:
+            return UART_FRAME_OVERHEAD + 1;
     }
 }
 
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      sendFrameReply
+ *
+ *  DESCRIPTION
+ *      Build an ACK, NAK, STATS or LATENCY frame carrying the number of free
+ *      slots in the pending key stroke queue and send it. A NAK also carries
+ *      the reason set by sendFrameNak. An ACK or NAK still
+ *      waiting for space in the UART transmit buffer is replaced by the new
+ *      one. STATS and LATENCY frames are queued behind the frames queued
+ *      before them instead, the caller having checked there is room.
+ *
+ * PARAMETERS
+ *      type [in]       UART_FRAME_TYPE_ACK, UART_FRAME_TYPE_NAK,
+ *                      UART_FRAME_TYPE_STATS or UART_FRAME_TYPE_LATENCY
+ *      seq  [in]       Sequence number to report
+ *
+ * RETURNS
+ *      Nothing
+ *----------------------------------------------------------------------------*/
+static void sendFrameReply(uint8 type, uint8 seq)
+{
+    uint8 reply[UART_FRAME_OVERHEAD + UART_FRAME_MAX_REPLY_PAYLOAD];
+    uint8 *p_reply = reply;
+    uint8 len = 1;
+    uint8 idx;
+    
+    p_reply[0] = UART_FRAME_SOF;
+    p_reply[1] = type;
+    p_reply[2] = seq;
+    p_reply[4] = GET_CQUEUE_FREE_SLOTS();
+    
+    if (type == UART_FRAME_TYPE_NAK)
+    {
+        p_reply[5] = frame_data.nak_reason;
+        len = UART_FRAME_NAK_PAYLOAD;
+    }
+    else if (type == UART_FRAME_TYPE_STATS)
+    {
+        const KEY_QUEUE_STATS_T *p_stats = GET_CQUEUE_STATS_REF();
+        const uint16 counters[] = { p_stats->rejected, p_stats->coalesced,
+                                    p_stats->dropped, p_stats->overwritten,
+                                    p_stats->high_water };
+        
+        p_reply[5] = (uint8)GET_CQUEUE_POLICY();
+        len = 2;
+        
+        for (idx = 0; idx < sizeof(counters)/sizeof(counters[0]); idx++)
+        {
+            p_reply[4 + len++] = counters[idx] & 0xFF;
+            p_reply[4 + len++] = (counters[idx] >> 8) & 0xFF;
+        }
+    }
+#ifdef KEY_LATENCY_STATS
+    else if (type == UART_FRAME_TYPE_LATENCY)
+    {
+        uint16 value;
+        
+        for (idx = 0; idx < latency_stage_count * 3; idx++)
+        {
+            switch (idx % 3)
+            {
+                case 0:
+                    value = LatencyGetCount((latency_stage)(idx / 3));
+                    break;
+                case 1:
+                    value = LatencyGetPercentile((latency_stage)(idx / 3), 50);
+                    break;
+                default:
+                    value = LatencyGetPercentile((latency_stage)(idx / 3), 99);
+                    break;
+            }
+            p_reply[4 + len++] = value & 0xFF;
+            p_reply[4 + len++] = (value >> 8) & 0xFF;
+        }
+    }
+#endif /* KEY_LATENCY_STATS */
+    p_reply[3] = len;
+    p_reply[UART_FRAME_OVERHEAD - 1 + len] = frameCrc(p_reply, len);
+    
+    if ((type == UART_FRAME_TYPE_ACK) || (type == UART_FRAME_TYPE_NAK))
+    {
+        MemCopy(frame_data.reply, p_reply, UART_FRAME_OVERHEAD + len);
+        frame_data.reply_len = UART_FRAME_OVERHEAD + len;
+        frame_data.reply_pending = TRUE;
+    }
+    else
+    {
+        /* It acknowledges the frames received the same way, so an older ACK
+         * or NAK waiting to be sent is no longer needed
+         */
+        BQSafeQueueBytes(&frame_queue, p_reply, UART_FRAME_OVERHEAD + len);
+        frame_data.reply_pending = FALSE;
+    }
+    
+    sendPendingData();
+}
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      sendFrameNak
+ *
+ *  DESCRIPTION
+ *      Send a NAK asking for the expected frame, and stop further NAKs until
+ *      a frame is accepted.
+ *
+ * PARAMETERS
+ *      reason [in]     One of the UART_NAK_ reasons
+ *
+ * RETURNS
+ *      Nothing
+ *----------------------------------------------------------------------------*/
+static void sendFrameNak(uint8 reason)
+{
+    frame_data.nak_reason = reason;
+    frame_data.nak_sent = TRUE;
+    sendFrameReply(UART_FRAME_TYPE_NAK, frame_data.expected_seq);
+}
+
+#ifdef UART_RX_BURST_MODE
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      uartRxIdleTimerExpiry
+ *
+ *  DESCRIPTION
+ *      This function is called when the UART receive line has been idle for
+ *      UART_RX_IDLE_FLUSH_TIME in the middle of a burst. The receive
+ *      threshold is dropped back to a single byte so that the bytes already
+ *      held by the UART driver are delivered straight away.
+ *
+ * PARAMETERS
+ *      tid [in]        ID of the timer that has expired
+ *
+ * RETURNS
+ *      Nothing
+ *----------------------------------------------------------------------------*/
+static void uartRxIdleTimerExpiry(timer_id tid)
+{
+    if(tid == rx_idle_tid)
+    {
+        rx_idle_tid = TIMER_INVALID;
+        
+        /* The receive callback will raise the threshold again once it has
+         * consumed the remainder of the burst
+         */
+        UartRead(1, 0);
+    }
+    /* Else it may be due to some race condition. Ignore it. */
+}
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      restartRxIdleTimer
+ *
+ *  DESCRIPTION
+ *      Restart the receive idle timer. It is restarted on every receive
+ *      callback, so it only expires once the sender has paused.
+ *
+ * PARAMETERS
+ *      None
+ *
+ * RETURNS
+ *      Nothing
+ *----------------------------------------------------------------------------*/
+static void restartRxIdleTimer(void)
+{
+    TimerDelete(rx_idle_tid);
+    
+    rx_idle_tid = TimerCreate(UART_RX_IDLE_FLUSH_TIME, TRUE,
+                              uartRxIdleTimerExpiry);
+}
+#endif /* UART_RX_BURST_MODE */
+
 /*----------------------------------------------------------------------------*
  *  NAME
  *      printSleepState
@@ -243,7 +1141,7 @@ static void printSleepState(sleep_state state)
         case sleep_state_cold_powerup:
         {
             /* The device powered up after a long time without power */
-            const uint8 state_msg[] = "cold_powerup";
+            static const uint8 state_msg[] = "cold_powerup";
             p_state_msg = state_msg;
             state_msg_len = (sizeof(state_msg) - 1)/sizeof(uint8);
             break;
@@ -254,7 +1152,7 @@ static void printSleepState(sleep_state state)
              * ~1 minute, based on how long data remains valid in the persistent
              * memory)
              */
-            const uint8 state_msg[] = "warm_powerup";
+            static const uint8 state_msg[] = "warm_powerup";
             p_state_msg = state_msg;
             state_msg_len = (sizeof(state_msg) - 1)/sizeof(uint8);
             break;
@@ -263,7 +1161,7 @@ static void printSleepState(sleep_state state)
         {
             /*  The device powered up after being placed into the Dormant state
              */
-            const uint8 state_msg[] = "dormant";
+            static const uint8 state_msg[] = "dormant";
             p_state_msg = state_msg;
             state_msg_len = (sizeof(state_msg) - 1)/sizeof(uint8);
             break;
@@ -272,7 +1170,7 @@ static void printSleepState(sleep_state state)
         {
             /* The device powered up after being placed into the Hibernate state 
              */
-            const uint8 state_msg[] = "hibernate";
+            static const uint8 state_msg[] = "hibernate";
             p_state_msg = state_msg;
             state_msg_len = (sizeof(state_msg) - 1)/sizeof(uint8);
             break;
@@ -281,7 +1179,7 @@ static void printSleepState(sleep_state state)
         {
             /* The device powered up after an application-triggered warm reset
              */
-            const uint8 state_msg[] = "warm_reset";
+            static const uint8 state_msg[] = "warm_reset";
             p_state_msg = state_msg;
             state_msg_len = (sizeof(state_msg) - 1)/sizeof(uint8);
             break;
@@ -289,7 +1187,7 @@ static void printSleepState(sleep_state state)
         default:
         {
             /* Unrecognised sleep state */
-            const uint8 state_msg[] = "unknown";
+            static const uint8 state_msg[] = "unknown";
             p_state_msg = state_msg;
             state_msg_len = (sizeof(state_msg) - 1)/sizeof(uint8);
             break;
@@ -297,10 +1195,10 @@ static void printSleepState(sleep_state state)
     }
     
     /* Add opening message to byte queue */
-    BQForceQueueBytes(message, message_len);
+    BQForceQueueBytes(&log_queue, message, message_len);
     
     /* Add translated sleep state to byte queue */
-    BQForceQueueBytes(p_state_msg, state_msg_len);
+    BQForceQueueBytes(&log_queue, p_state_msg, state_msg_len);
     
     /* Send byte queue over UART */
     sendPendingData();
@@ -325,7 +1223,8 @@ static void vt100ClearScreen(void)
     const uint8 clr_scr_cmd[] = { 0x1B, '[', '2', 'J' };
     
     /* Add clear screen command to the byte queue */
-    BQForceQueueBytes(clr_scr_cmd, sizeof(clr_scr_cmd)/sizeof(uint8));
+    BQForceQueueBytes(&log_queue, clr_scr_cmd,
+                      sizeof(clr_scr_cmd)/sizeof(uint8));
     
     /* Send byte queue over UART */
     sendPendingData();
@@ -365,8 +1264,10 @@ void UartStart(sleep_state last_sleep_state)
     /* Enable UART */
     UartEnable(TRUE);
 
-    /* UART receive threshold is set to 1 byte, so that every single byte
-     * received will trigger the receiver callback */
+    /* UART receive threshold is set to 1 byte, so that the first byte of a
+     * burst triggers the receiver callback. In burst mode the callback then
+     * raises the threshold to UART_RX_BURST_THRESHOLD.
+     */
     UartRead(1, 0);
 
     /* Send clear screen command over UART */
@@ -379,7 +1280,7 @@ void UartStart(sleep_state last_sleep_state)
     const uint8 message[] = "\r\nType something: ";
     
     /* Add message to the byte queue */
-    BQForceQueueBytes(message, sizeof(message)/sizeof(uint8));
+    BQForceQueueBytes(&log_queue, message, sizeof(message)/sizeof(uint8));
     
     /* Transmit the byte queue over UART */
     sendPendingData();
@@ -413,7 +1314,7 @@ void UartProcessSystemEvent(sys_event_id id, void *p_data)
         case sys_event_wakeup:
         {
             /* The system was woken by an edge on the WAKE pin */
-            const uint8 event_msg[] = "wakeup";
+            static const uint8 event_msg[] = "wakeup";
             p_event_msg = event_msg;
             event_msg_len = (sizeof(event_msg) - 1)/sizeof(uint8);
             break;
@@ -423,7 +1324,7 @@ void UartProcessSystemEvent(sys_event_id id, void *p_data)
             /* The system battery voltage has moved above or below the
              * monitoring threshold
              */
-            const uint8 event_msg[] = "battery_low";
+            static const uint8 event_msg[] = "battery_low";
             p_event_msg = event_msg;
             event_msg_len = (sizeof(event_msg) - 1)/sizeof(uint8);
             break;
@@ -433,7 +1334,7 @@ void UartProcessSystemEvent(sys_event_id id, void *p_data)
             /* One or more PIOs specified by PioSetEventMask() have changed
              * input level
              */
-            const uint8 event_msg[] = "pio_changed";
+            static const uint8 event_msg[] = "pio_changed";
             p_event_msg = event_msg;
             event_msg_len = (sizeof(event_msg) - 1)/sizeof(uint8);
             break;
@@ -441,7 +1342,7 @@ void UartProcessSystemEvent(sys_event_id id, void *p_data)
         case sys_event_pio_ctrlr:
         {
             /* An event was received from the 8051 PIO Controller */
-            const uint8 event_msg[] = "pio_ctrlr";
+            static const uint8 event_msg[] = "pio_ctrlr";
             p_event_msg = event_msg;
             event_msg_len = (sizeof(event_msg) - 1)/sizeof(uint8);
             break;
@@ -449,7 +1350,7 @@ void UartProcessSystemEvent(sys_event_id id, void *p_data)
         default:
         {
             /* Unrecognised system event */
-            const uint8 event_msg[] = "unknown";
+            static const uint8 event_msg[] = "unknown";
             p_event_msg = event_msg;
             event_msg_len = (sizeof(event_msg) - 1)/sizeof(uint8);
             break;
@@ -457,14 +1358,104 @@ void UartProcessSystemEvent(sys_event_id id, void *p_data)
     }
     
     /* Add opening message to byte queue */
-    BQForceQueueBytes(message, message_len);
+    BQForceQueueBytes(&log_queue, message, message_len);
     
     /* Add translated sleep state to byte queue */
-    BQForceQueueBytes(p_event_msg, event_msg_len);
+    BQForceQueueBytes(&log_queue, p_event_msg, event_msg_len);
     
     /* Add carriage return/new line to byte queue */
-    BQForceQueueBytes(new_line, new_line_len);
+    BQForceQueueBytes(&log_queue, new_line, new_line_len);
     
     /* Send byte queue over UART */
     sendPendingData();
 }
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      UartResumeRx
+ *
+ *  DESCRIPTION
+ *      Called once the pending key stroke queue has room again for the
+ *      characters which have been held back. In framed mode the host is told
+ *      the free slot count with an ACK, otherwise the bytes left with the UART
+ *      driver are asked for again.
+ *
+ * PARAMETERS
+ *      None
+ *
+ * RETURNS
+ *      Nothing
+ *----------------------------------------------------------------------------*/
+void UartResumeRx(void)
+{
+    if (frame_data.framed_mode)
+    {
+        sendFrameReply(UART_FRAME_TYPE_ACK,
+                       (frame_data.expected_seq - 1) & 0xFF);
+    }
+    else
+    {
+        UartRead(1, 0);
+    }
+}
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      UartQueueEcho
+ *
+ *  DESCRIPTION
+ *      Queue text echoing the characters received, or replying to them. It
+ *      is sent along with the rest of the echo, which overwrites the oldest
+ *      echo if the queue is full.
+ *
+ * PARAMETERS
+ *      p_data [in]     Text to send
+ *      len    [in]     Number of bytes of text
+ *
+ * RETURNS
+ *      Nothing
+ *----------------------------------------------------------------------------*/
+void UartQueueEcho(const uint8 *p_data, uint16 len)
+{
+    BQForceQueueBytes(&echo_queue, p_data, len);
+}
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      UartStringDone
+ *
+ *  DESCRIPTION
+ *      Send a DONE frame for a string typed from a STRING frame. It is sent
+ *      after the DONE frames of the strings received before it.
+ *
+ * PARAMETERS
+ *      id     [in]     String ID given by the host
+ *      status [in]     UART_STRING_TYPED or UART_STRING_DROPPED
+ *
+ * RETURNS
+ *      Nothing
+ *----------------------------------------------------------------------------*/
+void UartStringDone(uint8 id, uint8 status)
+{
+    uint8 done[DONE_FRAME_LEN];
+    
+    done[0] = UART_FRAME_SOF;
+    done[1] = UART_FRAME_TYPE_DONE;
+    done[2] = (frame_data.expected_seq - 1) & 0xFF;
+    done[3] = UART_FRAME_DONE_PAYLOAD;
+    done[4] = GET_CQUEUE_FREE_SLOTS();
+    done[5] = id;
+    done[6] = status;
+    done[UART_FRAME_OVERHEAD - 1 + UART_FRAME_DONE_PAYLOAD] =
+                                    frameCrc(done, UART_FRAME_DONE_PAYLOAD);
+    
+    /* Room has been kept for a DONE frame for every string pending */
+    BQSafeQueueBytes(&frame_queue, done, sizeof(done)/sizeof(uint8));
+    
+    if (frame_data.strings_pending)
+    {
+        -- frame_data.strings_pending;
+    }
+    
+    sendPendingData();
+}
@@ -22,6 +22,180 @@
 #include <sys_events.h>     /* System event definitions and declarations */
 #include <sleep.h>          /* Control the device sleep states */
 
+/*============================================================================*
+ *  Public Definitions
+ *============================================================================*/
+
+/* Framed binary protocol
+ *
+ * Besides plain text, characters can be sent in frames laid out as
+ *
+ *     SOF | TYPE | SEQ | LEN | PAYLOAD (LEN bytes) | CRC
+ *
+ * where CRC is a CRC-8 (polynomial x^8 + x^2 + x + 1, initial value 0) over
+ * TYPE, SEQ, LEN and PAYLOAD. The first SOF byte received switches the UART
+ * into framed mode for the rest of the session; from then on anything outside
+ * a frame is discarded and nothing is echoed back.
+ *
+ * Every frame is answered with an ACK or NAK frame whose payload starts with
+ * a byte holding the number of free slots in the pending key stroke queue.
+ * ACKs are cumulative: SEQ is that of the last frame accepted in order. A NAK
+ * carries the sequence number the device expects next, and one of the
+ * UART_NAK_ reasons after the free slot count:
+ *
+ *     UART_NAK_RESEND     the frame was lost, corrupted or received out of
+ *                         order; the host resends from SEQ straight away
+ *     UART_NAK_BUSY       there is no room for the frame yet; an ACK is sent
+ *                         unasked once there is, or a DONE frame for a STRING
+ *                         frame waiting for a string to be done
+ *     UART_NAK_TOO_LONG   the frame carries more characters than can ever be
+ *                         taken at once; the host sends them in shorter
+ *                         frames instead, starting with SEQ
+ *
+ * Frames received out of order are dropped, so the host can keep a window of
+ * frames in flight and go back to the NAKed one. A DATA frame with an empty
+ * payload can be used to poll for the free slot count.
+ *
+ * A DATA frame carries at most UART_FRAME_MAX_CHARS characters, 14 with the
+ * default MAX_PENDING_KEY_STROKES of 30: each character may need two key
+ * strokes and the last one a release, and they all have to fit in the queue.
+ * Under key_queue_policy_reject a DATA frame is NAKed as busy if the pending
+ * key stroke queue can not take all its characters yet. In plain text mode
+ * the characters are left in the UART receive buffer meanwhile.
+ */
+
+/* Start of frame. It is outside the 7-bit ASCII range so it can not be
+ * mistaken for text.
+ */
+#define UART_FRAME_SOF                  (0xA5)
+
+/* Frame types */
+#define UART_FRAME_TYPE_DATA            (0x01)  /* Characters to be typed */
+#define UART_FRAME_TYPE_LAYOUT          (0x02)  /* Select keyboard layout */
+#define UART_FRAME_TYPE_POLICY          (0x03)  /* Select queue policy */
+#define UART_FRAME_TYPE_GET_STATS       (0x04)  /* Ask for queue counters */
+#define UART_FRAME_TYPE_GET_LATENCY     (0x05)  /* Ask for key latencies */
+#define UART_FRAME_TYPE_CONSUMER        (0x06)  /* Hold consumer keys */
+#define UART_FRAME_TYPE_STRING          (0x07)  /* Type a string */
+#define UART_FRAME_TYPE_REPORT          (0x08)  /* Send a report as it is */
+#define UART_FRAME_TYPE_KEY_DOWN        (0x09)  /* Press keys */
+#define UART_FRAME_TYPE_KEY_UP          (0x0A)  /* Release keys */
+#define UART_FRAME_TYPE_ACK             (0x80)  /* Frames accepted */
+#define UART_FRAME_TYPE_NAK             (0x81)  /* Resend from SEQ */
+#define UART_FRAME_TYPE_STATS           (0x82)  /* Queue counters */
+#define UART_FRAME_TYPE_LATENCY         (0x83)  /* Key latencies */
+#define UART_FRAME_TYPE_DONE            (0x84)  /* String typed */
+
+/* A LAYOUT frame carries a single byte selecting the keyboard layout used
+ * for the DATA frames which follow, see char_map_layout in char_map.h. The
+ * selection is kept in NVM. An unknown layout is acknowledged and ignored.
+ */
+
+/* A POLICY frame carries a single byte selecting the policy applied when the
+ * pending key stroke queue is full, see key_queue_policy in keyboard.h. An
+ * unknown policy is acknowledged and ignored.
+ *
+ * A GET_STATS frame is answered with a STATS frame instead of an ACK. It
+ * acknowledges frames the same way, and its payload is the free slot count
+ * and the selected policy followed by the KEY_QUEUE_STATS_T counters as
+ * 16-bit little endian values. STATS and LATENCY frames are never replaced
+ * by a later ACK or NAK; a GET_STATS or GET_LATENCY frame is NAKed while the
+ * replies sent before it leave no room for its reply, and has to be sent
+ * again.
+ *
+ * A GET_LATENCY frame is answered the same way with a LATENCY frame. Its
+ * payload is the free slot count followed, for every latency_stage in
+ * latency_service.h, by the number of latencies recorded, the 50th and the
+ * 99th percentile in units of 2^LATENCY_UNIT_SHIFT microseconds, as 16-bit
+ * little endian values. It is only answered with KEY_LATENCY_STATS enabled,
+ * otherwise it is acknowledged and ignored like unknown frame types.
+ */
+
+/* A CONSUMER frame carries up to CONSUMER_REPORT_KEYS usages of the consumer
+ * page as 16-bit little endian values. They are held down, together with the
+ * consumer keys of the key matrix, until the next CONSUMER frame replaces
+ * them; an empty payload releases them all. A frame of odd length or with a
+ * usage above CONSUMER_MAX_USAGE is acknowledged and ignored.
+ */
+
+/* A STRING frame carries a string ID chosen by the host followed by up to
+ * UART_FRAME_MAX_CHARS characters to be typed. It is acknowledged like a
+ * DATA frame, and NAKed the same way if it is too long, if the pending key
+ * stroke queue can not take the characters, if
+ * UART_MAX_PENDING_STRINGS strings are still being typed, or if the DONE frames
+ * of strings already typed are still waiting to be sent and leave no room
+ * for one more.
+ *
+ * Once the last key stroke of the string has been confirmed by the firmware,
+ * a DONE frame is sent unasked. Its SEQ is that of the last frame accepted,
+ * and its payload is the free slot count, the string ID and one of the
+ * UART_STRING_ statuses. DONE frames are sent in the order the strings were
+ * received, and are never replaced by later ACKs or NAKs.
+ */
+
+/* A REPORT frame carries a report ID followed by a report, which is queued
+ * as it is without going through the keyboard layout. The report ID is
+ * either HID_INPUT_REPORT_ID followed by an 8-byte input report, or
+ * HID_CONSUMER_REPORT_ID followed by a consumer report of
+ * CONSUMER_REPORT_KEYS 16-bit usages. Any other report is acknowledged and
+ * ignored. An input report also replaces the keys held by KEY_DOWN frames,
+ * and a consumer report the consumer keys held by CONSUMER frames. The next
+ * report for the same report ID is worked out from those keys.
+ *
+ * KEY_DOWN and KEY_UP frames carry usages of the keyboard page, 0xE0 to 0xE7
+ * being the modifiers. The keys are pressed or released from those held
+ * before, and an input report is queued if the keys held have changed. An
+ * empty KEY_UP frame releases all the keys. Keys pressed while six keys are
+ * held are ignored.
+ *
+ * CONSUMER, REPORT, KEY_DOWN and KEY_UP frames are NAKed like DATA frames if
+ * the pending key stroke queue can not take the report.
+ */
+
+/* Largest payload accepted in a frame */
+#define UART_FRAME_MAX_PAYLOAD          (32)
+
+/* Largest payload of a frame sent by the device, that of a LATENCY frame.
+ * The host has to accept frames up to this size, which is larger than the
+ * frames it may send.
+ */
+#define UART_FRAME_MAX_REPLY_PAYLOAD    (UART_FRAME_LATENCY_PAYLOAD)
+
+/* Number of bytes in a frame besides the payload */
+#define UART_FRAME_OVERHEAD             (5)
+
+/* Most characters carried by a DATA frame or after the ID of a STRING frame,
+ * see MAX_TYPED_CHARS_AT_ONCE in keyboard.h
+ */
+#define UART_FRAME_MAX_CHARS            (14)
+
+/* Payload length of a NAK frame */
+#define UART_FRAME_NAK_PAYLOAD          (2)
+
+/* Reasons carried by a NAK frame */
+#define UART_NAK_RESEND                 (0x00)  /* Resend from SEQ */
+#define UART_NAK_BUSY                   (0x01)  /* No room for the frame yet */
+#define UART_NAK_TOO_LONG               (0x02)  /* Too many characters */
+
+/* Payload length of a STATS frame */
+#define UART_FRAME_STATS_PAYLOAD        (12)
+
+/* Payload length of a LATENCY frame, for the eight latency stages */
+#define UART_FRAME_LATENCY_PAYLOAD      (49)
+
+/* Payload length of a DONE frame */
+#define UART_FRAME_DONE_PAYLOAD         (3)
+
+/* Largest number of strings typed over UART waiting for their DONE frame */
+#define UART_MAX_PENDING_STRINGS        (4)
+
+/* Statuses carried by a DONE frame */
+#define UART_STRING_TYPED               (0x00)  /* All key strokes sent */
+#define UART_STRING_DROPPED             (0x01)  /* Key strokes dropped from
+                                                 * the queue, or the queue
+                                                 * cleared on disconnection
+                                                 */
+
 /*============================================================================*
  *  Public Function Prototypes
  *============================================================================*/
@@ -57,4 +231,54 @@ extern void UartStart(sleep_state last_sleep_state);
  *----------------------------------------------------------------------------*/
 void UartProcessSystemEvent(sys_event_id id, void *pData);
 
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      UartResumeRx
+ *
+ *  DESCRIPTION
+ *      Called once the pending key stroke queue has room again for the
+ *      characters which have been held back.
+ *
+ * PARAMETERS
+ *      None
+ *
+ * RETURNS
+ *      Nothing
+ *----------------------------------------------------------------------------*/
+extern void UartResumeRx(void);
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      UartQueueEcho
+ *
+ *  DESCRIPTION
+ *      Queue text echoing the characters received, or replying to them. It
+ *      is sent along with the rest of the echo, which overwrites the oldest
+ *      echo if the queue is full.
+ *
+ * PARAMETERS
+ *      p_data [in]     Text to send
+ *      len    [in]     Number of bytes of text
+ *
+ * RETURNS
+ *      Nothing
+ *----------------------------------------------------------------------------*/
+extern void UartQueueEcho(const uint8 *p_data, uint16 len);
+
+/*----------------------------------------------------------------------------*
+ *  NAME
+ *      UartStringDone
+ *
+ *  DESCRIPTION
+ *      Send a DONE frame for a string typed from a STRING frame.
+ *
+ * PARAMETERS
+ *      id     [in]     String ID given by the host
+ *      status [in]     UART_STRING_TYPED or UART_STRING_DROPPED
+ *
+ * RETURNS
+ *      Nothing
+ *----------------------------------------------------------------------------*/
+extern void UartStringDone(uint8 id, uint8 status);
+
 #endif /* __UARTIO_H__ */
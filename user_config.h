@@ -57,9 +57,55 @@
  */
 #define MAX_PENDING_KEY_STROKES                 30
 
+/* Policy applied when a key stroke is added to a full queue, until another
+ * one is selected over UART. See key_queue_policy in keyboard.h. Under the
+ * other policies every press state dropped from the queue is a character or
+ * a report received over UART lost, so they have to be selected explicitly.
+ */
+#define DEFAULT_KEY_QUEUE_POLICY                key_queue_policy_reject
+
+/* Maximum number of key stroke notifications handed to the firmware before
+ * the GATT_CHAR_VAL_NOT_CFM of the first one is received. The firmware can
+ * buffer several packets per connection event. The number actually used is
+ * halved whenever the firmware returns gatt_status_busy and grows by one
+ * again after a full window of notifications has been accepted. Set this
+ * to 1 to send one notification at a time. It must not be larger than
+ * MAX_PENDING_KEY_STROKES.
+ */
+#define MAX_NOTIFICATIONS_IN_FLIGHT             4
+
 /* The debouncing timer to be used for the keys of the keyboard */
 #define DEBOUNCE_TIMER                          40 * MILLISECOND
 
+/* Comment the below macro to debounce the keys of the key matrix one at a
+ * time. With it, all the keys of a row are debounced at once on bit planes,
+ * and a scan with no key pressed or held down returns straight away.
+ */
+#define DEBOUNCE_BIT_PARALLEL
+
+/* Uncomment the below macro to report a key press on the first scan it is
+ * seen in, rather than once it has been seen in a few more scans. Only key
+ * releases are then debounced. This takes about 10 ms off the latency of every
+ * key press, but a glitch on the key matrix is reported as a key stroke.
+ */
+/* #define DEBOUNCE_EAGER_PRESS */
+
+/* With DEBOUNCE_EAGER_PRESS, the number of scans after a key press during
+ * which the key is locked down, its bouncing ignored, and the number of scans
+ * in a row a key has to be seen released before its release is reported. A
+ * scan takes 5 ms. Each can be from 1 to 4, and the press lockout must end
+ * before the 25 ms debounce reset timer of keyboard_hw.c.
+ */
+#define DEBOUNCE_PRESS_LOCKOUT_SCANS            3
+#define DEBOUNCE_RELEASE_SCANS                  2
+
+/* Comment the below macro to drop a whole scan of the key matrix when it may
+ * hold ghost keys. With it, only the keys which can not be told from ghost
+ * keys, those whose row and column each have another key pressed, are held in
+ * the state they were debounced to, and the other keys of a chord go through.
+ */
+#define SUPPRESS_GHOST_KEYS_ONLY
+
 /*************** HID related customizable things ******************************/
 
 /* The input report with report ID 1 in the report descriptor. */
@@ -71,10 +117,42 @@
  */
 #define HID_CONSUMER_REPORT_ID                  3
 
+/* Uncomment the macro below to add an N-key rollover input report, with one
+ * bit per key, to the report descriptor in hid_service_db.db. It is sent in
+ * place of the input report with report ID 1 once the host has enabled its
+ * notifications in report mode, so that any number of keys can be held down
+ * at once. Within the 20 bytes of a notification, it holds the modifier keys
+ * and the keyboard usages 0x00 to 0x97. Keys mapped to higher usages are not
+ * reported while it is in use.
+ */
+/* #define NKRO_SUPPORT */
+
+#ifdef NKRO_SUPPORT
+
+/* The N-key rollover input report with report ID 4 in the report
+ * descriptor.
+ */
+#define HID_NKRO_REPORT_ID                      4
+
+/* Size of the N-key rollover input report: the modifier byte followed by the
+ * bitmap of the keyboard usages 0x00 to 0x97.
+ */
+#define NKRO_REPORT_SIZE                        20
+
+/* Highest keyboard usage held in the N-key rollover input report */
+#define NKRO_MAX_USAGE                          0x97
+
+#endif /* NKRO_SUPPORT */
+
 /* HID service may use different reports of different sizes. This macro
- * indicates the size of the report of largest size.
+ * indicates the size of the report of largest size. Every key stroke in the
+ * queue takes this many words.
  */
+#ifdef NKRO_SUPPORT
+#define LARGEST_REPORT_SIZE                     NKRO_REPORT_SIZE
+#else
 #define LARGEST_REPORT_SIZE                     8
+#endif /* NKRO_SUPPORT */
 
 /* Parser version (UINT16) - Version number of the base USB HID specification
  * Format - 0xJJMN (JJ - Major Version Number, M - Minor Version
@@ -95,8 +173,103 @@
  */
 #define HID_INFO_FLAGS                          REMOTE_WAKEUP_SUPPORTED
 
-/* Consumer report size = MAX_CONSUMER_KEYS * ONE_CONSUMER_KEY_REPORT_SIZE */
-#define CONSUMER_REPORT_SIZE                    2
+/* Number of consumer controls which can be held at once. The consumer report
+ * holds them as an array of 16-bit usages of the consumer page, the keys of
+ * the key matrix mapped to consumer controls first, then the ones set over
+ * UART.
+ */
+#define CONSUMER_REPORT_KEYS                    4
+
+/* Consumer report size = CONSUMER_REPORT_KEYS * 2 */
+#define CONSUMER_REPORT_SIZE                    8
+
+/* Highest consumer usage, the logical and usage maximum of the consumer report
+ * in the report descriptor
+ */
+#define CONSUMER_MAX_USAGE                      0x02FF
+
+/*************** UART related customizable things *****************************/
+
+/* Comment the below macro to have the UART receive callback called for every
+ * single byte received. With burst mode enabled the UART driver collects
+ * UART_RX_BURST_THRESHOLD bytes before calling the application, and a burst
+ * which stops short of the threshold is flushed once the line has been idle
+ * for UART_RX_IDLE_FLUSH_TIME.
+ */
+#define UART_RX_BURST_MODE
+
+/* Number of bytes to be received before the UART receive callback is called
+ * in burst mode. This must be smaller than the UART receive buffer size.
+ */
+#define UART_RX_BURST_THRESHOLD                 16
+
+/* Time for which the UART receive line has to be idle before a partially
+ * received burst is handed to the application. At 115200 baud one byte takes
+ * about 87 us, so this is roughly 20 character times.
+ */
+#define UART_RX_IDLE_FLUSH_TIME                 (2 * MILLISECOND)
+
+/* Keyboard layout used to translate characters received over UART until
+ * another one is selected over UART. See char_map_layout in char_map.h.
+ */
+#define DEFAULT_KEYBOARD_LAYOUT                 char_map_layout_us
+
+/*************** Key scan related customizable things *************************/
+
+/* Comment the below macro to scan the key matrix at the fast rate all the
+ * time. With the macro enabled, the key matrix is scanned at a quarter of the
+ * rate once no key has been held for KEY_SCAN_SLOW_IDLE_TIME, or for
+ * KEY_SCAN_SUSPENDED_IDLE_TIME while the host is suspended. After
+ * KEY_SCAN_SLEEP_IDLE_TIME more, the PIO controller is stopped with all the
+ * rows driven low until a key press pulls a column low. The fast rate is
+ * used again from the first scan which sees a key.
+ */
+#define ADAPTIVE_KEY_SCAN
+
+/* Time without a key held after which the slow scan rate is used. It must be
+ * longer than the PIO_CTRLR_SETTLE_SCANS scans a key release takes to
+ * debounce.
+ */
+#define KEY_SCAN_SLOW_IDLE_TIME                 (2 * SECOND)
+
+/* Time without a key held after which the slow scan rate is used while the
+ * host is suspended
+ */
+#define KEY_SCAN_SUSPENDED_IDLE_TIME            (100 * MILLISECOND)
+
+/* Time spent at the slow scan rate before the key scan sleeps */
+#define KEY_SCAN_SLEEP_IDLE_TIME                (30 * SECOND)
+
+/*************** Connection parameter related customizable things *************/
+
+/* Comment the below macro to keep the preferred connection parameters in
+ * gap_conn_params.h for the whole connection. With the macro enabled, the
+ * burst connection parameters are requested as soon as key strokes are
+ * generated or data is received over UART, and the preferred ones again once
+ * the keyboard has been quiet for CONN_PARAMS_QUIET_PERIOD.
+ */
+#define ADAPTIVE_CONN_PARAMS
+
+/* Time without key strokes or UART data, and with all the key strokes sent,
+ * after which the preferred connection parameters are requested again.
+ */
+#define CONN_PARAMS_QUIET_PERIOD                (3 * SECOND)
+
+/* Minimum time between two connection parameter update requests. A switch
+ * wanted sooner is delayed until this much time has passed. The time is also
+ * counted from the connection, so it must not be shorter than
+ * TGAP(conn_pause_peripheral), which is 5 seconds.
+ */
+#define CONN_PARAMS_MIN_UPDATE_SPACING          (5 * SECOND)
+
+/*************** Latency statistics related customizable things ***************/
+
+/* Comment the below macro to leave out the Key Latency service. With the
+ * macro enabled, the latency of every key stroke is counted in histograms
+ * from the UART reception, or the key matrix scan, to the radio event of the
+ * connection event in which it is sent. See latency_service.h.
+ */
+#define KEY_LATENCY_STATS
 
 /* Idle timer value in Connected state. At the expiry of this timer,
  * the Keyboard will disconnect itself from the Host.